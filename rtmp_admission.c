@@ -0,0 +1,145 @@
+// rtmp_admission.c
+#include "rtmp_admission.h"
+#include "rtmp_registry.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct rtmp_admission {
+    rtmp_admission_limits_t limits;
+    rtmp_admission_stats_t stats;
+    rtmp_registry_t* per_ip;        // peer address -> admitted connections
+    pthread_mutex_t lock;
+};
+
+rtmp_admission_t* rtmp_admission_create(const rtmp_admission_limits_t* limits) {
+    rtmp_admission_t* admission = calloc(1, sizeof(rtmp_admission_t));
+    if (!admission) return NULL;
+
+    admission->per_ip = rtmp_registry_create(RTMP_REGISTRY_KEY_FD, RTMP_REGISTRY_MIN_CAPACITY);
+    if (!admission->per_ip) {
+        free(admission);
+        return NULL;
+    }
+    if (limits) {
+        admission->limits = *limits;
+    }
+    pthread_mutex_init(&admission->lock, NULL);
+    return admission;
+}
+
+void rtmp_admission_destroy(rtmp_admission_t* admission) {
+    if (!admission) return;
+    rtmp_registry_destroy(admission->per_ip);
+    pthread_mutex_destroy(&admission->lock);
+    free(admission);
+}
+
+// New limits apply to the next admission; nobody already admitted is evicted
+void rtmp_admission_set_limits(rtmp_admission_t* admission, const rtmp_admission_limits_t* limits) {
+    if (!admission || !limits) return;
+    pthread_mutex_lock(&admission->lock);
+    admission->limits = *limits;
+    pthread_mutex_unlock(&admission->lock);
+}
+
+rtmp_admission_verdict_t rtmp_admission_admit(rtmp_admission_t* admission, uint32_t peer, size_t cost) {
+    if (!admission) return RTMP_ADMISSION_ACCEPT;
+
+    pthread_mutex_lock(&admission->lock);
+    const rtmp_admission_limits_t* limits = &admission->limits;
+    rtmp_admission_stats_t* stats = &admission->stats;
+    uint32_t from_peer = (uint32_t)(uintptr_t)rtmp_registry_get_fd(admission->per_ip, (int)peer);
+
+    rtmp_admission_verdict_t verdict = RTMP_ADMISSION_ACCEPT;
+    if (limits->max_connections && stats->connections >= limits->max_connections) {
+        verdict = RTMP_ADMISSION_REJECT_CONNECTIONS;
+    } else if (limits->max_per_ip && from_peer >= limits->max_per_ip) {
+        verdict = RTMP_ADMISSION_REJECT_PER_IP;
+    } else if (limits->max_handshakes && stats->handshakes >= limits->max_handshakes) {
+        verdict = RTMP_ADMISSION_REJECT_HANDSHAKES;
+    } else if (limits->memory_budget && stats->memory + cost > limits->memory_budget) {
+        verdict = RTMP_ADMISSION_REJECT_MEMORY;
+    } else if (!rtmp_registry_put_fd(admission->per_ip, (int)peer, (void*)(uintptr_t)(from_peer + 1))) {
+        verdict = RTMP_ADMISSION_REJECT_MEMORY;
+    }
+
+    if (verdict == RTMP_ADMISSION_ACCEPT) {
+        stats->connections++;
+        stats->handshakes++;
+        stats->memory += cost;
+    } else {
+        stats->rejected[verdict]++;
+    }
+    pthread_mutex_unlock(&admission->lock);
+
+    return verdict;
+}
+
+void rtmp_admission_handshake_done(rtmp_admission_t* admission) {
+    if (!admission) return;
+    pthread_mutex_lock(&admission->lock);
+    if (admission->stats.handshakes) {
+        admission->stats.handshakes--;
+    }
+    pthread_mutex_unlock(&admission->lock);
+}
+
+// Return what rtmp_admission_admit reserved
+void rtmp_admission_release(rtmp_admission_t* admission, uint32_t peer, size_t cost, bool handshaking) {
+    if (!admission) return;
+
+    pthread_mutex_lock(&admission->lock);
+    rtmp_admission_stats_t* stats = &admission->stats;
+    uint32_t from_peer = (uint32_t)(uintptr_t)rtmp_registry_get_fd(admission->per_ip, (int)peer);
+
+    if (from_peer > 1) {
+        rtmp_registry_put_fd(admission->per_ip, (int)peer, (void*)(uintptr_t)(from_peer - 1));
+    } else {
+        rtmp_registry_remove_fd(admission->per_ip, (int)peer, NULL);
+    }
+
+    if (stats->connections) stats->connections--;
+    if (handshaking && stats->handshakes) stats->handshakes--;
+    stats->memory = stats->memory > cost ? stats->memory - cost : 0;
+    pthread_mutex_unlock(&admission->lock);
+}
+
+void rtmp_admission_get_stats(rtmp_admission_t* admission, rtmp_admission_stats_t* stats) {
+    if (!stats) return;
+    if (!admission) {
+        memset(stats, 0, sizeof(rtmp_admission_stats_t));
+        return;
+    }
+    pthread_mutex_lock(&admission->lock);
+    *stats = admission->stats;
+    pthread_mutex_unlock(&admission->lock);
+}
+
+uint64_t rtmp_admission_rejected(rtmp_admission_t* admission) {
+    rtmp_admission_stats_t stats;
+    rtmp_admission_get_stats(admission, &stats);
+
+    uint64_t total = 0;
+    for (int i = RTMP_ADMISSION_REJECT_CONNECTIONS; i < RTMP_ADMISSION_VERDICTS; i++) {
+        total += stats.rejected[i];
+    }
+    return total;
+}
+
+const char* rtmp_admission_verdict_string(rtmp_admission_verdict_t verdict) {
+    switch (verdict) {
+        case RTMP_ADMISSION_ACCEPT:
+            return "Accept";
+        case RTMP_ADMISSION_REJECT_CONNECTIONS:
+            return "Connection limit";
+        case RTMP_ADMISSION_REJECT_PER_IP:
+            return "Per-IP limit";
+        case RTMP_ADMISSION_REJECT_HANDSHAKES:
+            return "Handshake limit";
+        case RTMP_ADMISSION_REJECT_MEMORY:
+            return "Memory budget";
+        default:
+            return "Unknown";
+    }
+}
@@ -0,0 +1,55 @@
+// rtmp_admission.h
+#ifndef RTMP_ADMISSION_H
+#define RTMP_ADMISSION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Admission limits; 0 disables a limit
+typedef struct {
+    uint32_t max_connections;       // Admitted connections in total
+    uint32_t max_per_ip;            // Admitted connections per peer address
+    uint32_t max_handshakes;        // Connections still in the handshake
+    size_t memory_budget;           // Sum of the per-connection cost estimates
+} rtmp_admission_limits_t;
+
+// Admission verdicts
+typedef enum {
+    RTMP_ADMISSION_ACCEPT = 0,
+    RTMP_ADMISSION_REJECT_CONNECTIONS,
+    RTMP_ADMISSION_REJECT_PER_IP,
+    RTMP_ADMISSION_REJECT_HANDSHAKES,
+    RTMP_ADMISSION_REJECT_MEMORY,
+    RTMP_ADMISSION_VERDICTS
+} rtmp_admission_verdict_t;
+
+// Current usage and rejections per verdict
+typedef struct {
+    uint32_t connections;
+    uint32_t handshakes;
+    size_t memory;
+    uint64_t rejected[RTMP_ADMISSION_VERDICTS];
+} rtmp_admission_stats_t;
+
+// Connection budget checked right after accept(), before anything is
+// allocated for the client. Thread-safe.
+typedef struct rtmp_admission rtmp_admission_t;
+
+// Admission lifecycle
+rtmp_admission_t* rtmp_admission_create(const rtmp_admission_limits_t* limits);
+void rtmp_admission_destroy(rtmp_admission_t* admission);
+void rtmp_admission_set_limits(rtmp_admission_t* admission, const rtmp_admission_limits_t* limits);
+
+// Reserve a slot for a new peer (IPv4 address in network order); an
+// accepted peer counts as handshaking until rtmp_admission_handshake_done
+rtmp_admission_verdict_t rtmp_admission_admit(rtmp_admission_t* admission, uint32_t peer, size_t cost);
+void rtmp_admission_handshake_done(rtmp_admission_t* admission);
+void rtmp_admission_release(rtmp_admission_t* admission, uint32_t peer, size_t cost, bool handshaking);
+
+// Stats
+void rtmp_admission_get_stats(rtmp_admission_t* admission, rtmp_admission_stats_t* stats);
+uint64_t rtmp_admission_rejected(rtmp_admission_t* admission);
+const char* rtmp_admission_verdict_string(rtmp_admission_verdict_t verdict);
+
+#endif /* RTMP_ADMISSION_H */
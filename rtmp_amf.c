@@ -7,6 +7,8 @@
 #define AMF_NUMBER_SIZE 9
 #define AMF_BOOLEAN_SIZE 2
 
+static int decode_properties(const uint8_t *buffer, size_t size, rtmp_amf_value_t *value, size_t *bytes_read);
+
 static void write_byte(uint8_t **buffer, uint8_t value) {
     **buffer = value;
     (*buffer)++;
@@ -136,13 +138,49 @@ int rtmp_amf_encode_object_start(uint8_t *buffer, size_t *size) {
 
 int rtmp_amf_encode_object_end(uint8_t *buffer, size_t *size) {
     uint8_t *start = buffer;
-    write_be24(&buffer, 0);  // Empty string
+    write_be16(&buffer, 0);  // Empty string
     write_byte(&buffer, AMF0_OBJECT_END);
     
     *size = buffer - start;
     return 1;
 }
 
+// Object and ECMA array keys carry no type marker
+int rtmp_amf_encode_property_name(const char *name, uint8_t *buffer, size_t *size) {
+    size_t name_len = strlen(name);
+    if (name_len > AMF_MAX_STRING_LEN) {
+        return 0;
+    }
+    
+    uint8_t *start = buffer;
+    write_be16(&buffer, name_len);
+    memcpy(buffer, name, name_len);
+    buffer += name_len;
+    
+    *size = buffer - start;
+    return 1;
+}
+
+// Properties follow, closed by rtmp_amf_encode_object_end
+int rtmp_amf_encode_ecma_array_start(uint32_t count, uint8_t *buffer, size_t *size) {
+    uint8_t *start = buffer;
+    write_byte(&buffer, AMF0_ECMA_ARRAY);
+    write_be32(&buffer, count);
+    
+    *size = buffer - start;
+    return 1;
+}
+
+// Exactly count values follow, with no end marker
+int rtmp_amf_encode_strict_array_start(uint32_t count, uint8_t *buffer, size_t *size) {
+    uint8_t *start = buffer;
+    write_byte(&buffer, AMF0_STRICT_ARRAY);
+    write_be32(&buffer, count);
+    
+    *size = buffer - start;
+    return 1;
+}
+
 rtmp_amf_value_t* rtmp_amf_value_new(void) {
     return (rtmp_amf_value_t*)calloc(1, sizeof(rtmp_amf_value_t));
 }
@@ -156,6 +194,7 @@ void rtmp_amf_value_free(rtmp_amf_value_t *value) {
             break;
             
         case AMF0_OBJECT:
+        case AMF0_ECMA_ARRAY:
             for (uint32_t i = 0; i < value->value.object.size; i++) {
                 free(value->value.object.names[i]);
                 rtmp_amf_value_free(value->value.object.properties[i]);
@@ -165,7 +204,6 @@ void rtmp_amf_value_free(rtmp_amf_value_t *value) {
             break;
             
         case AMF0_STRICT_ARRAY:
-        case AMF0_ECMA_ARRAY:
             for (uint32_t i = 0; i < value->value.array.size; i++) {
                 rtmp_amf_value_free(value->value.array.elements[i]);
             }
@@ -316,6 +354,47 @@ int rtmp_amf_encode_metadata(const char *name, const uint8_t *data, size_t data_
     return 1;
 }
 
+int rtmp_amf_encode_on_status(const char *level, const char *code, const char *description, uint8_t *buffer, size_t *size) {
+    const char *names[3] = { "level", "code", "description" };
+    const char *values[3] = { level, code, description };
+    uint8_t *start = buffer;
+    size_t tmp_size;
+    
+    // Command name
+    rtmp_amf_encode_string("onStatus", buffer, &tmp_size);
+    buffer += tmp_size;
+    
+    // Transaction ID (0 for status events)
+    rtmp_amf_encode_number(0.0, buffer, &tmp_size);
+    buffer += tmp_size;
+    
+    // Command object (null)
+    rtmp_amf_encode_null(buffer, &tmp_size);
+    buffer += tmp_size;
+    
+    // Info object; property names carry no type marker
+    rtmp_amf_encode_object_start(buffer, &tmp_size);
+    buffer += tmp_size;
+    
+    for (int i = 0; i < 3; i++) {
+        size_t name_len = strlen(names[i]);
+        write_be16(&buffer, name_len);
+        memcpy(buffer, names[i], name_len);
+        buffer += name_len;
+        
+        if (!rtmp_amf_encode_string(values[i], buffer, &tmp_size)) {
+            return 0;
+        }
+        buffer += tmp_size;
+    }
+    
+    rtmp_amf_encode_object_end(buffer, &tmp_size);
+    buffer += tmp_size;
+    
+    *size = buffer - start;
+    return 1;
+}
+
 int rtmp_amf_decode_number(const uint8_t *buffer, size_t size, double *value, size_t *bytes_read) {
     if (size < AMF_NUMBER_SIZE) return 0;
     
@@ -367,10 +446,64 @@ int rtmp_amf_decode_object(const uint8_t *buffer, size_t size, rtmp_amf_value_t
     if (size < 1) return 0;
     
     if (buffer[0] != AMF0_OBJECT) return 0;
-    buffer++;
-    size--;
     
     value->type = AMF0_OBJECT;
+    if (!decode_properties(buffer + 1, size - 1, value, bytes_read)) return 0;
+    
+    *bytes_read += 1;  // Type byte
+    return 1;
+}
+
+// Decoded like an object; the count in front is only a hint
+int rtmp_amf_decode_ecma_array(const uint8_t *buffer, size_t size, rtmp_amf_value_t *value, size_t *bytes_read) {
+    if (size < 5) return 0;
+    
+    if (buffer[0] != AMF0_ECMA_ARRAY) return 0;
+    
+    value->type = AMF0_ECMA_ARRAY;
+    if (!decode_properties(buffer + 5, size - 5, value, bytes_read)) return 0;
+    
+    *bytes_read += 5;  // Type byte and count
+    return 1;
+}
+
+int rtmp_amf_decode_array(const uint8_t *buffer, size_t size, rtmp_amf_value_t *value, size_t *bytes_read) {
+    if (size < 5) return 0;
+    
+    if (buffer[0] != AMF0_STRICT_ARRAY) return 0;
+    buffer++;
+    
+    uint32_t count = read_be32(&buffer);
+    size -= 5;
+    
+    // Every element takes at least one byte
+    if (count > size) return 0;
+    
+    value->type = AMF0_STRICT_ARRAY;
+    value->value.array.size = 0;
+    value->value.array.elements = calloc(count ? count : 1, sizeof(rtmp_amf_value_t*));
+    if (!value->value.array.elements) return 0;
+    
+    size_t total = 5;
+    for (uint32_t i = 0; i < count; i++) {
+        rtmp_amf_value_t *element = rtmp_amf_value_new();
+        size_t tmp_read;
+        if (!element || !rtmp_amf_decode_value(buffer, size, element, &tmp_read)) {
+            rtmp_amf_value_free(element);
+            return 0;
+        }
+        value->value.array.elements[value->value.array.size++] = element;
+        buffer += tmp_read;
+        size -= tmp_read;
+        total += tmp_read;
+    }
+    
+    *bytes_read = total;
+    return 1;
+}
+
+// Name/value pairs up to the object end marker, into value's object fields
+static int decode_properties(const uint8_t *buffer, size_t size, rtmp_amf_value_t *value, size_t *bytes_read) {
     value->value.object.size = 0;
     value->value.object.properties = NULL;
     value->value.object.names = NULL;
@@ -447,11 +580,11 @@ int rtmp_amf_decode_object(const uint8_t *buffer, size_t size, rtmp_amf_value_t
         value->value.object.size++;
     }
     
-    *bytes_read = (buffer - start) + 1;  // +1 for type byte
+    *bytes_read = buffer - start;
     return 1;
 }
 
-static int rtmp_amf_decode_value(const uint8_t *buffer, size_t size, rtmp_amf_value_t *value, size_t *bytes_read) {
+int rtmp_amf_decode_value(const uint8_t *buffer, size_t size, rtmp_amf_value_t *value, size_t *bytes_read) {
     if (size < 1) return 0;
     
     uint8_t type = buffer[0];
@@ -475,6 +608,9 @@ static int rtmp_amf_decode_value(const uint8_t *buffer, size_t size, rtmp_amf_va
             *bytes_read = 1;
             return 1;
             
+        case AMF0_ECMA_ARRAY:
+            return rtmp_amf_decode_ecma_array(buffer, size, value, bytes_read);
+            
         case AMF0_STRICT_ARRAY:
             return rtmp_amf_decode_array(buffer, size, value, bytes_read);
             
@@ -537,4 +673,84 @@ rtmp_amf_value_t* rtmp_amf_value_copy(const rtmp_amf_value_t *value) {
     }
     
     return copy;
-}
\ No newline at end of file
+}
+
+// Property of an object or ECMA array, NULL when absent
+rtmp_amf_value_t* rtmp_amf_get_property(const rtmp_amf_value_t *value, const char *name) {
+    if (!value || !name || (value->type != AMF0_OBJECT && value->type != AMF0_ECMA_ARRAY)) return NULL;
+    
+    for (uint32_t i = 0; i < value->value.object.size; i++) {
+        if (strcmp(value->value.object.names[i], name) == 0) {
+            return value->value.object.properties[i];
+        }
+    }
+    return NULL;
+}
+
+// _result of a connect: server properties and the NetConnection.Connect.Success info object
+int rtmp_amf_encode_connect_result(double transaction_id, uint8_t *buffer, size_t *size) {
+    uint8_t *start = buffer;
+    size_t tmp_size;
+    
+    rtmp_amf_encode_string("_result", buffer, &tmp_size);
+    buffer += tmp_size;
+    rtmp_amf_encode_number(transaction_id, buffer, &tmp_size);
+    buffer += tmp_size;
+    
+    // Properties
+    rtmp_amf_encode_object_start(buffer, &tmp_size);
+    buffer += tmp_size;
+    rtmp_amf_encode_property_name("fmsVer", buffer, &tmp_size);
+    buffer += tmp_size;
+    rtmp_amf_encode_string("FMS/3,0,1,123", buffer, &tmp_size);
+    buffer += tmp_size;
+    rtmp_amf_encode_property_name("capabilities", buffer, &tmp_size);
+    buffer += tmp_size;
+    rtmp_amf_encode_number(31.0, buffer, &tmp_size);
+    buffer += tmp_size;
+    rtmp_amf_encode_object_end(buffer, &tmp_size);
+    buffer += tmp_size;
+    
+    // Information
+    rtmp_amf_encode_object_start(buffer, &tmp_size);
+    buffer += tmp_size;
+    rtmp_amf_encode_property_name("level", buffer, &tmp_size);
+    buffer += tmp_size;
+    rtmp_amf_encode_string("status", buffer, &tmp_size);
+    buffer += tmp_size;
+    rtmp_amf_encode_property_name("code", buffer, &tmp_size);
+    buffer += tmp_size;
+    rtmp_amf_encode_string("NetConnection.Connect.Success", buffer, &tmp_size);
+    buffer += tmp_size;
+    rtmp_amf_encode_property_name("description", buffer, &tmp_size);
+    buffer += tmp_size;
+    rtmp_amf_encode_string("Connection succeeded.", buffer, &tmp_size);
+    buffer += tmp_size;
+    rtmp_amf_encode_property_name("objectEncoding", buffer, &tmp_size);
+    buffer += tmp_size;
+    rtmp_amf_encode_number(0.0, buffer, &tmp_size);
+    buffer += tmp_size;
+    rtmp_amf_encode_object_end(buffer, &tmp_size);
+    buffer += tmp_size;
+    
+    *size = buffer - start;
+    return 1;
+}
+
+// _result of a createStream: the new message stream id
+int rtmp_amf_encode_create_stream_result(double transaction_id, uint32_t stream_id, uint8_t *buffer, size_t *size) {
+    uint8_t *start = buffer;
+    size_t tmp_size;
+    
+    rtmp_amf_encode_string("_result", buffer, &tmp_size);
+    buffer += tmp_size;
+    rtmp_amf_encode_number(transaction_id, buffer, &tmp_size);
+    buffer += tmp_size;
+    rtmp_amf_encode_null(buffer, &tmp_size);
+    buffer += tmp_size;
+    rtmp_amf_encode_number(stream_id, buffer, &tmp_size);
+    buffer += tmp_size;
+    
+    *size = buffer - start;
+    return 1;
+}
@@ -49,6 +49,9 @@ int rtmp_amf_encode_null(uint8_t *buffer, size_t *size);
 int rtmp_amf_encode_undefined(uint8_t *buffer, size_t *size);
 int rtmp_amf_encode_object_start(uint8_t *buffer, size_t *size);
 int rtmp_amf_encode_object_end(uint8_t *buffer, size_t *size);
+int rtmp_amf_encode_property_name(const char *name, uint8_t *buffer, size_t *size);
+int rtmp_amf_encode_ecma_array_start(uint32_t count, uint8_t *buffer, size_t *size);
+int rtmp_amf_encode_strict_array_start(uint32_t count, uint8_t *buffer, size_t *size);
 int rtmp_amf_encode_array(rtmp_amf_value_t **elements, uint32_t count, uint8_t *buffer, size_t *size);
 
 // Funções de decoding
@@ -57,11 +60,14 @@ int rtmp_amf_decode_boolean(const uint8_t *buffer, size_t size, int *value, size
 int rtmp_amf_decode_string(const uint8_t *buffer, size_t size, char **str, uint32_t *str_size, size_t *bytes_read);
 int rtmp_amf_decode_object(const uint8_t *buffer, size_t size, rtmp_amf_value_t *value, size_t *bytes_read);
 int rtmp_amf_decode_array(const uint8_t *buffer, size_t size, rtmp_amf_value_t *value, size_t *bytes_read);
+int rtmp_amf_decode_ecma_array(const uint8_t *buffer, size_t size, rtmp_amf_value_t *value, size_t *bytes_read);
+int rtmp_amf_decode_value(const uint8_t *buffer, size_t size, rtmp_amf_value_t *value, size_t *bytes_read);
 
 // Funções de gerenciamento de valores AMF
 rtmp_amf_value_t* rtmp_amf_value_new(void);
 void rtmp_amf_value_free(rtmp_amf_value_t *value);
 rtmp_amf_value_t* rtmp_amf_value_copy(const rtmp_amf_value_t *value);
+rtmp_amf_value_t* rtmp_amf_get_property(const rtmp_amf_value_t *value, const char *name);
 
 // Funções para mensagens RTMP específicas
 int rtmp_amf_encode_connect(const char *app, const char *swf_url, const char *tc_url, uint8_t *buffer, size_t *size);
@@ -69,5 +75,8 @@ int rtmp_amf_encode_create_stream(uint32_t transaction_id, uint8_t *buffer, size
 int rtmp_amf_encode_play(const char *stream_name, uint8_t *buffer, size_t *size);
 int rtmp_amf_encode_publish(const char *stream_name, uint8_t *buffer, size_t *size);
 int rtmp_amf_encode_metadata(const char *name, const uint8_t *data, size_t data_size, uint8_t *buffer, size_t *size);
+int rtmp_amf_encode_connect_result(double transaction_id, uint8_t *buffer, size_t *size);
+int rtmp_amf_encode_create_stream_result(double transaction_id, uint32_t stream_id, uint8_t *buffer, size_t *size);
+int rtmp_amf_encode_on_status(const char *level, const char *code, const char *description, uint8_t *buffer, size_t *size);
 
 #endif // RTMP_AMF_H
\ No newline at end of file
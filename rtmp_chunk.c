@@ -2,106 +2,266 @@
 #include "rtmp_utils.h"
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
-// Maximum number of chunk streams we track
+// Chunk streams with a one byte basic header, indexed directly
 #define MAX_CHUNK_STREAMS 64
 
+// Extended chunk streams a peer may open, and the map's initial size
+#define MAX_EXTENDED_CHUNK_STREAMS 1024
+#define MIN_EXTENDED_CAPACITY 16
+
 // Internal structures
+
+// Header in front of every reassembly buffer; the payload stays 16-byte aligned
+typedef struct PoolBuffer {
+    struct PoolBuffer *next;            // Free list link while pooled
+    uint32_t sizeClass;                 // RTMP_CHUNK_POOL_CLASSES when not poolable
+} __attribute__((aligned(16))) PoolBuffer;
+
+// Free lists of one thread. Only the owner touches the lists; the counters
+// are also read by rtmp_chunk_get_pool_stats, so they are stored atomically.
+typedef struct BufferCache {
+    PoolBuffer *free[RTMP_CHUNK_POOL_CLASSES];
+    uint32_t count[RTMP_CHUNK_POOL_CLASSES];
+    RTMPChunkPoolStats stats;
+    struct BufferCache *next;           // Registry link, under poolLock
+} BufferCache;
+
+// Slot of the extended chunk stream map; csid 0 marks an empty slot
+typedef struct {
+    uint32_t csid;
+    RTMPChunkContext *ctx;
+} ChunkSlot;
+
 typedef struct {
-    RTMPChunkContext *chunks[MAX_CHUNK_STREAMS];
+    RTMPChunkContext chunks[MAX_CHUNK_STREAMS];
+    ChunkSlot *extended;                // Open addressing, linear probing
+    uint32_t extendedCapacity;          // Always a power of two
+    uint32_t extendedCount;
     uint32_t chunkSize;
+
+    // Received bytes not parsed yet are input[inputStart, inputEnd)
+    uint8_t *input;
+    size_t inputStart;
+    size_t inputEnd;
+    uint32_t readChunkSize;             // Set by the peer's Set Chunk Size
+    bool failed;                        // Malformed input; nothing more is parsed
+
+    // Serialized output the socket has not taken yet
+    uint8_t *pending;
+    size_t pendingSize;
+    size_t pendingOffset;
+    size_t pendingCapacity;
 } ChunkState;
 
+// Exported reader state: this header, an ExportedStream and its partial
+// message for every chunk stream in use, then the unparsed input. Native
+// byte order; only the same build reads it back.
+typedef struct {
+    uint32_t readChunkSize;
+    uint32_t numStreams;
+    uint32_t inputLength;
+} ExportedState;
+
+typedef struct {
+    uint32_t csid;
+    RTMPChunkHeader prevHeader;
+    uint32_t timestampDelta;
+    uint32_t bytesRead;                 // Partial message bytes that follow
+    uint32_t extendedTimestamp;
+} ExportedStream;
+
+// Private variables
+static pthread_once_t poolOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t poolKey;
+static bool poolKeyValid;
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER; // Registry and retired counters, never the fast path
+static BufferCache *poolCaches;
+static RTMPChunkPoolStats poolRetired;  // Counters of exited threads and of allocations without a cache
+
 // Helper functions
-static RTMPChunkHeaderType get_chunk_type(RTMPChunkHeader *current, RTMPChunkHeader *previous);
-static void update_chunk_context(RTMPChunkContext *ctx, RTMPChunkHeader *header);
-static bool write_basic_header(uint8_t *buf, uint8_t fmt, uint32_t csid);
+static ChunkState *state_create(void);
+static void state_destroy(ChunkState *state);
+static ssize_t receive_input(ChunkState *state, int fd);
+static RTMPChunkReadResult read_message(ChunkState *state, RTMPPacket *packet);
+static uint8_t *pool_acquire(uint32_t size);
+static void pool_release(uint8_t *data);
+static void pool_init(void);
+static BufferCache *pool_cache(void);
+static void pool_cache_destroy(void *arg);
+static void pool_count(uint64_t *counter, uint64_t delta);
+static void pool_count_bytes(size_t *counter, size_t add, size_t sub);
+static RTMPChunkContext *get_chunk_context(ChunkState *state, uint32_t csid);
+static RTMPChunkContext *context_at(const ChunkState *state, uint32_t index, uint32_t *csid);
+static RTMPChunkContext *get_extended_context(ChunkState *state, uint32_t csid);
+static uint32_t extended_slot(uint32_t csid, uint32_t capacity);
+static bool grow_extended(ChunkState *state);
+static uint32_t chunk_stream_for_packet(const RTMPPacket *packet);
+static RTMPChunkHeaderType get_chunk_type(RTMPChunkHeader *current, RTMPChunkContext *ctx);
+static void update_chunk_context(RTMPChunkContext *ctx, RTMPChunkHeader *header, RTMPChunkHeaderType type,
+                                 uint32_t timestampField);
+static uint32_t read_int32(uint8_t *buf);
+static void write_int32(uint8_t *buf, uint32_t val);
+static size_t write_basic_header(uint8_t *buf, uint8_t fmt, uint32_t csid);
 static size_t read_int24(uint8_t *buf);
 static void write_int24(uint8_t *buf, uint32_t val);
+static bool write_iov(ChunkState *state, int fd, struct iovec *iov, int count);
+static bool append_pending(ChunkState *state, const struct iovec *iov, int count);
+static RTMPChunkReadResult parse_chunk(ChunkState *state, uint8_t *data, size_t available,
+                                       RTMPPacket *packet, size_t *consumed);
+
+// Chunk state management
+bool rtmp_chunk_attach(RTMPContext *rtmp) {
+    if (!rtmp || rtmp->userData) return false;
+
+    rtmp->userData = state_create();
+    return rtmp->userData != NULL;
+}
+
+void rtmp_chunk_detach(RTMPContext *rtmp) {
+    if (!rtmp || !rtmp->userData) return;
+
+    state_destroy((ChunkState *)rtmp->userData);
+    rtmp->userData = NULL;
+}
 
 // Chunk writing implementation
 bool rtmp_chunk_write(RTMPContext *rtmp, RTMPPacket *packet) {
-    if (!rtmp || !packet || !packet->data) return false;
+    if (!rtmp || !packet || (!packet->data && packet->size)) return false;
 
     ChunkState *state = (ChunkState *)rtmp->userData;
     if (!state) return false;
 
-    uint8_t header[16]; // Maximum possible header size
+    uint32_t csid = chunk_stream_for_packet(packet);
     RTMPChunkHeader chunkHeader = {
         .timestamp = packet->timestamp,
-        .messageLength = packet->size,
+        .messageLength = (uint32_t)packet->size,
         .messageType = packet->type,
         .messageStreamId = packet->streamId
     };
 
     // Get chunk context for this stream
-    RTMPChunkContext *ctx = state->chunks[packet->type % MAX_CHUNK_STREAMS];
-    if (!ctx) {
-        ctx = rtmp_chunk_context_create();
-        if (!ctx) return false;
-        state->chunks[packet->type % MAX_CHUNK_STREAMS] = ctx;
+    RTMPChunkContext *ctx = get_chunk_context(state, csid);
+    if (!ctx) return false;
+
+    // Determine chunk type; past the first message only deltas go out
+    RTMPChunkHeaderType type = get_chunk_type(&chunkHeader, ctx);
+    RTMPChunkHeader wireHeader = chunkHeader;
+    if (type != CHUNK_TYPE_0) {
+        wireHeader.timestamp = chunkHeader.timestamp - ctx->prevHeader.timestamp;
     }
 
-    // Determine chunk type
-    RTMPChunkHeaderType type = get_chunk_type(&chunkHeader, &ctx->prevHeader);
-
-    // Write chunk header
-    size_t headerSize = rtmp_chunk_write_header(header, sizeof(header), &chunkHeader, type);
+    // The first header leads, a type 3 header precedes every later chunk.
+    // Both repeat an extended timestamp.
+    uint8_t header[RTMP_CHUNK_MAX_HEADER_SIZE];
+    size_t headerSize = rtmp_chunk_write_header(header, sizeof(header), csid, &wireHeader, type);
     if (headerSize == 0) return false;
 
-    // Send header
-    if (send(rtmp->socket, header, headerSize, 0) != headerSize) {
-        rtmp_log(RTMP_LOG_ERROR, "Failed to send chunk header");
-        return false;
+    uint8_t continuation[RTMP_CHUNK_MAX_HEADER_SIZE];
+    size_t continuationSize = rtmp_chunk_write_header(continuation, sizeof(continuation), csid,
+                                                      &wireHeader, CHUNK_TYPE_3);
+
+    // Earlier output goes first
+    if (state->pendingOffset < state->pendingSize && !rtmp_chunk_flush(rtmp)) return false;
+
+    // Past the cap nothing more is buffered; the context is left as it was so
+    // the same message can be written again once the backlog drains
+    size_t pending = state->pendingSize - state->pendingOffset;
+    if (pending > 0) {
+        size_t chunks = packet->size ? (packet->size + state->chunkSize - 1) / state->chunkSize : 1;
+        size_t wireSize = headerSize + packet->size + (chunks - 1) * continuationSize;
+        if (pending + wireSize > RTMP_CHUNK_PENDING_MAX) {
+            errno = ENOBUFS;
+            return false;
+        }
     }
 
-    // Send payload in chunks
-    uint32_t remaining = packet->size;
-    uint8_t *data = packet->data;
+    // Headers and payload slices go out together, the payload is not copied
+    struct iovec iov[RTMP_CHUNK_IOV_MAX];
     uint32_t chunkSize = state->chunkSize;
+    size_t offset = 0;
+    bool first = true;
+
+    while (first || offset < packet->size) {
+        int count = 0;
+        while (count + 2 <= RTMP_CHUNK_IOV_MAX && (first || offset < packet->size)) {
+            iov[count].iov_base = first ? header : continuation;
+            iov[count].iov_len = first ? headerSize : continuationSize;
+            count++;
+
+            size_t size = packet->size - offset > chunkSize ? chunkSize : packet->size - offset;
+            if (size) {
+                iov[count].iov_base = packet->data + offset;
+                iov[count].iov_len = size;
+                count++;
+            }
+            offset += size;
+            first = false;
+        }
 
-    while (remaining) {
-        uint32_t size = remaining > chunkSize ? chunkSize : remaining;
-
-        if (send(rtmp->socket, data, size, 0) != size) {
-            rtmp_log(RTMP_LOG_ERROR, "Failed to send chunk payload");
+        if (!write_iov(state, rtmp->socket, iov, count)) {
+            rtmp_log(RTMP_LOG_ERROR, "Failed to send chunk");
             return false;
         }
+    }
 
-        data += size;
-        remaining -= size;
+    // Update chunk context
+    update_chunk_context(ctx, &chunkHeader, type, wireHeader.timestamp);
+    ctx->hasDelta = type != CHUNK_TYPE_0;
 
-        // Write continuation header if needed
-        if (remaining > 0) {
-            uint8_t basicHeader = (packet->type & 0x3f) | (CHUNK_TYPE_3 << 6);
-            if (send(rtmp->socket, &basicHeader, 1, 0) != 1) {
-                rtmp_log(RTMP_LOG_ERROR, "Failed to send continuation header");
-                return false;
-            }
+    return true;
+}
+
+// Send what earlier writes left behind; true while the socket is healthy,
+// whether or not everything went out
+bool rtmp_chunk_flush(RTMPContext *rtmp) {
+    if (!rtmp) return false;
+
+    ChunkState *state = (ChunkState *)rtmp->userData;
+    if (!state) return false;
+
+    while (state->pendingOffset < state->pendingSize) {
+        ssize_t sent = send(rtmp->socket, state->pending + state->pendingOffset,
+                            state->pendingSize - state->pendingOffset, 0);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+            rtmp_log(RTMP_LOG_ERROR, "Failed to send pending chunks");
+            return false;
         }
+        state->pendingOffset += (size_t)sent;
     }
 
-    // Update chunk context
-    update_chunk_context(ctx, &chunkHeader);
-
+    state->pendingSize = 0;
+    state->pendingOffset = 0;
     return true;
 }
 
-bool rtmp_chunk_write_header(uint8_t *buf, size_t size, RTMPChunkHeader *header,
-                           RTMPChunkHeaderType type) {
-    if (!buf || !header || size < 11) return false;
+size_t rtmp_chunk_pending(RTMPContext *rtmp) {
+    if (!rtmp || !rtmp->userData) return 0;
 
-    size_t pos = 0;
+    ChunkState *state = (ChunkState *)rtmp->userData;
+    return state->pendingSize - state->pendingOffset;
+}
+
+size_t rtmp_chunk_write_header(uint8_t *buf, size_t size, uint32_t csid, RTMPChunkHeader *header,
+                               RTMPChunkHeaderType type) {
+    if (!buf || !header || size < RTMP_CHUNK_MAX_HEADER_SIZE) return 0;
 
     // Write basic header
-    if (!write_basic_header(buf, type, header->messageStreamId)) return false;
-    pos++;
+    size_t pos = write_basic_header(buf, type, csid);
+    bool extended = header->timestamp >= RTMP_CHUNK_EXTENDED_TIMESTAMP;
+    uint32_t timestamp = extended ? RTMP_CHUNK_EXTENDED_TIMESTAMP : header->timestamp;
 
     // Write message header based on type
     switch (type) {
         case CHUNK_TYPE_0:
             // Timestamp (3 bytes)
-            write_int24(buf + pos, header->timestamp);
+            write_int24(buf + pos, timestamp);
             pos += 3;
             // Message Length (3 bytes)
             write_int24(buf + pos, header->messageLength);
@@ -117,7 +277,7 @@ bool rtmp_chunk_write_header(uint8_t *buf, size_t size, RTMPChunkHeader *header,
 
         case CHUNK_TYPE_1:
             // Timestamp Delta (3 bytes)
-            write_int24(buf + pos, header->timestamp);
+            write_int24(buf + pos, timestamp);
             pos += 3;
             // Message Length (3 bytes)
             write_int24(buf + pos, header->messageLength);
@@ -128,7 +288,7 @@ bool rtmp_chunk_write_header(uint8_t *buf, size_t size, RTMPChunkHeader *header,
 
         case CHUNK_TYPE_2:
             // Timestamp Delta (3 bytes)
-            write_int24(buf + pos, header->timestamp);
+            write_int24(buf + pos, timestamp);
             pos += 3;
             break;
 
@@ -137,132 +297,452 @@ bool rtmp_chunk_write_header(uint8_t *buf, size_t size, RTMPChunkHeader *header,
             break;
     }
 
+    // Extended Timestamp (4 bytes)
+    if (extended) {
+        write_int32(buf + pos, header->timestamp);
+        pos += 4;
+    }
+
     return pos;
 }
 
+// Header bytes for a chunk stream id below 64, extended timestamp included
+size_t rtmp_chunk_calculate_size(RTMPChunkHeader *header, RTMPChunkHeaderType type) {
+    static const size_t headerSizes[4] = { 11, 7, 3, 0 };
+    if (!header) return 0;
+
+    return 1 + headerSizes[type & 3] + (header->timestamp >= RTMP_CHUNK_EXTENDED_TIMESTAMP ? 4 : 0);
+}
+
 // Chunk reading implementation
-bool rtmp_chunk_read(RTMPContext *rtmp, RTMPPacket *packet) {
-    if (!rtmp || !packet) return false;
+bool rtmp_chunk_receive(RTMPContext *rtmp) {
+    if (!rtmp) return false;
 
     ChunkState *state = (ChunkState *)rtmp->userData;
     if (!state) return false;
 
-    uint8_t basicHeader;
-    if (recv(rtmp->socket, &basicHeader, 1, 0) != 1) {
-        rtmp_log(RTMP_LOG_ERROR, "Failed to read basic header");
+    // A full buffer holds a whole chunk, so it is parsed before more is read
+    if (state->inputEnd - state->inputStart == RTMP_CHUNK_RECEIVE_BUFFER_SIZE) return true;
+
+    ssize_t received = receive_input(state, rtmp->socket);
+    if (received < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+        rtmp_log(RTMP_LOG_ERROR, "Failed to receive chunks");
         return false;
     }
+    if (received == 0) return false;
 
-    uint8_t fmt;
-    uint32_t csid;
-    if (!rtmp_chunk_read_basic_header(&basicHeader, &fmt, &csid)) {
+    rtmp->bytesReceived += (uint32_t)received;
+    return true;
+}
+
+RTMPChunkReadResult rtmp_chunk_read(RTMPContext *rtmp, RTMPPacket *packet) {
+    if (!rtmp || !packet) return RTMP_CHUNK_READ_ERROR;
+
+    ChunkState *state = (ChunkState *)rtmp->userData;
+    if (!state) return RTMP_CHUNK_READ_ERROR;
+
+    return read_message(state, packet);
+}
+
+// Server chunk stream implementation
+rtmp_chunk_stream_t *rtmp_chunk_stream_create(void) {
+    rtmp_chunk_stream_t *stream = (rtmp_chunk_stream_t *)calloc(1, sizeof(rtmp_chunk_stream_t));
+    if (!stream) return NULL;
+
+    stream->state = state_create();
+    if (!stream->state) {
+        free(stream);
+        return NULL;
+    }
+    return stream;
+}
+
+void rtmp_chunk_stream_destroy(rtmp_chunk_stream_t *stream) {
+    if (!stream) return;
+
+    rtmp_chunk_release_packet(&stream->packet);
+    state_destroy((ChunkState *)stream->state);
+    free(stream);
+}
+
+// One recv into the receive buffer; returns what recv did. A full buffer
+// (messages left unread) or a malformed stream fail with ENOBUFS and EPROTO.
+ssize_t rtmp_chunk_stream_receive(rtmp_chunk_stream_t *stream, int fd) {
+    if (!stream || !stream->state) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ChunkState *state = (ChunkState *)stream->state;
+    if (state->failed) {
+        errno = EPROTO;
+        return -1;
+    }
+    if (state->inputEnd - state->inputStart == RTMP_CHUNK_RECEIVE_BUFFER_SIZE) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    return receive_input(state, fd);
+}
+
+// Append bytes the caller received itself; false when they do not fit
+bool rtmp_chunk_stream_feed(rtmp_chunk_stream_t *stream, const uint8_t *data, size_t length) {
+    if (!stream || !stream->state || (!data && length)) return false;
+
+    ChunkState *state = (ChunkState *)stream->state;
+    if (state->failed) return false;
+
+    if (state->inputEnd + length > RTMP_CHUNK_RECEIVE_BUFFER_SIZE && state->inputStart > 0) {
+        memmove(state->input, state->input + state->inputStart, state->inputEnd - state->inputStart);
+        state->inputEnd -= state->inputStart;
+        state->inputStart = 0;
+    }
+    if (state->inputEnd + length > RTMP_CHUNK_RECEIVE_BUFFER_SIZE) {
+        rtmp_log(RTMP_LOG_ERROR, "Chunk receive buffer overflow");
         return false;
     }
 
-    // Get or create chunk context
-    RTMPChunkContext *ctx = state->chunks[csid % MAX_CHUNK_STREAMS];
-    if (!ctx) {
-        ctx = rtmp_chunk_context_create();
-        if (!ctx) return false;
-        state->chunks[csid % MAX_CHUNK_STREAMS] = ctx;
+    memcpy(state->input + state->inputEnd, data, length);
+    state->inputEnd += length;
+    return true;
+}
+
+// Next complete message, or NULL until more bytes arrive or once the stream failed
+rtmp_chunk_stream_t *rtmp_chunk_stream_get_next(rtmp_chunk_stream_t *stream) {
+    if (!stream || !stream->state) return NULL;
+
+    // The previous message's buffer goes back to the pool
+    rtmp_chunk_release_packet(&stream->packet);
+
+    if (read_message((ChunkState *)stream->state, &stream->packet) != RTMP_CHUNK_READ_MESSAGE) {
+        return NULL;
     }
 
-    // Read chunk header
-    RTMPChunkHeader header;
-    RTMPChunkHeaderType type;
-    uint8_t headerBuf[16];
-    size_t headerSize = 0;
+    stream->msg_type_id = stream->packet.type;
+    stream->msg_stream_id = stream->packet.streamId;
+    stream->timestamp = stream->packet.timestamp;
+    stream->msg_length = (uint32_t)stream->packet.size;
+    stream->msg_data = stream->packet.data;
+    return stream;
+}
 
-    switch (fmt) {
-        case CHUNK_TYPE_0:
-            headerSize = 11;
-            break;
-        case CHUNK_TYPE_1:
-            headerSize = 7;
-            break;
-        case CHUNK_TYPE_2:
-            headerSize = 3;
-            break;
-        case CHUNK_TYPE_3:
-            headerSize = 0;
-            break;
+bool rtmp_chunk_stream_failed(const rtmp_chunk_stream_t *stream) {
+    return !stream || !stream->state || ((ChunkState *)stream->state)->failed;
+}
+
+// Everything the parser carries between chunks, as one malloc'd blob
+uint8_t *rtmp_chunk_stream_export(const rtmp_chunk_stream_t *stream, size_t *length) {
+    if (!length || rtmp_chunk_stream_failed(stream)) return NULL;
+
+    const ChunkState *state = (const ChunkState *)stream->state;
+    uint32_t numContexts = MAX_CHUNK_STREAMS + state->extendedCapacity;
+    ExportedState header = { state->readChunkSize, 0, (uint32_t)(state->inputEnd - state->inputStart) };
+
+    // Size it up first so the blob is one allocation
+    size_t size = sizeof(header) + header.inputLength;
+    for (uint32_t i = 0; i < numContexts; i++) {
+        uint32_t csid;
+        RTMPChunkContext *ctx = context_at(state, i, &csid);
+        if (ctx) {
+            header.numStreams++;
+            size += sizeof(ExportedStream) + ctx->bytesRead;
+        }
     }
 
-    if (headerSize > 0) {
-        if (recv(rtmp->socket, headerBuf, headerSize, 0) != headerSize) {
-            rtmp_log(RTMP_LOG_ERROR, "Failed to read message header");
-            return false;
+    uint8_t *data = (uint8_t *)malloc(size);
+    if (!data) return NULL;
+
+    memcpy(data, &header, sizeof(header));
+    size_t offset = sizeof(header);
+    for (uint32_t i = 0; i < numContexts; i++) {
+        ExportedStream exported;
+        RTMPChunkContext *ctx = context_at(state, i, &exported.csid);
+        if (!ctx) continue;
+
+        exported.prevHeader = ctx->prevHeader;
+        exported.timestampDelta = ctx->timestampDelta;
+        exported.bytesRead = ctx->bytesRead;
+        exported.extendedTimestamp = ctx->extendedTimestamp;
+        memcpy(data + offset, &exported, sizeof(exported));
+        offset += sizeof(exported);
+        if (ctx->bytesRead) {
+            memcpy(data + offset, ctx->buffer, ctx->bytesRead);
+            offset += ctx->bytesRead;
         }
+    }
+    memcpy(data + offset, state->input + state->inputStart, header.inputLength);
 
-        if (!rtmp_chunk_read_header(headerBuf, headerSize, &header, &type)) {
+    *length = size;
+    return data;
+}
+
+// Only into a reader nothing was fed to yet; a failed import leaves it unusable
+bool rtmp_chunk_stream_import(rtmp_chunk_stream_t *stream, const uint8_t *data, size_t length) {
+    if (rtmp_chunk_stream_failed(stream) || !data || length < sizeof(ExportedState)) return false;
+
+    ChunkState *state = (ChunkState *)stream->state;
+    ExportedState header;
+    memcpy(&header, data, sizeof(header));
+    if (header.readChunkSize == 0 || header.readChunkSize > RTMP_MAX_CHUNK_SIZE) return false;
+
+    size_t offset = sizeof(header);
+    for (uint32_t i = 0; i < header.numStreams; i++) {
+        ExportedStream exported;
+        if (length - offset < sizeof(exported)) return false;
+        memcpy(&exported, data + offset, sizeof(exported));
+        offset += sizeof(exported);
+        if (exported.bytesRead > exported.prevHeader.messageLength || length - offset < exported.bytesRead) {
             return false;
         }
-    } else {
-        // Copy from previous header for type 3
-        header = ctx->prevHeader;
+
+        RTMPChunkContext *ctx = get_chunk_context(state, exported.csid);
+        if (!ctx) return false;
+
+        ctx->prevHeader = exported.prevHeader;
+        ctx->timestampDelta = exported.timestampDelta;
+        ctx->extendedTimestamp = exported.extendedTimestamp != 0;
+        if (exported.bytesRead) {
+            ctx->buffer = pool_acquire(exported.prevHeader.messageLength);
+            if (!ctx->buffer) return false;
+            ctx->bufferSize = exported.prevHeader.messageLength;
+            ctx->bytesRead = exported.bytesRead;
+            memcpy(ctx->buffer, data + offset, exported.bytesRead);
+            offset += exported.bytesRead;
+        }
     }
+    if (length - offset != header.inputLength) return false;
 
-    // Allocate packet data if needed
-    if (!ctx->buffer) {
-        ctx->buffer = (uint8_t *)malloc(header.messageLength);
-        if (!ctx->buffer) {
-            rtmp_log(RTMP_LOG_ERROR, "Failed to allocate chunk buffer");
-            return false;
+    state->readChunkSize = header.readChunkSize;
+    return rtmp_chunk_stream_feed(stream, data + offset, header.inputLength);
+}
+
+// Helper function implementations
+
+static ChunkState *state_create(void) {
+    ChunkState *state = NULL;
+    if (posix_memalign((void **)&state, RTMP_CHUNK_CACHE_LINE, sizeof(ChunkState)) != 0) return NULL;
+    memset(state, 0, sizeof(ChunkState));
+
+    state->input = (uint8_t *)malloc(RTMP_CHUNK_RECEIVE_BUFFER_SIZE);
+    if (!state->input) {
+        free(state);
+        return NULL;
+    }
+
+    state->chunkSize = RTMP_DEFAULT_CHUNK_SIZE;
+    state->readChunkSize = RTMP_DEFAULT_CHUNK_SIZE;
+    return state;
+}
+
+static void state_destroy(ChunkState *state) {
+    if (!state) return;
+
+    for (int i = 0; i < MAX_CHUNK_STREAMS; i++) {
+        pool_release(state->chunks[i].buffer);
+    }
+    for (uint32_t i = 0; i < state->extendedCapacity; i++) {
+        rtmp_chunk_context_destroy(state->extended[i].ctx);
+    }
+    free(state->extended);
+    free(state->input);
+    free(state->pending);
+    free(state);
+}
+
+// One recv behind the unparsed bytes; only the partial chunk at the front is
+// moved to make room
+static ssize_t receive_input(ChunkState *state, int fd) {
+    if (state->inputStart > 0) {
+        memmove(state->input, state->input + state->inputStart, state->inputEnd - state->inputStart);
+        state->inputEnd -= state->inputStart;
+        state->inputStart = 0;
+    }
+
+    ssize_t received;
+    do {
+        received = recv(fd, state->input + state->inputEnd, RTMP_CHUNK_RECEIVE_BUFFER_SIZE - state->inputEnd, 0);
+    } while (received < 0 && errno == EINTR);
+
+    if (received > 0) {
+        state->inputEnd += (size_t)received;
+    }
+    return received;
+}
+
+// Parse buffered chunks until a message completes
+static RTMPChunkReadResult read_message(ChunkState *state, RTMPPacket *packet) {
+    if (state->failed) return RTMP_CHUNK_READ_ERROR;
+
+    RTMPChunkReadResult result = RTMP_CHUNK_READ_PARTIAL;
+    while (result == RTMP_CHUNK_READ_PARTIAL && state->inputStart < state->inputEnd) {
+        size_t consumed = 0;
+        result = parse_chunk(state, state->input + state->inputStart, state->inputEnd - state->inputStart,
+                             packet, &consumed);
+        if (consumed == 0) break;
+        state->inputStart += consumed;
+    }
+
+    // A Set Chunk Size applies to the very next chunk, which may be buffered already
+    if (result == RTMP_CHUNK_READ_MESSAGE && packet->type == RTMP_MSG_CHUNK_SIZE && packet->size >= 4) {
+        uint32_t size = ((uint32_t)packet->data[0] << 24 | (uint32_t)packet->data[1] << 16 |
+                         (uint32_t)packet->data[2] << 8 | packet->data[3]) & 0x7fffffff;
+        if (size == 0 || size > RTMP_MAX_CHUNK_SIZE) {
+            rtmp_log(RTMP_LOG_ERROR, "Invalid peer chunk size");
+            pool_release(packet->data);
+            packet->data = NULL;
+            packet->size = 0;
+            result = RTMP_CHUNK_READ_ERROR;
+        } else {
+            state->readChunkSize = size;
         }
-        ctx->bufferSize = header.messageLength;
-        ctx->bytesRead = 0;
     }
 
-    // Read chunk data
-    uint32_t chunkSize = state->chunkSize;
-    uint32_t remaining = header.messageLength - ctx->bytesRead;
-    uint32_t size = remaining > chunkSize ? chunkSize : remaining;
+    state->failed = result == RTMP_CHUNK_READ_ERROR;
+    return result;
+}
 
-    if (recv(rtmp->socket, ctx->buffer + ctx->bytesRead, size, 0) != size) {
-        rtmp_log(RTMP_LOG_ERROR, "Failed to read chunk data");
-        return false;
+// Parse one chunk from data; consumed stays 0 until the whole chunk is there
+static RTMPChunkReadResult parse_chunk(ChunkState *state, uint8_t *data, size_t available,
+                                       RTMPPacket *packet, size_t *consumed) {
+    static const size_t headerSizes[4] = { 11, 7, 3, 0 };
+
+    // Basic header: 1 byte, 2 or 3 for extended chunk stream ids
+    size_t basicSize = (data[0] & 0x3f) == 0 ? 2 : (data[0] & 0x3f) == 1 ? 3 : 1;
+    if (available < basicSize) return RTMP_CHUNK_READ_PARTIAL;
+
+    uint8_t fmt;
+    uint32_t csid;
+    if (!rtmp_chunk_read_basic_header(data, &fmt, &csid)) {
+        return RTMP_CHUNK_READ_ERROR;
     }
 
-    ctx->bytesRead += size;
+    size_t headerSize = basicSize + headerSizes[fmt];
+    if (available < headerSize) return RTMP_CHUNK_READ_PARTIAL;
 
-    // If message complete, copy to packet
-    if (ctx->bytesRead >= header.messageLength) {
-        packet->data = (uint8_t *)malloc(header.messageLength);
-        if (!packet->data) {
-            rtmp_log(RTMP_LOG_ERROR, "Failed to allocate packet data");
-            return false;
+    // Get or create chunk context
+    RTMPChunkContext *ctx = get_chunk_context(state, csid);
+    if (!ctx) {
+        rtmp_log(RTMP_LOG_ERROR, "Too many chunk streams");
+        return RTMP_CHUNK_READ_ERROR;
+    }
+
+    // Fields a compressed header leaves out carry over from the previous one
+    RTMPChunkHeader header = ctx->prevHeader;
+    uint32_t timestampField = ctx->timestampDelta;
+    bool extended = ctx->extendedTimestamp;
+    if (fmt != CHUNK_TYPE_3) {
+        RTMPChunkHeaderType type = (RTMPChunkHeaderType)fmt;
+        if (!rtmp_chunk_read_header(data + basicSize, headerSizes[fmt], &header, &type)) {
+            return RTMP_CHUNK_READ_ERROR;
+        }
+        timestampField = header.timestamp;
+        extended = timestampField == RTMP_CHUNK_EXTENDED_TIMESTAMP;
+    } else if (!ctx->prevHeader.messageLength && !ctx->buffer) {
+        rtmp_log(RTMP_LOG_ERROR, "Type 3 chunk without a previous header");
+        return RTMP_CHUNK_READ_ERROR;
+    }
+
+    // The 4 byte timestamp follows every header of the message, type 3 too.
+    // A type 3 header keeps the delta it continues; some peers repeat the
+    // absolute timestamp there instead.
+    if (extended) {
+        if (available < headerSize + 4) return RTMP_CHUNK_READ_PARTIAL;
+        if (fmt != CHUNK_TYPE_3) {
+            timestampField = read_int32(data + headerSize);
         }
+        headerSize += 4;
+    }
 
-        memcpy(packet->data, ctx->buffer, header.messageLength);
-        packet->size = header.messageLength;
-        packet->type = header.messageType;
-        packet->timestamp = header.timestamp;
-        packet->streamId = header.messageStreamId;
+    // Type 0 is absolute, the others move on from the stream's last message;
+    // a type 3 header only does so when it starts a message
+    if (fmt == CHUNK_TYPE_0) {
+        header.timestamp = timestampField;
+    } else if (fmt != CHUNK_TYPE_3 || !ctx->buffer) {
+        header.timestamp = ctx->prevHeader.timestamp + timestampField;
+    }
 
-        // Reset chunk context
-        ctx->bytesRead = 0;
-        free(ctx->buffer);
+    // A new message header abandons whatever was in progress on this stream
+    if (fmt != CHUNK_TYPE_3 && ctx->buffer) {
+        pool_release(ctx->buffer);
         ctx->buffer = NULL;
         ctx->bufferSize = 0;
+        ctx->bytesRead = 0;
     }
 
+    uint32_t remaining = header.messageLength - ctx->bytesRead;
+    uint32_t size = remaining > state->readChunkSize ? state->readChunkSize : remaining;
+    if (available < headerSize + size) return RTMP_CHUNK_READ_PARTIAL;
+
+    // The whole message is reassembled in one pooled buffer
+    if (!ctx->buffer) {
+        ctx->buffer = pool_acquire(header.messageLength);
+        if (!ctx->buffer) {
+            rtmp_log(RTMP_LOG_ERROR, "Failed to allocate chunk buffer");
+            return RTMP_CHUNK_READ_ERROR;
+        }
+        ctx->bufferSize = header.messageLength;
+        ctx->bytesRead = 0;
+    }
+
+    memcpy(ctx->buffer + ctx->bytesRead, data + headerSize, size);
+    ctx->bytesRead += size;
+    *consumed = headerSize + size;
+
     // Update chunk context
-    update_chunk_context(ctx, &header);
+    update_chunk_context(ctx, &header, (RTMPChunkHeaderType)fmt, timestampField);
 
-    return true;
+    if (ctx->bytesRead < header.messageLength) return RTMP_CHUNK_READ_PARTIAL;
+
+    // Message complete, the packet takes the buffer over
+    packet->data = ctx->buffer;
+    packet->size = header.messageLength;
+    packet->type = header.messageType;
+    packet->timestamp = header.timestamp;
+    packet->streamId = header.messageStreamId;
+
+    // Reset chunk context
+    ctx->bytesRead = 0;
+    ctx->buffer = NULL;
+    ctx->bufferSize = 0;
+
+    return RTMP_CHUNK_READ_MESSAGE;
+}
+
+void rtmp_chunk_release_packet(RTMPPacket *packet) {
+    if (!packet) return;
+
+    pool_release(packet->data);
+    packet->data = NULL;
+    packet->size = 0;
+}
+
+// Sum over every thread's cache and the threads already gone
+void rtmp_chunk_get_pool_stats(RTMPChunkPoolStats *stats) {
+    if (!stats) return;
+
+    pthread_mutex_lock(&poolLock);
+    *stats = poolRetired;
+    for (BufferCache *cache = poolCaches; cache; cache = cache->next) {
+        stats->hits += __atomic_load_n(&cache->stats.hits, __ATOMIC_RELAXED);
+        stats->misses += __atomic_load_n(&cache->stats.misses, __ATOMIC_RELAXED);
+        stats->releases += __atomic_load_n(&cache->stats.releases, __ATOMIC_RELAXED);
+        stats->cachedBytes += __atomic_load_n(&cache->stats.cachedBytes, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&poolLock);
 }
 
 // Context management
 RTMPChunkContext *rtmp_chunk_context_create(void) {
-    RTMPChunkContext *ctx = (RTMPChunkContext *)calloc(1, sizeof(RTMPChunkContext));
+    RTMPChunkContext *ctx = NULL;
+    if (posix_memalign((void **)&ctx, RTMP_CHUNK_CACHE_LINE, sizeof(RTMPChunkContext)) != 0) return NULL;
+    memset(ctx, 0, sizeof(RTMPChunkContext));
     return ctx;
 }
 
 void rtmp_chunk_context_destroy(RTMPChunkContext *ctx) {
     if (!ctx) return;
-    if (ctx->buffer) {
-        free(ctx->buffer);
-    }
+    pool_release(ctx->buffer);
     free(ctx);
 }
 
@@ -270,16 +750,243 @@ void rtmp_chunk_context_reset(RTMPChunkContext *ctx) {
     if (!ctx) return;
     memset(&ctx->prevHeader, 0, sizeof(RTMPChunkHeader));
     ctx->timestampDelta = 0;
-    if (ctx->buffer) {
-        free(ctx->buffer);
-        ctx->buffer = NULL;
-    }
+    ctx->hasDelta = false;
+    ctx->extendedTimestamp = false;
+    pool_release(ctx->buffer);
+    ctx->buffer = NULL;
     ctx->bufferSize = 0;
     ctx->bytesRead = 0;
 }
 
-// Helper function implementations
-static RTMPChunkHeaderType get_chunk_type(RTMPChunkHeader *current, RTMPChunkHeader *previous) {
+// Smallest size class that fits, from the calling thread's free list when
+// one is there
+static uint8_t *pool_acquire(uint32_t size) {
+    uint32_t sizeClass = 0;
+    while (sizeClass < RTMP_CHUNK_POOL_CLASSES && ((size_t)1 << (RTMP_CHUNK_POOL_MIN_SHIFT + sizeClass)) < size) {
+        sizeClass++;
+    }
+
+    PoolBuffer *buffer = NULL;
+    BufferCache *cache = pool_cache();
+    if (cache && sizeClass < RTMP_CHUNK_POOL_CLASSES && cache->free[sizeClass]) {
+        buffer = cache->free[sizeClass];
+        cache->free[sizeClass] = buffer->next;
+        cache->count[sizeClass]--;
+        pool_count_bytes(&cache->stats.cachedBytes, 0, (size_t)1 << (RTMP_CHUNK_POOL_MIN_SHIFT + sizeClass));
+        pool_count(&cache->stats.hits, 1);
+        return (uint8_t *)(buffer + 1);
+    }
+
+    if (cache) {
+        pool_count(&cache->stats.misses, 1);
+    } else {
+        pthread_mutex_lock(&poolLock);
+        poolRetired.misses++;
+        pthread_mutex_unlock(&poolLock);
+    }
+
+    size_t capacity = sizeClass < RTMP_CHUNK_POOL_CLASSES ?
+                      (size_t)1 << (RTMP_CHUNK_POOL_MIN_SHIFT + sizeClass) : size;
+    buffer = (PoolBuffer *)malloc(sizeof(PoolBuffer) + capacity);
+    if (!buffer) return NULL;
+    buffer->sizeClass = sizeClass;
+    return (uint8_t *)(buffer + 1);
+}
+
+// Onto the releasing thread's free list, unless that list already holds its share
+static void pool_release(uint8_t *data) {
+    if (!data) return;
+
+    PoolBuffer *buffer = (PoolBuffer *)data - 1;
+    uint32_t sizeClass = buffer->sizeClass;
+    size_t capacity = (size_t)1 << (RTMP_CHUNK_POOL_MIN_SHIFT + sizeClass);
+
+    BufferCache *cache = pool_cache();
+    if (!cache) {
+        pthread_mutex_lock(&poolLock);
+        poolRetired.releases++;
+        pthread_mutex_unlock(&poolLock);
+        free(buffer);
+        return;
+    }
+
+    pool_count(&cache->stats.releases, 1);
+    if (sizeClass < RTMP_CHUNK_POOL_CLASSES &&
+        (size_t)(cache->count[sizeClass] + 1) * capacity <= RTMP_CHUNK_POOL_CLASS_BYTES) {
+        buffer->next = cache->free[sizeClass];
+        cache->free[sizeClass] = buffer;
+        cache->count[sizeClass]++;
+        pool_count_bytes(&cache->stats.cachedBytes, capacity, 0);
+        return;
+    }
+    free(buffer);
+}
+
+static void pool_init(void) {
+    poolKeyValid = pthread_key_create(&poolKey, pool_cache_destroy) == 0;
+}
+
+// The calling thread's cache, created on first use; NULL leaves the caller
+// to plain malloc and free
+static BufferCache *pool_cache(void) {
+    pthread_once(&poolOnce, pool_init);
+    if (!poolKeyValid) return NULL;
+
+    BufferCache *cache = (BufferCache *)pthread_getspecific(poolKey);
+    if (cache) return cache;
+
+    cache = (BufferCache *)calloc(1, sizeof(BufferCache));
+    if (!cache) return NULL;
+    if (pthread_setspecific(poolKey, cache) != 0) {
+        free(cache);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&poolLock);
+    cache->next = poolCaches;
+    poolCaches = cache;
+    pthread_mutex_unlock(&poolLock);
+    return cache;
+}
+
+// Thread exit: counters move to the retired totals, free buffers go back to malloc
+static void pool_cache_destroy(void *arg) {
+    BufferCache *cache = (BufferCache *)arg;
+
+    pthread_mutex_lock(&poolLock);
+    for (BufferCache **link = &poolCaches; *link; link = &(*link)->next) {
+        if (*link == cache) {
+            *link = cache->next;
+            break;
+        }
+    }
+    poolRetired.hits += cache->stats.hits;
+    poolRetired.misses += cache->stats.misses;
+    poolRetired.releases += cache->stats.releases;
+    pthread_mutex_unlock(&poolLock);
+
+    for (uint32_t i = 0; i < RTMP_CHUNK_POOL_CLASSES; i++) {
+        while (cache->free[i]) {
+            PoolBuffer *buffer = cache->free[i];
+            cache->free[i] = buffer->next;
+            free(buffer);
+        }
+    }
+    free(cache);
+}
+
+// Owner-only updates; the atomic store keeps a concurrent stats read whole
+static void pool_count(uint64_t *counter, uint64_t delta) {
+    __atomic_store_n(counter, *counter + delta, __ATOMIC_RELAXED);
+}
+
+static void pool_count_bytes(size_t *counter, size_t add, size_t sub) {
+    __atomic_store_n(counter, *counter + add - sub, __ATOMIC_RELAXED);
+}
+
+// Ids below 64 are one load; the rest go through the map, created on first use
+static RTMPChunkContext *get_chunk_context(ChunkState *state, uint32_t csid) {
+    if (csid < MAX_CHUNK_STREAMS) {
+        return &state->chunks[csid];
+    }
+    return get_extended_context(state, csid);
+}
+
+// Context behind index i of the direct table followed by the extended map,
+// NULL unless a header was ever read into it
+static RTMPChunkContext *context_at(const ChunkState *state, uint32_t index, uint32_t *csid) {
+    RTMPChunkContext *ctx;
+    if (index < MAX_CHUNK_STREAMS) {
+        ctx = (RTMPChunkContext *)&state->chunks[index];
+        *csid = index;
+    } else {
+        const ChunkSlot *slot = &state->extended[index - MAX_CHUNK_STREAMS];
+        if (!slot->csid) return NULL;
+        ctx = slot->ctx;
+        *csid = slot->csid;
+    }
+
+    bool used = ctx->buffer || ctx->prevHeader.messageLength || ctx->prevHeader.messageType ||
+                ctx->prevHeader.timestamp || ctx->prevHeader.messageStreamId || ctx->timestampDelta;
+    return used ? ctx : NULL;
+}
+
+static uint32_t extended_slot(uint32_t csid, uint32_t capacity) {
+    return ((csid * 2654435761u) >> 16) & (capacity - 1);
+}
+
+static RTMPChunkContext *get_extended_context(ChunkState *state, uint32_t csid) {
+    if (csid > RTMP_CHUNK_STREAM_MAX) return NULL;
+
+    uint32_t mask = state->extendedCapacity - 1;
+    if (state->extendedCapacity) {
+        for (uint32_t i = extended_slot(csid, state->extendedCapacity); state->extended[i].csid; i = (i + 1) & mask) {
+            if (state->extended[i].csid == csid) return state->extended[i].ctx;
+        }
+    }
+
+    // Keep the load under three quarters
+    if (state->extendedCount >= MAX_EXTENDED_CHUNK_STREAMS) return NULL;
+    if ((state->extendedCount + 1) * 4 > state->extendedCapacity * 3 && !grow_extended(state)) return NULL;
+
+    RTMPChunkContext *ctx = rtmp_chunk_context_create();
+    if (!ctx) return NULL;
+
+    mask = state->extendedCapacity - 1;
+    uint32_t i = extended_slot(csid, state->extendedCapacity);
+    while (state->extended[i].csid) {
+        i = (i + 1) & mask;
+    }
+    state->extended[i].csid = csid;
+    state->extended[i].ctx = ctx;
+    state->extendedCount++;
+    return ctx;
+}
+
+static bool grow_extended(ChunkState *state) {
+    uint32_t capacity = state->extendedCapacity ? state->extendedCapacity * 2 : MIN_EXTENDED_CAPACITY;
+    ChunkSlot *slots = (ChunkSlot *)calloc(capacity, sizeof(ChunkSlot));
+    if (!slots) return false;
+
+    for (uint32_t j = 0; j < state->extendedCapacity; j++) {
+        if (!state->extended[j].csid) continue;
+        uint32_t i = extended_slot(state->extended[j].csid, capacity);
+        while (slots[i].csid) {
+            i = (i + 1) & (capacity - 1);
+        }
+        slots[i] = state->extended[j];
+    }
+
+    free(state->extended);
+    state->extended = slots;
+    state->extendedCapacity = capacity;
+    return true;
+}
+
+// Each kind of message keeps to its own chunk stream, so header compression
+// only ever compares like with like
+static uint32_t chunk_stream_for_packet(const RTMPPacket *packet) {
+    switch (packet->type) {
+        case RTMP_MSG_CHUNK_SIZE:
+        case RTMP_MSG_ABORT:
+        case RTMP_MSG_ACK:
+        case RTMP_MSG_USER_CONTROL:
+        case RTMP_MSG_WINDOW_ACK_SIZE:
+        case RTMP_MSG_SET_PEER_BW:
+            return RTMP_CHUNK_STREAM_PROTOCOL;
+        case RTMP_MSG_AUDIO:
+            return RTMP_CHUNK_STREAM_AUDIO;
+        case RTMP_MSG_VIDEO:
+            return RTMP_CHUNK_STREAM_VIDEO;
+        case RTMP_MSG_DATA_AMF0:
+        case RTMP_MSG_DATA_AMF3:
+            return RTMP_CHUNK_STREAM_METADATA;
+        default:
+            return RTMP_CHUNK_STREAM_COMMAND;
+    }
+}
+static RTMPChunkHeaderType get_chunk_type(RTMPChunkHeader *current, RTMPChunkContext *ctx) {
+    RTMPChunkHeader *previous = &ctx->prevHeader;
     if (!previous->messageLength) {
         return CHUNK_TYPE_0;
     }
@@ -288,43 +995,121 @@ static RTMPChunkHeaderType get_chunk_type(RTMPChunkHeader *current, RTMPChunkHea
         return CHUNK_TYPE_0;
     }
 
+    // Deltas are unsigned; a timestamp going back starts over from an absolute one
+    uint32_t delta = current->timestamp - previous->timestamp;
+    if ((int32_t)delta < 0) {
+        return CHUNK_TYPE_0;
+    }
+
     if (current->messageLength != previous->messageLength ||
         current->messageType != previous->messageType) {
         return CHUNK_TYPE_1;
     }
 
-    if (current->timestamp != previous->timestamp) {
+    // Peers disagree on what a type 3 header repeats after a type 0 one, so
+    // only a delta that was sent explicitly is repeated
+    if (!ctx->hasDelta || delta != ctx->timestampDelta) {
         return CHUNK_TYPE_2;
     }
 
     return CHUNK_TYPE_3;
 }
 
-static void update_chunk_context(RTMPChunkContext *ctx, RTMPChunkHeader *header) {
+// Remember the header and the timestamp field as sent, which a following
+// type 3 header repeats
+static void update_chunk_context(RTMPChunkContext *ctx, RTMPChunkHeader *header, RTMPChunkHeaderType type,
+                                 uint32_t timestampField) {
     if (!ctx || !header) return;
-    
-    ctx->timestampDelta = header->timestamp - ctx->prevHeader.timestamp;
+
+    if (type != CHUNK_TYPE_3) {
+        ctx->extendedTimestamp = timestampField >= RTMP_CHUNK_EXTENDED_TIMESTAMP;
+    }
+    ctx->timestampDelta = timestampField;
     ctx->prevHeader = *header;
 }
 
-static bool write_basic_header(uint8_t *buf, uint8_t fmt, uint32_t csid) {
+static size_t write_basic_header(uint8_t *buf, uint8_t fmt, uint32_t csid) {
     if (csid >= 64) {
         if (csid >= 320) {
             buf[0] = (fmt << 6) | 1;
             buf[1] = (csid - 64) & 0xFF;
             buf[2] = ((csid - 64) >> 8) & 0xFF;
-            return true;
+            return 3;
         } else {
             buf[0] = (fmt << 6) | 0;
             buf[1] = (csid - 64) & 0xFF;
-            return true;
+            return 2;
         }
     } else {
         buf[0] = (fmt << 6) | csid;
-        return true;
+        return 1;
     }
 }
 
+// One writev per batch. Behind queued output, or once the socket is full,
+// the rest is copied to the pending buffer instead.
+static bool write_iov(ChunkState *state, int fd, struct iovec *iov, int count) {
+    if (state->pendingOffset < state->pendingSize) {
+        return append_pending(state, iov, count);
+    }
+
+    while (count > 0) {
+        ssize_t sent = writev(fd, iov, count);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return append_pending(state, iov, count);
+            return false;
+        }
+
+        // Skip what went out; a partially written iovec is resumed
+        size_t done = (size_t)sent;
+        while (count > 0 && done >= iov->iov_len) {
+            done -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (uint8_t *)iov->iov_base + done;
+            iov->iov_len -= done;
+        }
+    }
+
+    return true;
+}
+
+static bool append_pending(ChunkState *state, const struct iovec *iov, int count) {
+    size_t size = 0;
+    for (int i = 0; i < count; i++) {
+        size += iov[i].iov_len;
+    }
+
+    // Reclaim the space already sent before growing
+    if (state->pendingOffset > 0) {
+        memmove(state->pending, state->pending + state->pendingOffset, state->pendingSize - state->pendingOffset);
+        state->pendingSize -= state->pendingOffset;
+        state->pendingOffset = 0;
+    }
+    if (state->pendingSize + size > state->pendingCapacity) {
+        size_t capacity = state->pendingCapacity ? state->pendingCapacity : 4096;
+        while (capacity < state->pendingSize + size) {
+            capacity *= 2;
+        }
+        uint8_t *pending = (uint8_t *)realloc(state->pending, capacity);
+        if (!pending) {
+            rtmp_log(RTMP_LOG_ERROR, "Failed to allocate pending chunk buffer");
+            return false;
+        }
+        state->pending = pending;
+        state->pendingCapacity = capacity;
+    }
+
+    for (int i = 0; i < count; i++) {
+        memcpy(state->pending + state->pendingSize, iov[i].iov_base, iov[i].iov_len);
+        state->pendingSize += iov[i].iov_len;
+    }
+    return true;
+}
+
 static size_t read_int24(uint8_t *buf) {
     return (buf[0] << 16) | (buf[1] << 8) | buf[2];
 }
@@ -335,6 +1120,17 @@ static void write_int24(uint8_t *buf, uint32_t val) {
     buf[2] = val & 0xFF;
 }
 
+static uint32_t read_int32(uint8_t *buf) {
+    return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) | ((uint32_t)buf[2] << 8) | buf[3];
+}
+
+static void write_int32(uint8_t *buf, uint32_t val) {
+    buf[0] = (val >> 24) & 0xFF;
+    buf[1] = (val >> 16) & 0xFF;
+    buf[2] = (val >> 8) & 0xFF;
+    buf[3] = val & 0xFF;
+}
+
 bool rtmp_chunk_read_basic_header(uint8_t *buf, uint8_t *fmt, uint32_t *csid) {
     if (!buf || !fmt || !csid) return false;
 
@@ -399,6 +1195,8 @@ void rtmp_chunk_set_size(RTMPContext *rtmp, uint32_t size) {
     ChunkState *state = (ChunkState *)rtmp->userData;
     if (!state) return;
 
+    // Not a size the protocol can carry; the previous one stays
+    if (size == 0 || size > 0x7fffffff) return;
     if (size > RTMP_MAX_CHUNK_SIZE) {
         size = RTMP_MAX_CHUNK_SIZE;
     }
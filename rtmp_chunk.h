@@ -1,15 +1,33 @@
 #ifndef RTMP_CHUNK_H
 #define RTMP_CHUNK_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <sys/types.h>
 #include "rtmp_protocol.h"
 
 // Chunk size constants
 #define RTMP_DEFAULT_CHUNK_SIZE 128
 #define RTMP_MAX_CHUNK_SIZE 65536
+#define RTMP_CHUNK_MAX_HEADER_SIZE 18   // Basic (3) + message (11) + extended timestamp (4)
+#define RTMP_CHUNK_EXTENDED_TIMESTAMP 0xFFFFFF // Timestamp field saying 4 more bytes follow
+#define RTMP_CHUNK_IOV_MAX 64           // iovecs per writev call
+#define RTMP_CHUNK_CACHE_LINE 64
+#define RTMP_CHUNK_RECEIVE_BUFFER_SIZE (2 * RTMP_MAX_CHUNK_SIZE) // Always holds a whole chunk
+#define RTMP_CHUNK_PENDING_MAX (4 * 1024 * 1024) // Unsent output buffered before writes are refused
 
-// Chunk stream ID constants
+// Reassembly buffer pool: power-of-two size classes from 256 bytes to 1 MB.
+// Every thread keeps its own free lists, up to RTMP_CHUNK_POOL_CLASS_BYTES
+// per class, so acquiring and releasing take no lock; a buffer goes to the
+// cache of the thread releasing it. Larger messages are allocated and freed
+// directly.
+#define RTMP_CHUNK_POOL_MIN_SHIFT 8
+#define RTMP_CHUNK_POOL_CLASSES 13
+#define RTMP_CHUNK_POOL_CLASS_BYTES (2 * 1024 * 1024)
+
+// Chunk stream ID constants; ids from 64 up take a 2 or 3 byte basic header
+#define RTMP_CHUNK_STREAM_MAX 65599
 #define RTMP_CHUNK_STREAM_PROTOCOL 2
 #define RTMP_CHUNK_STREAM_COMMAND 3
 #define RTMP_CHUNK_STREAM_METADATA 4
@@ -24,7 +42,8 @@ typedef enum {
     CHUNK_TYPE_3 = 3  // No header (0 bytes)
 } RTMPChunkHeaderType;
 
-// Chunk header structure
+// Chunk header structure. On the wire the timestamp is absolute in type 0
+// headers and a delta from the stream's previous message otherwise.
 typedef struct {
     uint32_t timestamp;      // Timestamp of message
     uint32_t messageLength;  // Length of message
@@ -32,23 +51,58 @@ typedef struct {
     uint32_t messageStreamId;// Stream ID
 } RTMPChunkHeader;
 
-// Chunk context for maintaining state
+// Outcome of parsing buffered input
+typedef enum {
+    RTMP_CHUNK_READ_MESSAGE = 0, // packet holds a complete message
+    RTMP_CHUNK_READ_PARTIAL,     // No complete message buffered yet
+    RTMP_CHUNK_READ_ERROR        // Malformed stream; the connection is unusable
+} RTMPChunkReadResult;
+
+// Reassembly buffer pool counters, summed over all threads
+typedef struct {
+    uint64_t hits;              // Buffers reused from the pool
+    uint64_t misses;            // Buffers allocated: pool empty or message too large
+    uint64_t releases;          // Buffers given back
+    size_t cachedBytes;         // Free buffers held by the pool
+} RTMPChunkPoolStats;
+
+// Chunk context for maintaining state, one cache line per chunk stream
 typedef struct {
-    RTMPChunkHeader prevHeader;
-    uint32_t timestampDelta;
+    RTMPChunkHeader prevHeader;         // Absolute timestamp
+    uint32_t timestampDelta;            // Repeated by a type 3 header starting a message
     uint8_t *buffer;
     uint32_t bufferSize;
     uint32_t bytesRead;
-} RTMPChunkContext;
+    bool hasDelta;                      // Written: last header carried a delta
+    bool extendedTimestamp;             // Type 3 headers carry 4 timestamp bytes
+} __attribute__((aligned(RTMP_CHUNK_CACHE_LINE))) RTMPChunkContext;
 
-// Functions for chunk encoding
+// Chunk state of a connection, kept in rtmp->userData
+bool rtmp_chunk_attach(RTMPContext *rtmp);
+void rtmp_chunk_detach(RTMPContext *rtmp);
+
+// Functions for chunk encoding. A write serializes the whole message with
+// writev; what a non-blocking socket does not take is kept and sent first by
+// the next write or flush. While unsent output would pass
+// RTMP_CHUNK_PENDING_MAX a write fails with errno ENOBUFS and changes
+// nothing, so the caller can flush and write the same message again.
 bool rtmp_chunk_write(RTMPContext *rtmp, RTMPPacket *packet);
-bool rtmp_chunk_write_header(uint8_t *buf, size_t size, RTMPChunkHeader *header, 
-                           RTMPChunkHeaderType type);
+bool rtmp_chunk_flush(RTMPContext *rtmp);
+size_t rtmp_chunk_pending(RTMPContext *rtmp);
+size_t rtmp_chunk_write_header(uint8_t *buf, size_t size, uint32_t csid, RTMPChunkHeader *header,
+                               RTMPChunkHeaderType type);
 size_t rtmp_chunk_calculate_size(RTMPChunkHeader *header, RTMPChunkHeaderType type);
 
-// Functions for chunk decoding
-bool rtmp_chunk_read(RTMPContext *rtmp, RTMPPacket *packet);
+// Functions for chunk decoding. Receive does one recv per readiness event
+// into the connection's buffer; read then parses chunks from memory until a
+// message completes. Partial chunks stay buffered for the next receive.
+bool rtmp_chunk_receive(RTMPContext *rtmp);
+RTMPChunkReadResult rtmp_chunk_read(RTMPContext *rtmp, RTMPPacket *packet);
+
+// A message read hands its pooled reassembly buffer to the packet; give it
+// back with rtmp_chunk_release_packet instead of free
+void rtmp_chunk_release_packet(RTMPPacket *packet);
+void rtmp_chunk_get_pool_stats(RTMPChunkPoolStats *stats);
 bool rtmp_chunk_read_header(uint8_t *buf, size_t size, RTMPChunkHeader *header,
                           RTMPChunkHeaderType *type);
 bool rtmp_chunk_read_basic_header(uint8_t *buf, uint8_t *fmt, uint32_t *csid);
@@ -62,4 +116,33 @@ void rtmp_chunk_context_reset(RTMPChunkContext *ctx);
 void rtmp_chunk_set_size(RTMPContext *rtmp, uint32_t size);
 uint32_t rtmp_chunk_get_size(RTMPContext *rtmp);
 
+// Message-at-a-time reader for the server, on the same receive buffer and
+// parser as rtmp_chunk_read. Bytes come in straight from the socket with
+// receive, or with feed when the caller already read them. get_next returns
+// the stream itself holding the next complete message, valid until the next
+// call; a message built by hand for sending fills the same fields, state NULL.
+typedef struct rtmp_chunk_stream {
+    uint8_t msg_type_id;
+    uint32_t msg_stream_id;
+    uint32_t timestamp;
+    uint32_t msg_length;
+    uint8_t *msg_data;
+    void *state;                        // Chunk state; NULL for a message built by hand
+    RTMPPacket packet;                  // Pooled buffer behind msg_data
+} rtmp_chunk_stream_t;
+
+rtmp_chunk_stream_t *rtmp_chunk_stream_create(void);
+void rtmp_chunk_stream_destroy(rtmp_chunk_stream_t *stream);
+ssize_t rtmp_chunk_stream_receive(rtmp_chunk_stream_t *stream, int fd);
+bool rtmp_chunk_stream_feed(rtmp_chunk_stream_t *stream, const uint8_t *data, size_t length);
+rtmp_chunk_stream_t *rtmp_chunk_stream_get_next(rtmp_chunk_stream_t *stream);
+bool rtmp_chunk_stream_failed(const rtmp_chunk_stream_t *stream);
+
+// Parser state a connection handed to another process resumes with: the
+// peer's chunk size, every chunk stream's last header and the message it is
+// assembling, and the input not parsed yet. Export returns a malloc'd blob
+// that import applies to a freshly created reader of the same build.
+uint8_t *rtmp_chunk_stream_export(const rtmp_chunk_stream_t *stream, size_t *length);
+bool rtmp_chunk_stream_import(rtmp_chunk_stream_t *stream, const uint8_t *data, size_t length);
+
 #endif /* RTMP_CHUNK_H */
\ No newline at end of file
@@ -0,0 +1,501 @@
+// Host tests for the chunk layer; run with make check
+#include "rtmp_chunk.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+// Private variables
+static int failures;
+static uint8_t payload[600000];
+
+// Serialize one message at the given chunk size: a type 0 header, then a
+// type 3 header in front of every further chunk
+static size_t encode_message(uint8_t *out, uint32_t csid, uint8_t type, uint32_t timestamp, uint32_t streamId,
+                             const uint8_t *data, uint32_t length, uint32_t chunkSize) {
+    RTMPChunkHeader header = {
+        .timestamp = timestamp,
+        .messageLength = length,
+        .messageType = type,
+        .messageStreamId = streamId
+    };
+
+    size_t size = rtmp_chunk_write_header(out, RTMP_CHUNK_MAX_HEADER_SIZE, csid, &header, CHUNK_TYPE_0);
+    uint32_t offset = 0;
+    while (offset < length) {
+        if (offset > 0) {
+            size += rtmp_chunk_write_header(out + size, RTMP_CHUNK_MAX_HEADER_SIZE, csid, &header, CHUNK_TYPE_3);
+        }
+        uint32_t slice = length - offset > chunkSize ? chunkSize : length - offset;
+        memcpy(out + size, data + offset, slice);
+        size += slice;
+        offset += slice;
+    }
+    return size;
+}
+
+static bool message_is(rtmp_chunk_stream_t *msg, uint8_t type, uint32_t timestamp, const uint8_t *data,
+                       uint32_t length) {
+    return msg && msg->msg_type_id == type && msg->timestamp == timestamp && msg->msg_length == length &&
+           memcmp(msg->msg_data, data, length) == 0;
+}
+
+// A message arriving one byte at a time completes only with its last byte
+static void test_feed_split(void) {
+    static uint8_t wire[8192];
+    size_t size = encode_message(wire, RTMP_CHUNK_STREAM_VIDEO, RTMP_MSG_VIDEO, 1000, 1, payload, 5000,
+                                 RTMP_DEFAULT_CHUNK_SIZE);
+
+    rtmp_chunk_stream_t *stream = rtmp_chunk_stream_create();
+    CHECK(stream != NULL);
+    for (size_t i = 0; i + 1 < size; i++) {
+        CHECK(rtmp_chunk_stream_feed(stream, wire + i, 1));
+        CHECK(rtmp_chunk_stream_get_next(stream) == NULL);
+    }
+    CHECK(rtmp_chunk_stream_feed(stream, wire + size - 1, 1));
+    CHECK(message_is(rtmp_chunk_stream_get_next(stream), RTMP_MSG_VIDEO, 1000, payload, 5000));
+    CHECK(rtmp_chunk_stream_get_next(stream) == NULL);
+    CHECK(!rtmp_chunk_stream_failed(stream));
+    rtmp_chunk_stream_destroy(stream);
+}
+
+// Several messages in one read, interleaved chunk streams and a Set Chunk
+// Size that applies to the chunks right behind it in the same buffer
+static void test_feed_coalesced(void) {
+    static uint8_t wire[65536];
+    static uint8_t audio[4096];
+    size_t size = 0;
+
+    // Audio and video chunks interleaved at the default size
+    uint8_t video[RTMP_CHUNK_MAX_HEADER_SIZE * 2 + 256];
+    size_t videoSize = encode_message(video, RTMP_CHUNK_STREAM_VIDEO, RTMP_MSG_VIDEO, 40, 1, payload, 256,
+                                      RTMP_DEFAULT_CHUNK_SIZE);
+    size_t audioSize = encode_message(audio, RTMP_CHUNK_STREAM_AUDIO, RTMP_MSG_AUDIO, 20, 1, payload + 7, 100,
+                                      RTMP_DEFAULT_CHUNK_SIZE);
+    size_t firstChunk = videoSize - 128 - 1;
+    memcpy(wire + size, video, firstChunk);
+    size += firstChunk;
+    memcpy(wire + size, audio, audioSize);
+    size += audioSize;
+    memcpy(wire + size, video + firstChunk, videoSize - firstChunk);
+    size += videoSize - firstChunk;
+
+    // Set Chunk Size to 4096, then a message cut at the new size
+    uint8_t chunkSize[4] = { 0, 0, 0x10, 0 };
+    size += encode_message(wire + size, RTMP_CHUNK_STREAM_PROTOCOL, RTMP_MSG_CHUNK_SIZE, 0, 0, chunkSize, 4,
+                           RTMP_DEFAULT_CHUNK_SIZE);
+    size += encode_message(wire + size, RTMP_CHUNK_STREAM_VIDEO, RTMP_MSG_VIDEO, 80, 1, payload + 3, 10000, 4096);
+
+    rtmp_chunk_stream_t *stream = rtmp_chunk_stream_create();
+    CHECK(rtmp_chunk_stream_feed(stream, wire, size));
+    CHECK(message_is(rtmp_chunk_stream_get_next(stream), RTMP_MSG_AUDIO, 20, payload + 7, 100));
+    CHECK(message_is(rtmp_chunk_stream_get_next(stream), RTMP_MSG_VIDEO, 40, payload, 256));
+    CHECK(message_is(rtmp_chunk_stream_get_next(stream), RTMP_MSG_CHUNK_SIZE, 0, chunkSize, 4));
+    CHECK(message_is(rtmp_chunk_stream_get_next(stream), RTMP_MSG_VIDEO, 80, payload + 3, 10000));
+    CHECK(rtmp_chunk_stream_get_next(stream) == NULL);
+    CHECK(!rtmp_chunk_stream_failed(stream));
+    rtmp_chunk_stream_destroy(stream);
+}
+
+// A bad chunk size poisons the stream for good
+static void test_feed_invalid(void) {
+    uint8_t wire[64];
+    uint8_t chunkSize[4] = { 0, 0, 0, 0 };
+    size_t size = encode_message(wire, RTMP_CHUNK_STREAM_PROTOCOL, RTMP_MSG_CHUNK_SIZE, 0, 0, chunkSize, 4,
+                                 RTMP_DEFAULT_CHUNK_SIZE);
+
+    rtmp_chunk_stream_t *stream = rtmp_chunk_stream_create();
+    CHECK(rtmp_chunk_stream_feed(stream, wire, size));
+    CHECK(rtmp_chunk_stream_get_next(stream) == NULL);
+    CHECK(rtmp_chunk_stream_failed(stream));
+    CHECK(!rtmp_chunk_stream_feed(stream, wire, size));
+    rtmp_chunk_stream_destroy(stream);
+}
+
+// First chunk of a 200 byte message, or its type 3 remainder, filled with the
+// message's index
+static size_t encode_half(uint8_t *out, uint32_t csid, uint32_t index, bool first) {
+    RTMPChunkHeader header = {
+        .timestamp = index,
+        .messageLength = 200,
+        .messageType = RTMP_MSG_VIDEO,
+        .messageStreamId = 1
+    };
+    size_t size = rtmp_chunk_write_header(out, RTMP_CHUNK_MAX_HEADER_SIZE, csid, &header,
+                                          first ? CHUNK_TYPE_0 : CHUNK_TYPE_3);
+    size_t slice = first ? RTMP_DEFAULT_CHUNK_SIZE : 200 - RTMP_DEFAULT_CHUNK_SIZE;
+    memset(out + size, (int)(index & 0xff), slice);
+    return size + slice;
+}
+
+// One, two and three byte basic headers, ids that share a slot in the
+// extended map at every size it grows through, and a map that grows while
+// messages are half read; each chunk stream keeps its own header and buffer
+static void test_extended_ids(void) {
+    enum { STREAMS = 300 };
+    static const uint32_t fixed[] = { 3, 63, 64, 79, 94, 109, 124, 319, 320, 65599 };
+    uint32_t ids[STREAMS];
+    for (uint32_t i = 0; i < STREAMS; i++) {
+        ids[i] = i < sizeof(fixed) / sizeof(fixed[0]) ? fixed[i] : 400 + i * 200;
+    }
+
+    static uint8_t wire[STREAMS * 2 * (RTMP_CHUNK_MAX_HEADER_SIZE + RTMP_DEFAULT_CHUNK_SIZE)];
+    size_t size = 0;
+    for (uint32_t i = 0; i < STREAMS; i++) {
+        size += encode_half(wire + size, ids[i], i, true);
+    }
+    for (uint32_t i = STREAMS; i-- > 0;) {
+        size += encode_half(wire + size, ids[i], i, false);
+    }
+
+    rtmp_chunk_stream_t *stream = rtmp_chunk_stream_create();
+    CHECK(rtmp_chunk_stream_feed(stream, wire, size));
+    for (uint32_t i = STREAMS; i-- > 0;) {
+        rtmp_chunk_stream_t *msg = rtmp_chunk_stream_get_next(stream);
+        CHECK(msg != NULL);
+        if (!msg) break;
+        CHECK(msg->timestamp == i);
+        CHECK(msg->msg_length == 200 && msg->msg_data[0] == (uint8_t)i && msg->msg_data[199] == (uint8_t)i);
+    }
+    CHECK(rtmp_chunk_stream_get_next(stream) == NULL);
+    CHECK(!rtmp_chunk_stream_failed(stream));
+    rtmp_chunk_stream_destroy(stream);
+}
+
+// A peer opening more extended chunk streams than allowed is cut off
+static void test_extended_limit(void) {
+    rtmp_chunk_stream_t *stream = rtmp_chunk_stream_create();
+    uint8_t wire[RTMP_CHUNK_MAX_HEADER_SIZE + RTMP_DEFAULT_CHUNK_SIZE];
+
+    uint32_t opened = 0;
+    for (uint32_t csid = 64; csid <= RTMP_CHUNK_STREAM_MAX && !rtmp_chunk_stream_failed(stream); csid++) {
+        size_t size = encode_half(wire, csid, csid, true);
+        CHECK(rtmp_chunk_stream_feed(stream, wire, size));
+        CHECK(rtmp_chunk_stream_get_next(stream) == NULL);
+        opened++;
+    }
+    CHECK(rtmp_chunk_stream_failed(stream));
+    CHECK(opened > 64 && opened < RTMP_CHUNK_STREAM_MAX - 64);
+    rtmp_chunk_stream_destroy(stream);
+}
+
+// Feed two messages of the given size in receive-buffer sized slices,
+// reading as they complete; the stream is destroyed at the end
+static void feed_two_messages(uint32_t length) {
+    uint8_t *buffer = malloc(length + length / RTMP_DEFAULT_CHUNK_SIZE * RTMP_CHUNK_MAX_HEADER_SIZE +
+                             RTMP_CHUNK_MAX_HEADER_SIZE);
+    size_t size = encode_message(buffer, RTMP_CHUNK_STREAM_VIDEO, RTMP_MSG_VIDEO, 0, 1, payload, length,
+                                 RTMP_DEFAULT_CHUNK_SIZE);
+
+    rtmp_chunk_stream_t *stream = rtmp_chunk_stream_create();
+    for (int message = 0; message < 2; message++) {
+        rtmp_chunk_stream_t *msg = NULL;
+        for (size_t offset = 0; offset < size; offset += 65536) {
+            size_t slice = size - offset > 65536 ? 65536 : size - offset;
+            CHECK(rtmp_chunk_stream_feed(stream, buffer + offset, slice));
+            msg = rtmp_chunk_stream_get_next(stream);
+        }
+        CHECK(msg && msg->msg_length == length && memcmp(msg->msg_data, payload, length) == 0);
+    }
+    rtmp_chunk_stream_destroy(stream);
+    free(buffer);
+}
+
+static void *pool_thread(void *arg) {
+    (void)arg;
+    feed_two_messages(150000);
+    return NULL;
+}
+
+// One miss, then the first message's buffer comes back for the second; a
+// thread's cached buffers are freed when it exits but its counts remain
+static void test_pool_stats(void) {
+    RTMPChunkPoolStats before, after;
+    rtmp_chunk_get_pool_stats(&before);
+    feed_two_messages(600000);
+    rtmp_chunk_get_pool_stats(&after);
+    CHECK(after.misses - before.misses == 1);
+    CHECK(after.hits - before.hits == 1);
+    CHECK(after.releases - before.releases == 2);
+    CHECK(after.cachedBytes - before.cachedBytes == (size_t)1 << 20);
+
+    pthread_t thread;
+    before = after;
+    CHECK(pthread_create(&thread, NULL, pool_thread, NULL) == 0);
+    pthread_join(thread, NULL);
+    rtmp_chunk_get_pool_stats(&after);
+    CHECK(after.misses - before.misses == 1);
+    CHECK(after.hits - before.hits == 1);
+    CHECK(after.releases - before.releases == 2);
+    CHECK(after.cachedBytes == before.cachedBytes);
+}
+
+// Writer and reader on the two ends of a non-blocking socket pair
+static bool open_pair(RTMPContext *writer, RTMPContext *reader, int sendBuffer) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) return false;
+    if (sendBuffer) {
+        setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &sendBuffer, sizeof(sendBuffer));
+    }
+    fcntl(sv[0], F_SETFL, O_NONBLOCK);
+    fcntl(sv[1], F_SETFL, O_NONBLOCK);
+
+    memset(writer, 0, sizeof(*writer));
+    memset(reader, 0, sizeof(*reader));
+    writer->socket = sv[0];
+    reader->socket = sv[1];
+    return rtmp_chunk_attach(writer) && rtmp_chunk_attach(reader);
+}
+
+static void close_pair(RTMPContext *writer, RTMPContext *reader) {
+    rtmp_chunk_detach(writer);
+    rtmp_chunk_detach(reader);
+    close(writer->socket);
+    close(reader->socket);
+}
+
+// Read every complete message the reader has; each is checked against the
+// next expected size and timestamp, payload taken from the start of payload[]
+static int drain_reader(RTMPContext *reader, const uint32_t *sizes, const uint32_t *timestamps, int count,
+                        int received) {
+    while (received < count && rtmp_chunk_receive(reader)) {
+        RTMPPacket packet;
+        RTMPChunkReadResult result = RTMP_CHUNK_READ_PARTIAL;
+        bool progress = false;
+        while (received < count && (result = rtmp_chunk_read(reader, &packet)) == RTMP_CHUNK_READ_MESSAGE) {
+            CHECK(packet.size == sizes[received]);
+            CHECK(packet.timestamp == timestamps[received]);
+            CHECK(packet.size == sizes[received] && memcmp(packet.data, payload, packet.size) == 0);
+            rtmp_chunk_release_packet(&packet);
+            received++;
+            progress = true;
+        }
+        CHECK(result != RTMP_CHUNK_READ_ERROR);
+        if (!progress) break;
+    }
+    return received;
+}
+
+// Writes the socket cannot take are kept and sent in order by flush; past
+// the cap a write is refused without touching the chunk context
+static void test_write_partial(void) {
+    enum { MESSAGES = 64 };
+    uint32_t sizes[MESSAGES];
+    uint32_t timestamps[MESSAGES];
+    RTMPContext writer, reader;
+    CHECK(open_pair(&writer, &reader, 4096));
+
+    int written = 0;
+    bool refused = false;
+    while (written < MESSAGES) {
+        sizes[written] = 100000;
+        timestamps[written] = 1000 + 40 * (uint32_t)written;
+        RTMPPacket packet = { payload, sizes[written], timestamps[written], RTMP_MSG_VIDEO, 1 };
+        if (!rtmp_chunk_write(&writer, &packet)) {
+            CHECK(errno == ENOBUFS);
+            refused = true;
+            break;
+        }
+        CHECK(rtmp_chunk_pending(&writer) > 0);
+        CHECK(rtmp_chunk_pending(&writer) <= RTMP_CHUNK_PENDING_MAX);
+        written++;
+    }
+    CHECK(refused);
+    CHECK(written > 1);
+
+    // Drain, then write the refused message again; it goes out as if nothing happened
+    int received = 0;
+    while (rtmp_chunk_pending(&writer) > 0) {
+        CHECK(rtmp_chunk_flush(&writer));
+        received = drain_reader(&reader, sizes, timestamps, written, received);
+    }
+    RTMPPacket retry = { payload, sizes[written], timestamps[written], RTMP_MSG_VIDEO, 1 };
+    CHECK(rtmp_chunk_write(&writer, &retry));
+    written++;
+    while (received < written) {
+        CHECK(rtmp_chunk_flush(&writer));
+        int before = received;
+        received = drain_reader(&reader, sizes, timestamps, written, received);
+        if (received == before && rtmp_chunk_pending(&writer) == 0) break;
+    }
+    CHECK(received == written);
+
+    close_pair(&writer, &reader);
+}
+
+// Timestamps written as deltas and extended fields read back exactly, and
+// a steady stream settles on type 3 headers that start a new message
+static void test_timestamp_round_trip(void) {
+    enum { MAX_MESSAGES = 300 };
+    uint32_t timestamps[MAX_MESSAGES];
+    uint32_t sizes[MAX_MESSAGES];
+    int count = 0;
+
+    for (int i = 0; i < 100; i++) timestamps[count++] = 1000 + i * 40;              // Steady 25 fps
+    for (int i = 0; i < 50; i++) timestamps[count++] = 0xFFFFFF - 500 + i * 20;     // Crossing the 24 bit field
+    timestamps[count++] = 500;                                                      // Going back
+    for (int i = 0; i < 20; i++) timestamps[count++] = 0x1000000 * (uint32_t)(i + 1); // Extended deltas
+    for (int i = 0; i < 20; i++) timestamps[count++] = 0x7FFFFFF0u + i * 1000000;  // Large absolute values
+    timestamps[count++] = 0xFFFFFFF0u;
+    timestamps[count++] = 5;                                                        // Wrapping around
+    for (int i = 0; i < count; i++) {
+        sizes[i] = i < 150 ? 200 : 300;
+    }
+
+    RTMPContext writer, reader;
+    CHECK(open_pair(&writer, &reader, 0));
+    size_t rawCapacity = 1 << 20;
+    uint8_t *raw = malloc(rawCapacity);
+    size_t rawSize = 0;
+    for (int i = 0; i < count; i++) {
+        RTMPPacket packet = { payload, sizes[i], timestamps[i], RTMP_MSG_VIDEO, 1 };
+        CHECK(rtmp_chunk_write(&writer, &packet));
+        for (;;) {
+            ssize_t got = recv(reader.socket, raw + rawSize, rawCapacity - rawSize, 0);
+            if (got > 0) rawSize += (size_t)got;
+            CHECK(rtmp_chunk_flush(&writer));
+            if (got <= 0 && rtmp_chunk_pending(&writer) == 0) break;
+        }
+    }
+
+    // Type 0, then type 2 with the first delta, then type 3 repeating it
+    size_t first = 12 + 128 + 1 + 72;
+    size_t second = 4 + 128 + 1 + 72;
+    CHECK(raw[0] == (CHUNK_TYPE_0 << 6 | RTMP_CHUNK_STREAM_VIDEO));
+    CHECK(raw[first] == (CHUNK_TYPE_2 << 6 | RTMP_CHUNK_STREAM_VIDEO));
+    CHECK(raw[first + 1] == 0 && raw[first + 2] == 0 && raw[first + 3] == 40);
+    CHECK(raw[first + second] == (CHUNK_TYPE_3 << 6 | RTMP_CHUNK_STREAM_VIDEO));
+    CHECK(raw[first + second + 1 + 128] == (CHUNK_TYPE_3 << 6 | RTMP_CHUNK_STREAM_VIDEO));
+
+    rtmp_chunk_stream_t *stream = rtmp_chunk_stream_create();
+    int received = 0;
+    for (size_t offset = 0; offset < rawSize; offset += 65536) {
+        size_t slice = rawSize - offset > 65536 ? 65536 : rawSize - offset;
+        CHECK(rtmp_chunk_stream_feed(stream, raw + offset, slice));
+        rtmp_chunk_stream_t *msg;
+        while ((msg = rtmp_chunk_stream_get_next(stream)) != NULL && received < count) {
+            CHECK(msg->timestamp == timestamps[received]);
+            CHECK(msg->msg_length == sizes[received] && memcmp(msg->msg_data, payload, msg->msg_length) == 0);
+            received++;
+        }
+    }
+    CHECK(received == count);
+    CHECK(!rtmp_chunk_stream_failed(stream));
+    rtmp_chunk_stream_destroy(stream);
+
+    free(raw);
+    close_pair(&writer, &reader);
+}
+
+// A reader exported between two chunks of a message, with a chunk cut short
+// in its input, resumes in a fresh reader: the peer's chunk size, the header
+// a type 1 continues from and the partial message all carry over
+static void test_export_import(void) {
+    static uint8_t wire[32768];
+    const uint32_t chunkSize = 4096;
+    uint8_t sizeBody[4] = { 0, 0, (uint8_t)(chunkSize >> 8), 0 };
+    size_t size = encode_message(wire, RTMP_CHUNK_STREAM_PROTOCOL, RTMP_MSG_CHUNK_SIZE, 0, 0, sizeBody, 4,
+                                 RTMP_DEFAULT_CHUNK_SIZE);
+    size += encode_message(wire + size, 40000, RTMP_MSG_VIDEO, 1000, 1, payload, 5000, chunkSize);
+
+    // Type 1 with a 40 ms delta, then a type 3 starting the next message with the same delta
+    RTMPChunkHeader header = { .timestamp = 40, .messageLength = 6000, .messageType = RTMP_MSG_VIDEO };
+    size_t second = 0;
+    for (int message = 0; message < 2; message++) {
+        for (uint32_t offset = 0; offset < 6000; offset += chunkSize) {
+            RTMPChunkHeaderType type = message == 0 && offset == 0 ? CHUNK_TYPE_1 : CHUNK_TYPE_3;
+            size += rtmp_chunk_write_header(wire + size, RTMP_CHUNK_MAX_HEADER_SIZE, 40000, &header, type);
+            uint32_t slice = 6000 - offset > chunkSize ? chunkSize : 6000 - offset;
+            memcpy(wire + size, payload + 100 * message + offset, slice);
+            size += slice;
+            if (message == 0 && offset == 0) second = size;
+        }
+    }
+
+    rtmp_chunk_stream_t *stream = rtmp_chunk_stream_create();
+    size_t cut = second + 10;
+    CHECK(rtmp_chunk_stream_feed(stream, wire, cut));
+    CHECK(message_is(rtmp_chunk_stream_get_next(stream), RTMP_MSG_CHUNK_SIZE, 0, sizeBody, 4));
+    CHECK(message_is(rtmp_chunk_stream_get_next(stream), RTMP_MSG_VIDEO, 1000, payload, 5000));
+    CHECK(rtmp_chunk_stream_get_next(stream) == NULL);
+
+    size_t length = 0;
+    uint8_t *state = rtmp_chunk_stream_export(stream, &length);
+    CHECK(state != NULL);
+    rtmp_chunk_stream_destroy(stream);
+
+    stream = rtmp_chunk_stream_create();
+    CHECK(rtmp_chunk_stream_import(stream, state, length));
+    CHECK(rtmp_chunk_stream_feed(stream, wire + cut, size - cut));
+    CHECK(message_is(rtmp_chunk_stream_get_next(stream), RTMP_MSG_VIDEO, 1040, payload, 6000));
+    CHECK(message_is(rtmp_chunk_stream_get_next(stream), RTMP_MSG_VIDEO, 1080, payload + 100, 6000));
+    CHECK(rtmp_chunk_stream_get_next(stream) == NULL);
+    CHECK(!rtmp_chunk_stream_failed(stream));
+    rtmp_chunk_stream_destroy(stream);
+
+    // A truncated blob is refused
+    stream = rtmp_chunk_stream_create();
+    CHECK(!rtmp_chunk_stream_import(stream, state, length - 1));
+    rtmp_chunk_stream_destroy(stream);
+    free(state);
+}
+
+// Sizes the protocol cannot carry leave the write size alone; a reset
+// context starts the next message with a full header
+static void test_set_size_and_reset(void) {
+    RTMPContext writer, reader;
+    CHECK(open_pair(&writer, &reader, 0));
+    rtmp_chunk_set_size(&writer, 4096);
+    rtmp_chunk_set_size(&writer, 0);
+    CHECK(rtmp_chunk_get_size(&writer) == 4096);
+    rtmp_chunk_set_size(&writer, 0x80000000u);
+    CHECK(rtmp_chunk_get_size(&writer) == 4096);
+    rtmp_chunk_set_size(&writer, 0x7fffffff);
+    CHECK(rtmp_chunk_get_size(&writer) == RTMP_MAX_CHUNK_SIZE);
+    close_pair(&writer, &reader);
+
+    RTMPChunkContext *ctx = rtmp_chunk_context_create();
+    CHECK(ctx != NULL);
+    if (!ctx) return;
+    ctx->timestampDelta = 40;
+    ctx->hasDelta = true;
+    ctx->extendedTimestamp = true;
+    rtmp_chunk_context_reset(ctx);
+    CHECK(ctx->timestampDelta == 0 && !ctx->hasDelta && !ctx->extendedTimestamp);
+    rtmp_chunk_context_destroy(ctx);
+}
+
+int main(void) {
+    for (size_t i = 0; i < sizeof(payload); i++) {
+        payload[i] = (uint8_t)(i * 13 + (i >> 8));
+    }
+
+    test_feed_split();
+    test_feed_coalesced();
+    test_feed_invalid();
+    test_write_partial();
+    test_extended_ids();
+    test_extended_limit();
+    test_pool_stats();
+    test_timestamp_round_trip();
+    test_export_import();
+    test_set_size_and_reset();
+
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("rtmp_chunk_test: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,211 @@
+// rtmp_file_source.c
+#include "rtmp_file_source.h"
+#include "rtmp_reactor.h"
+#include <pthread.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// FLV file header: "FLV", version, flags, header size; PreviousTagSize0 follows
+#define RTMP_FILE_SOURCE_HEADER_SIZE 9
+
+struct rtmp_file_source {
+    const uint8_t* map;
+    size_t size;
+    size_t body;                        // First tag
+
+    double speed;
+    bool loop;
+    rtmp_file_source_callback_t callback;
+    void* userdata;
+    bool running;                       // Cleared to stop the thread
+    bool started;                       // Thread to join
+    pthread_t thread;
+
+    // Written by the source thread, read by stats
+    uint64_t tags;
+    uint64_t bytes;
+    uint32_t loops;
+    uint64_t start_ms;
+    uint64_t end_ms;
+    bool finished;
+};
+
+// Forward declarations of internal functions
+static void* rtmp_file_source_thread(void* arg);
+static bool rtmp_file_source_next(const rtmp_file_source_t* source, size_t* position, rtmp_flv_tag_t* tag);
+static bool rtmp_file_source_wait(rtmp_file_source_t* source, uint64_t due_ms);
+
+rtmp_file_source_t* rtmp_file_source_open(const char* path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < RTMP_FILE_SOURCE_HEADER_SIZE + RTMP_FLV_TAG_TRAILER_SIZE) {
+        close(fd);
+        return NULL;
+    }
+    size_t size = (size_t)st.st_size;
+    uint8_t* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+
+    // Start reading the whole file in now; loops come back to the front, so
+    // pages are kept rather than dropped behind the reader
+    madvise(map, size, MADV_WILLNEED);
+
+    uint32_t header = ((uint32_t)map[5] << 24) | ((uint32_t)map[6] << 16) | ((uint32_t)map[7] << 8) | map[8];
+    rtmp_file_source_t* source = NULL;
+    if (memcmp(map, "FLV", 3) == 0 && header >= RTMP_FILE_SOURCE_HEADER_SIZE &&
+        header <= size - RTMP_FLV_TAG_TRAILER_SIZE) {
+        source = calloc(1, sizeof(rtmp_file_source_t));
+    }
+    if (!source) {
+        munmap(map, size);
+        return NULL;
+    }
+
+    source->map = map;
+    source->size = size;
+    source->body = header + RTMP_FLV_TAG_TRAILER_SIZE;
+    return source;
+}
+
+void rtmp_file_source_close(rtmp_file_source_t* source) {
+    if (!source) return;
+
+    rtmp_file_source_stop(source);
+    munmap((void*)source->map, source->size);
+    free(source);
+}
+
+bool rtmp_file_source_start(rtmp_file_source_t* source, double speed, bool loop,
+                            rtmp_file_source_callback_t callback, void* userdata) {
+    if (!source || !callback || source->started || speed < 0) return false;
+
+    source->speed = speed;
+    source->loop = loop;
+    source->callback = callback;
+    source->userdata = userdata;
+    source->tags = 0;
+    source->bytes = 0;
+    source->loops = 0;
+    source->finished = false;
+    source->start_ms = rtmp_reactor_clock_ms();
+    source->running = true;
+
+    if (pthread_create(&source->thread, NULL, rtmp_file_source_thread, source) != 0) {
+        source->running = false;
+        return false;
+    }
+    source->started = true;
+    return true;
+}
+
+// Waits for the thread; the callback is not called once this returns
+void rtmp_file_source_stop(rtmp_file_source_t* source) {
+    if (!source || !source->started) return;
+
+    __atomic_store_n(&source->running, false, __ATOMIC_RELEASE);
+    pthread_join(source->thread, NULL);
+    source->started = false;
+}
+
+void rtmp_file_source_get_stats(rtmp_file_source_t* source, rtmp_file_source_stats_t* stats) {
+    memset(stats, 0, sizeof(rtmp_file_source_stats_t));
+    if (!source || !source->start_ms) return;
+
+    stats->tags = __atomic_load_n(&source->tags, __ATOMIC_RELAXED);
+    stats->bytes = __atomic_load_n(&source->bytes, __ATOMIC_RELAXED);
+    stats->loops = __atomic_load_n(&source->loops, __ATOMIC_RELAXED);
+    stats->finished = __atomic_load_n(&source->finished, __ATOMIC_ACQUIRE);
+    uint64_t end = stats->finished ? source->end_ms : rtmp_reactor_clock_ms();
+    stats->elapsed_ms = end - source->start_ms;
+}
+
+// Hand the tags out on their schedule. Each pass is rebased to continue one
+// frame after the previous pass ended, so looping never moves time back.
+static void* rtmp_file_source_thread(void* arg) {
+    rtmp_file_source_t* source = (rtmp_file_source_t*)arg;
+    bool more = true;
+    uint32_t base = 0;
+    uint32_t last = 0;
+    uint32_t step = 0;                  // Last forward step, carried across a loop
+
+    while (more) {
+        size_t position = source->body;
+        bool first = true;
+        uint32_t first_timestamp = 0;
+        rtmp_flv_tag_t tag;
+
+        while (more && rtmp_file_source_next(source, &position, &tag)) {
+            if (first) {
+                first_timestamp = tag.timestamp;
+                first = false;
+            }
+
+            // Audio a little ahead of the first video frame would go negative
+            int32_t relative = (int32_t)(tag.timestamp - first_timestamp);
+            tag.timestamp = base + (relative > 0 ? (uint32_t)relative : 0);
+            if ((int32_t)(tag.timestamp - last) > 0) {
+                step = tag.timestamp - last;
+                last = tag.timestamp;
+            }
+
+            if (source->speed > 0) {
+                more = rtmp_file_source_wait(source, source->start_ms + (uint64_t)(tag.timestamp / source->speed));
+            } else {
+                more = __atomic_load_n(&source->running, __ATOMIC_ACQUIRE);
+            }
+            if (!more) break;
+
+            __atomic_add_fetch(&source->tags, 1, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&source->bytes, tag.length, __ATOMIC_RELAXED);
+            more = source->callback(&tag, source->userdata);
+        }
+
+        // A file without a single tag would spin instead of looping
+        if (!more || first) break;
+        __atomic_add_fetch(&source->loops, 1, __ATOMIC_RELAXED);
+        if (!source->loop) break;
+        base = last + (step ? step : 1);
+    }
+
+    // Only a file that ran out is reported; stop and the callback ended the others
+    if (more) {
+        source->callback(NULL, source->userdata);
+    }
+    source->end_ms = rtmp_reactor_clock_ms();
+    __atomic_store_n(&source->finished, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// rtmp_flv_next_tag takes 32-bit lengths; a window from the current tag on
+// keeps files past 4 GB readable
+static bool rtmp_file_source_next(const rtmp_file_source_t* source, size_t* position, rtmp_flv_tag_t* tag) {
+    if (*position >= source->size) return false;
+
+    size_t remaining = source->size - *position;
+    uint32_t window = remaining > UINT32_MAX ? UINT32_MAX : (uint32_t)remaining;
+    uint32_t offset = 0;
+    if (!rtmp_flv_next_tag(source->map + *position, window, &offset, tag)) return false;
+
+    *position += offset;
+    return true;
+}
+
+// Sleep until due_ms in short slices; false once stopped
+static bool rtmp_file_source_wait(rtmp_file_source_t* source, uint64_t due_ms) {
+    for (;;) {
+        if (!__atomic_load_n(&source->running, __ATOMIC_ACQUIRE)) return false;
+
+        uint64_t now = rtmp_reactor_clock_ms();
+        if (now >= due_ms) return true;
+
+        uint64_t wait = due_ms - now;
+        usleep((useconds_t)(wait < RTMP_FILE_SOURCE_WAIT_SLICE_MS ? wait : RTMP_FILE_SOURCE_WAIT_SLICE_MS) * 1000);
+    }
+}
@@ -0,0 +1,43 @@
+// rtmp_file_source.h
+#ifndef RTMP_FILE_SOURCE_H
+#define RTMP_FILE_SOURCE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "rtmp_flv.h"
+
+// File source configurations
+#define RTMP_FILE_SOURCE_REALTIME 1.0           // Speeds: timestamp-faithful,
+#define RTMP_FILE_SOURCE_UNTHROTTLED 0.0        // or as fast as the tags are taken
+#define RTMP_FILE_SOURCE_WAIT_SLICE_MS 50       // Longest single sleep; bounds how long stop waits
+
+// Tags of a memory-mapped FLV file replayed by a thread of its own, for
+// benchmarks and reproductions without an encoder or a network. Timestamps
+// come out zero-based and keep increasing across loops.
+typedef struct rtmp_file_source rtmp_file_source_t;
+
+// Called on the source thread for every tag, whose data points into the
+// mapping; tag is NULL once the file ends. Return false to stop early.
+typedef bool (*rtmp_file_source_callback_t)(const rtmp_flv_tag_t* tag, void* userdata);
+
+typedef struct {
+    uint64_t tags;
+    uint64_t bytes;                     // Tag payloads handed out
+    uint32_t loops;                     // Completed passes over the file
+    uint64_t elapsed_ms;                // Since start, up to now or the end
+    bool finished;
+} rtmp_file_source_stats_t;
+
+// Map and check the FLV header; NULL when the file is missing or not FLV
+rtmp_file_source_t* rtmp_file_source_open(const char* path);
+void rtmp_file_source_close(rtmp_file_source_t* source);
+
+// speed scales the tags' own pacing: 1 is real time, 4 four times faster,
+// 0 unthrottled. loop restarts at the end instead of finishing.
+bool rtmp_file_source_start(rtmp_file_source_t* source, double speed, bool loop,
+                            rtmp_file_source_callback_t callback, void* userdata);
+void rtmp_file_source_stop(rtmp_file_source_t* source);
+
+void rtmp_file_source_get_stats(rtmp_file_source_t* source, rtmp_file_source_stats_t* stats);
+
+#endif /* RTMP_FILE_SOURCE_H */
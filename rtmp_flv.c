@@ -0,0 +1,396 @@
+// rtmp_flv.c
+#include "rtmp_flv.h"
+#include <string.h>
+
+// MSB-first bit reader; reading past the end sets error and yields zeros
+typedef struct {
+    const uint8_t* data;
+    uint32_t length;
+    uint32_t bit;
+    bool error;
+} rtmp_flv_bits_t;
+
+// Private variables
+static const uint32_t legacy_sample_rates[4] = { 5512, 11025, 22050, 44100 };
+static const uint32_t aac_sample_rates[13] = {
+    96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350
+};
+
+// Forward declarations of internal functions
+static bool rtmp_flv_parse_legacy_video(const uint8_t* data, uint32_t length, rtmp_flv_video_t* video);
+static bool rtmp_flv_parse_enhanced_video(const uint8_t* data, uint32_t length, rtmp_flv_video_t* video);
+static int32_t rtmp_flv_read_si24(const uint8_t* data);
+static uint32_t rtmp_flv_read_u24(const uint8_t* data);
+static bool rtmp_flv_parse_sps(const uint8_t* nal, uint32_t length, rtmp_flv_avc_config_t* config);
+static void rtmp_flv_skip_scaling_list(rtmp_flv_bits_t* bits, uint32_t size);
+static uint32_t rtmp_flv_aac_sample_rate(rtmp_flv_bits_t* bits);
+static uint32_t rtmp_flv_read_bits(rtmp_flv_bits_t* bits, uint32_t count);
+static uint32_t rtmp_flv_read_ue(rtmp_flv_bits_t* bits);
+static int32_t rtmp_flv_read_se(rtmp_flv_bits_t* bits);
+
+bool rtmp_flv_parse_video(const uint8_t* data, uint32_t length, rtmp_flv_video_t* video) {
+    memset(video, 0, sizeof(rtmp_flv_video_t));
+    if (!data || length < 1) return false;
+
+    bool parsed = (data[0] & 0x80) ? rtmp_flv_parse_enhanced_video(data, length, video)
+                                   : rtmp_flv_parse_legacy_video(data, length, video);
+    if (!parsed) return false;
+
+    // Sequence headers carry the keyframe type too, but open no GOP
+    video->keyframe = !video->sequence_header && video->packet_type != RTMP_FLV_PACKET_METADATA &&
+                      (video->frame_type == RTMP_FLV_FRAME_KEY || video->frame_type == RTMP_FLV_FRAME_GENERATED_KEY);
+    return true;
+}
+
+// SoundFormat:4 SoundRate:2 SoundSize:1 SoundType:1, then AACPacketType for AAC
+bool rtmp_flv_parse_audio(const uint8_t* data, uint32_t length, rtmp_flv_audio_t* audio) {
+    memset(audio, 0, sizeof(rtmp_flv_audio_t));
+    if (!data || length < 1) return false;
+
+    audio->format = data[0] >> 4;
+    audio->sample_rate = legacy_sample_rates[(data[0] >> 2) & 0x03];
+    audio->sample_size = (data[0] & 0x02) ? 16 : 8;
+    audio->channels = (data[0] & 0x01) + 1;
+    audio->header_length = 1;
+
+    if (audio->format == RTMP_FLV_SOUND_AAC) {
+        if (length < 2) return false;
+        audio->sequence_header = data[1] == 0;
+        audio->header_length = 2;
+    }
+    return true;
+}
+
+// configurationVersion, profile, compatibility, level, lengthSizeMinusOne, then the SPS list
+bool rtmp_flv_parse_avc_config(const uint8_t* data, uint32_t length, rtmp_flv_avc_config_t* config) {
+    memset(config, 0, sizeof(rtmp_flv_avc_config_t));
+    if (!data || length < 8 || data[0] != 1) return false;
+
+    config->profile = data[1];
+    config->level = data[3];
+    config->nal_length_size = (data[4] & 0x03) + 1;
+
+    uint32_t num_sps = data[5] & 0x1f;
+    uint32_t sps_length = ((uint32_t)data[6] << 8) | data[7];
+    if (num_sps == 0 || sps_length > length - 8) return false;
+
+    return rtmp_flv_parse_sps(data + 8, sps_length, config);
+}
+
+// audioObjectType:5 (escaped), samplingFrequencyIndex:4 (escaped), channelConfiguration:4,
+// then the SBR extension rate when signalled explicitly
+bool rtmp_flv_parse_aac_config(const uint8_t* data, uint32_t length, rtmp_flv_aac_config_t* config) {
+    memset(config, 0, sizeof(rtmp_flv_aac_config_t));
+    if (!data || length < 2) return false;
+
+    rtmp_flv_bits_t bits = { data, length, 0, false };
+    uint32_t object_type = rtmp_flv_read_bits(&bits, 5);
+    if (object_type == 31) {
+        object_type = 32 + rtmp_flv_read_bits(&bits, 6);
+    }
+    config->object_type = (uint8_t)object_type;
+    config->sample_rate = rtmp_flv_aac_sample_rate(&bits);
+
+    uint32_t channel_config = rtmp_flv_read_bits(&bits, 4);
+    config->channels = channel_config == 7 ? 8 : (uint8_t)channel_config;
+
+    // Explicit SBR or PS signalling: the output rate follows
+    if (object_type == 5 || object_type == 29) {
+        config->sample_rate = rtmp_flv_aac_sample_rate(&bits);
+    }
+    return !bits.error && config->sample_rate > 0 && channel_config <= 7;
+}
+
+// TagType:8 DataSize:24 Timestamp:24 TimestampExtended:8 StreamID:24, data, PreviousTagSize:32.
+// A missing back pointer after the last tag is tolerated.
+bool rtmp_flv_next_tag(const uint8_t* data, uint32_t length, uint32_t* offset, rtmp_flv_tag_t* tag) {
+    if (*offset > length || length - *offset < RTMP_FLV_TAG_HEADER_SIZE) return false;
+
+    const uint8_t* h = data + *offset;
+    uint32_t size = rtmp_flv_read_u24(h + 1);
+    if (size > length - *offset - RTMP_FLV_TAG_HEADER_SIZE) return false;
+
+    tag->type = h[0] & 0x1f;
+    tag->timestamp = rtmp_flv_read_u24(h + 4) | ((uint32_t)h[7] << 24);
+    tag->data = h + RTMP_FLV_TAG_HEADER_SIZE;
+    tag->length = size;
+
+    uint32_t end = *offset + RTMP_FLV_TAG_HEADER_SIZE + size;
+    *offset = length - end < RTMP_FLV_TAG_TRAILER_SIZE ? length : end + RTMP_FLV_TAG_TRAILER_SIZE;
+    return true;
+}
+
+void rtmp_flv_write_tag_header(uint8_t* out, uint8_t type, uint32_t length, uint32_t timestamp) {
+    out[0] = type;
+    out[1] = (length >> 16) & 0xff;
+    out[2] = (length >> 8) & 0xff;
+    out[3] = length & 0xff;
+    out[4] = (timestamp >> 16) & 0xff;
+    out[5] = (timestamp >> 8) & 0xff;
+    out[6] = timestamp & 0xff;
+    out[7] = (timestamp >> 24) & 0xff;
+    out[8] = 0;
+    out[9] = 0;
+    out[10] = 0;
+}
+
+void rtmp_flv_write_tag_trailer(uint8_t* out, uint32_t length) {
+    uint32_t size = RTMP_FLV_TAG_HEADER_SIZE + length;
+    out[0] = (size >> 24) & 0xff;
+    out[1] = (size >> 16) & 0xff;
+    out[2] = (size >> 8) & 0xff;
+    out[3] = size & 0xff;
+}
+
+// FrameType:4 CodecID:4, then AVCPacketType and composition time for AVC and HEVC
+static bool rtmp_flv_parse_legacy_video(const uint8_t* data, uint32_t length, rtmp_flv_video_t* video) {
+    video->frame_type = data[0] >> 4;
+    video->codec = data[0] & 0x0f;
+    video->packet_type = RTMP_FLV_PACKET_CODED_FRAMES;
+    video->header_length = 1;
+
+    if (video->frame_type == RTMP_FLV_FRAME_COMMAND) return true;
+    if (video->codec != RTMP_FLV_CODEC_AVC && video->codec != RTMP_FLV_CODEC_HEVC) return true;
+    if (length < 5) return false;
+
+    switch (data[1]) {
+        case RTMP_FLV_PACKET_SEQUENCE_START:
+            video->sequence_header = true;
+            break;
+        case RTMP_FLV_PACKET_CODED_FRAMES:
+            video->composition_time = rtmp_flv_read_si24(data + 2);
+            break;
+        case RTMP_FLV_PACKET_SEQUENCE_END:
+            video->end_of_sequence = true;
+            break;
+        default:
+            return false;
+    }
+    video->packet_type = data[1];
+    video->header_length = 5;
+    return true;
+}
+
+// IsExHeader:1 FrameType:3 PacketType:4 FourCC:32, then the packet type's own fields
+static bool rtmp_flv_parse_enhanced_video(const uint8_t* data, uint32_t length, rtmp_flv_video_t* video) {
+    if (length < 5) return false;
+
+    video->enhanced = true;
+    video->frame_type = (data[0] >> 4) & 0x07;
+    video->packet_type = data[0] & 0x0f;
+    video->codec = RTMP_FLV_FOURCC(data[1], data[2], data[3], data[4]);
+    video->header_length = 5;
+
+    if (video->frame_type == RTMP_FLV_FRAME_COMMAND && video->packet_type != RTMP_FLV_PACKET_METADATA) {
+        video->header_length = 6;
+        return length >= 6;
+    }
+
+    switch (video->packet_type) {
+        case RTMP_FLV_PACKET_SEQUENCE_START:
+        case RTMP_FLV_PACKET_MPEG2TS_SEQUENCE_START:
+            video->sequence_header = true;
+            break;
+        case RTMP_FLV_PACKET_CODED_FRAMES:
+            // Only codecs with B-frames signal a composition time here
+            if (video->codec == RTMP_FLV_FOURCC_AVC || video->codec == RTMP_FLV_FOURCC_HEVC) {
+                if (length < 8) return false;
+                video->composition_time = rtmp_flv_read_si24(data + 5);
+                video->header_length = 8;
+            }
+            break;
+        case RTMP_FLV_PACKET_SEQUENCE_END:
+            video->end_of_sequence = true;
+            break;
+        case RTMP_FLV_PACKET_CODED_FRAMES_X:
+        case RTMP_FLV_PACKET_METADATA:
+            break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+static int32_t rtmp_flv_read_si24(const uint8_t* data) {
+    uint32_t value = rtmp_flv_read_u24(data);
+    if (value & 0x800000) value |= 0xff000000;
+    return (int32_t)value;
+}
+
+static uint32_t rtmp_flv_read_u24(const uint8_t* data) {
+    return ((uint32_t)data[0] << 16) | ((uint32_t)data[1] << 8) | data[2];
+}
+
+// Width, height and frame rate out of a sequence parameter set NAL unit
+static bool rtmp_flv_parse_sps(const uint8_t* nal, uint32_t length, rtmp_flv_avc_config_t* config) {
+    if (length < 4 || (nal[0] & 0x1f) != 7) return false;
+
+    // Strip emulation prevention bytes after the NAL header
+    uint8_t rbsp[RTMP_FLV_SPS_MAX];
+    uint32_t size = 0;
+    uint32_t zeros = 0;
+    for (uint32_t i = 1; i < length && size < RTMP_FLV_SPS_MAX; i++) {
+        if (zeros >= 2 && nal[i] == 3) {
+            zeros = 0;
+            continue;
+        }
+        rbsp[size++] = nal[i];
+        zeros = nal[i] ? 0 : zeros + 1;
+    }
+
+    rtmp_flv_bits_t bits = { rbsp, size, 0, false };
+    uint32_t profile = rtmp_flv_read_bits(&bits, 8);
+    rtmp_flv_read_bits(&bits, 8);
+    config->profile = (uint8_t)profile;
+    config->level = (uint8_t)rtmp_flv_read_bits(&bits, 8);
+    rtmp_flv_read_ue(&bits);
+
+    uint32_t chroma_format = 1;
+    bool separate_planes = false;
+    if (profile == 100 || profile == 110 || profile == 122 || profile == 244 || profile == 44 ||
+        profile == 83 || profile == 86 || profile == 118 || profile == 128 || profile == 138 ||
+        profile == 139 || profile == 134 || profile == 135) {
+        chroma_format = rtmp_flv_read_ue(&bits);
+        if (chroma_format == 3) {
+            separate_planes = rtmp_flv_read_bits(&bits, 1);
+        }
+        rtmp_flv_read_ue(&bits);
+        rtmp_flv_read_ue(&bits);
+        rtmp_flv_read_bits(&bits, 1);
+        if (rtmp_flv_read_bits(&bits, 1)) {
+            uint32_t lists = chroma_format == 3 ? 12 : 8;
+            for (uint32_t i = 0; i < lists && !bits.error; i++) {
+                if (rtmp_flv_read_bits(&bits, 1)) {
+                    rtmp_flv_skip_scaling_list(&bits, i < 6 ? 16 : 64);
+                }
+            }
+        }
+    }
+
+    rtmp_flv_read_ue(&bits);
+    uint32_t poc_type = rtmp_flv_read_ue(&bits);
+    if (poc_type == 0) {
+        rtmp_flv_read_ue(&bits);
+    } else if (poc_type == 1) {
+        rtmp_flv_read_bits(&bits, 1);
+        rtmp_flv_read_se(&bits);
+        rtmp_flv_read_se(&bits);
+        uint32_t cycle = rtmp_flv_read_ue(&bits);
+        for (uint32_t i = 0; i < cycle && !bits.error; i++) {
+            rtmp_flv_read_se(&bits);
+        }
+    }
+
+    rtmp_flv_read_ue(&bits);
+    rtmp_flv_read_bits(&bits, 1);
+    uint32_t width_mbs = rtmp_flv_read_ue(&bits) + 1;
+    uint32_t height_units = rtmp_flv_read_ue(&bits) + 1;
+    uint32_t frame_mbs_only = rtmp_flv_read_bits(&bits, 1);
+    if (!frame_mbs_only) {
+        rtmp_flv_read_bits(&bits, 1);
+    }
+    rtmp_flv_read_bits(&bits, 1);
+
+    uint32_t crop_left = 0, crop_right = 0, crop_top = 0, crop_bottom = 0;
+    if (rtmp_flv_read_bits(&bits, 1)) {
+        crop_left = rtmp_flv_read_ue(&bits);
+        crop_right = rtmp_flv_read_ue(&bits);
+        crop_top = rtmp_flv_read_ue(&bits);
+        crop_bottom = rtmp_flv_read_ue(&bits);
+    }
+    if (bits.error) return false;
+
+    // Crop offsets count in chroma samples
+    uint32_t crop_x = 1;
+    uint32_t crop_y = 2 - frame_mbs_only;
+    if (chroma_format != 0 && !separate_planes) {
+        crop_x = chroma_format == 3 ? 1 : 2;
+        crop_y *= chroma_format == 1 ? 2 : 1;
+    }
+    uint64_t width = (uint64_t)width_mbs * 16;
+    uint64_t height = (uint64_t)(2 - frame_mbs_only) * height_units * 16;
+    uint64_t crop_width = (uint64_t)crop_x * ((uint64_t)crop_left + crop_right);
+    uint64_t crop_height = (uint64_t)crop_y * ((uint64_t)crop_top + crop_bottom);
+    if (crop_width >= width || crop_height >= height || width > 0xffff || height > 0xffff) return false;
+    config->width = (uint32_t)(width - crop_width);
+    config->height = (uint32_t)(height - crop_height);
+
+    // VUI up to the timing info; anything truncated after the size is not fatal
+    if (rtmp_flv_read_bits(&bits, 1)) {
+        if (rtmp_flv_read_bits(&bits, 1) && rtmp_flv_read_bits(&bits, 8) == 255) {
+            rtmp_flv_read_bits(&bits, 32);
+        }
+        if (rtmp_flv_read_bits(&bits, 1)) {
+            rtmp_flv_read_bits(&bits, 1);
+        }
+        if (rtmp_flv_read_bits(&bits, 1)) {
+            rtmp_flv_read_bits(&bits, 4);
+            if (rtmp_flv_read_bits(&bits, 1)) {
+                rtmp_flv_read_bits(&bits, 24);
+            }
+        }
+        if (rtmp_flv_read_bits(&bits, 1)) {
+            rtmp_flv_read_ue(&bits);
+            rtmp_flv_read_ue(&bits);
+        }
+        if (rtmp_flv_read_bits(&bits, 1)) {
+            uint32_t units = rtmp_flv_read_bits(&bits, 32);
+            uint32_t time_scale = rtmp_flv_read_bits(&bits, 32);
+            // Two ticks per frame; rounded to whole frames per second
+            if (!bits.error && units) {
+                config->frame_rate = (uint32_t)(((uint64_t)time_scale + units) / (2 * (uint64_t)units));
+            }
+        }
+    }
+    return true;
+}
+
+static void rtmp_flv_skip_scaling_list(rtmp_flv_bits_t* bits, uint32_t size) {
+    int32_t last = 8;
+    int32_t next = 8;
+    for (uint32_t i = 0; i < size && !bits->error; i++) {
+        if (next != 0) {
+            next = (last + rtmp_flv_read_se(bits) + 256) % 256;
+        }
+        last = next == 0 ? last : next;
+    }
+}
+
+// Index into the standard table, or an explicit 24-bit rate
+static uint32_t rtmp_flv_aac_sample_rate(rtmp_flv_bits_t* bits) {
+    uint32_t index = rtmp_flv_read_bits(bits, 4);
+    if (index == 15) {
+        return rtmp_flv_read_bits(bits, 24);
+    }
+    return index < 13 ? aac_sample_rates[index] : 0;
+}
+
+static uint32_t rtmp_flv_read_bits(rtmp_flv_bits_t* bits, uint32_t count) {
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (bits->bit >= bits->length * 8) {
+            bits->error = true;
+            return 0;
+        }
+        value = (value << 1) | ((bits->data[bits->bit >> 3] >> (7 - (bits->bit & 7))) & 1);
+        bits->bit++;
+    }
+    return value;
+}
+
+// Exp-Golomb codes
+static uint32_t rtmp_flv_read_ue(rtmp_flv_bits_t* bits) {
+    uint32_t zeros = 0;
+    while (!rtmp_flv_read_bits(bits, 1)) {
+        if (bits->error || ++zeros > 31) {
+            bits->error = true;
+            return 0;
+        }
+    }
+    return ((1u << zeros) - 1) + rtmp_flv_read_bits(bits, zeros);
+}
+
+static int32_t rtmp_flv_read_se(rtmp_flv_bits_t* bits) {
+    uint32_t code = rtmp_flv_read_ue(bits);
+    return (code & 1) ? (int32_t)((code + 1) / 2) : -(int32_t)(code / 2);
+}
@@ -0,0 +1,116 @@
+// rtmp_flv.h
+#ifndef RTMP_FLV_H
+#define RTMP_FLV_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Legacy FLV video codec ids
+#define RTMP_FLV_CODEC_AVC 7
+#define RTMP_FLV_CODEC_HEVC 12                 // Pre-standard extension some encoders still send
+
+// Enhanced RTMP FourCCs, stored big-endian as they appear on the wire
+#define RTMP_FLV_FOURCC(a, b, c, d) \
+    (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+#define RTMP_FLV_FOURCC_AVC RTMP_FLV_FOURCC('a', 'v', 'c', '1')
+#define RTMP_FLV_FOURCC_HEVC RTMP_FLV_FOURCC('h', 'v', 'c', '1')
+#define RTMP_FLV_FOURCC_AV1 RTMP_FLV_FOURCC('a', 'v', '0', '1')
+#define RTMP_FLV_FOURCC_VP9 RTMP_FLV_FOURCC('v', 'p', '0', '9')
+
+// Legacy FLV sound formats
+#define RTMP_FLV_SOUND_AAC 10
+
+// Sequence header parsing limits
+#define RTMP_FLV_SPS_MAX 512                   // Unescaped SPS bytes examined
+
+// FLV tag framing, shared by files and aggregate messages
+#define RTMP_FLV_TAG_HEADER_SIZE 11
+#define RTMP_FLV_TAG_TRAILER_SIZE 4            // PreviousTagSize back pointer
+
+// Video frame types
+typedef enum {
+    RTMP_FLV_FRAME_KEY = 1,
+    RTMP_FLV_FRAME_INTER,
+    RTMP_FLV_FRAME_DISPOSABLE,
+    RTMP_FLV_FRAME_GENERATED_KEY,
+    RTMP_FLV_FRAME_COMMAND                     // No coded picture follows
+} rtmp_flv_frame_type_t;
+
+// Video packet types; the legacy AVC packet types share the first three
+typedef enum {
+    RTMP_FLV_PACKET_SEQUENCE_START = 0,
+    RTMP_FLV_PACKET_CODED_FRAMES,
+    RTMP_FLV_PACKET_SEQUENCE_END,
+    RTMP_FLV_PACKET_CODED_FRAMES_X,            // Composition time implied zero
+    RTMP_FLV_PACKET_METADATA,
+    RTMP_FLV_PACKET_MPEG2TS_SEQUENCE_START
+} rtmp_flv_packet_type_t;
+
+// What the video tag header says about the frame behind it
+typedef struct {
+    bool enhanced;                             // ExVideoTagHeader with a FourCC
+    uint32_t codec;                            // Legacy codec id, or FourCC when enhanced
+    uint8_t frame_type;
+    uint8_t packet_type;
+    bool keyframe;
+    bool sequence_header;                      // Decoder configuration later frames depend on
+    bool end_of_sequence;
+    int32_t composition_time;
+    uint32_t header_length;                    // Bytes before the codec payload
+} rtmp_flv_video_t;
+
+// What the audio tag header says; AAC refines rate and channels in its config
+typedef struct {
+    uint8_t format;
+    uint32_t sample_rate;                      // Hz
+    uint8_t sample_size;                       // Bits
+    uint8_t channels;
+    bool sequence_header;
+    uint32_t header_length;                    // Bytes before the codec payload
+} rtmp_flv_audio_t;
+
+// Stream parameters from an AVCDecoderConfigurationRecord and its first SPS
+typedef struct {
+    uint8_t profile;
+    uint8_t level;
+    uint8_t nal_length_size;
+    uint32_t width;                            // Cropped, in pixels
+    uint32_t height;
+    uint32_t frame_rate;                       // From VUI timing; 0 when absent
+} rtmp_flv_avc_config_t;
+
+// Stream parameters from an AAC AudioSpecificConfig
+typedef struct {
+    uint8_t object_type;
+    uint32_t sample_rate;                      // Output rate, after SBR
+    uint8_t channels;                          // 0 when the config leaves it to the PCE
+} rtmp_flv_aac_config_t;
+
+// One tag; data points into the buffer it was read from
+typedef struct {
+    uint8_t type;                              // RTMP message type
+    uint32_t timestamp;
+    const uint8_t* data;
+    uint32_t length;
+} rtmp_flv_tag_t;
+
+// Parse the tag header at the start of a video message, legacy or enhanced.
+// False when it is truncated or uses a packet type we do not understand.
+bool rtmp_flv_parse_video(const uint8_t* data, uint32_t length, rtmp_flv_video_t* video);
+
+// Parse the tag header at the start of an audio message
+bool rtmp_flv_parse_audio(const uint8_t* data, uint32_t length, rtmp_flv_audio_t* audio);
+
+// Parse a sequence header payload, past the tag header
+bool rtmp_flv_parse_avc_config(const uint8_t* data, uint32_t length, rtmp_flv_avc_config_t* config);
+bool rtmp_flv_parse_aac_config(const uint8_t* data, uint32_t length, rtmp_flv_aac_config_t* config);
+
+// Walk tags packed back to back from *offset, advancing it past each one.
+// False at the end or at the first truncated tag.
+bool rtmp_flv_next_tag(const uint8_t* data, uint32_t length, uint32_t* offset, rtmp_flv_tag_t* tag);
+
+// Frame length bytes of tag data: the header goes before it, the trailer after
+void rtmp_flv_write_tag_header(uint8_t* out, uint8_t type, uint32_t length, uint32_t timestamp);
+void rtmp_flv_write_tag_trailer(uint8_t* out, uint32_t length);
+
+#endif /* RTMP_FLV_H */
@@ -0,0 +1,95 @@
+// rtmp_frame_ring.c
+#include "rtmp_frame_ring.h"
+#include <stdlib.h>
+
+#define RTMP_FRAME_RING_CACHE_LINE 64
+
+// Producer and consumer indices sit on their own cache lines so the two
+// threads only share the slots they hand over
+struct rtmp_frame_ring {
+    uint32_t mask;
+    rtmp_frame_t* slots;
+    uint32_t head __attribute__((aligned(RTMP_FRAME_RING_CACHE_LINE)));    // Next slot to pop, consumer owned
+    uint32_t tail __attribute__((aligned(RTMP_FRAME_RING_CACHE_LINE)));    // Next slot to fill, producer owned
+    uint64_t overflows;
+};
+
+rtmp_frame_ring_t* rtmp_frame_ring_create(uint32_t capacity) {
+    uint32_t size = RTMP_FRAME_RING_MIN_CAPACITY;
+    while (size < capacity && size < (1u << 31)) {
+        size <<= 1;
+    }
+
+    rtmp_frame_ring_t* ring = NULL;
+    if (posix_memalign((void**)&ring, RTMP_FRAME_RING_CACHE_LINE, sizeof(rtmp_frame_ring_t)) != 0) {
+        return NULL;
+    }
+
+    ring->slots = calloc(size, sizeof(rtmp_frame_t));
+    if (!ring->slots) {
+        free(ring);
+        return NULL;
+    }
+    ring->mask = size - 1;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->overflows = 0;
+    return ring;
+}
+
+// Destroy once both sides have stopped; queued frames are released
+void rtmp_frame_ring_destroy(rtmp_frame_ring_t* ring) {
+    if (!ring) return;
+
+    rtmp_frame_t frame;
+    while (rtmp_frame_ring_pop(ring, &frame)) {
+        rtmp_msgbuf_release(frame.msg);
+    }
+    free(ring->slots);
+    free(ring);
+}
+
+bool rtmp_frame_ring_push(rtmp_frame_ring_t* ring, const rtmp_frame_t* frame) {
+    uint32_t tail = ring->tail;
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+    if (tail - head > ring->mask) {
+        __atomic_store_n(&ring->overflows, ring->overflows + 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    rtmp_frame_t* slot = &ring->slots[tail & ring->mask];
+    *slot = *frame;
+    rtmp_msgbuf_retain(slot->msg);
+
+    // Publish the slot before the new tail becomes visible
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_SEQ_CST);
+    return true;
+}
+
+bool rtmp_frame_ring_pop(rtmp_frame_ring_t* ring, rtmp_frame_t* frame) {
+    uint32_t head = ring->head;
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    if (head == tail) {
+        return false;
+    }
+
+    *frame = ring->slots[head & ring->mask];
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+uint32_t rtmp_frame_ring_occupancy(rtmp_frame_ring_t* ring) {
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    return tail - head;
+}
+
+uint32_t rtmp_frame_ring_capacity(rtmp_frame_ring_t* ring) {
+    return ring->mask + 1;
+}
+
+uint64_t rtmp_frame_ring_overflows(rtmp_frame_ring_t* ring) {
+    return __atomic_load_n(&ring->overflows, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,39 @@
+// rtmp_frame_ring.h
+#ifndef RTMP_FRAME_RING_H
+#define RTMP_FRAME_RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "rtmp_relay.h"
+
+// Frame ring configurations
+#define RTMP_FRAME_RING_MIN_CAPACITY 16
+
+// One completed frame; the ring owns a reference to msg while it is queued
+typedef struct {
+    rtmp_msgbuf_t* msg;
+    bool is_keyframe;
+    uint32_t source;                // Publisher it came from, nonzero
+    uint64_t arrival_ms;            // Monotonic receive time
+} rtmp_frame_t;
+
+// Lock-free single-producer/single-consumer ring of frames. Exactly one
+// thread pushes and exactly one thread pops; a full ring drops the new frame.
+typedef struct rtmp_frame_ring rtmp_frame_ring_t;
+
+// Ring lifecycle; capacity is rounded up to a power of two
+rtmp_frame_ring_t* rtmp_frame_ring_create(uint32_t capacity);
+void rtmp_frame_ring_destroy(rtmp_frame_ring_t* ring);
+
+// Producer side: retains frame->msg on success, counts an overflow otherwise
+bool rtmp_frame_ring_push(rtmp_frame_ring_t* ring, const rtmp_frame_t* frame);
+
+// Consumer side: the caller takes over the reference in frame->msg
+bool rtmp_frame_ring_pop(rtmp_frame_ring_t* ring, rtmp_frame_t* frame);
+
+// Counters, safe to read from any thread
+uint32_t rtmp_frame_ring_occupancy(rtmp_frame_ring_t* ring);
+uint32_t rtmp_frame_ring_capacity(rtmp_frame_ring_t* ring);
+uint64_t rtmp_frame_ring_overflows(rtmp_frame_ring_t* ring);
+
+#endif /* RTMP_FRAME_RING_H */
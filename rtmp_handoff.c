@@ -0,0 +1,228 @@
+// rtmp_handoff.c
+#include "rtmp_handoff.h"
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// A successor that dies mid-transfer must not raise SIGPIPE
+#ifdef MSG_NOSIGNAL
+#define RTMP_HANDOFF_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define RTMP_HANDOFF_SEND_FLAGS 0
+#endif
+
+// Ancillary buffer for one descriptor, aligned for cmsghdr
+typedef union {
+    struct cmsghdr header;
+    uint8_t space[CMSG_SPACE(sizeof(int))];
+} rtmp_handoff_control_t;
+
+// Forward declarations of internal functions
+static bool rtmp_handoff_address(const char* path, struct sockaddr_un* addr);
+static void rtmp_handoff_configure(int channel);
+static bool rtmp_handoff_read_all(int channel, uint8_t* data, size_t length, size_t offset);
+static bool rtmp_handoff_write_all(int channel, const uint8_t* data, size_t length, size_t offset);
+
+int rtmp_handoff_offer(const char* path, uint32_t timeout_ms) {
+    struct sockaddr_un addr;
+    if (!rtmp_handoff_address(path, &addr)) return -1;
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+
+    unlink(addr.sun_path);
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(sock, 1) < 0) {
+        close(sock);
+        unlink(addr.sun_path);
+        return -1;
+    }
+
+    struct pollfd pfd;
+    pfd.fd = sock;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    int ready;
+    do {
+        ready = poll(&pfd, 1, (int)timeout_ms);
+    } while (ready < 0 && errno == EINTR);
+
+    // Only one successor is served; the path goes away with the listener
+    int channel = ready > 0 ? accept(sock, NULL, NULL) : -1;
+    close(sock);
+    unlink(addr.sun_path);
+
+    if (channel >= 0) {
+        rtmp_handoff_configure(channel);
+    }
+    return channel;
+}
+
+int rtmp_handoff_connect(const char* path) {
+    struct sockaddr_un addr;
+    if (!rtmp_handoff_address(path, &addr)) return -1;
+
+    int channel = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (channel < 0) return -1;
+
+    if (connect(channel, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(channel);
+        return -1;
+    }
+
+    rtmp_handoff_configure(channel);
+    return channel;
+}
+
+// The descriptor rides on the first byte; the rest of the record and the payload follow as plain data
+bool rtmp_handoff_send(int channel, const rtmp_handoff_record_t* record, int fd, const uint8_t* payload) {
+    const uint8_t* data = (const uint8_t*)record;
+    rtmp_handoff_control_t control;
+
+    struct iovec iov;
+    iov.iov_base = (void*)data;
+    iov.iov_len = sizeof(rtmp_handoff_record_t);
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    if (fd >= 0) {
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.space;
+        msg.msg_controllen = sizeof(control.space);
+
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+
+    ssize_t bytes;
+    do {
+        bytes = sendmsg(channel, &msg, RTMP_HANDOFF_SEND_FLAGS);
+    } while (bytes < 0 && errno == EINTR);
+    if (bytes <= 0) return false;
+
+    return rtmp_handoff_write_all(channel, data, sizeof(rtmp_handoff_record_t), (size_t)bytes) &&
+           rtmp_handoff_write_all(channel, payload, record->payload_length, 0);
+}
+
+bool rtmp_handoff_recv(int channel, rtmp_handoff_record_t* record, int* fd, uint8_t** payload) {
+    uint8_t* data = (uint8_t*)record;
+    rtmp_handoff_control_t control;
+    *fd = -1;
+    *payload = NULL;
+
+    struct iovec iov;
+    iov.iov_base = data;
+    iov.iov_len = sizeof(rtmp_handoff_record_t);
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    memset(&control, 0, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.space;
+    msg.msg_controllen = sizeof(control.space);
+
+    ssize_t bytes;
+    do {
+        bytes = recvmsg(channel, &msg, 0);
+    } while (bytes < 0 && errno == EINTR);
+    if (bytes <= 0) return false;
+
+    // Take ownership of whatever arrived before anything can fail, so nothing leaks
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+
+        size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < count; i++) {
+            int received;
+            memcpy(&received, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            if (*fd < 0) {
+                *fd = received;
+            } else {
+                close(received);
+            }
+        }
+    }
+
+    bool ok = !(msg.msg_flags & MSG_CTRUNC) && rtmp_handoff_read_all(channel, data, sizeof(rtmp_handoff_record_t),
+                                                                   (size_t)bytes) &&
+              record->magic == RTMP_HANDOFF_MAGIC && record->version == RTMP_HANDOFF_VERSION &&
+              record->kind <= RTMP_HANDOFF_END && record->payload_length <= RTMP_HANDOFF_MAX_PAYLOAD;
+
+    // Only listeners and connections carry a descriptor
+    bool wants_fd = ok && (record->kind == RTMP_HANDOFF_LISTENER || record->kind == RTMP_HANDOFF_CONNECTION);
+    ok = ok && (wants_fd == (*fd >= 0));
+
+    if (ok && record->payload_length > 0) {
+        *payload = malloc(record->payload_length);
+        ok = *payload && rtmp_handoff_read_all(channel, *payload, record->payload_length, 0);
+    }
+
+    if (!ok) {
+        if (*fd >= 0) {
+            close(*fd);
+            *fd = -1;
+        }
+        free(*payload);
+        *payload = NULL;
+        return false;
+    }
+
+    record->app_name[RTMP_HANDOFF_NAME_SIZE - 1] = '\0';
+    record->stream_name[RTMP_HANDOFF_NAME_SIZE - 1] = '\0';
+    return true;
+}
+
+static bool rtmp_handoff_address(const char* path, struct sockaddr_un* addr) {
+    if (!path || strlen(path) >= sizeof(addr->sun_path)) return false;
+
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+    strcpy(addr->sun_path, path);
+    return true;
+}
+
+// Bound every record so a wedged peer cannot stall the restart
+static void rtmp_handoff_configure(int channel) {
+    struct timeval timeout;
+    timeout.tv_sec = RTMP_HANDOFF_IO_TIMEOUT_MS / 1000;
+    timeout.tv_usec = (RTMP_HANDOFF_IO_TIMEOUT_MS % 1000) * 1000;
+    setsockopt(channel, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(channel, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#ifdef SO_NOSIGPIPE
+    int nosigpipe = 1;
+    setsockopt(channel, SOL_SOCKET, SO_NOSIGPIPE, &nosigpipe, sizeof(nosigpipe));
+#endif
+}
+
+// Read bytes offset..length; the first offset already came with the descriptor
+static bool rtmp_handoff_read_all(int channel, uint8_t* data, size_t length, size_t offset) {
+    while (offset < length) {
+        ssize_t bytes = recv(channel, data + offset, length - offset, 0);
+        if (bytes < 0 && errno == EINTR) continue;
+        if (bytes <= 0) return false;
+        offset += (size_t)bytes;
+    }
+    return true;
+}
+
+static bool rtmp_handoff_write_all(int channel, const uint8_t* data, size_t length, size_t offset) {
+    while (offset < length) {
+        ssize_t bytes = send(channel, data + offset, length - offset, RTMP_HANDOFF_SEND_FLAGS);
+        if (bytes < 0 && errno == EINTR) continue;
+        if (bytes <= 0) return false;
+        offset += (size_t)bytes;
+    }
+    return true;
+}
@@ -0,0 +1,55 @@
+// rtmp_handoff.h
+#ifndef RTMP_HANDOFF_H
+#define RTMP_HANDOFF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Handoff configurations
+#define RTMP_HANDOFF_MAGIC 0x52484f46          // "RHOF"
+#define RTMP_HANDOFF_VERSION 2                  // Bump whenever the record layout changes
+#define RTMP_HANDOFF_NAME_SIZE 128
+#define RTMP_HANDOFF_IO_TIMEOUT_MS 2000         // Per record once the successor is connected
+#define RTMP_HANDOFF_MAX_PAYLOAD (1024 * 1024)  // Largest message or parser state carried by a record
+
+// Record kinds
+typedef enum {
+    RTMP_HANDOFF_LISTENER = 0,
+    RTMP_HANDOFF_CONNECTION,
+    RTMP_HANDOFF_HEADER,                        // Cached start-up message of the connection before it
+    RTMP_HANDOFF_PARSER,                        // Inbound chunk parser state of the connection before it
+    RTMP_HANDOFF_END                            // Carries no descriptor
+} rtmp_handoff_kind_t;
+
+// One descriptor and what the successor needs to resume it, or one message
+// payload_length bytes long. Both sides run the same build, so the record goes
+// over the wire as is.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t kind;
+    uint32_t state;                             // rtmp_connection_state_t
+    uint32_t is_publisher;
+    uint32_t peer_addr;                         // IPv4, network order
+    uint32_t chunk_size;                        // Outgoing chunk size the peer last saw
+    char app_name[RTMP_HANDOFF_NAME_SIZE];
+    char stream_name[RTMP_HANDOFF_NAME_SIZE];
+    uint32_t msg_type;                          // Header records only
+    uint32_t timestamp;
+    uint32_t payload_length;
+} rtmp_handoff_record_t;
+
+// Outgoing process: bind the Unix socket at path and wait for the successor.
+// Returns the channel, or -1 on error or once timeout_ms passes.
+int rtmp_handoff_offer(const char* path, uint32_t timeout_ms);
+
+// Incoming process: connect to the predecessor's socket
+int rtmp_handoff_connect(const char* path);
+
+// One record per call; fd travels as SCM_RIGHTS and is -1 for header and end
+// records. What is received belongs to the caller: close the descriptor and free
+// the payload, which is NULL when there is none. A failed receive leaves neither.
+bool rtmp_handoff_send(int channel, const rtmp_handoff_record_t* record, int fd, const uint8_t* payload);
+bool rtmp_handoff_recv(int channel, rtmp_handoff_record_t* record, int* fd, uint8_t** payload);
+
+#endif /* RTMP_HANDOFF_H */
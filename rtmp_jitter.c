@@ -0,0 +1,183 @@
+// rtmp_jitter.c
+#include "rtmp_jitter.h"
+#include <stdlib.h>
+
+typedef struct {
+    rtmp_msgbuf_t* msg;
+    bool is_keyframe;
+    int64_t timestamp;                  // Normalized
+    uint64_t due_ms;
+} rtmp_jitter_slot_t;
+
+struct rtmp_jitter {
+    rtmp_jitter_slot_t slots[RTMP_JITTER_CAPACITY];
+    uint32_t head;
+    uint32_t count;
+    uint32_t min_delay_ms;
+    uint32_t max_delay_ms;
+    uint32_t delay_ms;                  // Slews toward the target one step per frame
+
+    // Timestamp normalization
+    bool started;
+    uint32_t last_raw;
+    int64_t last_timestamp;
+    int64_t last_step;                  // Last ordinary step, reused across a discontinuity
+
+    // Clock mapping: arrival minus timestamp of the fastest recent frame
+    uint64_t last_arrival;
+    int64_t offset;
+    int64_t window_min;
+    uint64_t window_start;
+    uint32_t jitter_q4;                 // RFC 3550 interarrival jitter, in 1/16 ms
+};
+
+// Forward declarations of internal functions
+static int64_t rtmp_jitter_normalize(rtmp_jitter_t* jitter, uint32_t raw, uint64_t now_ms);
+static void rtmp_jitter_track_transit(rtmp_jitter_t* jitter, int64_t timestamp, uint64_t now_ms);
+static void rtmp_jitter_adapt(rtmp_jitter_t* jitter);
+
+rtmp_jitter_t* rtmp_jitter_create(uint32_t min_delay_ms, uint32_t max_delay_ms) {
+    rtmp_jitter_t* jitter = calloc(1, sizeof(rtmp_jitter_t));
+    if (!jitter) return NULL;
+
+    jitter->min_delay_ms = min_delay_ms < max_delay_ms ? min_delay_ms : max_delay_ms;
+    jitter->max_delay_ms = max_delay_ms;
+    jitter->delay_ms = jitter->min_delay_ms;
+    return jitter;
+}
+
+void rtmp_jitter_destroy(rtmp_jitter_t* jitter) {
+    if (!jitter) return;
+
+    while (jitter->count) {
+        rtmp_msgbuf_release(jitter->slots[jitter->head].msg);
+        jitter->head = (jitter->head + 1) % RTMP_JITTER_CAPACITY;
+        jitter->count--;
+    }
+    free(jitter);
+}
+
+bool rtmp_jitter_push(rtmp_jitter_t* jitter, rtmp_msgbuf_t* msg, bool is_keyframe, uint32_t timestamp,
+                      uint64_t now_ms) {
+    if (jitter->count == RTMP_JITTER_CAPACITY) return false;
+
+    int64_t normalized = rtmp_jitter_normalize(jitter, timestamp, now_ms);
+    rtmp_jitter_slot_t* slot = &jitter->slots[(jitter->head + jitter->count) % RTMP_JITTER_CAPACITY];
+    slot->msg = rtmp_msgbuf_retain(msg);
+    slot->is_keyframe = is_keyframe;
+    slot->timestamp = normalized;
+
+    // Due when the fastest path would have brought it, plus the playout delay;
+    // never before it arrived
+    int64_t due = normalized + jitter->offset + jitter->delay_ms;
+    slot->due_ms = jitter->max_delay_ms && due > (int64_t)now_ms ? (uint64_t)due : now_ms;
+
+    jitter->count++;
+    return true;
+}
+
+bool rtmp_jitter_pop(rtmp_jitter_t* jitter, uint64_t now_ms, bool force, rtmp_jitter_frame_t* frame) {
+    if (!jitter->count) return false;
+
+    rtmp_jitter_slot_t* slot = &jitter->slots[jitter->head];
+    if (!force && slot->due_ms > now_ms) return false;
+
+    frame->msg = slot->msg;
+    frame->is_keyframe = slot->is_keyframe;
+    frame->timestamp = (uint32_t)slot->timestamp;
+    slot->msg = NULL;
+    jitter->head = (jitter->head + 1) % RTMP_JITTER_CAPACITY;
+    jitter->count--;
+    return true;
+}
+
+int64_t rtmp_jitter_wait_ms(const rtmp_jitter_t* jitter, uint64_t now_ms) {
+    if (!jitter->count) return -1;
+
+    uint64_t due = jitter->slots[jitter->head].due_ms;
+    return due > now_ms ? (int64_t)(due - now_ms) : 0;
+}
+
+uint32_t rtmp_jitter_delay_ms(const rtmp_jitter_t* jitter) {
+    return jitter->delay_ms;
+}
+
+uint32_t rtmp_jitter_measured_ms(const rtmp_jitter_t* jitter) {
+    return jitter->jitter_q4 >> 4;
+}
+
+// Rebase to zero and unwrap. Steps outside the plausible range (encoder
+// restart, a publisher taking over the stream) continue from the last frame
+// and restart the clock mapping instead of stalling or flushing the buffer.
+static int64_t rtmp_jitter_normalize(rtmp_jitter_t* jitter, uint32_t raw, uint64_t now_ms) {
+    if (!jitter->started) {
+        jitter->started = true;
+        jitter->last_raw = raw;
+        jitter->last_timestamp = 0;
+        jitter->last_arrival = now_ms;
+        jitter->offset = (int64_t)now_ms;
+        jitter->window_min = jitter->offset;
+        jitter->window_start = now_ms;
+        return 0;
+    }
+
+    int32_t step = (int32_t)(raw - jitter->last_raw);
+    int64_t timestamp;
+    if (step < -RTMP_JITTER_MAX_BACKWARD_MS || step > RTMP_JITTER_MAX_GAP_MS) {
+        timestamp = jitter->last_timestamp + jitter->last_step;
+        jitter->offset = (int64_t)now_ms - timestamp;
+        jitter->window_min = jitter->offset;
+        jitter->window_start = now_ms;
+    } else {
+        timestamp = jitter->last_timestamp + step;
+        if (step > 0) {
+            jitter->last_step = step;
+        }
+
+        // |D| = difference between arrival spacing and timestamp spacing
+        int64_t deviation = (int64_t)(now_ms - jitter->last_arrival) - step;
+        if (deviation < 0) deviation = -deviation;
+        if (deviation > RTMP_JITTER_MAX_GAP_MS) deviation = RTMP_JITTER_MAX_GAP_MS;
+        jitter->jitter_q4 += (uint32_t)deviation - ((jitter->jitter_q4 + 8) >> 4);
+
+        rtmp_jitter_track_transit(jitter, timestamp, now_ms);
+        rtmp_jitter_adapt(jitter);
+    }
+
+    jitter->last_raw = raw;
+    jitter->last_arrival = now_ms;
+    // Small backward steps (audio and video interleaved) never move time back
+    if (timestamp > jitter->last_timestamp) {
+        jitter->last_timestamp = timestamp;
+    }
+    return timestamp > 0 ? timestamp : 0;
+}
+
+// The fastest frame defines the clock mapping. The minimum is re-taken every
+// window so the mapping follows clock drift in both directions.
+static void rtmp_jitter_track_transit(rtmp_jitter_t* jitter, int64_t timestamp, uint64_t now_ms) {
+    int64_t transit = (int64_t)now_ms - timestamp;
+
+    if (transit < jitter->offset) {
+        jitter->offset = transit;
+    }
+    if (transit < jitter->window_min) {
+        jitter->window_min = transit;
+    }
+    if (now_ms - jitter->window_start >= RTMP_JITTER_WINDOW_MS) {
+        jitter->offset = jitter->window_min;
+        jitter->window_min = transit;
+        jitter->window_start = now_ms;
+    }
+}
+
+// Move the delay an eighth of the way to the target, so the schedule never lurches
+static void rtmp_jitter_adapt(rtmp_jitter_t* jitter) {
+    uint64_t target = (uint64_t)RTMP_JITTER_DEPTH_FACTOR * (jitter->jitter_q4 >> 4);
+    if (target < jitter->min_delay_ms) target = jitter->min_delay_ms;
+    if (target > jitter->max_delay_ms) target = jitter->max_delay_ms;
+
+    uint32_t gap = target > jitter->delay_ms ? (uint32_t)target - jitter->delay_ms : jitter->delay_ms - (uint32_t)target;
+    uint32_t step = gap >= 8 ? gap / 8 : (gap ? 1 : 0);
+    jitter->delay_ms = target > jitter->delay_ms ? jitter->delay_ms + step : jitter->delay_ms - step;
+}
@@ -0,0 +1,49 @@
+// rtmp_jitter.h
+#ifndef RTMP_JITTER_H
+#define RTMP_JITTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "rtmp_relay.h"
+
+// Jitter buffer configurations
+#define RTMP_JITTER_CAPACITY 256               // Frames held per stream; a full buffer releases early
+#define RTMP_JITTER_WINDOW_MS 2000             // How long the fastest transit is trusted
+#define RTMP_JITTER_MAX_BACKWARD_MS 500        // Larger backward steps are discontinuities
+#define RTMP_JITTER_MAX_GAP_MS 10000           // Larger forward steps are discontinuities
+#define RTMP_JITTER_DEPTH_FACTOR 3             // Target delay in units of measured jitter
+
+// One frame on its way out; timestamp is normalized: zero-based, and
+// continuous across 32-bit wraps and publisher restarts
+typedef struct {
+    rtmp_msgbuf_t* msg;
+    bool is_keyframe;
+    uint32_t timestamp;
+} rtmp_jitter_frame_t;
+
+// Receive-side playout buffer for one stream. Frames go in as they arrive and
+// come out on the schedule their timestamps describe, delayed just enough to
+// absorb the inter-arrival jitter measured so far. Not thread-safe; one
+// thread pushes and pops.
+typedef struct rtmp_jitter rtmp_jitter_t;
+
+// The delay adapts between the bounds; max_delay_ms 0 passes frames straight through
+rtmp_jitter_t* rtmp_jitter_create(uint32_t min_delay_ms, uint32_t max_delay_ms);
+void rtmp_jitter_destroy(rtmp_jitter_t* jitter);
+
+// Retains msg on success; false when the buffer is full
+bool rtmp_jitter_push(rtmp_jitter_t* jitter, rtmp_msgbuf_t* msg, bool is_keyframe, uint32_t timestamp,
+                      uint64_t now_ms);
+
+// Next frame due at now_ms; the caller takes over the reference in frame->msg.
+// Pass force to empty the buffer regardless of schedule.
+bool rtmp_jitter_pop(rtmp_jitter_t* jitter, uint64_t now_ms, bool force, rtmp_jitter_frame_t* frame);
+
+// Milliseconds until the next frame is due: 0 if one is, -1 when empty
+int64_t rtmp_jitter_wait_ms(const rtmp_jitter_t* jitter, uint64_t now_ms);
+
+// Current playout delay and measured jitter
+uint32_t rtmp_jitter_delay_ms(const rtmp_jitter_t* jitter);
+uint32_t rtmp_jitter_measured_ms(const rtmp_jitter_t* jitter);
+
+#endif /* RTMP_JITTER_H */
@@ -0,0 +1,839 @@
+// rtmp_loadgen.c
+// Load generator: N publishers and M players against an in-process server.
+// Publishers send H.264-shaped synthetic video at a chosen bitrate, or loop an
+// FLV file; players stamp-check every frame they receive. Reports handshake
+// rate, sustained ingest and egress, frame latency percentiles (all frames
+// and per player) and the server's share of CPU and memory.
+#include "rtmp_server_integration.h"
+#include "rtmp_amf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define LOADGEN_DEFAULT_PORT 19351
+#define LOADGEN_DEFAULT_PUBLISHERS 10
+#define LOADGEN_DEFAULT_PLAYERS 100
+#define LOADGEN_DEFAULT_KBPS 2500
+#define LOADGEN_DEFAULT_FPS 30
+#define LOADGEN_DEFAULT_GOP 60                  // Frames per keyframe interval
+#define LOADGEN_DEFAULT_SECONDS 10
+#define LOADGEN_SPARE_CONNECTIONS 16            // Admission headroom past the generated clients
+#define LOADGEN_CHUNK_SIZE 4096                 // What encoders typically switch to
+#define LOADGEN_COMMAND_SIZE 1024
+#define LOADGEN_READ_SIZE 65536
+#define LOADGEN_WAIT_SLICE_US 50000             // Longest single sleep of a publisher
+
+// Chunk streams, as encoders commonly use them
+#define LOADGEN_CSID_PROTOCOL 2
+#define LOADGEN_CSID_COMMAND 3
+#define LOADGEN_CSID_DATA 4
+#define LOADGEN_CSID_VIDEO 6
+#define LOADGEN_CSID_AUDIO 7
+#define LOADGEN_MAX_CSID 64                     // Chunk streams a player tracks
+
+// Send time stamped into video frames: FLV video header (5), NAL length (4),
+// NAL header (1), then the magic and microseconds on the monotonic clock
+#define LOADGEN_STAMP_OFFSET 10
+#define LOADGEN_STAMP_MAGIC 0x4c475453          // "LGTS"
+#define LOADGEN_STAMP_SIZE 12
+
+// Latency histogram: log-linear, 16 buckets per power of two of microseconds
+#define LOADGEN_HIST_SUB_BITS 4
+#define LOADGEN_HIST_SUB (1u << LOADGEN_HIST_SUB_BITS)
+#define LOADGEN_HIST_BUCKETS (40 * LOADGEN_HIST_SUB)
+
+typedef struct {
+    uint32_t counts[LOADGEN_HIST_BUCKETS];
+    uint64_t total;
+    uint64_t max_us;
+} loadgen_hist_t;
+
+// Reassembly state of one incoming chunk stream
+typedef struct {
+    uint32_t length;
+    uint8_t type;
+    bool extended;                      // Extended timestamp follows every header
+    uint8_t* message;
+    uint32_t received;
+    uint32_t capacity;
+} loadgen_chunk_stream_t;
+
+typedef struct {
+    int fd;
+    uint32_t stream;                    // Publisher it plays
+    rtmp_reactor_t* reactor;
+    rtmp_reactor_handle_t* handle;
+    uint8_t buffer[LOADGEN_READ_SIZE];  // Input not parsed yet
+    size_t used;
+    uint32_t chunk_size;
+    loadgen_chunk_stream_t streams[LOADGEN_MAX_CSID];
+    uint64_t joined_us;                 // Frames stamped earlier are start-up burst
+    uint64_t bytes;
+    uint64_t frames;
+    bool closed;
+    loadgen_hist_t latency;
+} loadgen_player_t;
+
+typedef struct {
+    int fd;
+    char name[32];
+    rtmp_send_queue_t queue;
+    pthread_t thread;
+    bool started;
+    rtmp_file_source_t* file;
+    uint64_t bytes;
+    uint64_t frames;
+    uint64_t cpu_ns;                    // Sending thread's CPU time
+    bool failed;
+} loadgen_publisher_t;
+
+// One player event loop and the CPU its thread has used, sampled every tick
+typedef struct {
+    rtmp_reactor_t* reactor;
+    uint64_t cpu_ns;
+} loadgen_loop_t;
+
+typedef struct {
+    uint16_t port;
+    uint32_t kbps;
+    uint32_t fps;
+    uint32_t gop;
+    const char* file;
+} loadgen_config_t;
+
+// Private variables
+static loadgen_config_t config = { LOADGEN_DEFAULT_PORT, LOADGEN_DEFAULT_KBPS, LOADGEN_DEFAULT_FPS, LOADGEN_DEFAULT_GOP, NULL };
+static volatile bool running = true;
+
+// H.264 SPS for 1280x720 at 24 fps, so the server derives real stream parameters
+static const uint8_t loadgen_sps[] = {
+    0x67, 0x42, 0xc0, 0x1f, 0xda, 0x01, 0x40, 0x16, 0xec, 0x04, 0x40, 0x00,
+    0x00, 0x03, 0x00, 0x40, 0x00, 0x00, 0x0c, 0x23, 0xc6, 0x0c, 0xa8
+};
+static const uint8_t loadgen_pps[] = { 0x68, 0xce, 0x3c, 0x80 };
+
+static uint64_t loadgen_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static uint64_t loadgen_thread_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t loadgen_process_cpu_ns(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return ((uint64_t)usage.ru_utime.tv_sec + (uint64_t)usage.ru_stime.tv_sec) * 1000000000 +
+           ((uint64_t)usage.ru_utime.tv_usec + (uint64_t)usage.ru_stime.tv_usec) * 1000;
+}
+
+// Reads "VmRSS:" from /proc; zero where unavailable
+static long loadgen_rss_kb(void) {
+    long rss_kb = 0;
+    FILE* f = fopen("/proc/self/status", "r");
+    if (!f) return 0;
+
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        sscanf(line, "VmRSS: %ld", &rss_kb);
+    }
+    fclose(f);
+    return rss_kb;
+}
+
+static uint32_t loadgen_read_u24(const uint8_t* p) {
+    return ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+}
+
+static uint32_t loadgen_read_u32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void loadgen_write_u32(uint8_t* p, uint32_t value) {
+    p[0] = (value >> 24) & 0xff;
+    p[1] = (value >> 16) & 0xff;
+    p[2] = (value >> 8) & 0xff;
+    p[3] = value & 0xff;
+}
+
+// Histogram
+
+static uint32_t loadgen_hist_bucket(uint64_t us) {
+    if (us < LOADGEN_HIST_SUB) return (uint32_t)us;
+
+    uint32_t msb = 63 - (uint32_t)__builtin_clzll(us);
+    uint32_t sub = (uint32_t)(us >> (msb - LOADGEN_HIST_SUB_BITS)) & (LOADGEN_HIST_SUB - 1);
+    uint32_t bucket = (msb - LOADGEN_HIST_SUB_BITS + 1) * LOADGEN_HIST_SUB + sub;
+    return bucket < LOADGEN_HIST_BUCKETS ? bucket : LOADGEN_HIST_BUCKETS - 1;
+}
+
+// Lower bound of a bucket, in microseconds
+static uint64_t loadgen_hist_value(uint32_t bucket) {
+    if (bucket < LOADGEN_HIST_SUB) return bucket;
+
+    uint32_t msb = bucket / LOADGEN_HIST_SUB + LOADGEN_HIST_SUB_BITS - 1;
+    uint64_t sub = bucket % LOADGEN_HIST_SUB;
+    return (LOADGEN_HIST_SUB + sub) << (msb - LOADGEN_HIST_SUB_BITS);
+}
+
+static void loadgen_hist_add(loadgen_hist_t* hist, uint64_t us) {
+    hist->counts[loadgen_hist_bucket(us)]++;
+    hist->total++;
+    if (us > hist->max_us) {
+        hist->max_us = us;
+    }
+}
+
+static void loadgen_hist_merge(loadgen_hist_t* into, const loadgen_hist_t* from) {
+    for (uint32_t i = 0; i < LOADGEN_HIST_BUCKETS; i++) {
+        into->counts[i] += from->counts[i];
+    }
+    into->total += from->total;
+    if (from->max_us > into->max_us) {
+        into->max_us = from->max_us;
+    }
+}
+
+static double loadgen_hist_percentile_ms(const loadgen_hist_t* hist, double percentile) {
+    if (!hist->total) return 0;
+
+    uint64_t rank = (uint64_t)(percentile / 100.0 * (double)hist->total + 0.5);
+    if (rank < 1) rank = 1;
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < LOADGEN_HIST_BUCKETS; i++) {
+        seen += hist->counts[i];
+        if (seen < rank) continue;
+
+        // Middle of the bucket, which is never past the largest sample
+        uint64_t low = loadgen_hist_value(i);
+        uint64_t high = i + 1 < LOADGEN_HIST_BUCKETS ? loadgen_hist_value(i + 1) : hist->max_us + 1;
+        uint64_t value = low + (high - low - 1) / 2;
+        return (value < hist->max_us ? value : hist->max_us) / 1000.0;
+    }
+    return hist->max_us / 1000.0;
+}
+
+static int loadgen_compare_double(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Sending side
+
+// Queue one message and block until the socket has taken everything queued
+static bool loadgen_send(int fd, rtmp_send_queue_t* queue, rtmp_msgbuf_t* msg, uint64_t* bytes) {
+    if (!msg) return false;
+
+    bool ok = rtmp_send_queue_push(queue, msg);
+    rtmp_msgbuf_release(msg);
+
+    size_t written = 0;
+    while (ok && rtmp_send_queue_pending(queue)) {
+        ok = rtmp_send_queue_flush(queue, fd, &written);
+    }
+    if (bytes) *bytes += written;
+    return ok;
+}
+
+// AMF0 command: name, transaction id, then the encoded arguments
+typedef struct {
+    uint8_t data[LOADGEN_COMMAND_SIZE];
+    size_t length;
+} loadgen_amf_t;
+
+static void loadgen_amf_string(loadgen_amf_t* amf, const char* value) {
+    size_t size;
+    rtmp_amf_encode_string(value, amf->data + amf->length, &size);
+    amf->length += size;
+}
+
+static void loadgen_amf_number(loadgen_amf_t* amf, double value) {
+    size_t size;
+    rtmp_amf_encode_number(value, amf->data + amf->length, &size);
+    amf->length += size;
+}
+
+static void loadgen_amf_null(loadgen_amf_t* amf) {
+    size_t size;
+    rtmp_amf_encode_null(amf->data + amf->length, &size);
+    amf->length += size;
+}
+
+static void loadgen_amf_property(loadgen_amf_t* amf, const char* name, const char* value) {
+    size_t size;
+    rtmp_amf_encode_property_name(name, amf->data + amf->length, &size);
+    amf->length += size;
+    loadgen_amf_string(amf, value);
+}
+
+// connect, createStream, then publish or play on message stream 1, without
+// waiting for the replies, as many encoders do
+static bool loadgen_start_session(int fd, rtmp_send_queue_t* queue, const char* name, bool publish,
+                                  uint64_t* bytes) {
+    uint8_t chunk_size[4];
+    loadgen_write_u32(chunk_size, LOADGEN_CHUNK_SIZE);
+    bool ok = loadgen_send(fd, queue, rtmp_msgbuf_create(LOADGEN_CSID_PROTOCOL, RTMP_RELAY_MSG_SET_CHUNK_SIZE, 0, 0,
+                                                         chunk_size, sizeof(chunk_size)), bytes);
+
+    char tc_url[64];
+    snprintf(tc_url, sizeof(tc_url), "rtmp://127.0.0.1:%u/live", config.port);
+    loadgen_amf_t amf;
+    amf.length = 0;
+    loadgen_amf_string(&amf, "connect");
+    loadgen_amf_number(&amf, 1);
+    size_t size;
+    rtmp_amf_encode_object_start(amf.data + amf.length, &size);
+    amf.length += size;
+    loadgen_amf_property(&amf, "app", "live");
+    loadgen_amf_property(&amf, "type", "nonprivate");
+    loadgen_amf_property(&amf, "flashVer", "FMLE/3.0 (compatible; rtmp_loadgen)");
+    loadgen_amf_property(&amf, "tcUrl", tc_url);
+    rtmp_amf_encode_object_end(amf.data + amf.length, &size);
+    amf.length += size;
+    ok = ok && loadgen_send(fd, queue, rtmp_msgbuf_create(LOADGEN_CSID_COMMAND, RTMP_MSG_COMMAND_AMF0, 0, 0,
+                                                          amf.data, (uint32_t)amf.length), bytes);
+
+    amf.length = 0;
+    loadgen_amf_string(&amf, "createStream");
+    loadgen_amf_number(&amf, 2);
+    loadgen_amf_null(&amf);
+    ok = ok && loadgen_send(fd, queue, rtmp_msgbuf_create(LOADGEN_CSID_COMMAND, RTMP_MSG_COMMAND_AMF0, 0, 0,
+                                                          amf.data, (uint32_t)amf.length), bytes);
+
+    amf.length = 0;
+    loadgen_amf_string(&amf, publish ? "publish" : "play");
+    loadgen_amf_number(&amf, 0);
+    loadgen_amf_null(&amf);
+    loadgen_amf_string(&amf, name);
+    if (publish) {
+        loadgen_amf_string(&amf, "live");
+    }
+    return ok && loadgen_send(fd, queue, rtmp_msgbuf_create(LOADGEN_CSID_COMMAND, RTMP_MSG_COMMAND_AMF0, 0,
+                                                            RTMP_RELAY_STREAM_ID, amf.data, (uint32_t)amf.length),
+                              bytes);
+}
+
+// Replies and acknowledgements from the server are not looked at, only kept
+// from filling its send buffer
+static void loadgen_discard_input(int fd) {
+    uint8_t buffer[4096];
+    while (recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT) > 0) {
+    }
+}
+
+static void loadgen_stamp(rtmp_msgbuf_t* msg) {
+    uint64_t now = loadgen_now_us();
+    uint8_t* p = msg->payload + LOADGEN_STAMP_OFFSET;
+    loadgen_write_u32(p, LOADGEN_STAMP_MAGIC);
+    loadgen_write_u32(p + 4, (uint32_t)(now >> 32));
+    loadgen_write_u32(p + 8, (uint32_t)now);
+}
+
+// Synthetic publisher: an AVC sequence header, then frames at the configured
+// rate, keyframes three times the size of inter frames
+static void* loadgen_publisher_thread(void* arg) {
+    loadgen_publisher_t* publisher = (loadgen_publisher_t*)arg;
+    uint32_t average = config.kbps * 1000 / 8 / config.fps;
+    uint32_t inter = (uint32_t)((uint64_t)average * config.gop / (config.gop + 2));
+    if (inter < LOADGEN_STAMP_OFFSET + LOADGEN_STAMP_SIZE) {
+        inter = LOADGEN_STAMP_OFFSET + LOADGEN_STAMP_SIZE;
+    }
+
+    // AVCDecoderConfigurationRecord with one SPS and one PPS
+    uint8_t header[64] = { 0x17, 0, 0, 0, 0, 1, loadgen_sps[1], loadgen_sps[2], loadgen_sps[3], 0xff, 0xe1 };
+    uint32_t length = 11;
+    header[length++] = 0;
+    header[length++] = sizeof(loadgen_sps);
+    memcpy(header + length, loadgen_sps, sizeof(loadgen_sps));
+    length += sizeof(loadgen_sps);
+    header[length++] = 1;
+    header[length++] = 0;
+    header[length++] = sizeof(loadgen_pps);
+    memcpy(header + length, loadgen_pps, sizeof(loadgen_pps));
+    length += sizeof(loadgen_pps);
+    publisher->failed = !loadgen_send(publisher->fd, &publisher->queue,
+                                      rtmp_msgbuf_create(LOADGEN_CSID_VIDEO, RTMP_MSG_VIDEO, 0, RTMP_RELAY_STREAM_ID,
+                                                         header, length),
+                                      &publisher->bytes);
+
+    uint64_t start = loadgen_now_us();
+    for (uint64_t i = 0; running && !publisher->failed; i++) {
+        uint64_t due = start + i * 1000000 / config.fps;
+        uint64_t now = loadgen_now_us();
+        while (running && now < due) {
+            uint64_t wait = due - now;
+            usleep((useconds_t)(wait < LOADGEN_WAIT_SLICE_US ? wait : LOADGEN_WAIT_SLICE_US));
+            now = loadgen_now_us();
+        }
+        if (!running) break;
+
+        bool keyframe = i % config.gop == 0;
+        uint32_t size = keyframe ? 3 * inter : inter;
+        rtmp_msgbuf_t* msg = rtmp_msgbuf_create(LOADGEN_CSID_VIDEO, RTMP_MSG_VIDEO, (uint32_t)(i * 1000 / config.fps),
+                                                RTMP_RELAY_STREAM_ID, NULL, size);
+        if (!msg) break;
+
+        uint8_t* p = msg->payload;
+        p[0] = keyframe ? 0x17 : 0x27;
+        p[1] = 1;
+        p[2] = p[3] = p[4] = 0;
+        loadgen_write_u32(p + 5, size - 9);
+        p[9] = keyframe ? 0x65 : 0x41;
+        memset(p + LOADGEN_STAMP_OFFSET + LOADGEN_STAMP_SIZE, (int)(i & 0xff),
+               size - LOADGEN_STAMP_OFFSET - LOADGEN_STAMP_SIZE);
+        loadgen_stamp(msg);
+
+        publisher->failed = !loadgen_send(publisher->fd, &publisher->queue, msg, &publisher->bytes);
+        publisher->frames++;
+        loadgen_discard_input(publisher->fd);
+    }
+
+    publisher->cpu_ns = loadgen_thread_cpu_ns();
+    return NULL;
+}
+
+// File-sourced publisher: every tag of the file, looped in real time; video
+// frames long enough to hold it carry the send stamp
+static bool loadgen_file_tag(const rtmp_flv_tag_t* tag, void* userdata) {
+    loadgen_publisher_t* publisher = (loadgen_publisher_t*)userdata;
+    if (!tag) return false;
+
+    uint32_t csid = tag->type == RTMP_MSG_VIDEO ? LOADGEN_CSID_VIDEO :
+                    tag->type == RTMP_MSG_AUDIO ? LOADGEN_CSID_AUDIO : LOADGEN_CSID_DATA;
+    rtmp_msgbuf_t* msg = rtmp_msgbuf_create(csid, tag->type, tag->timestamp, RTMP_RELAY_STREAM_ID,
+                                            tag->data, tag->length);
+    if (!msg) return false;
+
+    rtmp_flv_video_t video;
+    if (tag->type == RTMP_MSG_VIDEO && tag->length >= LOADGEN_STAMP_OFFSET + LOADGEN_STAMP_SIZE &&
+        rtmp_flv_parse_video(tag->data, tag->length, &video) && !video.sequence_header && !video.enhanced) {
+        loadgen_stamp(msg);
+        publisher->frames++;
+    }
+
+    publisher->failed = !loadgen_send(publisher->fd, &publisher->queue, msg, &publisher->bytes);
+    loadgen_discard_input(publisher->fd);
+    publisher->cpu_ns = loadgen_thread_cpu_ns();
+    return running && !publisher->failed;
+}
+
+// Receiving side
+
+// A complete message from the server
+static void loadgen_player_message(loadgen_player_t* player, uint8_t type, const uint8_t* data, uint32_t length) {
+    if (type == RTMP_RELAY_MSG_SET_CHUNK_SIZE && length >= 4) {
+        player->chunk_size = loadgen_read_u32(data) & 0x7fffffff;
+    } else if (type == RTMP_MSG_USER_CONTROL && length >= 6 && data[0] == 0 && data[1] == 6) {
+        // Ping request: answer, or the server counts the player as gone
+        uint8_t response[6] = { 0, 7, data[2], data[3], data[4], data[5] };
+        rtmp_msgbuf_t* msg = rtmp_msgbuf_create(LOADGEN_CSID_PROTOCOL, RTMP_MSG_USER_CONTROL, 0, 0,
+                                                response, sizeof(response));
+        if (msg) {
+            rtmp_send_queue_t queue;
+            rtmp_send_queue_init(&queue, RTMP_DEFAULT_CHUNK_SIZE);
+            loadgen_send(player->fd, &queue, msg, NULL);
+            rtmp_send_queue_destroy(&queue);
+        }
+    } else if (type == RTMP_MSG_VIDEO) {
+        player->frames++;
+        const uint8_t* p = data + LOADGEN_STAMP_OFFSET;
+        if (length >= LOADGEN_STAMP_OFFSET + LOADGEN_STAMP_SIZE && loadgen_read_u32(p) == LOADGEN_STAMP_MAGIC) {
+            uint64_t sent = ((uint64_t)loadgen_read_u32(p + 4) << 32) | loadgen_read_u32(p + 8);
+            uint64_t now = loadgen_now_us();
+            if (sent >= player->joined_us && now >= sent) {
+                loadgen_hist_add(&player->latency, now - sent);
+            }
+        }
+    }
+}
+
+// Consume every whole chunk in the input; a partial one waits for more bytes.
+// Only message boundaries matter here, so timestamps are skipped.
+static bool loadgen_player_parse(loadgen_player_t* player) {
+    static const uint8_t header_sizes[4] = { 11, 7, 3, 0 };
+    size_t position = 0;
+
+    while (position < player->used) {
+        const uint8_t* p = player->buffer + position;
+        size_t available = player->used - position;
+        uint8_t fmt = p[0] >> 6;
+        uint32_t csid = p[0] & 0x3f;
+        size_t basic = 1;
+        if (csid == 0) {
+            if (available < 2) break;
+            csid = 64 + p[1];
+            basic = 2;
+        } else if (csid == 1) {
+            if (available < 3) break;
+            csid = 64 + p[1] + 256 * (uint32_t)p[2];
+            basic = 3;
+        }
+        if (csid >= LOADGEN_MAX_CSID) return false;
+        if (available < basic + header_sizes[fmt]) break;
+
+        loadgen_chunk_stream_t* stream = &player->streams[csid];
+        const uint8_t* m = p + basic;
+        bool extended = fmt < 3 ? loadgen_read_u24(m) == 0xffffff : stream->extended;
+        uint32_t length = fmt < 2 ? loadgen_read_u24(m + 3) : stream->length;
+        uint32_t received = fmt < 3 ? 0 : stream->received;
+        size_t header = basic + header_sizes[fmt] + (extended ? 4 : 0);
+        uint32_t part = length - received < player->chunk_size ? length - received : player->chunk_size;
+        if (available < header + part) break;
+
+        stream->extended = extended;
+        stream->length = length;
+        if (fmt < 2) {
+            stream->type = m[6];
+        }
+        if (length > stream->capacity) {
+            uint8_t* message = realloc(stream->message, length);
+            if (!message) return false;
+            stream->message = message;
+            stream->capacity = length;
+        }
+        memcpy(stream->message + received, p + header, part);
+        stream->received = received + part;
+        position += header + part;
+
+        if (stream->received == stream->length) {
+            stream->received = 0;
+            loadgen_player_message(player, stream->type, stream->message, stream->length);
+        }
+    }
+
+    memmove(player->buffer, player->buffer + position, player->used - position);
+    player->used -= position;
+    return true;
+}
+
+static void loadgen_player_on_read(rtmp_reactor_t* reactor, int fd, uint32_t events, void* userdata) {
+    loadgen_player_t* player = (loadgen_player_t*)userdata;
+
+    ssize_t n = recv(fd, player->buffer + player->used, sizeof(player->buffer) - player->used, 0);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+    if (n > 0) {
+        player->used += (size_t)n;
+        player->bytes += (uint64_t)n;
+        if (loadgen_player_parse(player)) return;
+    }
+
+    rtmp_reactor_remove(reactor, player->handle);
+    player->closed = true;
+}
+
+static void loadgen_loop_on_tick(rtmp_reactor_t* reactor, uint64_t now_ms, void* userdata) {
+    ((loadgen_loop_t*)userdata)->cpu_ns = loadgen_thread_cpu_ns();
+}
+
+// Connection setup
+
+static int loadgen_connect(const struct sockaddr_in* addr) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    int opt = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    if (connect(fd, (const struct sockaddr*)addr, sizeof(*addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool loadgen_io(int fd, uint8_t* buf, size_t size, bool write_side) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = write_side ? send(fd, buf + done, size - done, 0)
+                               : recv(fd, buf + done, size - done, 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return false;
+        }
+        done += (size_t)n;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    rtmp_server_io_mode_t mode = RTMP_SERVER_IO_REACTOR;
+    uint32_t loops = 0;
+    uint32_t num_publishers = LOADGEN_DEFAULT_PUBLISHERS;
+    uint32_t num_players = LOADGEN_DEFAULT_PLAYERS;
+    uint32_t seconds = LOADGEN_DEFAULT_SECONDS;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t num_loops = cpus > 1 ? (uint32_t)cpus / 2 : 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "m:l:p:P:M:b:r:g:d:f:w:")) != -1) {
+        switch (opt) {
+            case 'm':
+                if (strcmp(optarg, "threaded") == 0) mode = RTMP_SERVER_IO_THREADED;
+                else if (strcmp(optarg, "sharded") == 0) mode = RTMP_SERVER_IO_SHARDED;
+                else mode = RTMP_SERVER_IO_REACTOR;
+                break;
+            case 'l': loops = (uint32_t)atoi(optarg); break;
+            case 'p': config.port = (uint16_t)atoi(optarg); break;
+            case 'P': num_publishers = (uint32_t)atoi(optarg); break;
+            case 'M': num_players = (uint32_t)atoi(optarg); break;
+            case 'b': config.kbps = (uint32_t)atoi(optarg); break;
+            case 'r': config.fps = (uint32_t)atoi(optarg); break;
+            case 'g': config.gop = (uint32_t)atoi(optarg); break;
+            case 'd': seconds = (uint32_t)atoi(optarg); break;
+            case 'f': config.file = optarg; break;
+            case 'w': num_loops = (uint32_t)atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-m threaded|reactor|sharded] [-l loops] [-p port] [-P publishers] "
+                        "[-M players] [-b kbps] [-r fps] [-g gop] [-d seconds] [-f file.flv] [-w player loops]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+    if (num_publishers == 0 || config.fps == 0 || config.gop == 0 || num_loops == 0) {
+        fprintf(stderr, "publishers, fps, gop and player loops must be positive\n");
+        return 1;
+    }
+
+    // Both ends of every connection live in this process
+    struct rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+
+    // Every client comes from loopback and handshakes at once
+    rtmp_server_initialize();
+    rtmp_server_set_io_mode(mode, loops);
+    uint32_t clients = num_publishers + num_players;
+    rtmp_admission_limits_t limits = { clients + LOADGEN_SPARE_CONNECTIONS, 0, clients, 0 };
+    rtmp_server_set_admission_limits(&limits);
+    if (!rtmp_server_start(config.port)) {
+        fprintf(stderr, "failed to start server on port %u\n", config.port);
+        return 1;
+    }
+
+    loadgen_publisher_t* publishers = calloc(num_publishers, sizeof(loadgen_publisher_t));
+    loadgen_player_t* players = calloc(num_players ? num_players : 1, sizeof(loadgen_player_t));
+    loadgen_loop_t* player_loops = calloc(num_loops, sizeof(loadgen_loop_t));
+    uint32_t total = num_publishers + num_players;
+    int* fds = malloc(total * sizeof(int));
+    if (!publishers || !players || !player_loops || !fds) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(config.port);
+
+    // Phase 1: every connection handshakes, publishers first
+    uint8_t c0c1[1 + RTMP_HANDSHAKE_SIZE];
+    uint8_t s0s1s2[1 + 2 * RTMP_HANDSHAKE_SIZE];
+    memset(c0c1, 0, sizeof(c0c1));
+    c0c1[0] = 3;
+
+    uint64_t start = loadgen_now_us();
+    uint32_t opened = 0;
+    for (; opened < total; opened++) {
+        fds[opened] = loadgen_connect(&addr);
+        if (fds[opened] < 0 || !loadgen_io(fds[opened], c0c1, sizeof(c0c1), true)) {
+            fprintf(stderr, "connection %u failed: %s\n", opened, strerror(errno));
+            break;
+        }
+    }
+    uint32_t completed = 0;
+    for (uint32_t i = 0; i < opened; i++) {
+        if (!loadgen_io(fds[i], s0s1s2, sizeof(s0s1s2), false)) continue;
+        if (!loadgen_io(fds[i], s0s1s2 + 1, RTMP_HANDSHAKE_SIZE, true)) continue;
+        completed++;
+    }
+    double handshake_s = (loadgen_now_us() - start) / 1e6;
+    if (opened < total) {
+        for (uint32_t i = 0; i <= opened && i < total; i++) {
+            if (fds[i] >= 0) close(fds[i]);
+        }
+        rtmp_server_cleanup();
+        return 1;
+    }
+
+    // Phase 2: publish and play; each player watches one publisher's stream
+    for (uint32_t i = 0; i < num_publishers; i++) {
+        loadgen_publisher_t* publisher = &publishers[i];
+        publisher->fd = fds[i];
+        snprintf(publisher->name, sizeof(publisher->name), "load%u", i);
+        rtmp_send_queue_init(&publisher->queue, RTMP_DEFAULT_CHUNK_SIZE);
+        publisher->failed = !loadgen_start_session(publisher->fd, &publisher->queue, publisher->name, true,
+                                                   &publisher->bytes);
+        if (config.file) {
+            publisher->file = rtmp_file_source_open(config.file);
+            if (!publisher->file) {
+                fprintf(stderr, "cannot read %s\n", config.file);
+                return 1;
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < num_loops; i++) {
+        player_loops[i].reactor = rtmp_reactor_create();
+        if (!player_loops[i].reactor) {
+            fprintf(stderr, "cannot create player loop\n");
+            return 1;
+        }
+        rtmp_reactor_set_tick_callback(player_loops[i].reactor, loadgen_loop_on_tick, &player_loops[i]);
+        rtmp_reactor_start(player_loops[i].reactor);
+    }
+
+    for (uint32_t i = 0; i < num_players; i++) {
+        loadgen_player_t* player = &players[i];
+        rtmp_send_queue_t queue;
+        player->fd = fds[num_publishers + i];
+        player->stream = i % num_publishers;
+        player->chunk_size = RTMP_DEFAULT_CHUNK_SIZE;
+        player->joined_us = loadgen_now_us();
+
+        rtmp_send_queue_init(&queue, RTMP_DEFAULT_CHUNK_SIZE);
+        player->closed = !loadgen_start_session(player->fd, &queue, publishers[player->stream].name, false, NULL);
+        rtmp_send_queue_destroy(&queue);
+
+        fcntl(player->fd, F_SETFL, fcntl(player->fd, F_GETFL, 0) | O_NONBLOCK);
+        player->reactor = player_loops[i % num_loops].reactor;
+        player->handle = rtmp_reactor_add(player->reactor, player->fd, RTMP_REACTOR_EVENT_READ,
+                                          loadgen_player_on_read, player);
+        player->closed = player->closed || !player->handle;
+    }
+
+    // Phase 3: sustained traffic
+    uint64_t server_in = rtmp_server_get_bytes_received();
+    uint64_t cpu_start = loadgen_process_cpu_ns();
+    uint64_t loops_cpu_start = 0;
+    for (uint32_t i = 0; i < num_loops; i++) {
+        loops_cpu_start += player_loops[i].cpu_ns;
+    }
+    start = loadgen_now_us();
+
+    for (uint32_t i = 0; i < num_publishers; i++) {
+        loadgen_publisher_t* publisher = &publishers[i];
+        if (publisher->file) {
+            publisher->started = rtmp_file_source_start(publisher->file, RTMP_FILE_SOURCE_REALTIME, true,
+                                                        loadgen_file_tag, publisher);
+        } else {
+            publisher->started = pthread_create(&publisher->thread, NULL, loadgen_publisher_thread, publisher) == 0;
+        }
+    }
+
+    sleep(seconds);
+    running = false;
+    double elapsed = (loadgen_now_us() - start) / 1e6;
+    uint64_t cpu_used = loadgen_process_cpu_ns() - cpu_start;
+    uint64_t server_bytes = rtmp_server_get_bytes_received() - server_in;
+    long rss_kb = loadgen_rss_kb();
+
+    uint64_t generator_cpu = 0;
+    for (uint32_t i = 0; i < num_publishers; i++) {
+        loadgen_publisher_t* publisher = &publishers[i];
+        if (publisher->file) {
+            rtmp_file_source_close(publisher->file);
+        } else if (publisher->started) {
+            pthread_join(publisher->thread, NULL);
+        }
+        generator_cpu += publisher->cpu_ns;
+    }
+    for (uint32_t i = 0; i < num_loops; i++) {
+        generator_cpu += player_loops[i].cpu_ns;
+        rtmp_reactor_stop(player_loops[i].reactor);
+    }
+    generator_cpu -= generator_cpu > loops_cpu_start ? loops_cpu_start : generator_cpu;
+    uint64_t server_cpu = cpu_used > generator_cpu ? cpu_used - generator_cpu : 0;
+
+    // Results
+    uint64_t sent = 0;
+    uint32_t failed = 0;
+    for (uint32_t i = 0; i < num_publishers; i++) {
+        sent += publishers[i].bytes;
+        failed += publishers[i].failed;
+    }
+
+    loadgen_hist_t* all = calloc(1, sizeof(loadgen_hist_t));
+    double* player_p99 = calloc(num_players ? num_players : 1, sizeof(double));
+    uint64_t received = 0;
+    uint32_t measured = 0;
+    uint32_t starved = 0;
+    uint32_t closed = 0;
+    for (uint32_t i = 0; i < num_players; i++) {
+        loadgen_player_t* player = &players[i];
+        received += player->bytes;
+        closed += player->closed;
+        if (!player->latency.total) {
+            starved++;
+            continue;
+        }
+        loadgen_hist_merge(all, &player->latency);
+        player_p99[measured++] = loadgen_hist_percentile_ms(&player->latency, 99);
+    }
+    qsort(player_p99, measured, sizeof(double), loadgen_compare_double);
+
+    static const char* mode_names[] = { "threaded", "reactor", "sharded" };
+    printf("mode=%s loops=%u publishers=%u players=%u source=", mode_names[mode], loops, num_publishers, num_players);
+    if (config.file) {
+        printf("%s\n", config.file);
+    } else {
+        printf("synthetic %u kbps %u fps gop %u\n", config.kbps, config.fps, config.gop);
+    }
+    printf("  handshakes: %u/%u in %.3f s (%.0f handshakes/s)\n", completed, total, handshake_s,
+           handshake_s > 0 ? completed / handshake_s : 0.0);
+    printf("  ingest: %.1f Mbps sent, %.1f Mbps received by server over %.1f s (%u publishers failed)\n",
+           sent * 8 / 1e6 / elapsed, server_bytes * 8 / 1e6 / elapsed, elapsed, failed);
+    printf("  egress: %.1f Mbps received by players (%u closed)\n", received * 8 / 1e6 / elapsed, closed);
+    if (all && all->total) {
+        printf("  latency: p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, p99.9 %.2f ms, max %.2f ms (%llu frames)\n",
+               loadgen_hist_percentile_ms(all, 50), loadgen_hist_percentile_ms(all, 90),
+               loadgen_hist_percentile_ms(all, 99), loadgen_hist_percentile_ms(all, 99.9), all->max_us / 1000.0,
+               (unsigned long long)all->total);
+        printf("  per-player p99: median %.2f ms, p90 %.2f ms, worst %.2f ms; %u players got no frames\n",
+               player_p99[measured / 2], player_p99[measured * 9 / 10], player_p99[measured - 1], starved);
+    } else {
+        printf("  latency: no stamped frames reached %u players\n", starved);
+    }
+    printf("  server cpu: %.1f%% of a core (process %.1f%%, load generator %.1f%%)\n",
+           server_cpu / 1e7 / elapsed, cpu_used / 1e7 / elapsed, (cpu_used - server_cpu) / 1e7 / elapsed);
+    printf("  rss: %ld KB, process including the load generator\n", rss_kb);
+
+    for (uint32_t i = 0; i < num_players; i++) {
+        close(players[i].fd);
+        for (uint32_t c = 0; c < LOADGEN_MAX_CSID; c++) {
+            free(players[i].streams[c].message);
+        }
+    }
+    for (uint32_t i = 0; i < num_loops; i++) {
+        rtmp_reactor_destroy(player_loops[i].reactor);
+    }
+    for (uint32_t i = 0; i < num_publishers; i++) {
+        close(publishers[i].fd);
+        rtmp_send_queue_destroy(&publishers[i].queue);
+    }
+    free(all);
+    free(player_p99);
+    free(players);
+    free(publishers);
+    free(player_loops);
+    free(fds);
+
+    rtmp_server_cleanup();
+    return 0;
+}
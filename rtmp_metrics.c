@@ -0,0 +1,624 @@
+// rtmp_metrics.c
+#include "rtmp_metrics.h"
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Scrapers that hang up early must not raise SIGPIPE
+#ifdef MSG_NOSIGNAL
+#define RTMP_METRICS_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define RTMP_METRICS_SEND_FLAGS 0
+#endif
+
+// Growable text buffer for one response
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+    bool failed;
+} rtmp_metrics_buffer_t;
+
+// One consistent copy of a slot, taken by the scraper
+typedef struct {
+    rtmp_metrics_slot_t slot;
+    double bitrate_in;
+    double bitrate_out;
+    double frame_rate;
+} rtmp_metrics_sample_t;
+
+// Scraper-side baseline for windowed rates, one per slot
+typedef struct {
+    uint32_t generation;
+    bool windowed;                  // A full window has been measured
+    uint64_t since_ms;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t video_frames;
+    double bitrate_in;
+    double bitrate_out;
+    double frame_rate;
+} rtmp_metrics_rate_t;
+
+// Endpoint state
+typedef struct {
+    int listen_socket;
+    char unix_path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+    pthread_t thread;
+    bool running;
+    rtmp_metrics_collector_t collector;
+    void* userdata;
+} rtmp_metrics_endpoint_t;
+
+// Private variables
+static rtmp_metrics_slot_t* metrics_segments[RTMP_METRICS_MAX_SEGMENTS];
+static uint32_t metrics_segment_count;      // Published with release; segments are never moved
+static rtmp_metrics_slot_t* metrics_free;
+static pthread_mutex_t metrics_alloc_lock = PTHREAD_MUTEX_INITIALIZER;
+static rtmp_metrics_rate_t* metrics_rates[RTMP_METRICS_MAX_SEGMENTS];   // Parallel to the segments
+static pthread_mutex_t metrics_rate_lock = PTHREAD_MUTEX_INITIALIZER;  // Scrapers only
+static rtmp_metrics_endpoint_t endpoint = { .listen_socket = -1 };
+
+// Forward declarations of internal functions
+static uint64_t rtmp_metrics_clock_ms(void);
+static void rtmp_metrics_grow(void);
+static bool rtmp_metrics_snapshot(const rtmp_metrics_slot_t* slot, rtmp_metrics_slot_t* copy);
+static uint32_t rtmp_metrics_collect(rtmp_metrics_sample_t** samples);
+static void rtmp_metrics_rate(rtmp_metrics_rate_t* rate, rtmp_metrics_sample_t* sample, uint64_t now);
+static void rtmp_metrics_global(rtmp_metrics_global_t* global);
+static void rtmp_metrics_printf(rtmp_metrics_buffer_t* buffer, const char* format, ...);
+static void rtmp_metrics_escape(rtmp_metrics_buffer_t* buffer, const char* text, bool json);
+static const char* rtmp_metrics_role_string(uint32_t role);
+static void rtmp_metrics_prometheus_series(rtmp_metrics_buffer_t* buffer, rtmp_metrics_sample_t* samples,
+                                           uint32_t count, const char* name, const char* type,
+                                           const char* help, uint32_t field);
+static double rtmp_metrics_field(const rtmp_metrics_sample_t* sample, uint32_t field);
+static int rtmp_metrics_open(const char* address);
+static void* rtmp_metrics_thread(void* arg);
+static void rtmp_metrics_serve(int client);
+
+// Per-connection series, in output order
+enum {
+    RTMP_METRICS_FIELD_BYTES_IN = 0,
+    RTMP_METRICS_FIELD_BYTES_OUT,
+    RTMP_METRICS_FIELD_BITRATE_IN,
+    RTMP_METRICS_FIELD_BITRATE_OUT,
+    RTMP_METRICS_FIELD_FRAME_RATE,
+    RTMP_METRICS_FIELD_DROPPED,
+    RTMP_METRICS_FIELD_QUEUE_DEPTH,
+    RTMP_METRICS_FIELD_QUEUE_BYTES,
+    RTMP_METRICS_FIELD_HANDSHAKE_MS
+};
+
+// Claim a free slot; counters start at zero
+rtmp_metrics_slot_t* rtmp_metrics_acquire(int fd) {
+    pthread_mutex_lock(&metrics_alloc_lock);
+    if (!metrics_free) {
+        rtmp_metrics_grow();
+    }
+    rtmp_metrics_slot_t* slot = metrics_free;
+    if (slot) {
+        metrics_free = slot->next_free;
+    }
+    pthread_mutex_unlock(&metrics_alloc_lock);
+    if (!slot) return NULL;
+
+    // Odd seq must be visible before any field changes under it
+    __atomic_add_fetch(&slot->seq, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&slot->used, 1, __ATOMIC_RELEASE);
+    slot->generation++;
+    slot->fd = fd;
+    slot->role = RTMP_METRICS_ROLE_NONE;
+    slot->stream[0] = '\0';
+    __atomic_store_n(&slot->connect_ms, rtmp_metrics_clock_ms(), __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->handshake_ms, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->bytes_in, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->bytes_out, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->video_frames, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->audio_frames, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->dropped_frames, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->queue_depth, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->queue_bytes, 0, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&slot->seq, 1, __ATOMIC_RELEASE);
+    return slot;
+}
+
+void rtmp_metrics_release(rtmp_metrics_slot_t* slot) {
+    if (!slot) return;
+    __atomic_add_fetch(&slot->seq, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&slot->used, 0, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&slot->seq, 1, __ATOMIC_RELEASE);
+
+    pthread_mutex_lock(&metrics_alloc_lock);
+    slot->next_free = metrics_free;
+    metrics_free = slot;
+    pthread_mutex_unlock(&metrics_alloc_lock);
+}
+
+void rtmp_metrics_set_stream(rtmp_metrics_slot_t* slot, const char* stream, rtmp_metrics_role_t role) {
+    if (!slot) return;
+    __atomic_add_fetch(&slot->seq, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    strncpy(slot->stream, stream ? stream : "", sizeof(slot->stream) - 1);
+    slot->stream[sizeof(slot->stream) - 1] = '\0';
+    slot->role = role;
+    __atomic_add_fetch(&slot->seq, 1, __ATOMIC_RELEASE);
+}
+
+void rtmp_metrics_handshake_done(rtmp_metrics_slot_t* slot) {
+    if (!slot) return;
+    uint64_t elapsed = rtmp_metrics_clock_ms() - __atomic_load_n(&slot->connect_ms, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->handshake_ms, elapsed ? elapsed : 1, __ATOMIC_RELAXED);
+}
+
+// Start serving; the collector supplies server-wide gauges on each scrape
+bool rtmp_metrics_start(const char* address, rtmp_metrics_collector_t collector, void* userdata) {
+    if (endpoint.running || !address) return false;
+
+    endpoint.listen_socket = rtmp_metrics_open(address);
+    if (endpoint.listen_socket < 0) {
+        return false;
+    }
+
+    endpoint.collector = collector;
+    endpoint.userdata = userdata;
+    endpoint.running = true;
+    if (pthread_create(&endpoint.thread, NULL, rtmp_metrics_thread, NULL) != 0) {
+        endpoint.running = false;
+        close(endpoint.listen_socket);
+        endpoint.listen_socket = -1;
+        return false;
+    }
+    return true;
+}
+
+void rtmp_metrics_stop(void) {
+    if (!endpoint.running) return;
+
+    endpoint.running = false;
+    pthread_join(endpoint.thread, NULL);
+
+    close(endpoint.listen_socket);
+    endpoint.listen_socket = -1;
+    if (endpoint.unix_path[0]) {
+        unlink(endpoint.unix_path);
+        endpoint.unix_path[0] = '\0';
+    }
+}
+
+char* rtmp_metrics_render_prometheus(size_t* length) {
+    rtmp_metrics_buffer_t buffer = { NULL, 0, 0, false };
+    rtmp_metrics_global_t global;
+    rtmp_metrics_sample_t* samples = NULL;
+    uint32_t count = rtmp_metrics_collect(&samples);
+
+    rtmp_metrics_global(&global);
+    rtmp_metrics_printf(&buffer, "# HELP rtmp_connections Admitted connections\n");
+    rtmp_metrics_printf(&buffer, "# TYPE rtmp_connections gauge\nrtmp_connections %u\n", global.connections);
+    rtmp_metrics_printf(&buffer, "# HELP rtmp_handshakes_in_progress Connections still in the handshake\n");
+    rtmp_metrics_printf(&buffer, "# TYPE rtmp_handshakes_in_progress gauge\nrtmp_handshakes_in_progress %u\n",
+                        global.handshakes);
+    rtmp_metrics_printf(&buffer, "# HELP rtmp_admission_rejected_total Connections refused at accept\n");
+    rtmp_metrics_printf(&buffer, "# TYPE rtmp_admission_rejected_total counter\nrtmp_admission_rejected_total %llu\n",
+                        (unsigned long long)global.rejected);
+    rtmp_metrics_printf(&buffer, "# HELP rtmp_frame_ring_occupancy Frames waiting for the frame consumer\n");
+    rtmp_metrics_printf(&buffer, "# TYPE rtmp_frame_ring_occupancy gauge\nrtmp_frame_ring_occupancy %u\n",
+                        global.ring_occupancy);
+    rtmp_metrics_printf(&buffer, "# HELP rtmp_frame_ring_overflows_total Frames dropped on a full ring\n");
+    rtmp_metrics_printf(&buffer, "# TYPE rtmp_frame_ring_overflows_total counter\nrtmp_frame_ring_overflows_total %llu\n",
+                        (unsigned long long)global.ring_overflows);
+
+    rtmp_metrics_prometheus_series(&buffer, samples, count, "rtmp_connection_bytes_in_total", "counter",
+                                   "Media bytes received", RTMP_METRICS_FIELD_BYTES_IN);
+    rtmp_metrics_prometheus_series(&buffer, samples, count, "rtmp_connection_bytes_out_total", "counter",
+                                   "Bytes written to the socket", RTMP_METRICS_FIELD_BYTES_OUT);
+    rtmp_metrics_prometheus_series(&buffer, samples, count, "rtmp_connection_bitrate_in_bps", "gauge",
+                                   "Receive bitrate over the latest window", RTMP_METRICS_FIELD_BITRATE_IN);
+    rtmp_metrics_prometheus_series(&buffer, samples, count, "rtmp_connection_bitrate_out_bps", "gauge",
+                                   "Send bitrate over the latest window", RTMP_METRICS_FIELD_BITRATE_OUT);
+    rtmp_metrics_prometheus_series(&buffer, samples, count, "rtmp_connection_frame_rate", "gauge",
+                                   "Video frames per second over the latest window", RTMP_METRICS_FIELD_FRAME_RATE);
+    rtmp_metrics_prometheus_series(&buffer, samples, count, "rtmp_connection_dropped_frames_total", "counter",
+                                   "Video messages shed from the send queue", RTMP_METRICS_FIELD_DROPPED);
+    rtmp_metrics_prometheus_series(&buffer, samples, count, "rtmp_connection_queue_depth", "gauge",
+                                   "Messages waiting in the send queue", RTMP_METRICS_FIELD_QUEUE_DEPTH);
+    rtmp_metrics_prometheus_series(&buffer, samples, count, "rtmp_connection_queue_bytes", "gauge",
+                                   "Payload bytes waiting in the send queue", RTMP_METRICS_FIELD_QUEUE_BYTES);
+    rtmp_metrics_prometheus_series(&buffer, samples, count, "rtmp_connection_handshake_latency_ms", "gauge",
+                                   "Time from accept to handshake completion", RTMP_METRICS_FIELD_HANDSHAKE_MS);
+
+    free(samples);
+    if (buffer.failed) {
+        free(buffer.data);
+        return NULL;
+    }
+    if (length) *length = buffer.length;
+    return buffer.data;
+}
+
+char* rtmp_metrics_render_json(size_t* length) {
+    rtmp_metrics_buffer_t buffer = { NULL, 0, 0, false };
+    rtmp_metrics_global_t global;
+    rtmp_metrics_sample_t* samples = NULL;
+    uint32_t count = rtmp_metrics_collect(&samples);
+
+    rtmp_metrics_global(&global);
+    rtmp_metrics_printf(&buffer, "{\"connections\":%u,\"handshakes_in_progress\":%u,\"admission_rejected\":%llu,"
+                        "\"frame_ring_occupancy\":%u,\"frame_ring_overflows\":%llu,\"clients\":[",
+                        global.connections, global.handshakes, (unsigned long long)global.rejected,
+                        global.ring_occupancy, (unsigned long long)global.ring_overflows);
+
+    for (uint32_t i = 0; i < count; i++) {
+        rtmp_metrics_sample_t* sample = &samples[i];
+        rtmp_metrics_printf(&buffer, "%s{\"fd\":%d,\"role\":\"%s\",\"stream\":\"", i ? "," : "",
+                            sample->slot.fd, rtmp_metrics_role_string(sample->slot.role));
+        rtmp_metrics_escape(&buffer, sample->slot.stream, true);
+        rtmp_metrics_printf(&buffer, "\",\"bytes_in\":%llu,\"bytes_out\":%llu,\"bitrate_in_bps\":%.0f,"
+                            "\"bitrate_out_bps\":%.0f,\"frame_rate\":%.2f,\"dropped_frames\":%llu,"
+                            "\"queue_depth\":%llu,\"queue_bytes\":%llu,\"handshake_latency_ms\":%llu}",
+                            (unsigned long long)sample->slot.bytes_in,
+                            (unsigned long long)sample->slot.bytes_out,
+                            rtmp_metrics_field(sample, RTMP_METRICS_FIELD_BITRATE_IN),
+                            rtmp_metrics_field(sample, RTMP_METRICS_FIELD_BITRATE_OUT),
+                            rtmp_metrics_field(sample, RTMP_METRICS_FIELD_FRAME_RATE),
+                            (unsigned long long)sample->slot.dropped_frames,
+                            (unsigned long long)sample->slot.queue_depth,
+                            (unsigned long long)sample->slot.queue_bytes,
+                            (unsigned long long)sample->slot.handshake_ms);
+    }
+    rtmp_metrics_printf(&buffer, "]}\n");
+
+    free(samples);
+    if (buffer.failed) {
+        free(buffer.data);
+        return NULL;
+    }
+    if (length) *length = buffer.length;
+    return buffer.data;
+}
+
+static uint64_t rtmp_metrics_clock_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+// Add a segment of free slots, lowest first; caller holds metrics_alloc_lock
+static void rtmp_metrics_grow(void) {
+    uint32_t count = metrics_segment_count;
+    if (count == RTMP_METRICS_MAX_SEGMENTS) return;
+
+    rtmp_metrics_slot_t* segment = calloc(RTMP_METRICS_SEGMENT_SLOTS, sizeof(rtmp_metrics_slot_t));
+    rtmp_metrics_rate_t* rates = calloc(RTMP_METRICS_SEGMENT_SLOTS, sizeof(rtmp_metrics_rate_t));
+    if (!segment || !rates) {
+        free(segment);
+        free(rates);
+        return;
+    }
+
+    for (uint32_t i = RTMP_METRICS_SEGMENT_SLOTS; i-- > 0;) {
+        segment[i].next_free = metrics_free;
+        metrics_free = &segment[i];
+    }
+    metrics_segments[count] = segment;
+    metrics_rates[count] = rates;
+    __atomic_store_n(&metrics_segment_count, count + 1, __ATOMIC_RELEASE);
+}
+
+// Seqlock read: retry while a writer rewrites the identity fields
+static bool rtmp_metrics_snapshot(const rtmp_metrics_slot_t* slot, rtmp_metrics_slot_t* copy) {
+    for (int attempt = 0; attempt < 4; attempt++) {
+        if (!__atomic_load_n(&slot->used, __ATOMIC_ACQUIRE)) return false;
+
+        uint32_t before = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (before & 1) continue;
+
+        copy->generation = slot->generation;
+        copy->fd = slot->fd;
+        copy->role = slot->role;
+        memcpy(copy->stream, slot->stream, sizeof(copy->stream));
+        copy->stream[sizeof(copy->stream) - 1] = '\0';
+        copy->connect_ms = __atomic_load_n(&slot->connect_ms, __ATOMIC_RELAXED);
+        copy->handshake_ms = __atomic_load_n(&slot->handshake_ms, __ATOMIC_RELAXED);
+        copy->bytes_in = __atomic_load_n(&slot->bytes_in, __ATOMIC_RELAXED);
+        copy->bytes_out = __atomic_load_n(&slot->bytes_out, __ATOMIC_RELAXED);
+        copy->video_frames = __atomic_load_n(&slot->video_frames, __ATOMIC_RELAXED);
+        copy->audio_frames = __atomic_load_n(&slot->audio_frames, __ATOMIC_RELAXED);
+        copy->dropped_frames = __atomic_load_n(&slot->dropped_frames, __ATOMIC_RELAXED);
+        copy->queue_depth = __atomic_load_n(&slot->queue_depth, __ATOMIC_RELAXED);
+        copy->queue_bytes = __atomic_load_n(&slot->queue_bytes, __ATOMIC_RELAXED);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == before) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Copy every live slot; returns the number of samples
+static uint32_t rtmp_metrics_collect(rtmp_metrics_sample_t** samples) {
+    uint32_t segments = __atomic_load_n(&metrics_segment_count, __ATOMIC_ACQUIRE);
+    *samples = malloc((size_t)segments * RTMP_METRICS_SEGMENT_SLOTS * sizeof(rtmp_metrics_sample_t));
+    if (!*samples) return 0;
+
+    uint64_t now = rtmp_metrics_clock_ms();
+    uint32_t count = 0;
+    pthread_mutex_lock(&metrics_rate_lock);
+    for (uint32_t i = 0; i < segments * RTMP_METRICS_SEGMENT_SLOTS; i++) {
+        uint32_t segment = i / RTMP_METRICS_SEGMENT_SLOTS;
+        uint32_t index = i % RTMP_METRICS_SEGMENT_SLOTS;
+        rtmp_metrics_sample_t* sample = &(*samples)[count];
+        if (rtmp_metrics_snapshot(&metrics_segments[segment][index], &sample->slot)) {
+            rtmp_metrics_rate(&metrics_rates[segment][index], sample, now);
+            count++;
+        }
+    }
+    pthread_mutex_unlock(&metrics_rate_lock);
+    return count;
+}
+
+// Rates over the latest window of at least RTMP_METRICS_RATE_WINDOW_MS, so a
+// stall shows up within a scrape or two; scrapes closer together repeat the
+// last window. A connection younger than one window reports since connect.
+static void rtmp_metrics_rate(rtmp_metrics_rate_t* rate, rtmp_metrics_sample_t* sample, uint64_t now) {
+    const rtmp_metrics_slot_t* slot = &sample->slot;
+    if (rate->generation != slot->generation) {
+        memset(rate, 0, sizeof(rtmp_metrics_rate_t));
+        rate->generation = slot->generation;
+        rate->since_ms = slot->connect_ms;
+    }
+
+    uint64_t elapsed = now > rate->since_ms ? now - rate->since_ms : 0;
+    if (!rate->windowed || elapsed >= RTMP_METRICS_RATE_WINDOW_MS) {
+        double seconds = elapsed ? elapsed / 1000.0 : 1;
+        rate->bitrate_in = (slot->bytes_in - rate->bytes_in) * 8.0 / seconds;
+        rate->bitrate_out = (slot->bytes_out - rate->bytes_out) * 8.0 / seconds;
+        rate->frame_rate = (slot->video_frames - rate->video_frames) / seconds;
+    }
+    if (elapsed >= RTMP_METRICS_RATE_WINDOW_MS) {
+        rate->windowed = true;
+        rate->since_ms = now;
+        rate->bytes_in = slot->bytes_in;
+        rate->bytes_out = slot->bytes_out;
+        rate->video_frames = slot->video_frames;
+    }
+
+    sample->bitrate_in = rate->bitrate_in;
+    sample->bitrate_out = rate->bitrate_out;
+    sample->frame_rate = rate->frame_rate;
+}
+
+static void rtmp_metrics_global(rtmp_metrics_global_t* global) {
+    memset(global, 0, sizeof(rtmp_metrics_global_t));
+    if (endpoint.collector) {
+        endpoint.collector(global, endpoint.userdata);
+    }
+}
+
+static void rtmp_metrics_printf(rtmp_metrics_buffer_t* buffer, const char* format, ...) {
+    if (buffer->failed) return;
+
+    for (;;) {
+        size_t room = buffer->capacity - buffer->length;
+        va_list args;
+        va_start(args, format);
+        int written = room ? vsnprintf(buffer->data + buffer->length, room, format, args) : -1;
+        va_end(args);
+
+        if (written >= 0 && (size_t)written < room) {
+            buffer->length += (size_t)written;
+            return;
+        }
+
+        size_t capacity = buffer->capacity ? buffer->capacity * 2 : 4096;
+        if (written >= 0 && capacity < buffer->length + (size_t)written + 1) {
+            capacity = buffer->length + (size_t)written + 1;
+        }
+        char* data = realloc(buffer->data, capacity);
+        if (!data) {
+            buffer->failed = true;
+            return;
+        }
+        buffer->data = data;
+        buffer->capacity = capacity;
+    }
+}
+
+// Escape for a JSON string or a Prometheus label value
+static void rtmp_metrics_escape(rtmp_metrics_buffer_t* buffer, const char* text, bool json) {
+    for (const unsigned char* c = (const unsigned char*)text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            rtmp_metrics_printf(buffer, "\\%c", *c);
+        } else if (*c == '\n') {
+            rtmp_metrics_printf(buffer, "\\n");
+        } else if (*c < 0x20) {
+            if (json) rtmp_metrics_printf(buffer, "\\u%04x", *c);
+        } else {
+            rtmp_metrics_printf(buffer, "%c", *c);
+        }
+    }
+}
+
+static const char* rtmp_metrics_role_string(uint32_t role) {
+    switch (role) {
+        case RTMP_METRICS_ROLE_PUBLISHER:
+            return "publisher";
+        case RTMP_METRICS_ROLE_PLAYER:
+            return "player";
+        default:
+            return "none";
+    }
+}
+
+static void rtmp_metrics_prometheus_series(rtmp_metrics_buffer_t* buffer, rtmp_metrics_sample_t* samples,
+                                           uint32_t count, const char* name, const char* type,
+                                           const char* help, uint32_t field) {
+    rtmp_metrics_printf(buffer, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+    for (uint32_t i = 0; i < count; i++) {
+        rtmp_metrics_printf(buffer, "%s{fd=\"%d\",role=\"%s\",stream=\"", name, samples[i].slot.fd,
+                            rtmp_metrics_role_string(samples[i].slot.role));
+        rtmp_metrics_escape(buffer, samples[i].slot.stream, false);
+        rtmp_metrics_printf(buffer, "\"} %.15g\n", rtmp_metrics_field(&samples[i], field));
+    }
+}
+
+// Rates come windowed from the collector
+static double rtmp_metrics_field(const rtmp_metrics_sample_t* sample, uint32_t field) {
+    const rtmp_metrics_slot_t* slot = &sample->slot;
+
+    switch (field) {
+        case RTMP_METRICS_FIELD_BYTES_IN:
+            return (double)slot->bytes_in;
+        case RTMP_METRICS_FIELD_BYTES_OUT:
+            return (double)slot->bytes_out;
+        case RTMP_METRICS_FIELD_BITRATE_IN:
+            return sample->bitrate_in;
+        case RTMP_METRICS_FIELD_BITRATE_OUT:
+            return sample->bitrate_out;
+        case RTMP_METRICS_FIELD_FRAME_RATE:
+            return sample->frame_rate;
+        case RTMP_METRICS_FIELD_DROPPED:
+            return (double)slot->dropped_frames;
+        case RTMP_METRICS_FIELD_QUEUE_DEPTH:
+            return (double)slot->queue_depth;
+        case RTMP_METRICS_FIELD_QUEUE_BYTES:
+            return (double)slot->queue_bytes;
+        case RTMP_METRICS_FIELD_HANDSHAKE_MS:
+            return (double)slot->handshake_ms;
+        default:
+            return 0;
+    }
+}
+
+// Bind a Unix socket, or a TCP port on loopback only
+static int rtmp_metrics_open(const char* address) {
+    int sock = -1;
+
+    if (strncmp(address, "unix:", 5) == 0) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(address + 5) >= sizeof(addr.sun_path)) return -1;
+        strcpy(addr.sun_path, address + 5);
+
+        sock = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (sock < 0) return -1;
+        unlink(addr.sun_path);
+        if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            close(sock);
+            return -1;
+        }
+        strcpy(endpoint.unix_path, addr.sun_path);
+    } else if (strncmp(address, "tcp:", 4) == 0) {
+        int port = atoi(address + 4);
+        if (port <= 0 || port > 65535) return -1;
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons((uint16_t)port);
+
+        sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (sock < 0) return -1;
+        int reuse = 1;
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            close(sock);
+            return -1;
+        }
+    } else {
+        return -1;
+    }
+
+    if (listen(sock, 8) < 0) {
+        close(sock);
+        if (endpoint.unix_path[0]) {
+            unlink(endpoint.unix_path);
+            endpoint.unix_path[0] = '\0';
+        }
+        return -1;
+    }
+    return sock;
+}
+
+// One scrape at a time; nothing here takes a lock the media path uses
+static void* rtmp_metrics_thread(void* arg) {
+    struct pollfd pfd = { endpoint.listen_socket, POLLIN, 0 };
+
+    while (endpoint.running) {
+        int ready = poll(&pfd, 1, RTMP_METRICS_POLL_MS);
+        if (ready <= 0) continue;
+
+        int client = accept(endpoint.listen_socket, NULL, NULL);
+        if (client < 0) continue;
+
+        struct timeval timeout = { 1, 0 };
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#ifdef SO_NOSIGPIPE
+        int nosigpipe = 1;
+        setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &nosigpipe, sizeof(nosigpipe));
+#endif
+        rtmp_metrics_serve(client);
+        close(client);
+    }
+
+    return NULL;
+}
+
+// Minimal HTTP/1.0: read the request line, answer and close
+static void rtmp_metrics_serve(int client) {
+    char request[1024];
+    size_t received = 0;
+
+    while (received < sizeof(request) - 1) {
+        ssize_t n = recv(client, request + received, sizeof(request) - 1 - received, 0);
+        if (n <= 0) break;
+        received += (size_t)n;
+        request[received] = '\0';
+        if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) break;
+    }
+    request[received] = '\0';
+
+    const char* status = "404 Not Found";
+    const char* type = "text/plain";
+    char* body = NULL;
+    size_t length = 0;
+
+    if (strncmp(request, "GET /metrics.json ", 18) == 0) {
+        body = rtmp_metrics_render_json(&length);
+        type = "application/json";
+        status = body ? "200 OK" : "500 Internal Server Error";
+    } else if (strncmp(request, "GET /metrics ", 13) == 0) {
+        body = rtmp_metrics_render_prometheus(&length);
+        type = "text/plain; version=0.0.4";
+        status = body ? "200 OK" : "500 Internal Server Error";
+    }
+
+    char header[256];
+    int header_length = snprintf(header, sizeof(header),
+                                 "HTTP/1.0 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                                 status, type, length);
+
+    send(client, header, (size_t)header_length, RTMP_METRICS_SEND_FLAGS);
+    for (size_t sent = 0; body && sent < length;) {
+        ssize_t n = send(client, body + sent, length - sent, RTMP_METRICS_SEND_FLAGS);
+        if (n <= 0) break;
+        sent += (size_t)n;
+    }
+    free(body);
+}
@@ -0,0 +1,80 @@
+// rtmp_metrics.h
+#ifndef RTMP_METRICS_H
+#define RTMP_METRICS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Metrics configurations
+#define RTMP_METRICS_SEGMENT_SLOTS 256   // Slots added each time the table runs out
+#define RTMP_METRICS_MAX_SEGMENTS 4096
+#define RTMP_METRICS_NAME_SIZE 256
+#define RTMP_METRICS_POLL_MS 100
+#define RTMP_METRICS_RATE_WINDOW_MS 1000    // Shortest span a reported rate covers
+
+// Connection roles
+typedef enum {
+    RTMP_METRICS_ROLE_NONE = 0,
+    RTMP_METRICS_ROLE_PUBLISHER,
+    RTMP_METRICS_ROLE_PLAYER
+} rtmp_metrics_role_t;
+
+// Per-connection counters. Writers update them with relaxed atomics from
+// whatever thread touches the connection; the scraper reads them without
+// locks. The identity fields are guarded by seq (odd while rewritten).
+typedef struct rtmp_metrics_slot {
+    uint32_t used;
+    uint32_t seq;
+    uint32_t generation;            // Bumped on every acquire so the scraper sees reuse
+    int32_t fd;
+    uint32_t role;
+    char stream[RTMP_METRICS_NAME_SIZE];
+    uint64_t connect_ms;
+    uint64_t handshake_ms;          // Handshake latency, 0 until complete
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t video_frames;
+    uint64_t audio_frames;
+    uint64_t dropped_frames;
+    uint64_t queue_depth;           // Messages waiting in the send queue
+    uint64_t queue_bytes;
+    struct rtmp_metrics_slot* next_free;    // Allocator's free list; guarded by its lock
+} rtmp_metrics_slot_t;
+
+// Server-wide gauges, filled on demand by the collector
+typedef struct {
+    uint32_t connections;
+    uint32_t handshakes;
+    uint64_t rejected;
+    uint32_t ring_occupancy;
+    uint64_t ring_overflows;
+} rtmp_metrics_global_t;
+
+typedef void (*rtmp_metrics_collector_t)(rtmp_metrics_global_t* global, void* userdata);
+
+// Slots; the table grows a segment at a time and its slots are reused, never
+// freed. A full table hands out NULL and every update on NULL is a no-op.
+rtmp_metrics_slot_t* rtmp_metrics_acquire(int fd);
+void rtmp_metrics_release(rtmp_metrics_slot_t* slot);
+void rtmp_metrics_set_stream(rtmp_metrics_slot_t* slot, const char* stream, rtmp_metrics_role_t role);
+void rtmp_metrics_handshake_done(rtmp_metrics_slot_t* slot);
+
+static inline void rtmp_metrics_add(rtmp_metrics_slot_t* slot, uint64_t* counter, uint64_t value) {
+    if (slot) __atomic_add_fetch(counter, value, __ATOMIC_RELAXED);
+}
+
+static inline void rtmp_metrics_set(rtmp_metrics_slot_t* slot, uint64_t* gauge, uint64_t value) {
+    if (slot) __atomic_store_n(gauge, value, __ATOMIC_RELAXED);
+}
+
+// Endpoint: "unix:/path/to/socket" or "tcp:PORT" (bound to 127.0.0.1).
+// GET /metrics serves Prometheus text, GET /metrics.json serves JSON.
+bool rtmp_metrics_start(const char* address, rtmp_metrics_collector_t collector, void* userdata);
+void rtmp_metrics_stop(void);
+
+// Render into a malloc'd buffer; callers free it
+char* rtmp_metrics_render_prometheus(size_t* length);
+char* rtmp_metrics_render_json(size_t* length);
+
+#endif /* RTMP_METRICS_H */
@@ -1,4 +1,5 @@
 #include "rtmp_protocol.h"
+#include "rtmp_chunk.h"
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
@@ -87,6 +88,14 @@ bool rtmp_connect(RTMPContext *ctx, const char *host, int port) {
         ctx->socket = -1;
         return false;
     }
+
+    // Fresh chunk state per connection; disconnect drops it
+    if (!rtmp_chunk_attach(ctx)) {
+        rtmp_log(RTMP_LOG_ERROR, "Failed to allocate chunk state");
+        close(ctx->socket);
+        ctx->socket = -1;
+        return false;
+    }
     
     // Start handshake
     ctx->state = RTMP_STATE_HANDSHAKE_INIT;
@@ -116,6 +125,7 @@ void rtmp_disconnect(RTMPContext *ctx) {
         close(ctx->socket);
         ctx->socket = -1;
     }
+    rtmp_chunk_detach(ctx);
     
     ctx->state = RTMP_STATE_DISCONNECTED;
     ctx->streamId = 0;
@@ -198,156 +208,36 @@ static bool handshake_c2(RTMPContext *ctx) {
 }
 
 // Packet handling implementation
+// Headers, chunking and chunk stream choice come from the chunk writer
 bool rtmp_send_packet(RTMPContext *ctx, RTMPPacket *packet) {
     if (!ctx || !packet || ctx->socket < 0) return false;
-    
-    uint8_t header[16]; // Maximum header size
-    int headerSize;
-    
-    // Write basic header
-    header[0] = (packet->type & 0x3f) | (RTMP_CHUNK_TYPE_0 << 6);
-    headerSize = 1;
-    
-    // Write message header based on chunk type
-    if (RTMP_CHUNK_TYPE_0) {
-        uint32_t timestamp = packet->timestamp;
-        header[headerSize++] = (timestamp >> 16) & 0xff;
-        header[headerSize++] = (timestamp >> 8) & 0xff;
-        header[headerSize++] = timestamp & 0xff;
-        
-        header[headerSize++] = (packet->size >> 16) & 0xff;
-        header[headerSize++] = (packet->size >> 8) & 0xff;
-        header[headerSize++] = packet->size & 0xff;
-        header[headerSize++] = packet->type;
-        
-        header[headerSize++] = packet->streamId & 0xff;
-        header[headerSize++] = (packet->streamId >> 8) & 0xff;
-        header[headerSize++] = (packet->streamId >> 16) & 0xff;
-        header[headerSize++] = (packet->streamId >> 24) & 0xff;
-    }
 
-    // Send header
-    if (send(ctx->socket, header, headerSize, 0) != headerSize) {
-        rtmp_log(RTMP_LOG_ERROR, "Failed to send packet header");
+    if (!rtmp_chunk_write(ctx, packet)) {
+        rtmp_log(RTMP_LOG_ERROR, "Failed to send packet");
         return false;
     }
 
-    // Send payload
-    if (packet->size > 0 && packet->data) {
-        size_t chunk_size = ctx->chunkSize;
-        size_t remaining = packet->size;
-        uint8_t *data = packet->data;
-
-        while (remaining > 0) {
-            size_t send_size = remaining > chunk_size ? chunk_size : remaining;
-            if (send(ctx->socket, data, send_size, 0) != send_size) {
-                rtmp_log(RTMP_LOG_ERROR, "Failed to send packet data");
-                return false;
-            }
-
-            data += send_size;
-            remaining -= send_size;
-
-            // Write continuation header if needed
-            if (remaining > 0) {
-                uint8_t basic_header = (packet->type & 0x3f) | (RTMP_CHUNK_TYPE_3 << 6);
-                if (send(ctx->socket, &basic_header, 1, 0) != 1) {
-                    rtmp_log(RTMP_LOG_ERROR, "Failed to send continuation header");
-                    return false;
-                }
-            }
-        }
-    }
-
     return true;
 }
 
+// Blocks until a whole message is in; chunk headers, interleaving and Set
+// Chunk Size are handled by the chunk reader
 bool rtmp_read_packet(RTMPContext *ctx, RTMPPacket *packet) {
     if (!ctx || !packet || ctx->socket < 0) return false;
 
-    uint8_t header[16];
-    int headerSize = 1;
-
-    // Read basic header
-    if (recv(ctx->socket, header, 1, 0) != 1) {
-        rtmp_log(RTMP_LOG_ERROR, "Failed to read basic header");
-        return false;
-    }
-
-    uint8_t chunk_type = (header[0] >> 6) & 0x03;
-    packet->type = header[0] & 0x3f;
-
-    // Read message header based on chunk type
-    switch (chunk_type) {
-        case RTMP_CHUNK_TYPE_0:
-            headerSize = 12;
-            break;
-        case RTMP_CHUNK_TYPE_1:
-            headerSize = 8;
-            break;
-        case RTMP_CHUNK_TYPE_2:
-            headerSize = 4;
-            break;
-        case RTMP_CHUNK_TYPE_3:
-            headerSize = 1;
-            break;
-    }
-
-    // Read the rest of header
-    if (headerSize > 1) {
-        if (recv(ctx->socket, header + 1, headerSize - 1, 0) != headerSize - 1) {
-            rtmp_log(RTMP_LOG_ERROR, "Failed to read message header");
+    RTMPChunkReadResult result;
+    while ((result = rtmp_chunk_read(ctx, packet)) == RTMP_CHUNK_READ_PARTIAL) {
+        if (!rtmp_chunk_receive(ctx)) {
+            rtmp_log(RTMP_LOG_ERROR, "Failed to read packet");
             return false;
         }
-
-        if (chunk_type == RTMP_CHUNK_TYPE_0) {
-            packet->timestamp = (header[1] << 16) | (header[2] << 8) | header[3];
-            packet->size = (header[4] << 16) | (header[5] << 8) | header[6];
-            packet->type = header[7];
-            packet->streamId = (header[11] << 24) | (header[10] << 16) | 
-                             (header[9] << 8) | header[8];
-        }
     }
-
-    // Allocate and read payload
-    if (packet->size > 0) {
-        packet->data = (uint8_t *)malloc(packet->size);
-        if (!packet->data) {
-            rtmp_log(RTMP_LOG_ERROR, "Failed to allocate packet data");
-            return false;
-        }
-
-        size_t chunk_size = ctx->chunkSize;
-        size_t remaining = packet->size;
-        uint8_t *data = packet->data;
-
-        while (remaining > 0) {
-            size_t read_size = remaining > chunk_size ? chunk_size : remaining;
-            if (recv(ctx->socket, data, read_size, 0) != read_size) {
-                rtmp_log(RTMP_LOG_ERROR, "Failed to read packet data");
-                free(packet->data);
-                packet->data = NULL;
-                return false;
-            }
-
-            data += read_size;
-            remaining -= read_size;
-
-            // Read continuation header if needed
-            if (remaining > 0) {
-                uint8_t basic_header;
-                if (recv(ctx->socket, &basic_header, 1, 0) != 1) {
-                    rtmp_log(RTMP_LOG_ERROR, "Failed to read continuation header");
-                    free(packet->data);
-                    packet->data = NULL;
-                    return false;
-                }
-            }
-        }
+    if (result == RTMP_CHUNK_READ_ERROR) {
+        rtmp_log(RTMP_LOG_ERROR, "Malformed chunk stream");
+        return false;
     }
 
-    // Update bytes received and send acknowledgement if needed
-    ctx->bytesReceived += packet->size + headerSize;
+    // Acknowledge once a window's worth has arrived
     if (ctx->bytesReceived - ctx->lastAckSize >= ctx->windowAckSize) {
         rtmp_send_ack(ctx, ctx->bytesReceived);
         ctx->lastAckSize = ctx->bytesReceived;
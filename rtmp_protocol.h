@@ -90,7 +90,7 @@ bool rtmp_connect(RTMPContext *ctx, const char *host, int port);
 void rtmp_disconnect(RTMPContext *ctx);
 bool rtmp_is_connected(RTMPContext *ctx);
 
-// Message handling
+// Message handling; a read packet's data goes back with rtmp_chunk_release_packet
 bool rtmp_send_packet(RTMPContext *ctx, RTMPPacket *packet);
 bool rtmp_read_packet(RTMPContext *ctx, RTMPPacket *packet);
 void rtmp_handle_packet(RTMPContext *ctx, RTMPPacket *packet);
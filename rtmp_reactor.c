@@ -0,0 +1,340 @@
+// rtmp_reactor.c
+#include "rtmp_reactor.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#define RTMP_REACTOR_USE_EPOLL 1
+#else
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/time.h>
+#define RTMP_REACTOR_USE_KQUEUE 1
+#endif
+
+// Registered descriptor
+struct rtmp_reactor_handle {
+    int fd;
+    uint32_t events;
+    bool dead;
+    rtmp_reactor_callback_t callback;
+    void* userdata;
+    struct rtmp_reactor_handle* next_dead;
+};
+
+// Event loop
+struct rtmp_reactor {
+    int poll_fd;
+    int wakeup_pipe[2];
+    pthread_t thread;
+    bool running;
+    bool started;
+    uint64_t now_ms;
+    uint32_t num_handles;
+    rtmp_reactor_tick_callback_t tick_callback;
+    void* tick_userdata;
+    uint64_t last_tick_ms;
+    rtmp_reactor_handle_t* wakeup_handle;
+    rtmp_reactor_handle_t* dead_handles;
+    pthread_mutex_t lock;
+};
+
+// Forward declarations of internal functions
+static void* rtmp_reactor_thread(void* arg);
+static bool rtmp_reactor_ctl(rtmp_reactor_t* reactor, rtmp_reactor_handle_t* handle,
+                             uint32_t old_events, uint32_t new_events);
+static void rtmp_reactor_free_dead(rtmp_reactor_t* reactor);
+static void rtmp_reactor_dispatch(rtmp_reactor_t* reactor, rtmp_reactor_handle_t* handle, uint32_t events);
+
+uint64_t rtmp_reactor_clock_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+// Create reactor
+rtmp_reactor_t* rtmp_reactor_create(void) {
+    rtmp_reactor_t* reactor = calloc(1, sizeof(rtmp_reactor_t));
+    if (!reactor) return NULL;
+
+#if RTMP_REACTOR_USE_EPOLL
+    reactor->poll_fd = epoll_create1(EPOLL_CLOEXEC);
+#else
+    reactor->poll_fd = kqueue();
+#endif
+    if (reactor->poll_fd < 0) {
+        free(reactor);
+        return NULL;
+    }
+
+    // Self-pipe used to interrupt the wait on stop
+    if (pipe(reactor->wakeup_pipe) < 0) {
+        close(reactor->poll_fd);
+        free(reactor);
+        return NULL;
+    }
+    for (int i = 0; i < 2; i++) {
+        int flags = fcntl(reactor->wakeup_pipe[i], F_GETFL, 0);
+        fcntl(reactor->wakeup_pipe[i], F_SETFL, flags | O_NONBLOCK);
+    }
+
+    pthread_mutex_init(&reactor->lock, NULL);
+    reactor->now_ms = rtmp_reactor_clock_ms();
+
+    // The wakeup handle carries no callback and is never dispatched
+    reactor->wakeup_handle = rtmp_reactor_add(reactor, reactor->wakeup_pipe[0],
+                                              RTMP_REACTOR_EVENT_READ, NULL, NULL);
+    if (!reactor->wakeup_handle) {
+        rtmp_reactor_destroy(reactor);
+        return NULL;
+    }
+    reactor->num_handles--;
+
+    return reactor;
+}
+
+// Destroy reactor
+void rtmp_reactor_destroy(rtmp_reactor_t* reactor) {
+    if (!reactor) return;
+
+    rtmp_reactor_stop(reactor);
+    rtmp_reactor_free_dead(reactor);
+    free(reactor->wakeup_handle);
+
+    close(reactor->wakeup_pipe[0]);
+    close(reactor->wakeup_pipe[1]);
+    close(reactor->poll_fd);
+    pthread_mutex_destroy(&reactor->lock);
+    free(reactor);
+}
+
+// Start loop thread
+bool rtmp_reactor_start(rtmp_reactor_t* reactor) {
+    if (!reactor || reactor->started) return false;
+
+    reactor->running = true;
+    if (pthread_create(&reactor->thread, NULL, rtmp_reactor_thread, reactor) != 0) {
+        reactor->running = false;
+        return false;
+    }
+
+    reactor->started = true;
+    return true;
+}
+
+// Stop loop thread and wait for it
+void rtmp_reactor_stop(rtmp_reactor_t* reactor) {
+    if (!reactor || !reactor->started) return;
+
+    reactor->running = false;
+    uint8_t byte = 1;
+    (void)write(reactor->wakeup_pipe[1], &byte, 1);
+
+    if (!rtmp_reactor_in_loop_thread(reactor)) {
+        pthread_join(reactor->thread, NULL);
+    }
+    reactor->started = false;
+}
+
+// Register descriptor
+rtmp_reactor_handle_t* rtmp_reactor_add(rtmp_reactor_t* reactor, int fd, uint32_t events,
+                                        rtmp_reactor_callback_t callback, void* userdata) {
+    if (!reactor || fd < 0) return NULL;
+
+    rtmp_reactor_handle_t* handle = calloc(1, sizeof(rtmp_reactor_handle_t));
+    if (!handle) return NULL;
+
+    handle->fd = fd;
+    handle->callback = callback;
+    handle->userdata = userdata;
+
+    if (!rtmp_reactor_ctl(reactor, handle, 0, events)) {
+        free(handle);
+        return NULL;
+    }
+    handle->events = events;
+
+    pthread_mutex_lock(&reactor->lock);
+    reactor->num_handles++;
+    pthread_mutex_unlock(&reactor->lock);
+
+    return handle;
+}
+
+// Change interest set
+bool rtmp_reactor_modify(rtmp_reactor_t* reactor, rtmp_reactor_handle_t* handle, uint32_t events) {
+    if (!reactor || !handle || handle->dead) return false;
+    if (handle->events == events) return true;
+
+    if (!rtmp_reactor_ctl(reactor, handle, handle->events, events)) {
+        return false;
+    }
+    handle->events = events;
+    return true;
+}
+
+// Unregister descriptor; the handle is freed once the current dispatch batch is done
+void rtmp_reactor_remove(rtmp_reactor_t* reactor, rtmp_reactor_handle_t* handle) {
+    if (!reactor || !handle) return;
+
+    pthread_mutex_lock(&reactor->lock);
+    if (handle->dead) {
+        pthread_mutex_unlock(&reactor->lock);
+        return;
+    }
+    handle->dead = true;
+    rtmp_reactor_ctl(reactor, handle, handle->events, 0);
+    handle->next_dead = reactor->dead_handles;
+    reactor->dead_handles = handle;
+    reactor->num_handles--;
+    pthread_mutex_unlock(&reactor->lock);
+}
+
+void rtmp_reactor_set_tick_callback(rtmp_reactor_t* reactor, rtmp_reactor_tick_callback_t callback, void* userdata) {
+    if (!reactor) return;
+    reactor->tick_callback = callback;
+    reactor->tick_userdata = userdata;
+}
+
+// Loop time cached once per wakeup, cheap enough for per-chunk use
+uint64_t rtmp_reactor_now_ms(rtmp_reactor_t* reactor) {
+    if (!reactor) return rtmp_reactor_clock_ms();
+    return reactor->now_ms;
+}
+
+bool rtmp_reactor_in_loop_thread(rtmp_reactor_t* reactor) {
+    return reactor && reactor->started && pthread_equal(reactor->thread, pthread_self());
+}
+
+uint32_t rtmp_reactor_get_num_handles(rtmp_reactor_t* reactor) {
+    return reactor ? reactor->num_handles : 0;
+}
+
+// Loop thread function
+static void* rtmp_reactor_thread(void* arg) {
+    rtmp_reactor_t* reactor = (rtmp_reactor_t*)arg;
+
+#if RTMP_REACTOR_USE_EPOLL
+    struct epoll_event events[RTMP_REACTOR_MAX_EVENTS];
+#else
+    struct kevent events[RTMP_REACTOR_MAX_EVENTS];
+#endif
+
+    reactor->last_tick_ms = rtmp_reactor_clock_ms();
+
+    while (reactor->running) {
+#if RTMP_REACTOR_USE_EPOLL
+        int count = epoll_wait(reactor->poll_fd, events, RTMP_REACTOR_MAX_EVENTS, RTMP_REACTOR_TICK_MS);
+#else
+        struct timespec timeout = { 0, RTMP_REACTOR_TICK_MS * 1000000L };
+        int count = kevent(reactor->poll_fd, NULL, 0, events, RTMP_REACTOR_MAX_EVENTS, &timeout);
+#endif
+        if (count < 0 && errno != EINTR) {
+            break;
+        }
+
+        reactor->now_ms = rtmp_reactor_clock_ms();
+
+        for (int i = 0; i < count; i++) {
+#if RTMP_REACTOR_USE_EPOLL
+            rtmp_reactor_handle_t* handle = (rtmp_reactor_handle_t*)events[i].data.ptr;
+            uint32_t flags = 0;
+            if (events[i].events & EPOLLIN) flags |= RTMP_REACTOR_EVENT_READ;
+            if (events[i].events & EPOLLOUT) flags |= RTMP_REACTOR_EVENT_WRITE;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) flags |= RTMP_REACTOR_EVENT_ERROR;
+#else
+            rtmp_reactor_handle_t* handle = (rtmp_reactor_handle_t*)events[i].udata;
+            uint32_t flags = 0;
+            if (events[i].filter == EVFILT_READ) flags |= RTMP_REACTOR_EVENT_READ;
+            if (events[i].filter == EVFILT_WRITE) flags |= RTMP_REACTOR_EVENT_WRITE;
+            if (events[i].flags & EV_ERROR) flags |= RTMP_REACTOR_EVENT_ERROR;
+#endif
+            rtmp_reactor_dispatch(reactor, handle, flags);
+        }
+
+        // Periodic services
+        if (reactor->tick_callback && reactor->now_ms - reactor->last_tick_ms >= RTMP_REACTOR_TICK_MS) {
+            reactor->last_tick_ms = reactor->now_ms;
+            reactor->tick_callback(reactor, reactor->now_ms, reactor->tick_userdata);
+        }
+
+        rtmp_reactor_free_dead(reactor);
+    }
+
+    return NULL;
+}
+
+// Dispatch events for one handle
+static void rtmp_reactor_dispatch(rtmp_reactor_t* reactor, rtmp_reactor_handle_t* handle, uint32_t events) {
+    if (!handle || handle->dead) return;
+
+    // Drain wakeup pipe
+    if (handle->fd == reactor->wakeup_pipe[0]) {
+        uint8_t buf[64];
+        while (read(handle->fd, buf, sizeof(buf)) > 0) {}
+        return;
+    }
+
+    if (handle->callback) {
+        handle->callback(reactor, handle->fd, events, handle->userdata);
+    }
+}
+
+// Apply interest change to the kernel
+static bool rtmp_reactor_ctl(rtmp_reactor_t* reactor, rtmp_reactor_handle_t* handle,
+                             uint32_t old_events, uint32_t new_events) {
+#if RTMP_REACTOR_USE_EPOLL
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.data.ptr = handle;
+    if (new_events & RTMP_REACTOR_EVENT_READ) ev.events |= EPOLLIN | EPOLLRDHUP;
+    if (new_events & RTMP_REACTOR_EVENT_WRITE) ev.events |= EPOLLOUT;
+
+    if (!new_events) {
+        return epoll_ctl(reactor->poll_fd, EPOLL_CTL_DEL, handle->fd, &ev) == 0 || errno == ENOENT || errno == EBADF;
+    }
+
+    // An empty interest set is unregistered above, so ADD whenever there was none
+    int op = old_events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    return epoll_ctl(reactor->poll_fd, op, handle->fd, &ev) == 0;
+#else
+    struct kevent changes[2];
+    int n = 0;
+
+    uint32_t toggled = old_events ^ new_events;
+    if (toggled & RTMP_REACTOR_EVENT_READ) {
+        EV_SET(&changes[n++], handle->fd, EVFILT_READ,
+               (new_events & RTMP_REACTOR_EVENT_READ) ? EV_ADD : EV_DELETE, 0, 0, handle);
+    }
+    if (toggled & RTMP_REACTOR_EVENT_WRITE) {
+        EV_SET(&changes[n++], handle->fd, EVFILT_WRITE,
+               (new_events & RTMP_REACTOR_EVENT_WRITE) ? EV_ADD : EV_DELETE, 0, 0, handle);
+    }
+    if (n == 0) return true;
+
+    if (kevent(reactor->poll_fd, changes, n, NULL, 0, NULL) < 0) {
+        return !new_events && (errno == ENOENT || errno == EBADF);
+    }
+    return true;
+#endif
+}
+
+// Free handles removed since the last iteration
+static void rtmp_reactor_free_dead(rtmp_reactor_t* reactor) {
+    pthread_mutex_lock(&reactor->lock);
+    rtmp_reactor_handle_t* handle = reactor->dead_handles;
+    reactor->dead_handles = NULL;
+    pthread_mutex_unlock(&reactor->lock);
+
+    while (handle) {
+        rtmp_reactor_handle_t* next = handle->next_dead;
+        free(handle);
+        handle = next;
+    }
+}
@@ -0,0 +1,46 @@
+// rtmp_reactor.h
+#ifndef RTMP_REACTOR_H
+#define RTMP_REACTOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Event flags
+#define RTMP_REACTOR_EVENT_READ  (1u << 0)
+#define RTMP_REACTOR_EVENT_WRITE (1u << 1)
+#define RTMP_REACTOR_EVENT_ERROR (1u << 2)
+
+// Reactor configurations
+#define RTMP_REACTOR_MAX_EVENTS 256
+#define RTMP_REACTOR_TICK_MS 100
+
+// Opaque types
+typedef struct rtmp_reactor rtmp_reactor_t;
+typedef struct rtmp_reactor_handle rtmp_reactor_handle_t;
+
+// Callback function prototypes
+typedef void (*rtmp_reactor_callback_t)(rtmp_reactor_t* reactor, int fd, uint32_t events, void* userdata);
+typedef void (*rtmp_reactor_tick_callback_t)(rtmp_reactor_t* reactor, uint64_t now_ms, void* userdata);
+
+// Reactor lifecycle
+rtmp_reactor_t* rtmp_reactor_create(void);
+void rtmp_reactor_destroy(rtmp_reactor_t* reactor);
+bool rtmp_reactor_start(rtmp_reactor_t* reactor);
+void rtmp_reactor_stop(rtmp_reactor_t* reactor);
+
+// Descriptor registration (thread-safe, callbacks always run on the loop thread)
+rtmp_reactor_handle_t* rtmp_reactor_add(rtmp_reactor_t* reactor, int fd, uint32_t events,
+                                        rtmp_reactor_callback_t callback, void* userdata);
+bool rtmp_reactor_modify(rtmp_reactor_t* reactor, rtmp_reactor_handle_t* handle, uint32_t events);
+void rtmp_reactor_remove(rtmp_reactor_t* reactor, rtmp_reactor_handle_t* handle);
+
+// Loop services
+void rtmp_reactor_set_tick_callback(rtmp_reactor_t* reactor, rtmp_reactor_tick_callback_t callback, void* userdata);
+uint64_t rtmp_reactor_now_ms(rtmp_reactor_t* reactor);
+bool rtmp_reactor_in_loop_thread(rtmp_reactor_t* reactor);
+uint32_t rtmp_reactor_get_num_handles(rtmp_reactor_t* reactor);
+
+// Monotonic clock in milliseconds
+uint64_t rtmp_reactor_clock_ms(void);
+
+#endif /* RTMP_REACTOR_H */
@@ -0,0 +1,660 @@
+// rtmp_record.c
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+#include "rtmp_record.h"
+#include "rtmp_flv.h"
+#include "rtmp_amf.h"
+#include <pthread.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#if defined(__linux__)
+#include <linux/falloc.h>
+#define RTMP_RECORD_USE_FALLOCATE 1
+#elif defined(F_PREALLOCATE)
+#define RTMP_RECORD_USE_PREALLOCATE 1
+#endif
+
+// FLV file layout: header, PreviousTagSize0, the reserved onMetaData tag, then media
+#define RTMP_RECORD_FLV_HEADER_SIZE 9
+#define RTMP_RECORD_FLV_AUDIO 0x04
+#define RTMP_RECORD_FLV_VIDEO 0x01
+#define RTMP_RECORD_MSG_DATA 18
+#define RTMP_RECORD_METADATA_OFFSET (RTMP_RECORD_FLV_HEADER_SIZE + RTMP_FLV_TAG_TRAILER_SIZE)
+#define RTMP_RECORD_MEDIA_OFFSET (RTMP_RECORD_METADATA_OFFSET + RTMP_FLV_TAG_HEADER_SIZE + \
+                                  RTMP_RECORD_METADATA_BYTES + RTMP_FLV_TAG_TRAILER_SIZE)
+#define RTMP_RECORD_METADATA_FIXED 1024     // Everything in onMetaData but the index arrays
+#define RTMP_RECORD_INDEX_ENTRY 18          // Two AMF numbers per keyframe
+
+// One queued tag, or the file's creation when msg is NULL
+typedef struct {
+    rtmp_recording_t* recording;
+    rtmp_msgbuf_t* msg;
+} rtmp_record_entry_t;
+
+struct rtmp_recording {
+    char path[RTMP_RECORD_PATH_SIZE];
+    bool failed;                        // Set by the writer, read by the producer
+    bool skip_video;                    // Producer owned: waiting for a keyframe after a drop
+    struct rtmp_recording* next;        // Open recordings, guarded by the writer lock
+    struct rtmp_recording* next_closing;
+
+    // Writer owned
+    int fd;
+    uint64_t offset;
+    uint64_t allocated;
+    bool started;
+    uint32_t base_timestamp;
+    uint32_t duration_ms;
+    bool has_video;
+    bool has_audio;
+    uint32_t video_codec;
+    uint32_t audio_codec;
+    uint32_t width;
+    uint32_t height;
+    uint32_t frame_rate;
+    uint32_t sample_rate;
+    uint32_t channels;
+    uint64_t* keyframe_positions;
+    uint32_t* keyframe_times;
+    uint32_t num_keyframes;
+    uint32_t max_keyframes;
+};
+
+// Producers append under lock; the writer swaps the array out whole
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    rtmp_record_entry_t* entries;
+    uint32_t count;
+    uint32_t capacity;
+    rtmp_recording_t* recordings;
+    rtmp_recording_t* closing;          // Finished once the tags queued before their close are written
+    uint32_t num_recordings;
+    uint64_t queued_bytes;
+    uint64_t written_bytes;
+    uint64_t dropped;
+    bool running;
+    pthread_t thread;
+} rtmp_record_writer_t;
+
+// Private variables
+static rtmp_record_writer_t writer = { .lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER };
+
+// Forward declarations of internal functions
+static bool rtmp_record_push(rtmp_recording_t* recording, rtmp_msgbuf_t* msg);
+static void* rtmp_record_thread(void* arg);
+static uint64_t rtmp_record_process(rtmp_record_entry_t* entries, uint32_t count);
+static void rtmp_record_create(rtmp_recording_t* recording);
+static int rtmp_record_open_exclusive(rtmp_recording_t* recording);
+static void rtmp_record_append(rtmp_recording_t* recording, const rtmp_record_entry_t* entries, uint32_t count);
+static uint32_t rtmp_record_track(rtmp_recording_t* recording, const rtmp_msgbuf_t* msg, uint64_t position);
+static void rtmp_record_reserve(rtmp_recording_t* recording, uint64_t end);
+static bool rtmp_record_writev_all(int fd, struct iovec* iov, int count);
+static void rtmp_record_finish(rtmp_recording_t* recording);
+static bool rtmp_record_encode_metadata(const rtmp_recording_t* recording, uint8_t* out);
+static void rtmp_record_put_number(uint8_t** out, uint32_t* count, const char* name, double value);
+static void rtmp_record_put_boolean(uint8_t** out, uint32_t* count, const char* name, bool value);
+static void rtmp_record_put_index(uint8_t** out, const char* name, const rtmp_recording_t* recording,
+                                  uint32_t entries, uint32_t stride, bool times);
+
+bool rtmp_record_start(void) {
+    pthread_mutex_lock(&writer.lock);
+    bool started = writer.running;
+    if (!started) {
+        writer.running = true;
+        started = pthread_create(&writer.thread, NULL, rtmp_record_thread, NULL) == 0;
+        writer.running = started;
+    }
+    pthread_mutex_unlock(&writer.lock);
+    return started;
+}
+
+// Recordings still open are finished here and must not be used afterwards
+void rtmp_record_stop(void) {
+    pthread_mutex_lock(&writer.lock);
+    bool running = writer.running;
+    writer.running = false;
+    pthread_cond_signal(&writer.wake);
+    pthread_mutex_unlock(&writer.lock);
+
+    if (running) {
+        pthread_join(writer.thread, NULL);
+    }
+}
+
+rtmp_recording_t* rtmp_record_open(const char* path) {
+    if (!path || strlen(path) >= RTMP_RECORD_PATH_SIZE) return NULL;
+
+    rtmp_recording_t* recording = calloc(1, sizeof(rtmp_recording_t));
+    if (!recording) return NULL;
+    strcpy(recording->path, path);
+    recording->fd = -1;
+
+    pthread_mutex_lock(&writer.lock);
+    bool queued = writer.running && rtmp_record_push(recording, NULL);
+    if (queued) {
+        recording->next = writer.recordings;
+        writer.recordings = recording;
+        writer.num_recordings++;
+    }
+    pthread_mutex_unlock(&writer.lock);
+
+    if (!queued) {
+        free(recording);
+        return NULL;
+    }
+    return recording;
+}
+
+// Queue audio or video; only ever waits for the queue lock
+void rtmp_record_write(rtmp_recording_t* recording, rtmp_msgbuf_t* msg) {
+    if (!recording || !msg || (msg->type != RTMP_RELAY_MSG_AUDIO && msg->type != RTMP_RELAY_MSG_VIDEO)) return;
+
+    // After a drop, video waits for the next keyframe; sequence headers always go in
+    bool is_video = msg->type == RTMP_RELAY_MSG_VIDEO;
+    rtmp_flv_video_t video;
+    bool decodable = is_video && rtmp_flv_parse_video(msg->payload, msg->length, &video) &&
+                     (video.keyframe || video.sequence_header);
+    if (is_video && recording->skip_video && !decodable) {
+        __atomic_add_fetch(&writer.dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    pthread_mutex_lock(&writer.lock);
+    bool queued = writer.running && !__atomic_load_n(&recording->failed, __ATOMIC_ACQUIRE) &&
+                  writer.queued_bytes + msg->length <= RTMP_RECORD_QUEUE_BYTES && rtmp_record_push(recording, msg);
+    if (queued) {
+        writer.queued_bytes += msg->length;
+    }
+    pthread_mutex_unlock(&writer.lock);
+
+    if (!queued) {
+        __atomic_add_fetch(&writer.dropped, 1, __ATOMIC_RELAXED);
+        recording->skip_video = recording->skip_video || is_video;
+    } else if (is_video && video.keyframe) {
+        recording->skip_video = false;
+    }
+}
+
+// The writer finishes the file once every tag queued before this is written
+void rtmp_record_close(rtmp_recording_t* recording) {
+    if (!recording) return;
+
+    pthread_mutex_lock(&writer.lock);
+    recording->next_closing = writer.closing;
+    writer.closing = recording;
+    pthread_cond_signal(&writer.wake);
+    pthread_mutex_unlock(&writer.lock);
+}
+
+void rtmp_record_get_stats(rtmp_record_stats_t* stats) {
+    pthread_mutex_lock(&writer.lock);
+    stats->recordings = writer.num_recordings;
+    stats->queued_bytes = writer.queued_bytes;
+    pthread_mutex_unlock(&writer.lock);
+    stats->written_bytes = __atomic_load_n(&writer.written_bytes, __ATOMIC_RELAXED);
+    stats->dropped = __atomic_load_n(&writer.dropped, __ATOMIC_RELAXED);
+}
+
+// Append one entry; caller holds the writer lock
+static bool rtmp_record_push(rtmp_recording_t* recording, rtmp_msgbuf_t* msg) {
+    if (writer.count == writer.capacity) {
+        uint32_t capacity = writer.capacity ? writer.capacity * 2 : 256;
+        rtmp_record_entry_t* entries = realloc(writer.entries, capacity * sizeof(rtmp_record_entry_t));
+        if (!entries) return false;
+        writer.entries = entries;
+        writer.capacity = capacity;
+    }
+
+    writer.entries[writer.count].recording = recording;
+    writer.entries[writer.count].msg = rtmp_msgbuf_retain(msg);
+    if (writer.count++ == 0) {
+        pthread_cond_signal(&writer.wake);
+    }
+    return true;
+}
+
+static void* rtmp_record_thread(void* arg) {
+    rtmp_record_entry_t* batch = NULL;
+    uint32_t batch_capacity = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&writer.lock);
+        while (writer.running && !writer.count && !writer.closing) {
+            pthread_cond_wait(&writer.wake, &writer.lock);
+        }
+        bool running = writer.running;
+
+        // Take everything queued so far and leave the spare array behind
+        rtmp_record_entry_t* entries = writer.entries;
+        uint32_t count = writer.count;
+        uint32_t capacity = writer.capacity;
+        writer.entries = batch;
+        writer.capacity = batch_capacity;
+        writer.count = 0;
+        batch = entries;
+        batch_capacity = capacity;
+
+        rtmp_recording_t* closing = writer.closing;
+        writer.closing = NULL;
+        pthread_mutex_unlock(&writer.lock);
+
+        uint64_t bytes = rtmp_record_process(batch, count);
+        while (closing) {
+            rtmp_recording_t* next = closing->next_closing;
+            rtmp_record_finish(closing);
+            closing = next;
+        }
+
+        pthread_mutex_lock(&writer.lock);
+        writer.queued_bytes -= bytes;
+        pthread_mutex_unlock(&writer.lock);
+
+        if (!running && count == 0) break;
+    }
+
+    // Stopping: producers are gone, so finish whatever was never closed
+    for (;;) {
+        pthread_mutex_lock(&writer.lock);
+        rtmp_recording_t* recording = writer.recordings;
+        pthread_mutex_unlock(&writer.lock);
+        if (!recording) break;
+        rtmp_record_finish(recording);
+    }
+
+    free(batch);
+    pthread_mutex_lock(&writer.lock);
+    free(writer.entries);
+    writer.entries = NULL;
+    writer.capacity = 0;
+    pthread_mutex_unlock(&writer.lock);
+    return NULL;
+}
+
+// Write a batch in queue order, one writev run per recording; returns the
+// media bytes it releases from the queue budget
+static uint64_t rtmp_record_process(rtmp_record_entry_t* entries, uint32_t count) {
+    uint64_t bytes = 0;
+
+    for (uint32_t i = 0; i < count;) {
+        rtmp_recording_t* recording = entries[i].recording;
+        if (!entries[i].msg) {
+            rtmp_record_create(recording);
+            i++;
+            continue;
+        }
+
+        uint32_t end = i;
+        while (end < count && entries[end].msg && entries[end].recording == recording) {
+            end++;
+        }
+        rtmp_record_append(recording, entries + i, end - i);
+        i = end;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (entries[i].msg) {
+            bytes += entries[i].msg->length;
+            rtmp_msgbuf_release(entries[i].msg);
+        }
+    }
+    return bytes;
+}
+
+// Create the file with its header and a placeholder onMetaData that is
+// already valid, so a crash still leaves a playable file
+static void rtmp_record_create(rtmp_recording_t* recording) {
+    uint8_t* head = calloc(1, RTMP_RECORD_MEDIA_OFFSET);
+    recording->fd = head ? rtmp_record_open_exclusive(recording) : -1;
+    if (recording->fd < 0) {
+        __atomic_store_n(&recording->failed, true, __ATOMIC_RELEASE);
+        free(head);
+        return;
+    }
+
+    memcpy(head, "FLV", 3);
+    head[3] = 1;
+    head[4] = RTMP_RECORD_FLV_AUDIO | RTMP_RECORD_FLV_VIDEO;
+    head[8] = RTMP_RECORD_FLV_HEADER_SIZE;
+    rtmp_flv_write_tag_header(head + RTMP_RECORD_METADATA_OFFSET, RTMP_RECORD_MSG_DATA, RTMP_RECORD_METADATA_BYTES, 0);
+    rtmp_record_encode_metadata(recording, head + RTMP_RECORD_METADATA_OFFSET + RTMP_FLV_TAG_HEADER_SIZE);
+    rtmp_flv_write_tag_trailer(head + RTMP_RECORD_MEDIA_OFFSET - RTMP_FLV_TAG_TRAILER_SIZE, RTMP_RECORD_METADATA_BYTES);
+
+    struct iovec iov;
+    iov.iov_base = head;
+    iov.iov_len = RTMP_RECORD_MEDIA_OFFSET;
+    rtmp_record_reserve(recording, RTMP_RECORD_MEDIA_OFFSET);
+    if (rtmp_record_writev_all(recording->fd, &iov, 1)) {
+        recording->offset = RTMP_RECORD_MEDIA_OFFSET;
+        __atomic_add_fetch(&writer.written_bytes, RTMP_RECORD_MEDIA_OFFSET, __ATOMIC_RELAXED);
+    } else {
+        __atomic_store_n(&recording->failed, true, __ATOMIC_RELEASE);
+    }
+    free(head);
+}
+
+// Create a file that did not exist; a taken name becomes <stem>-N<extension>
+// and recording->path follows the name actually used
+static int rtmp_record_open_exclusive(rtmp_recording_t* recording) {
+    char base[RTMP_RECORD_PATH_SIZE];
+    strcpy(base, recording->path);
+    char* extension = strrchr(base, '.');
+    char* slash = strrchr(base, '/');
+    if (!extension || (slash && extension < slash)) {
+        extension = base + strlen(base);
+    }
+    int stem = (int)(extension - base);
+
+    for (uint32_t attempt = 0; attempt < RTMP_RECORD_NAME_ATTEMPTS; attempt++) {
+        if (attempt) {
+            int length = snprintf(recording->path, sizeof(recording->path), "%.*s-%u%s", stem, base, attempt, extension);
+            if (length < 0 || (size_t)length >= sizeof(recording->path)) break;
+        }
+        int fd = open(recording->path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd >= 0 || errno != EEXIST) return fd;
+    }
+    return -1;
+}
+
+// Header, payload and trailer of each tag go out together, many tags per writev
+static void rtmp_record_append(rtmp_recording_t* recording, const rtmp_record_entry_t* entries, uint32_t count) {
+    uint8_t headers[RTMP_RECORD_IOV_MAX / 3][RTMP_FLV_TAG_HEADER_SIZE];
+    uint8_t trailers[RTMP_RECORD_IOV_MAX / 3][RTMP_FLV_TAG_TRAILER_SIZE];
+    struct iovec iov[RTMP_RECORD_IOV_MAX];
+
+    for (uint32_t i = 0; i < count;) {
+        if (__atomic_load_n(&recording->failed, __ATOMIC_ACQUIRE)) {
+            __atomic_add_fetch(&writer.dropped, count - i, __ATOMIC_RELAXED);
+            return;
+        }
+
+        uint32_t tags = 0;
+        uint64_t bytes = 0;
+        for (; i < count && tags < RTMP_RECORD_IOV_MAX / 3; i++, tags++) {
+            rtmp_msgbuf_t* msg = entries[i].msg;
+            uint32_t timestamp = rtmp_record_track(recording, msg, recording->offset + bytes);
+
+            rtmp_flv_write_tag_header(headers[tags], msg->type, msg->length, timestamp);
+            rtmp_flv_write_tag_trailer(trailers[tags], msg->length);
+            iov[3 * tags].iov_base = headers[tags];
+            iov[3 * tags].iov_len = RTMP_FLV_TAG_HEADER_SIZE;
+            iov[3 * tags + 1].iov_base = msg->payload;
+            iov[3 * tags + 1].iov_len = msg->length;
+            iov[3 * tags + 2].iov_base = trailers[tags];
+            iov[3 * tags + 2].iov_len = RTMP_FLV_TAG_TRAILER_SIZE;
+            bytes += RTMP_FLV_TAG_HEADER_SIZE + msg->length + RTMP_FLV_TAG_TRAILER_SIZE;
+        }
+
+        rtmp_record_reserve(recording, recording->offset + bytes);
+        if (!rtmp_record_writev_all(recording->fd, iov, (int)(3 * tags))) {
+            __atomic_store_n(&recording->failed, true, __ATOMIC_RELEASE);
+            __atomic_add_fetch(&writer.dropped, tags, __ATOMIC_RELAXED);
+            continue;
+        }
+        recording->offset += bytes;
+        __atomic_add_fetch(&writer.written_bytes, bytes, __ATOMIC_RELAXED);
+    }
+}
+
+// Learn what onMetaData will say from the tag written at position; returns
+// its timestamp relative to the first tag of the file
+static uint32_t rtmp_record_track(rtmp_recording_t* recording, const rtmp_msgbuf_t* msg, uint64_t position) {
+    if (!recording->started) {
+        recording->started = true;
+        recording->base_timestamp = msg->timestamp;
+    }
+
+    // Audio a little ahead of the first video frame would go negative
+    uint32_t timestamp = msg->timestamp - recording->base_timestamp;
+    if ((int32_t)timestamp < 0) {
+        timestamp = 0;
+    }
+    if (timestamp > recording->duration_ms) {
+        recording->duration_ms = timestamp;
+    }
+
+    if (msg->type == RTMP_RELAY_MSG_VIDEO) {
+        rtmp_flv_video_t video;
+        rtmp_flv_avc_config_t avc;
+        recording->has_video = true;
+        if (!rtmp_flv_parse_video(msg->payload, msg->length, &video)) return timestamp;
+
+        recording->video_codec = video.codec;
+        bool avc_header = video.sequence_header &&
+                          video.codec == (video.enhanced ? RTMP_FLV_FOURCC_AVC : RTMP_FLV_CODEC_AVC);
+        if (avc_header && rtmp_flv_parse_avc_config(msg->payload + video.header_length,
+                                                    msg->length - video.header_length, &avc)) {
+            recording->width = avc.width;
+            recording->height = avc.height;
+            recording->frame_rate = avc.frame_rate;
+        }
+
+        if (video.keyframe && recording->num_keyframes == recording->max_keyframes) {
+            uint32_t capacity = recording->max_keyframes ? recording->max_keyframes * 2 : 64;
+            uint64_t* positions = realloc(recording->keyframe_positions, capacity * sizeof(uint64_t));
+            if (positions) {
+                recording->keyframe_positions = positions;
+            }
+            uint32_t* times = realloc(recording->keyframe_times, capacity * sizeof(uint32_t));
+            if (times) {
+                recording->keyframe_times = times;
+            }
+            if (positions && times) {
+                recording->max_keyframes = capacity;
+            }
+        }
+        if (video.keyframe && recording->num_keyframes < recording->max_keyframes) {
+            recording->keyframe_positions[recording->num_keyframes] = position;
+            recording->keyframe_times[recording->num_keyframes] = timestamp;
+            recording->num_keyframes++;
+        }
+    } else {
+        rtmp_flv_audio_t audio;
+        rtmp_flv_aac_config_t aac;
+        recording->has_audio = true;
+        if (!rtmp_flv_parse_audio(msg->payload, msg->length, &audio)) return timestamp;
+
+        recording->audio_codec = audio.format;
+        if (audio.format != RTMP_FLV_SOUND_AAC) {
+            recording->sample_rate = audio.sample_rate;
+            recording->channels = audio.channels;
+        } else if (audio.sequence_header &&
+                   rtmp_flv_parse_aac_config(msg->payload + audio.header_length,
+                                             msg->length - audio.header_length, &aac)) {
+            recording->sample_rate = aac.sample_rate;
+            recording->channels = aac.channels;
+        }
+    }
+    return timestamp;
+}
+
+// Keep space allocated well ahead of the writes, so the file grows in large
+// extents; best effort, without changing the file size
+static void rtmp_record_reserve(rtmp_recording_t* recording, uint64_t end) {
+    if (end <= recording->allocated) return;
+
+    uint64_t length = end - recording->allocated + RTMP_RECORD_PREALLOCATE_BYTES;
+#if defined(RTMP_RECORD_USE_FALLOCATE)
+    fallocate(recording->fd, FALLOC_FL_KEEP_SIZE, (off_t)recording->allocated, (off_t)length);
+#elif defined(RTMP_RECORD_USE_PREALLOCATE)
+    fstore_t store = { F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, (off_t)length, 0 };
+    if (fcntl(recording->fd, F_PREALLOCATE, &store) < 0) {
+        store.fst_flags = F_ALLOCATEALL;
+        fcntl(recording->fd, F_PREALLOCATE, &store);
+    }
+#endif
+    recording->allocated += length;
+}
+
+static bool rtmp_record_writev_all(int fd, struct iovec* iov, int count) {
+    while (count > 0) {
+        ssize_t bytes = writev(fd, iov, count);
+        if (bytes < 0 && errno == EINTR) continue;
+        if (bytes <= 0) return false;
+
+        // Skip what went out, which may end inside an iovec
+        while (count > 0 && (size_t)bytes >= iov->iov_len) {
+            bytes -= (ssize_t)iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (uint8_t*)iov->iov_base + bytes;
+            iov->iov_len -= (size_t)bytes;
+        }
+    }
+    return true;
+}
+
+// Rewrite onMetaData and the header flags, give back the reserved tail, close
+static void rtmp_record_finish(rtmp_recording_t* recording) {
+    if (recording->fd >= 0) {
+        uint8_t* metadata = malloc(RTMP_RECORD_METADATA_BYTES);
+        if (metadata && rtmp_record_encode_metadata(recording, metadata)) {
+            pwrite(recording->fd, metadata, RTMP_RECORD_METADATA_BYTES,
+                   RTMP_RECORD_METADATA_OFFSET + RTMP_FLV_TAG_HEADER_SIZE);
+        }
+        free(metadata);
+
+        uint8_t flags = (recording->has_audio ? RTMP_RECORD_FLV_AUDIO : 0) |
+                        (recording->has_video ? RTMP_RECORD_FLV_VIDEO : 0);
+        pwrite(recording->fd, &flags, 1, 4);
+        if (ftruncate(recording->fd, (off_t)recording->offset) < 0) {
+            // The reserved tail stays allocated; the file itself is complete
+        }
+        close(recording->fd);
+    }
+
+    pthread_mutex_lock(&writer.lock);
+    for (rtmp_recording_t** link = &writer.recordings; *link; link = &(*link)->next) {
+        if (*link == recording) {
+            *link = recording->next;
+            writer.num_recordings--;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&writer.lock);
+
+    free(recording->keyframe_positions);
+    free(recording->keyframe_times);
+    free(recording);
+}
+
+// onMetaData as an ECMA array padded to exactly RTMP_RECORD_METADATA_BYTES
+// (at most 64 KB, so one AMF string pads it). An index that would not fit
+// keeps every stride-th keyframe.
+static bool rtmp_record_encode_metadata(const rtmp_recording_t* recording, uint8_t* out) {
+    // Keyframes past a failed write never reached the file
+    uint32_t keyframes = recording->num_keyframes;
+    while (keyframes && recording->keyframe_positions[keyframes - 1] >= recording->offset) {
+        keyframes--;
+    }
+    uint32_t room = (RTMP_RECORD_METADATA_BYTES - RTMP_RECORD_METADATA_FIXED) / RTMP_RECORD_INDEX_ENTRY;
+    uint32_t stride = keyframes > room ? (keyframes + room - 1) / room : 1;
+    uint32_t entries = (keyframes + stride - 1) / stride;
+
+    uint8_t* p = out;
+    uint32_t count = 0;
+    size_t size;
+    rtmp_amf_encode_string("onMetaData", p, &size);
+    p += size;
+    uint8_t* array = p;
+    rtmp_amf_encode_ecma_array_start(0, p, &size);
+    p += size;
+
+    rtmp_record_put_number(&p, &count, "duration", recording->duration_ms / 1000.0);
+    rtmp_record_put_number(&p, &count, "filesize", (double)recording->offset);
+    rtmp_record_put_boolean(&p, &count, "hasVideo", recording->has_video);
+    rtmp_record_put_boolean(&p, &count, "hasAudio", recording->has_audio);
+    rtmp_record_put_boolean(&p, &count, "hasKeyframes", entries > 0);
+    rtmp_record_put_boolean(&p, &count, "hasMetadata", true);
+    if (recording->has_video) {
+        rtmp_record_put_number(&p, &count, "videocodecid", recording->video_codec);
+        if (recording->width && recording->height) {
+            rtmp_record_put_number(&p, &count, "width", recording->width);
+            rtmp_record_put_number(&p, &count, "height", recording->height);
+        }
+        if (recording->frame_rate) {
+            rtmp_record_put_number(&p, &count, "framerate", recording->frame_rate);
+        }
+    }
+    if (recording->has_audio) {
+        rtmp_record_put_number(&p, &count, "audiocodecid", recording->audio_codec);
+        if (recording->sample_rate) {
+            rtmp_record_put_number(&p, &count, "audiosamplerate", recording->sample_rate);
+        }
+        if (recording->channels) {
+            rtmp_record_put_boolean(&p, &count, "stereo", recording->channels > 1);
+        }
+    }
+
+    // keyframes: { filepositions: [...], times: [...] }
+    rtmp_amf_encode_property_name("keyframes", p, &size);
+    p += size;
+    rtmp_amf_encode_object_start(p, &size);
+    p += size;
+    rtmp_record_put_index(&p, "filepositions", recording, entries, stride, false);
+    rtmp_record_put_index(&p, "times", recording, entries, stride, true);
+    rtmp_amf_encode_object_end(p, &size);
+    p += size;
+    count++;
+
+    // Pad with a string sized to end the array exactly at the reserved length
+    rtmp_amf_encode_property_name("_padding", p, &size);
+    p += size;
+    count++;
+    size_t used = (size_t)(p - out) + 3 + 3;
+    if (used > RTMP_RECORD_METADATA_BYTES) return false;
+    size_t padding = RTMP_RECORD_METADATA_BYTES - used;
+    *p++ = AMF0_STRING;
+    *p++ = (padding >> 8) & 0xff;
+    *p++ = padding & 0xff;
+    memset(p, ' ', padding);
+    p += padding;
+    rtmp_amf_encode_object_end(p, &size);
+
+    rtmp_amf_encode_ecma_array_start(count, array, &size);
+    return true;
+}
+
+static void rtmp_record_put_number(uint8_t** out, uint32_t* count, const char* name, double value) {
+    size_t size;
+    rtmp_amf_encode_property_name(name, *out, &size);
+    *out += size;
+    rtmp_amf_encode_number(value, *out, &size);
+    *out += size;
+    (*count)++;
+}
+
+static void rtmp_record_put_boolean(uint8_t** out, uint32_t* count, const char* name, bool value) {
+    size_t size;
+    rtmp_amf_encode_property_name(name, *out, &size);
+    *out += size;
+    rtmp_amf_encode_boolean(value, *out, &size);
+    *out += size;
+    (*count)++;
+}
+
+// Strict array of file positions, or of times in seconds
+static void rtmp_record_put_index(uint8_t** out, const char* name, const rtmp_recording_t* recording,
+                                  uint32_t entries, uint32_t stride, bool times) {
+    size_t size;
+    rtmp_amf_encode_property_name(name, *out, &size);
+    *out += size;
+    rtmp_amf_encode_strict_array_start(entries, *out, &size);
+    *out += size;
+
+    for (uint32_t i = 0; i < entries; i++) {
+        uint32_t k = i * stride;
+        double value = times ? recording->keyframe_times[k] / 1000.0 : (double)recording->keyframe_positions[k];
+        rtmp_amf_encode_number(value, *out, &size);
+        *out += size;
+    }
+}
@@ -0,0 +1,44 @@
+// rtmp_record.h
+#ifndef RTMP_RECORD_H
+#define RTMP_RECORD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "rtmp_relay.h"
+
+// Recorder configurations
+#define RTMP_RECORD_QUEUE_BYTES (32 * 1024 * 1024)      // Media waiting for the disk, all recordings
+#define RTMP_RECORD_PREALLOCATE_BYTES (8 * 1024 * 1024) // File space reserved ahead of the write position
+#define RTMP_RECORD_METADATA_BYTES (64 * 1024)          // onMetaData space kept for the keyframe index
+#define RTMP_RECORD_IOV_MAX 63                          // iovecs per writev, three per tag
+#define RTMP_RECORD_PATH_SIZE 512
+#define RTMP_RECORD_NAME_ATTEMPTS 16                    // Suffixes tried when a file name is taken
+
+// One FLV file being written. The network side hands it audio and video and
+// never waits for the disk: a dedicated writer thread creates the file,
+// batches tags with writev and, at close, rewrites the onMetaData at the front
+// with the duration and a keyframe index. Tags the disk cannot keep up with
+// are dropped and counted; video then resumes at the next keyframe.
+typedef struct rtmp_recording rtmp_recording_t;
+
+typedef struct {
+    uint32_t recordings;                // Files open
+    uint64_t queued_bytes;
+    uint64_t written_bytes;
+    uint64_t dropped;                   // Tags dropped behind a slow or failed disk
+} rtmp_record_stats_t;
+
+// Writer thread; stop writes out what is queued and finishes every open file
+bool rtmp_record_start(void);
+void rtmp_record_stop(void);
+
+// Producer side, one thread per recording at a time. Open only queues the
+// file's creation; an existing file is never overwritten, the name gets a
+// -1, -2... suffix instead. After close the recording must not be used again.
+rtmp_recording_t* rtmp_record_open(const char* path);
+void rtmp_record_write(rtmp_recording_t* recording, rtmp_msgbuf_t* msg);
+void rtmp_record_close(rtmp_recording_t* recording);
+
+void rtmp_record_get_stats(rtmp_record_stats_t* stats);
+
+#endif /* RTMP_RECORD_H */
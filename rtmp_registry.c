@@ -0,0 +1,252 @@
+// rtmp_registry.c
+#include "rtmp_registry.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Maximum load before the table doubles, in percent
+#define RTMP_REGISTRY_MAX_LOAD 70
+
+// Table slot; an empty slot has used == false
+typedef struct {
+    bool used;
+    uint32_t hash;
+    int fd;
+    char* name;
+    void* value;
+} rtmp_registry_slot_t;
+
+// Hash index
+struct rtmp_registry {
+    rtmp_registry_key_t kind;
+    rtmp_registry_slot_t* slots;
+    uint32_t capacity;      // Always a power of two
+    uint32_t count;
+};
+
+// Forward declarations of internal functions
+static uint32_t rtmp_registry_hash_fd(int fd);
+static uint32_t rtmp_registry_hash_name(const char* name);
+static bool rtmp_registry_matches(rtmp_registry_t* registry, rtmp_registry_slot_t* slot,
+                                  uint32_t hash, int fd, const char* name);
+static rtmp_registry_slot_t* rtmp_registry_find(rtmp_registry_t* registry, uint32_t hash, int fd, const char* name);
+static bool rtmp_registry_grow(rtmp_registry_t* registry);
+static bool rtmp_registry_insert(rtmp_registry_t* registry, uint32_t hash, int fd, const char* name, void* value);
+static void rtmp_registry_erase(rtmp_registry_t* registry, rtmp_registry_slot_t* slot);
+
+rtmp_registry_t* rtmp_registry_create(rtmp_registry_key_t kind, uint32_t capacity) {
+    rtmp_registry_t* registry = calloc(1, sizeof(rtmp_registry_t));
+    if (!registry) return NULL;
+
+    uint32_t size = RTMP_REGISTRY_MIN_CAPACITY;
+    while (size < capacity && size < (1u << 30)) {
+        size <<= 1;
+    }
+
+    registry->slots = calloc(size, sizeof(rtmp_registry_slot_t));
+    if (!registry->slots) {
+        free(registry);
+        return NULL;
+    }
+
+    registry->kind = kind;
+    registry->capacity = size;
+    return registry;
+}
+
+void rtmp_registry_destroy(rtmp_registry_t* registry) {
+    if (!registry) return;
+    rtmp_registry_clear(registry);
+    free(registry->slots);
+    free(registry);
+}
+
+void rtmp_registry_clear(rtmp_registry_t* registry) {
+    if (!registry) return;
+    for (uint32_t i = 0; i < registry->capacity; i++) {
+        free(registry->slots[i].name);
+    }
+    memset(registry->slots, 0, registry->capacity * sizeof(rtmp_registry_slot_t));
+    registry->count = 0;
+}
+
+uint32_t rtmp_registry_count(rtmp_registry_t* registry) {
+    return registry ? registry->count : 0;
+}
+
+// Visit every value; the visitor must not insert or remove entries
+void rtmp_registry_foreach(rtmp_registry_t* registry, void (*visit)(void* value, void* userdata), void* userdata) {
+    if (!registry || !visit) return;
+    for (uint32_t i = 0; i < registry->capacity; i++) {
+        if (registry->slots[i].used) {
+            visit(registry->slots[i].value, userdata);
+        }
+    }
+}
+
+bool rtmp_registry_put_fd(rtmp_registry_t* registry, int fd, void* value) {
+    if (!registry || registry->kind != RTMP_REGISTRY_KEY_FD) return false;
+    return rtmp_registry_insert(registry, rtmp_registry_hash_fd(fd), fd, NULL, value);
+}
+
+void* rtmp_registry_get_fd(rtmp_registry_t* registry, int fd) {
+    if (!registry || registry->kind != RTMP_REGISTRY_KEY_FD) return NULL;
+    rtmp_registry_slot_t* slot = rtmp_registry_find(registry, rtmp_registry_hash_fd(fd), fd, NULL);
+    return slot ? slot->value : NULL;
+}
+
+// Remove fd; when expected is non-NULL only an entry holding that value is removed
+bool rtmp_registry_remove_fd(rtmp_registry_t* registry, int fd, const void* expected) {
+    if (!registry || registry->kind != RTMP_REGISTRY_KEY_FD) return false;
+    rtmp_registry_slot_t* slot = rtmp_registry_find(registry, rtmp_registry_hash_fd(fd), fd, NULL);
+    if (!slot || (expected && slot->value != expected)) return false;
+    rtmp_registry_erase(registry, slot);
+    return true;
+}
+
+bool rtmp_registry_put_name(rtmp_registry_t* registry, const char* name, void* value) {
+    if (!registry || !name || registry->kind != RTMP_REGISTRY_KEY_NAME) return false;
+    return rtmp_registry_insert(registry, rtmp_registry_hash_name(name), -1, name, value);
+}
+
+void* rtmp_registry_get_name(rtmp_registry_t* registry, const char* name) {
+    if (!registry || !name || registry->kind != RTMP_REGISTRY_KEY_NAME) return NULL;
+    rtmp_registry_slot_t* slot = rtmp_registry_find(registry, rtmp_registry_hash_name(name), -1, name);
+    return slot ? slot->value : NULL;
+}
+
+// Remove name; when expected is non-NULL only an entry holding that value is removed
+bool rtmp_registry_remove_name(rtmp_registry_t* registry, const char* name, const void* expected) {
+    if (!registry || !name || registry->kind != RTMP_REGISTRY_KEY_NAME) return false;
+    rtmp_registry_slot_t* slot = rtmp_registry_find(registry, rtmp_registry_hash_name(name), -1, name);
+    if (!slot || (expected && slot->value != expected)) return false;
+    rtmp_registry_erase(registry, slot);
+    return true;
+}
+
+void rtmp_registry_stream_key(char* key, size_t size, const char* app, const char* stream) {
+    snprintf(key, size, "%s/%s", app ? app : "", stream ? stream : "");
+}
+
+// Integer finalizer from MurmurHash3; descriptors are small and dense
+static uint32_t rtmp_registry_hash_fd(int fd) {
+    uint32_t h = (uint32_t)fd;
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+// FNV-1a
+static uint32_t rtmp_registry_hash_name(const char* name) {
+    uint32_t h = 2166136261u;
+    for (const uint8_t* p = (const uint8_t*)name; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static bool rtmp_registry_matches(rtmp_registry_t* registry, rtmp_registry_slot_t* slot,
+                                  uint32_t hash, int fd, const char* name) {
+    if (slot->hash != hash) return false;
+    if (registry->kind == RTMP_REGISTRY_KEY_FD) return slot->fd == fd;
+    return strcmp(slot->name, name) == 0;
+}
+
+static rtmp_registry_slot_t* rtmp_registry_find(rtmp_registry_t* registry, uint32_t hash, int fd, const char* name) {
+    uint32_t mask = registry->capacity - 1;
+    for (uint32_t i = hash & mask; registry->slots[i].used; i = (i + 1) & mask) {
+        if (rtmp_registry_matches(registry, &registry->slots[i], hash, fd, name)) {
+            return &registry->slots[i];
+        }
+    }
+    return NULL;
+}
+
+// Double the table and reinsert every entry; names move without copying
+static bool rtmp_registry_grow(rtmp_registry_t* registry) {
+    uint32_t capacity = registry->capacity << 1;
+    rtmp_registry_slot_t* slots = calloc(capacity, sizeof(rtmp_registry_slot_t));
+    if (!slots) return false;
+
+    uint32_t mask = capacity - 1;
+    for (uint32_t i = 0; i < registry->capacity; i++) {
+        rtmp_registry_slot_t* old = &registry->slots[i];
+        if (!old->used) continue;
+
+        uint32_t j = old->hash & mask;
+        while (slots[j].used) {
+            j = (j + 1) & mask;
+        }
+        slots[j] = *old;
+    }
+
+    free(registry->slots);
+    registry->slots = slots;
+    registry->capacity = capacity;
+    return true;
+}
+
+// Insert or replace
+static bool rtmp_registry_insert(rtmp_registry_t* registry, uint32_t hash, int fd, const char* name, void* value) {
+    rtmp_registry_slot_t* slot = rtmp_registry_find(registry, hash, fd, name);
+    if (slot) {
+        slot->value = value;
+        return true;
+    }
+
+    if ((registry->count + 1) * 100 > registry->capacity * RTMP_REGISTRY_MAX_LOAD &&
+        !rtmp_registry_grow(registry)) {
+        return false;
+    }
+
+    char* copy = NULL;
+    if (name) {
+        size_t length = strnlen(name, RTMP_REGISTRY_MAX_NAME - 1);
+        copy = malloc(length + 1);
+        if (!copy) return false;
+        memcpy(copy, name, length);
+        copy[length] = '\0';
+    }
+
+    uint32_t mask = registry->capacity - 1;
+    uint32_t i = hash & mask;
+    while (registry->slots[i].used) {
+        i = (i + 1) & mask;
+    }
+
+    slot = &registry->slots[i];
+    slot->used = true;
+    slot->hash = hash;
+    slot->fd = fd;
+    slot->name = copy;
+    slot->value = value;
+    registry->count++;
+    return true;
+}
+
+// Backward-shift deletion: pull later members of the probe run into the gap
+// so lookups never need tombstones
+static void rtmp_registry_erase(rtmp_registry_t* registry, rtmp_registry_slot_t* slot) {
+    uint32_t mask = registry->capacity - 1;
+    uint32_t hole = (uint32_t)(slot - registry->slots);
+
+    free(slot->name);
+
+    uint32_t i = (hole + 1) & mask;
+    while (registry->slots[i].used) {
+        uint32_t home = registry->slots[i].hash & mask;
+        // Move the entry if its home slot is not cyclically within (hole, i]
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            registry->slots[hole] = registry->slots[i];
+            hole = i;
+        }
+        i = (i + 1) & mask;
+    }
+
+    memset(&registry->slots[hole], 0, sizeof(rtmp_registry_slot_t));
+    registry->count--;
+}
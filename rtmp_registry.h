@@ -0,0 +1,43 @@
+// rtmp_registry.h
+#ifndef RTMP_REGISTRY_H
+#define RTMP_REGISTRY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Registry configurations
+#define RTMP_REGISTRY_MIN_CAPACITY 64
+#define RTMP_REGISTRY_MAX_NAME 256
+
+// Key kinds
+typedef enum {
+    RTMP_REGISTRY_KEY_FD = 0,   // Integer keys such as socket descriptors
+    RTMP_REGISTRY_KEY_NAME      // NUL-terminated string keys, copied on insert
+} rtmp_registry_key_t;
+
+// Open-addressing hash index (linear probing, backward-shift deletion).
+// Not thread-safe: callers serialize access with their own lock.
+typedef struct rtmp_registry rtmp_registry_t;
+
+// Registry lifecycle
+rtmp_registry_t* rtmp_registry_create(rtmp_registry_key_t kind, uint32_t capacity);
+void rtmp_registry_destroy(rtmp_registry_t* registry);
+void rtmp_registry_clear(rtmp_registry_t* registry);
+uint32_t rtmp_registry_count(rtmp_registry_t* registry);
+void rtmp_registry_foreach(rtmp_registry_t* registry, void (*visit)(void* value, void* userdata), void* userdata);
+
+// Descriptor keyed entries
+bool rtmp_registry_put_fd(rtmp_registry_t* registry, int fd, void* value);
+void* rtmp_registry_get_fd(rtmp_registry_t* registry, int fd);
+bool rtmp_registry_remove_fd(rtmp_registry_t* registry, int fd, const void* expected);
+
+// Name keyed entries
+bool rtmp_registry_put_name(rtmp_registry_t* registry, const char* name, void* value);
+void* rtmp_registry_get_name(rtmp_registry_t* registry, const char* name);
+bool rtmp_registry_remove_name(rtmp_registry_t* registry, const char* name, const void* expected);
+
+// Build the "app/stream" key used by the name index
+void rtmp_registry_stream_key(char* key, size_t size, const char* app, const char* stream);
+
+#endif /* RTMP_REGISTRY_H */
@@ -0,0 +1,423 @@
+// rtmp_relay.c
+#include "rtmp_relay.h"
+#include "rtmp_flv.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+// Forward declarations of internal functions
+static uint8_t rtmp_relay_basic_header(uint8_t* out, uint8_t fmt, uint32_t csid);
+static bool rtmp_send_queue_grow(rtmp_send_queue_t* queue);
+static uint32_t rtmp_send_queue_next_chunk_size(const rtmp_msgbuf_t* msg, uint32_t chunk_size);
+static void rtmp_send_queue_consume(rtmp_send_queue_t* queue, size_t bytes);
+static bool rtmp_send_queue_over_budget(const rtmp_send_queue_t* queue, const rtmp_msgbuf_t* msg);
+static void rtmp_send_queue_shed_video(rtmp_send_queue_t* queue);
+static bool rtmp_msgbuf_is_keyframe(const rtmp_msgbuf_t* msg);
+static bool rtmp_msgbuf_is_droppable(const rtmp_msgbuf_t* msg);
+static bool rtmp_msgbuf_is_media(const rtmp_msgbuf_t* msg);
+
+// Build the message once: type 0 header for the first chunk, type 3 for the rest
+rtmp_msgbuf_t* rtmp_msgbuf_create(uint32_t csid, uint8_t type, uint32_t timestamp, uint32_t stream_id,
+                                  const uint8_t* data, uint32_t length) {
+    rtmp_msgbuf_t* msg = malloc(sizeof(rtmp_msgbuf_t) + length);
+    if (!msg) return NULL;
+
+    msg->refcount = 1;
+    msg->type = type;
+    msg->csid = csid;
+    msg->stream_id = stream_id;
+    msg->timestamp = timestamp;
+    msg->length = length;
+    if (length && data) {
+        memcpy(msg->payload, data, length);
+    }
+
+    bool extended = timestamp >= 0xffffff;
+    uint32_t ts = extended ? 0xffffff : timestamp;
+    uint8_t* h = msg->header;
+    uint8_t n = rtmp_relay_basic_header(h, 0, csid);
+
+    h[n++] = (ts >> 16) & 0xff;
+    h[n++] = (ts >> 8) & 0xff;
+    h[n++] = ts & 0xff;
+    h[n++] = (length >> 16) & 0xff;
+    h[n++] = (length >> 8) & 0xff;
+    h[n++] = length & 0xff;
+    h[n++] = type;
+    // Message stream id is little-endian
+    h[n++] = stream_id & 0xff;
+    h[n++] = (stream_id >> 8) & 0xff;
+    h[n++] = (stream_id >> 16) & 0xff;
+    h[n++] = (stream_id >> 24) & 0xff;
+    if (extended) {
+        h[n++] = (timestamp >> 24) & 0xff;
+        h[n++] = (timestamp >> 16) & 0xff;
+        h[n++] = (timestamp >> 8) & 0xff;
+        h[n++] = timestamp & 0xff;
+    }
+    msg->header_length = n;
+
+    // Type 3 chunks repeat the extended timestamp when the message carries one
+    n = rtmp_relay_basic_header(msg->continuation, 3, csid);
+    if (extended) {
+        memcpy(msg->continuation + n, msg->header + msg->header_length - 4, 4);
+        n += 4;
+    }
+    msg->continuation_length = n;
+
+    return msg;
+}
+
+// Pack messages as FLV tags into one aggregate on the first one's chunk
+// stream. Every tag keeps its own timestamp; the aggregate carries the first.
+rtmp_msgbuf_t* rtmp_msgbuf_aggregate(rtmp_msgbuf_t* const* msgs, uint32_t count) {
+    if (count == 0) return NULL;
+
+    size_t length = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        length += RTMP_FLV_TAG_HEADER_SIZE + msgs[i]->length + RTMP_FLV_TAG_TRAILER_SIZE;
+    }
+    if (length > 0xffffff) return NULL;
+
+    rtmp_msgbuf_t* aggregate = rtmp_msgbuf_create(msgs[0]->csid, RTMP_RELAY_MSG_AGGREGATE, msgs[0]->timestamp,
+                                                  msgs[0]->stream_id, NULL, (uint32_t)length);
+    if (!aggregate) return NULL;
+
+    uint8_t* out = aggregate->payload;
+    for (uint32_t i = 0; i < count; i++) {
+        rtmp_flv_write_tag_header(out, msgs[i]->type, msgs[i]->length, msgs[i]->timestamp);
+        out += RTMP_FLV_TAG_HEADER_SIZE;
+        memcpy(out, msgs[i]->payload, msgs[i]->length);
+        out += msgs[i]->length;
+        rtmp_flv_write_tag_trailer(out, msgs[i]->length);
+        out += RTMP_FLV_TAG_TRAILER_SIZE;
+    }
+    return aggregate;
+}
+
+rtmp_msgbuf_t* rtmp_msgbuf_retain(rtmp_msgbuf_t* msg) {
+    if (msg) {
+        __atomic_add_fetch(&msg->refcount, 1, __ATOMIC_RELAXED);
+    }
+    return msg;
+}
+
+void rtmp_msgbuf_release(rtmp_msgbuf_t* msg) {
+    if (msg && __atomic_sub_fetch(&msg->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(msg);
+    }
+}
+
+// Bytes on the wire for this message at the given chunk size
+size_t rtmp_msgbuf_serialized_size(const rtmp_msgbuf_t* msg, uint32_t chunk_size) {
+    uint32_t chunks = msg->length ? (msg->length + chunk_size - 1) / chunk_size : 1;
+    return msg->header_length + msg->length + (size_t)(chunks - 1) * msg->continuation_length;
+}
+
+// Describe the serialized message from offset onward; returns iovecs filled
+uint32_t rtmp_msgbuf_iov(const rtmp_msgbuf_t* msg, uint32_t chunk_size, size_t offset,
+                         struct iovec* iov, uint32_t max_iov) {
+    uint32_t n = 0;
+    size_t header = msg->header_length;
+    size_t stride = chunk_size + msg->continuation_length;
+
+    if (max_iov == 0) return 0;
+
+    if (offset < header) {
+        iov[n].iov_base = (void*)(msg->header + offset);
+        iov[n].iov_len = header - offset;
+        n++;
+        offset = header;
+    }
+
+    // Locate the chunk holding offset: chunk 0 has no continuation header
+    size_t rel = offset - header;
+    uint32_t first = rel < chunk_size ? 0 : 1 + (uint32_t)((rel - chunk_size) / stride);
+
+    for (uint32_t k = first; (size_t)k * chunk_size < msg->length && n < max_iov; k++) {
+        size_t start = k == 0 ? header : header + chunk_size + (size_t)(k - 1) * stride;
+        size_t payload = (size_t)k * chunk_size;
+        size_t length = msg->length - payload < chunk_size ? msg->length - payload : chunk_size;
+
+        if (k > 0) {
+            if (offset < start + msg->continuation_length) {
+                size_t skip = offset > start ? offset - start : 0;
+                iov[n].iov_base = (void*)(msg->continuation + skip);
+                iov[n].iov_len = msg->continuation_length - skip;
+                n++;
+                if (n == max_iov) break;
+            }
+            start += msg->continuation_length;
+        }
+
+        size_t skip = offset > start ? offset - start : 0;
+        iov[n].iov_base = (void*)(msg->payload + payload + skip);
+        iov[n].iov_len = length - skip;
+        n++;
+    }
+
+    return n;
+}
+
+bool rtmp_send_queue_init(rtmp_send_queue_t* queue, uint32_t chunk_size) {
+    memset(queue, 0, sizeof(rtmp_send_queue_t));
+    queue->items = calloc(RTMP_RELAY_QUEUE_MIN, sizeof(rtmp_msgbuf_t*));
+    if (!queue->items) return false;
+    queue->capacity = RTMP_RELAY_QUEUE_MIN;
+    queue->chunk_size = chunk_size;
+    return true;
+}
+
+void rtmp_send_queue_set_budget(rtmp_send_queue_t* queue, size_t max_bytes, uint32_t max_latency_ms) {
+    queue->max_bytes = max_bytes;
+    queue->max_latency_ms = max_latency_ms;
+}
+
+void rtmp_send_queue_destroy(rtmp_send_queue_t* queue) {
+    if (!queue->items) return;
+    while (queue->count) {
+        rtmp_msgbuf_release(queue->items[queue->head]);
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+    }
+    free(queue->items);
+    memset(queue, 0, sizeof(rtmp_send_queue_t));
+}
+
+// Queue a reference to msg; the buffer itself is shared, never copied.
+// Dropping video is not a failure; false means the consumer is hopeless.
+bool rtmp_send_queue_push(rtmp_send_queue_t* queue, rtmp_msgbuf_t* msg) {
+    if (queue->skip_video && rtmp_msgbuf_is_droppable(msg)) {
+        if (!rtmp_msgbuf_is_keyframe(msg)) {
+            queue->dropped++;
+            return true;
+        }
+        queue->skip_video = false;
+    }
+
+    if (rtmp_send_queue_over_budget(queue, msg)) {
+        rtmp_send_queue_shed_video(queue);
+        bool fits = !queue->max_bytes || queue->bytes + msg->length <= queue->max_bytes;
+        if (rtmp_msgbuf_is_droppable(msg)) {
+            // A keyframe with no room even now waits for the next one, like any frame
+            if (!fits || !rtmp_msgbuf_is_keyframe(msg)) {
+                queue->dropped++;
+                return true;
+            }
+            // Catch up by resuming right here
+            queue->skip_video = false;
+        }
+        // Audio alone still over the hard bound
+        if (!fits) {
+            return false;
+        }
+    }
+
+    if (queue->count == queue->capacity && !rtmp_send_queue_grow(queue)) {
+        return false;
+    }
+    queue->items[(queue->head + queue->count) % queue->capacity] = rtmp_msgbuf_retain(msg);
+    queue->count++;
+    queue->bytes += msg->length;
+    return true;
+}
+
+// Queue a publisher run as its shared aggregate, if any. A player that is skipping
+// video or would go over budget takes the messages one by one instead, so
+// shedding still sees every frame.
+bool rtmp_send_queue_push_run(rtmp_send_queue_t* queue, rtmp_msgbuf_t* aggregate,
+                              rtmp_msgbuf_t* const* msgs, uint32_t count) {
+    bool whole = aggregate && !queue->skip_video && !rtmp_send_queue_over_budget(queue, msgs[count - 1]) &&
+                 !(queue->max_bytes && queue->bytes + aggregate->length > queue->max_bytes);
+    if (whole) {
+        return rtmp_send_queue_push(queue, aggregate);
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (!rtmp_send_queue_push(queue, msgs[i])) return false;
+    }
+    return true;
+}
+
+// Write queued messages with sendmsg until empty or the socket is full;
+// false only on a hard socket error
+bool rtmp_send_queue_flush(rtmp_send_queue_t* queue, int fd, size_t* written) {
+    struct iovec iov[RTMP_RELAY_IOV_MAX];
+
+    while (queue->count) {
+        uint32_t n = 0;
+        size_t offset = queue->head_offset;
+        uint32_t chunk_size = queue->chunk_size;
+        for (uint32_t i = 0; i < queue->count && n < RTMP_RELAY_IOV_MAX; i++) {
+            rtmp_msgbuf_t* msg = queue->items[(queue->head + i) % queue->capacity];
+            n += rtmp_msgbuf_iov(msg, chunk_size, offset, iov + n, RTMP_RELAY_IOV_MAX - n);
+            chunk_size = rtmp_send_queue_next_chunk_size(msg, chunk_size);
+            offset = 0;
+        }
+
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = iov;
+        message.msg_iovlen = n;
+        ssize_t bytes = sendmsg(fd, &message, RTMP_RELAY_SEND_FLAGS);
+        if (bytes < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+
+        if (written) *written += (size_t)bytes;
+        rtmp_send_queue_consume(queue, (size_t)bytes);
+    }
+
+    return true;
+}
+
+bool rtmp_send_queue_pending(const rtmp_send_queue_t* queue) {
+    return queue->count > 0;
+}
+
+static uint8_t rtmp_relay_basic_header(uint8_t* out, uint8_t fmt, uint32_t csid) {
+    if (csid < 64) {
+        out[0] = (uint8_t)((fmt << 6) | csid);
+        return 1;
+    }
+    if (csid < 320) {
+        out[0] = (uint8_t)(fmt << 6);
+        out[1] = (uint8_t)(csid - 64);
+        return 2;
+    }
+    out[0] = (uint8_t)((fmt << 6) | 1);
+    out[1] = (uint8_t)((csid - 64) & 0xff);
+    out[2] = (uint8_t)((csid - 64) >> 8);
+    return 3;
+}
+
+static bool rtmp_send_queue_grow(rtmp_send_queue_t* queue) {
+    uint32_t capacity = queue->capacity ? queue->capacity * 2 : RTMP_RELAY_QUEUE_MIN;
+    rtmp_msgbuf_t** items = malloc(capacity * sizeof(rtmp_msgbuf_t*));
+    if (!items) return false;
+
+    for (uint32_t i = 0; i < queue->count; i++) {
+        items[i] = queue->items[(queue->head + i) % queue->capacity];
+    }
+    free(queue->items);
+    queue->items = items;
+    queue->capacity = capacity;
+    queue->head = 0;
+    return true;
+}
+
+// Chunk size in force after msg has been written
+static uint32_t rtmp_send_queue_next_chunk_size(const rtmp_msgbuf_t* msg, uint32_t chunk_size) {
+    if (msg->type != RTMP_RELAY_MSG_SET_CHUNK_SIZE || msg->length < 4) {
+        return chunk_size;
+    }
+    uint32_t size = ((uint32_t)msg->payload[0] << 24) | ((uint32_t)msg->payload[1] << 16) |
+                    ((uint32_t)msg->payload[2] << 8) | msg->payload[3];
+    size &= 0x7fffffff;
+    return size ? size : chunk_size;
+}
+
+// Drop fully written messages and remember how far into the next one we got
+static void rtmp_send_queue_consume(rtmp_send_queue_t* queue, size_t bytes) {
+    while (bytes && queue->count) {
+        rtmp_msgbuf_t* msg = queue->items[queue->head];
+        size_t left = rtmp_msgbuf_serialized_size(msg, queue->chunk_size) - queue->head_offset;
+
+        if (bytes < left) {
+            queue->head_offset += bytes;
+            return;
+        }
+
+        bytes -= left;
+        queue->head_offset = 0;
+        queue->bytes -= msg->length;
+        queue->chunk_size = rtmp_send_queue_next_chunk_size(msg, queue->chunk_size);
+        rtmp_msgbuf_release(msg);
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+    }
+}
+
+// Byte bound, or media timestamps spanning more than the latency budget
+static bool rtmp_send_queue_over_budget(const rtmp_send_queue_t* queue, const rtmp_msgbuf_t* msg) {
+    if (queue->max_bytes && queue->bytes + msg->length > queue->max_bytes) {
+        return true;
+    }
+    if (!queue->max_latency_ms || (msg->type != RTMP_RELAY_MSG_AUDIO && msg->type != RTMP_RELAY_MSG_VIDEO)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < queue->count; i++) {
+        const rtmp_msgbuf_t* oldest = queue->items[(queue->head + i) % queue->capacity];
+        if (rtmp_msgbuf_is_media(oldest)) {
+            return (int32_t)(msg->timestamp - oldest->timestamp) > (int32_t)queue->max_latency_ms;
+        }
+    }
+    return false;
+}
+
+// Compact the ring keeping everything but droppable video; a partially
+// written head stays so the byte stream is never cut mid-message
+static void rtmp_send_queue_shed_video(rtmp_send_queue_t* queue) {
+    uint32_t kept = 0;
+
+    for (uint32_t i = 0; i < queue->count; i++) {
+        rtmp_msgbuf_t* msg = queue->items[(queue->head + i) % queue->capacity];
+        if ((i == 0 && queue->head_offset) || !rtmp_msgbuf_is_droppable(msg)) {
+            queue->items[(queue->head + kept) % queue->capacity] = msg;
+            kept++;
+        } else {
+            queue->bytes -= msg->length;
+            queue->dropped++;
+            rtmp_msgbuf_release(msg);
+        }
+    }
+
+    queue->count = kept;
+    queue->skip_video = true;
+}
+
+// Audio and video join the run while its aggregate stays under max_bytes,
+// on one message stream, with timestamps that never go backwards
+bool rtmp_relay_run_fits(const rtmp_relay_run_t* run, const rtmp_msgbuf_t* msg, size_t max_bytes) {
+    size_t tag = RTMP_FLV_TAG_HEADER_SIZE + msg->length + RTMP_FLV_TAG_TRAILER_SIZE;
+    if (msg->type != RTMP_RELAY_MSG_AUDIO && msg->type != RTMP_RELAY_MSG_VIDEO) return false;
+    if (run->count == RTMP_RELAY_AGGREGATE_MAX || run->bytes + tag > max_bytes) return false;
+    if (!run->count) return true;
+
+    const rtmp_msgbuf_t* first = run->msgs[0];
+    const rtmp_msgbuf_t* last = run->msgs[run->count - 1];
+    return msg->stream_id == first->stream_id && (int32_t)(msg->timestamp - last->timestamp) >= 0;
+}
+
+void rtmp_relay_run_add(rtmp_relay_run_t* run, rtmp_msgbuf_t* msg) {
+    run->msgs[run->count++] = rtmp_msgbuf_retain(msg);
+    run->bytes += RTMP_FLV_TAG_HEADER_SIZE + msg->length + RTMP_FLV_TAG_TRAILER_SIZE;
+}
+
+void rtmp_relay_run_clear(rtmp_relay_run_t* run) {
+    while (run->count) {
+        rtmp_msgbuf_release(run->msgs[--run->count]);
+    }
+    run->bytes = 0;
+}
+
+static bool rtmp_msgbuf_is_keyframe(const rtmp_msgbuf_t* msg) {
+    rtmp_flv_video_t video;
+    return rtmp_flv_parse_video(msg->payload, msg->length, &video) && video.keyframe;
+}
+
+// Video other than sequence headers, which later frames depend on
+static bool rtmp_msgbuf_is_droppable(const rtmp_msgbuf_t* msg) {
+    if (msg->type != RTMP_RELAY_MSG_VIDEO) return false;
+    rtmp_flv_video_t video;
+    return !(rtmp_flv_parse_video(msg->payload, msg->length, &video) && video.sequence_header);
+}
+
+// Audio, video, or both packed together
+static bool rtmp_msgbuf_is_media(const rtmp_msgbuf_t* msg) {
+    return msg->type == RTMP_RELAY_MSG_AUDIO || msg->type == RTMP_RELAY_MSG_VIDEO ||
+           msg->type == RTMP_RELAY_MSG_AGGREGATE;
+}
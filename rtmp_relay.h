@@ -0,0 +1,97 @@
+// rtmp_relay.h
+#ifndef RTMP_RELAY_H
+#define RTMP_RELAY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+// Relay configurations
+#define RTMP_RELAY_STREAM_ID 1              // Message stream id handed to players
+#define RTMP_RELAY_MSG_SET_CHUNK_SIZE 1     // Protocol control: Set Chunk Size
+#define RTMP_RELAY_QUEUE_MIN 16             // Initial send queue capacity
+#define RTMP_RELAY_IOV_MAX 64               // iovecs per writev call
+#define RTMP_RELAY_AGGREGATE_MAX 32         // Messages packed into one aggregate
+#define RTMP_RELAY_MSG_AUDIO 8
+#define RTMP_RELAY_MSG_VIDEO 9
+#define RTMP_RELAY_MSG_AGGREGATE 22
+
+// Peers that hang up mid-write must not raise SIGPIPE; where the flag does not
+// exist, sockets carry SO_NOSIGPIPE instead
+#ifdef MSG_NOSIGNAL
+#define RTMP_RELAY_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define RTMP_RELAY_SEND_FLAGS 0
+#endif
+
+// Immutable, refcounted media message. The chunk headers are built once at
+// creation; per-connection egress only varies the chunk size, so the type 3
+// continuation header is stored beside the payload and interleaved at flush.
+typedef struct {
+    uint32_t refcount;
+    uint8_t type;
+    uint32_t csid;
+    uint32_t stream_id;
+    uint32_t timestamp;
+    uint32_t length;
+    uint8_t header[18];                     // Basic + type 0 header + extended timestamp
+    uint8_t header_length;
+    uint8_t continuation[7];                // Type 3 basic header + extended timestamp
+    uint8_t continuation_length;
+    uint8_t payload[];
+} rtmp_msgbuf_t;
+
+// Per-connection queue of messages waiting for the socket. A queued Set Chunk
+// Size takes effect for the messages behind it once it has been written.
+// Past its budget the queue sheds queued inter frames and skips video until
+// the next keyframe; audio and sequence headers are always kept.
+typedef struct {
+    rtmp_msgbuf_t** items;                  // Ring buffer
+    uint32_t capacity;
+    uint32_t head;
+    uint32_t count;
+    size_t head_offset;                     // Serialized bytes of items[head] already written
+    uint32_t chunk_size;                    // Outgoing chunk size at the head of the queue
+    size_t bytes;                           // Queued payload bytes
+    size_t max_bytes;                       // Hard bound; 0 for none
+    uint32_t max_latency_ms;                // Media timestamp span allowed; 0 for none
+    bool skip_video;                        // Waiting for a keyframe after a drop
+    uint32_t dropped;                       // Video messages dropped so far
+} rtmp_send_queue_t;
+
+// Audio and video a publisher read in one pass. The run is packed into one
+// aggregate before fan-out so every player shares the same copy.
+typedef struct {
+    rtmp_msgbuf_t* msgs[RTMP_RELAY_AGGREGATE_MAX];
+    uint32_t count;
+    size_t bytes;                           // Aggregate payload the run packs into
+} rtmp_relay_run_t;
+
+// Message buffers; a NULL data leaves the payload for the caller to fill
+rtmp_msgbuf_t* rtmp_msgbuf_create(uint32_t csid, uint8_t type, uint32_t timestamp, uint32_t stream_id,
+                                  const uint8_t* data, uint32_t length);
+rtmp_msgbuf_t* rtmp_msgbuf_aggregate(rtmp_msgbuf_t* const* msgs, uint32_t count);
+rtmp_msgbuf_t* rtmp_msgbuf_retain(rtmp_msgbuf_t* msg);
+void rtmp_msgbuf_release(rtmp_msgbuf_t* msg);
+size_t rtmp_msgbuf_serialized_size(const rtmp_msgbuf_t* msg, uint32_t chunk_size);
+uint32_t rtmp_msgbuf_iov(const rtmp_msgbuf_t* msg, uint32_t chunk_size, size_t offset,
+                         struct iovec* iov, uint32_t max_iov);
+
+// Send queues; not thread-safe, callers hold the connection's send lock
+bool rtmp_send_queue_init(rtmp_send_queue_t* queue, uint32_t chunk_size);
+void rtmp_send_queue_set_budget(rtmp_send_queue_t* queue, size_t max_bytes, uint32_t max_latency_ms);
+void rtmp_send_queue_destroy(rtmp_send_queue_t* queue);
+bool rtmp_send_queue_push(rtmp_send_queue_t* queue, rtmp_msgbuf_t* msg);
+bool rtmp_send_queue_push_run(rtmp_send_queue_t* queue, rtmp_msgbuf_t* aggregate,
+                              rtmp_msgbuf_t* const* msgs, uint32_t count);
+bool rtmp_send_queue_flush(rtmp_send_queue_t* queue, int fd, size_t* written);
+bool rtmp_send_queue_pending(const rtmp_send_queue_t* queue);
+
+// Publisher runs; owned by the publisher's thread
+bool rtmp_relay_run_fits(const rtmp_relay_run_t* run, const rtmp_msgbuf_t* msg, size_t max_bytes);
+void rtmp_relay_run_add(rtmp_relay_run_t* run, rtmp_msgbuf_t* msg);
+void rtmp_relay_run_clear(rtmp_relay_run_t* run);
+
+#endif /* RTMP_RELAY_H */
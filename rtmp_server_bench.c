@@ -0,0 +1,184 @@
+// rtmp_server_bench.c
+// Connection scaling benchmark: opens N handshaken client connections against an
+// in-process server and reports setup rate, thread count and resident memory.
+// With -f, measures ingest instead: an FLV file is published through the
+// server's pipeline at -x times real time (0, the default, is unthrottled).
+#include "rtmp_server_integration.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define BENCH_DEFAULT_PORT 19350
+#define BENCH_DEFAULT_CONNECTIONS 2000
+#define BENCH_SPARE_CONNECTIONS 16              // File source and stragglers past the count
+
+static double bench_now(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// Reads "Threads:" and "VmRSS:" from /proc; zero where unavailable
+static void bench_process_stats(long* threads, long* rss_kb) {
+    *threads = 0;
+    *rss_kb = 0;
+
+    FILE* f = fopen("/proc/self/status", "r");
+    if (!f) return;
+
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        sscanf(line, "Threads: %ld", threads);
+        sscanf(line, "VmRSS: %ld", rss_kb);
+    }
+    fclose(f);
+}
+
+// Publish the file and wait for it to run out
+static int bench_file(const char* path, double speed) {
+    if (!rtmp_server_add_file_source(path, "bench", "file", speed, false)) {
+        fprintf(stderr, "cannot publish %s\n", path);
+        return 1;
+    }
+
+    rtmp_file_source_stats_t stats;
+    while (rtmp_server_get_file_source_stats("bench", "file", &stats) && !stats.finished) {
+        usleep(10000);
+    }
+
+    double seconds = stats.elapsed_ms / 1000.0;
+    printf("file=%s speed=%g\n", path, speed);
+    printf("  tags: %llu in %.3f s (%.0f tags/s)\n", (unsigned long long)stats.tags, seconds,
+           seconds > 0 ? stats.tags / seconds : 0.0);
+    printf("  payload: %.1f MB (%.1f MB/s)\n", stats.bytes / 1e6, seconds > 0 ? stats.bytes / 1e6 / seconds : 0.0);
+    rtmp_server_remove_file_source("bench", "file");
+    return 0;
+}
+
+static bool bench_io(int fd, uint8_t* buf, size_t size, bool write_side) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = write_side ? send(fd, buf + done, size - done, 0)
+                               : recv(fd, buf + done, size - done, 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return false;
+        }
+        done += (size_t)n;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    rtmp_server_io_mode_t mode = RTMP_SERVER_IO_REACTOR;
+    uint32_t loops = 0;
+    int count = BENCH_DEFAULT_CONNECTIONS;
+    uint16_t port = BENCH_DEFAULT_PORT;
+    const char* file = NULL;
+    double speed = RTMP_FILE_SOURCE_UNTHROTTLED;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "m:n:l:p:f:x:")) != -1) {
+        switch (opt) {
+            case 'm':
+                if (strcmp(optarg, "threaded") == 0) mode = RTMP_SERVER_IO_THREADED;
+                else if (strcmp(optarg, "sharded") == 0) mode = RTMP_SERVER_IO_SHARDED;
+                else mode = RTMP_SERVER_IO_REACTOR;
+                break;
+            case 'n': count = atoi(optarg); break;
+            case 'l': loops = (uint32_t)atoi(optarg); break;
+            case 'p': port = (uint16_t)atoi(optarg); break;
+            case 'f': file = optarg; break;
+            case 'x': speed = atof(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-m threaded|reactor|sharded] [-n connections] [-l loops] [-p port] "
+                        "[-f file.flv [-x speed]]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    // Both ends of every connection live in this process
+    struct rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+
+    // Every client comes from loopback and handshakes at once
+    rtmp_server_initialize();
+    rtmp_server_set_io_mode(mode, loops);
+    rtmp_admission_limits_t limits = { (uint32_t)count + BENCH_SPARE_CONNECTIONS, 0, (uint32_t)count, 0 };
+    rtmp_server_set_admission_limits(&limits);
+    if (!rtmp_server_start(port)) {
+        fprintf(stderr, "failed to start server on port %u\n", port);
+        return 1;
+    }
+
+    if (file) {
+        int status = bench_file(file, speed);
+        rtmp_server_cleanup();
+        return status;
+    }
+
+    int* fds = calloc(count, sizeof(int));
+    uint8_t c0c1[1 + RTMP_HANDSHAKE_SIZE];
+    uint8_t s0s1s2[1 + 2 * RTMP_HANDSHAKE_SIZE];
+    memset(c0c1, 0, sizeof(c0c1));
+    c0c1[0] = 3;
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+
+    // Phase 1: connect and send C0C1 everywhere so the server holds N half-open handshakes
+    double start = bench_now();
+    int opened = 0;
+    for (; opened < count; opened++) {
+        fds[opened] = socket(AF_INET, SOCK_STREAM, 0);
+        if (fds[opened] < 0 ||
+            connect(fds[opened], (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+            !bench_io(fds[opened], c0c1, sizeof(c0c1), true)) {
+            fprintf(stderr, "connection %d failed: %s\n", opened, strerror(errno));
+            break;
+        }
+    }
+
+    // Phase 2: complete every handshake
+    int completed = 0;
+    for (int i = 0; i < opened; i++) {
+        if (!bench_io(fds[i], s0s1s2, sizeof(s0s1s2), false)) continue;
+        if (!bench_io(fds[i], s0s1s2 + 1, RTMP_HANDSHAKE_SIZE, true)) continue;
+        completed++;
+    }
+    double elapsed = bench_now() - start;
+
+    // Let the server settle before sampling
+    sleep(1);
+    long threads, rss_kb;
+    bench_process_stats(&threads, &rss_kb);
+
+    static const char* mode_names[] = { "threaded", "reactor", "sharded" };
+    printf("mode=%s loops=%u\n", mode_names[mode], loops);
+    printf("  connections: %d opened, %d handshaken, %u tracked by server\n",
+           opened, completed, rtmp_server_get_num_connections());
+    printf("  setup: %.3f s (%.0f handshakes/s)\n", elapsed, elapsed > 0 ? completed / elapsed : 0.0);
+    printf("  threads: %ld\n", threads);
+    printf("  rss: %ld KB (%.1f KB/connection)\n", rss_kb, completed ? (double)rss_kb / completed : 0.0);
+
+    for (int i = 0; i < opened; i++) {
+        close(fds[i]);
+    }
+    free(fds);
+
+    rtmp_server_cleanup();
+    return 0;
+}
@@ -1,17 +1,175 @@
 // rtmp_server_integration.c
 #include "rtmp_server_integration.h"
+#include "rtmp_registry.h"
+#include "rtmp_chunk.h"
+#include "rtmp_amf.h"
+#include "rtmp_handoff.h"
+#include "rtmp_flv.h"
 #include <pthread.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <poll.h>
 #include <sys/time.h>
+#include <sys/resource.h>
+
+// Reactor tuning
+#define RTMP_REACTOR_ACCEPT_BUDGET 64   // accepts per listen readiness event
+#define RTMP_REACTOR_READ_BUDGET 4      // recv calls per connection readiness event
+
+// Timer wheel and the lock serializing arm, cancel and advance on it
+typedef struct {
+    rtmp_timer_wheel_t* wheel;
+    pthread_mutex_t lock;
+} rtmp_server_timers_t;
+
+// Event loop owned by the server in reactor mode
+typedef struct {
+    rtmp_reactor_t* reactor;
+    uint8_t* scratch;                   // receive buffer shared by the loop's connections
+    int listen_socket;                  // sharded mode only, -1 otherwise
+    rtmp_reactor_handle_t* listen_handle;
+    rtmp_connection_t* connections;     // sharded mode only
+    uint32_t num_connections;
+    pthread_mutex_t lock;
+    rtmp_server_timers_t timers;        // deadlines of this loop's connections
+} rtmp_server_loop_t;
+
+// Handshake sizes: C0+C1+C2 in, S0+S1+S2 out
+#define RTMP_SERVER_HANDSHAKE_IN  (1 + 2 * RTMP_HANDSHAKE_SIZE)
+#define RTMP_SERVER_HANDSHAKE_OUT (1 + 2 * RTMP_HANDSHAKE_SIZE)
+
+// Footprint charged against the memory budget for each admitted connection
+#define RTMP_SERVER_CONN_COST (sizeof(rtmp_connection_t) + RTMP_SERVER_HANDSHAKE_OUT + RTMP_BUFFER_SIZE)
+
+// Resumable server handshake, held in conn->handshake_data until complete.
+// C1 is copied straight into the S2 slot as it arrives and C2 is only counted,
+// so a stalled client costs this struct and nothing else.
+typedef struct {
+    uint32_t received;                          // C0C1C2 bytes consumed
+    uint32_t sent;                              // S0S1S2 bytes written
+    uint8_t out[RTMP_SERVER_HANDSHAKE_OUT];     // S0 + S1 + S2 (echo of C1)
+} rtmp_server_handshake_t;
+
+// Named stream: one publisher fanning out to its players
+typedef struct rtmp_server_stream {
+    char key[RTMP_REGISTRY_MAX_NAME];   // "app/stream"
+    uint32_t refs;                      // attached connections, guarded by registry_lock
+    rtmp_connection_t* publisher;
+    rtmp_connection_t** subscribers;
+    uint32_t num_subscribers;
+    uint32_t max_subscribers;
+    rtmp_stream_callbacks_t callbacks;  // copied from stream_callbacks on creation
+    pthread_mutex_t lock;
+
+    // Start-up burst for late joiners; shares the buffers sent live
+    rtmp_msgbuf_t* metadata;            // Last onMetaData
+    rtmp_msgbuf_t* video_header;        // Video sequence header, any codec
+    rtmp_msgbuf_t* audio_header;        // AAC sequence header
+    rtmp_msgbuf_t** gop;                // Messages since the last keyframe
+    uint32_t gop_count;
+    uint32_t gop_capacity;
+    size_t gop_bytes;
+
+    rtmp_recording_t* recording;        // Current publisher's FLV file, when recording
+} rtmp_server_stream_t;
+
+// Playout state of one publisher, owned by the delivery thread
+typedef struct {
+    uint32_t source;
+    rtmp_jitter_t* jitter;
+    uint64_t last_ms;                   // Last frame in, for reaping
+} rtmp_server_jitter_entry_t;
+
+// Frame delivery off the network threads: one ring per producer thread
+// (each loop, or every threaded connection behind producer_lock). The
+// consumer paces each publisher's frames through its own jitter buffer.
+// producer_lock also covers rings coming and going, for stats readers.
+typedef struct {
+    rtmp_frame_ring_t** rings;
+    uint32_t num_rings;
+    pthread_mutex_t producer_lock;
+    pthread_mutex_t wake_lock;
+    pthread_cond_t wake;
+    bool waiting;                       // consumer is about to sleep
+    bool running;
+    pthread_t thread;
+    rtmp_server_jitter_entry_t* jitters;
+    uint32_t num_jitters;
+    uint32_t max_jitters;
+} rtmp_server_delivery_t;
+
+// Reference to one connection list
+typedef struct {
+    rtmp_connection_t** head;
+    uint32_t* count;
+    pthread_mutex_t* lock;
+} rtmp_server_list_t;
+
+// Connection received from a predecessor, resumed once the server starts
+typedef struct rtmp_server_adoptee {
+    rtmp_connection_t* conn;
+    rtmp_msgbuf_t* headers[3];          // Publisher's cached metadata and sequence headers
+    uint32_t num_headers;
+    uint8_t* parser;                    // Exported chunk parser state
+    size_t parser_length;
+    struct rtmp_server_adoptee* next;
+} rtmp_server_adoptee_t;
+
+// Publisher fed from a local FLV file through the same handlers as a socket
+typedef struct rtmp_server_file_source {
+    rtmp_file_source_t* source;
+    rtmp_connection_t* conn;            // Socketless; used by the source thread while it runs
+    struct rtmp_server_file_source* next;
+} rtmp_server_file_source_t;
+
+// Decoded AMF0 command: name, transaction id, command object, then arguments
+#define RTMP_SERVER_COMMAND_VALUES 8
+typedef struct {
+    rtmp_amf_value_t* values[RTMP_SERVER_COMMAND_VALUES];
+    uint32_t count;
+} rtmp_server_command_t;
 
 // Private variables
 static rtmp_server_context_t server_ctx;
+static rtmp_server_loop_t* server_loops;
+static uint32_t next_loop;
+static rtmp_registry_t* conns_by_fd;
+static rtmp_registry_t* publishers_by_name;
+static rtmp_registry_t* streams_by_name;
+static rtmp_registry_t* stream_callbacks;   // "app/stream" -> rtmp_stream_callbacks_t*, outlives the streams
+static rtmp_admission_t* admission;
+static bool admission_configured;         // Set limits win over the per-mode defaults
+static rtmp_server_adoptee_t* adopted_connections;
+static int* adopted_listeners;              // Taken by the next start; -1 once used
+static uint32_t num_adopted_listeners;
+static pthread_rwlock_t registry_lock = PTHREAD_RWLOCK_INITIALIZER;
+static rtmp_server_timers_t threaded_timers = { NULL, PTHREAD_MUTEX_INITIALIZER };
+static volatile uint64_t threaded_clock_ms;
+static uint32_t threaded_live;              // Client threads still running; each frees its own connection
+static bool listeners_handed_off;           // A successor shares the listening sockets; never shut them down
+static size_t send_budget_bytes = RTMP_SEND_QUEUE_MAX_BYTES;
+static rtmp_server_delivery_t frame_delivery = {
+    .producer_lock = PTHREAD_MUTEX_INITIALIZER, .wake_lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER
+};
+static uint32_t send_budget_ms = RTMP_SEND_QUEUE_LATENCY_MS;
+static uint32_t jitter_min_ms;
+static uint32_t jitter_max_ms = RTMP_FRAME_JITTER_MAX_MS;
+static uint32_t next_frame_source;
+static size_t send_aggregate_bytes;         // 0 sends every message on its own
+static char record_directory[RTMP_RECORD_PATH_SIZE];  // Empty: no recording
+static bool record_active;                  // Recorder running since the last start
+static uint32_t record_sequence;            // Tells apart recordings started in the same second
+static rtmp_server_file_source_t* file_sources;
+static pthread_mutex_t file_sources_lock = PTHREAD_MUTEX_INITIALIZER;
 static rtmp_connection_callback_t connection_callback;
 static rtmp_metadata_callback_t metadata_callback;
 static rtmp_frame_callback_t frame_callback;
@@ -25,26 +183,156 @@ static void* state_callback_data;
 static void* rtmp_server_accept_thread(void* arg);
 static void* rtmp_server_monitor_thread(void* arg);
 static bool rtmp_server_handle_connection(rtmp_connection_t* conn);
+static void* rtmp_server_client_thread(void* arg);
+static bool rtmp_server_spawn_client(rtmp_connection_t* conn);
 static void rtmp_server_cleanup_connection(rtmp_connection_t* conn);
 static void rtmp_server_update_state(rtmp_server_state_t new_state);
 static bool rtmp_connection_send_chunk(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk);
 static bool rtmp_connection_receive_chunk(rtmp_connection_t* conn);
 static void rtmp_connection_handle_message(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk);
 static bool rtmp_handshake_process(rtmp_connection_t* conn);
-static void rtmp_handle_connect(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk);
-static void rtmp_handle_create_stream(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk);
-static void rtmp_handle_play(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk);
-static void rtmp_handle_publish(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk);
+static void rtmp_connection_handle_command(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk);
+static bool rtmp_server_command_decode(const uint8_t* data, uint32_t length, rtmp_server_command_t* command);
+static void rtmp_server_command_free(rtmp_server_command_t* command);
+static const char* rtmp_server_command_string(const rtmp_server_command_t* command, uint32_t index);
+static double rtmp_server_command_transaction(const rtmp_server_command_t* command);
+static void rtmp_handle_connect(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk,
+                                const rtmp_server_command_t* command);
+static void rtmp_handle_create_stream(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk,
+                                      const rtmp_server_command_t* command);
+static void rtmp_handle_play(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk,
+                             const rtmp_server_command_t* command);
+static void rtmp_handle_publish(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk,
+                                const rtmp_server_command_t* command);
 static void rtmp_handle_video(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk);
 static void rtmp_handle_audio(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk);
 static void rtmp_handle_metadata(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk);
+static void rtmp_handle_aggregate(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk);
+static void rtmp_server_notify_metadata(rtmp_connection_t* conn);
+static bool rtmp_server_reactor_start(void);
+static void rtmp_server_reactor_stop(void);
+static void rtmp_server_reactor_destroy(void);
+static void rtmp_server_reactor_on_accept(rtmp_reactor_t* reactor, int fd, uint32_t events, void* userdata);
+static void rtmp_server_reactor_on_client(rtmp_reactor_t* reactor, int fd, uint32_t events, void* userdata);
+static void rtmp_server_reactor_update_interest(rtmp_connection_t* conn);
+static rtmp_server_handshake_t* rtmp_server_handshake_state(rtmp_connection_t* conn);
+static bool rtmp_server_handshake_input(rtmp_connection_t* conn, const uint8_t* data, size_t length, size_t* consumed);
+static bool rtmp_server_handshake_flush(rtmp_connection_t* conn);
+static bool rtmp_server_handshake_wants_write(rtmp_connection_t* conn);
+static bool rtmp_server_handshake_finish(rtmp_connection_t* conn);
+static bool rtmp_connection_process_input(rtmp_connection_t* conn, const uint8_t* data, size_t length);
+static void rtmp_connection_dispatch(rtmp_connection_t* conn);
+static int rtmp_server_open_listener(uint16_t port, bool reuse_port);
+static uint32_t rtmp_server_num_lists(void);
+static rtmp_server_list_t rtmp_server_list(uint32_t index);
+static rtmp_server_list_t rtmp_server_conn_list(rtmp_connection_t* conn);
+static void rtmp_server_track_connection(rtmp_connection_t* conn);
+static bool rtmp_server_list_unlink(rtmp_server_list_t list, rtmp_connection_t* conn);
+static void rtmp_server_index_publisher(rtmp_connection_t* conn);
+static void rtmp_server_unindex_publisher(rtmp_connection_t* conn);
+static rtmp_server_timers_t* rtmp_server_conn_timers(rtmp_connection_t* conn);
+static uint64_t rtmp_server_now_ms(rtmp_connection_t* conn);
+static void rtmp_server_start_timers(rtmp_connection_t* conn);
+static void rtmp_server_arm_timer(rtmp_connection_t* conn, rtmp_timer_t* timer, uint32_t timeout_ms);
+static void rtmp_server_cancel_timers(rtmp_connection_t* conn);
+static void rtmp_server_on_idle_timer(rtmp_timer_wheel_t* wheel, rtmp_timer_t* timer, void* userdata);
+static void rtmp_server_on_handshake_timer(rtmp_timer_wheel_t* wheel, rtmp_timer_t* timer, void* userdata);
+static void rtmp_server_on_ping_timer(rtmp_timer_wheel_t* wheel, rtmp_timer_t* timer, void* userdata);
+static void rtmp_server_reactor_on_tick(rtmp_reactor_t* reactor, uint64_t now_ms, void* userdata);
+static bool rtmp_connection_send_ping(rtmp_connection_t* conn);
+static bool rtmp_server_admit(int client_socket, const struct sockaddr_in* client_addr);
+static rtmp_connection_t* rtmp_server_connection_create(int socket);
+static void rtmp_server_collect_metrics(rtmp_metrics_global_t* global, void* userdata);
+static void rtmp_server_connection_free(rtmp_connection_t* conn);
+static rtmp_server_stream_t* rtmp_server_stream_attach(rtmp_connection_t* conn, bool publisher);
+static void rtmp_server_stream_detach(rtmp_connection_t* conn);
+static bool rtmp_server_stream_callbacks(rtmp_connection_t* conn, rtmp_stream_callbacks_t* callbacks);
+static void rtmp_server_free_value(void* value, void* userdata);
+static rtmp_msgbuf_t* rtmp_server_media_message(rtmp_chunk_stream_t* chunk, uint32_t csid);
+static void rtmp_server_stream_relay(rtmp_connection_t* publisher, rtmp_msgbuf_t* msg);
+static void rtmp_server_stream_fan_out(rtmp_server_stream_t* stream, rtmp_msgbuf_t* msg);
+static void rtmp_server_stream_fan_out_run(rtmp_server_stream_t* stream, rtmp_relay_run_t* run);
+static void rtmp_server_relay_flush(rtmp_connection_t* publisher);
+static void rtmp_server_stream_record(rtmp_server_stream_t* stream, bool publishing);
+static void rtmp_server_stream_cache(rtmp_server_stream_t* stream, rtmp_msgbuf_t* msg);
+static void rtmp_server_stream_replay(rtmp_server_stream_t* stream, rtmp_connection_t* conn);
+static void rtmp_server_stream_reset_cache(rtmp_server_stream_t* stream);
+static void rtmp_connection_enqueue(rtmp_connection_t* conn, rtmp_msgbuf_t* msg);
+static void rtmp_server_broadcast_control(rtmp_msgbuf_t* msg);
+static void rtmp_connection_enqueue_run(rtmp_connection_t* conn, rtmp_msgbuf_t* aggregate,
+                                        rtmp_msgbuf_t* const* msgs, uint32_t count);
+static bool rtmp_server_delivery_start(uint32_t num_loops);
+static void rtmp_server_delivery_stop(void);
+static void* rtmp_server_delivery_thread(void* arg);
+static void rtmp_server_deliver_frame(rtmp_connection_t* conn, rtmp_msgbuf_t* msg, bool is_keyframe);
+static void rtmp_server_delivery_receive(const rtmp_frame_t* frame);
+static int64_t rtmp_server_delivery_release(uint64_t now_ms, bool force, bool* delivered);
+static void rtmp_server_delivery_emit(rtmp_jitter_frame_t* frame);
+static bool rtmp_connection_flush(rtmp_connection_t* conn);
+static void rtmp_server_stop_accepting(void);
+static void rtmp_connection_close_when_flushed(rtmp_connection_t* conn);
+static bool rtmp_server_plays_live(rtmp_connection_t* conn);
+static void rtmp_server_end_publish(rtmp_connection_t* conn);
+static void rtmp_server_drain_audio_only(rtmp_connection_t* conn);
+static rtmp_msgbuf_t* rtmp_server_status_message(const char* code, const char* description);
+static bool rtmp_server_handoff_connection(int channel, rtmp_connection_t* conn);
+static rtmp_server_adoptee_t* rtmp_server_adopt_connection(const rtmp_handoff_record_t* record, int fd);
+static void rtmp_server_adopt_header(rtmp_server_adoptee_t* adoptee, const rtmp_handoff_record_t* record,
+                                     const uint8_t* payload);
+static void rtmp_server_resume_adopted(void);
+static void rtmp_server_resume_connection(rtmp_server_adoptee_t* adoptee);
+static void rtmp_server_free_adoptee(rtmp_server_adoptee_t* adoptee);
+static void rtmp_server_close_adopted_listeners(void);
+static void rtmp_server_discard_adopted(void);
+static bool rtmp_server_file_source_tag(const rtmp_flv_tag_t* tag, void* userdata);
+static void rtmp_server_file_source_unpublish(rtmp_connection_t* conn);
+static void rtmp_server_file_source_free(rtmp_server_file_source_t* entry);
+static void rtmp_server_stop_file_sources(void);
+
+// Admission limits for a mode the caller has not configured. Threaded mode keeps
+// its thread-per-client caps; the event loops are bounded by descriptors only.
+static void rtmp_server_default_limits(rtmp_server_io_mode_t mode, rtmp_admission_limits_t* limits) {
+    memset(limits, 0, sizeof(*limits));
+    if (mode == RTMP_SERVER_IO_THREADED) {
+        limits->max_connections = RTMP_MAX_CONNECTIONS;
+        limits->max_per_ip = RTMP_MAX_CONNECTIONS_PER_IP;
+        limits->max_handshakes = RTMP_MAX_PENDING_HANDSHAKES;
+        limits->memory_budget = RTMP_MEMORY_BUDGET;
+        return;
+    }
+
+    struct rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur != RLIM_INFINITY &&
+        lim.rlim_cur > RTMP_RESERVED_FDS * 2 && lim.rlim_cur - RTMP_RESERVED_FDS <= UINT32_MAX) {
+        limits->max_connections = (uint32_t)(lim.rlim_cur - RTMP_RESERVED_FDS);
+    }
+}
 
 // Initialize server
 bool rtmp_server_initialize(void) {
     memset(&server_ctx, 0, sizeof(server_ctx));
     pthread_mutex_init(&server_ctx.lock, NULL);
     server_ctx.state = RTMP_SERVER_STATE_STOPPED;
-    return true;
+    server_ctx.io_mode = RTMP_SERVER_IO_THREADED;
+
+    if (!conns_by_fd) {
+        conns_by_fd = rtmp_registry_create(RTMP_REGISTRY_KEY_FD, RTMP_REGISTRY_MIN_CAPACITY);
+    }
+    if (!publishers_by_name) {
+        publishers_by_name = rtmp_registry_create(RTMP_REGISTRY_KEY_NAME, RTMP_REGISTRY_MIN_CAPACITY);
+    }
+    if (!streams_by_name) {
+        streams_by_name = rtmp_registry_create(RTMP_REGISTRY_KEY_NAME, RTMP_REGISTRY_MIN_CAPACITY);
+    }
+    if (!stream_callbacks) {
+        stream_callbacks = rtmp_registry_create(RTMP_REGISTRY_KEY_NAME, RTMP_REGISTRY_MIN_CAPACITY);
+    }
+    if (!admission) {
+        rtmp_admission_limits_t limits;
+        rtmp_server_default_limits(RTMP_SERVER_IO_THREADED, &limits);
+        admission = rtmp_admission_create(&limits);
+    }
+    return conns_by_fd && publishers_by_name && streams_by_name && stream_callbacks && admission;
 }
 
 // Start server
@@ -53,19 +341,117 @@ bool rtmp_server_start(uint16_t port) {
         return false;
     }
 
-    // Create socket
-    server_ctx.listen_socket = socket(AF_INET, SOCK_STREAM, 0);
+    // Create listening socket; sharded loops open their own siblings on the same port.
+    // A successor keeps serving on the one its predecessor handed over.
+    if (num_adopted_listeners > 0 && adopted_listeners[0] >= 0) {
+        server_ctx.listen_socket = adopted_listeners[0];
+        adopted_listeners[0] = -1;
+    } else {
+        server_ctx.listen_socket = rtmp_server_open_listener(port, server_ctx.io_mode == RTMP_SERVER_IO_SHARDED);
+    }
     if (server_ctx.listen_socket < 0) {
         return false;
     }
 
-    // Set socket options
-    int reuse = 1;
-    if (setsockopt(server_ctx.listen_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0) {
+    if (!admission_configured) {
+        rtmp_admission_limits_t limits;
+        rtmp_server_default_limits(server_ctx.io_mode, &limits);
+        rtmp_admission_set_limits(admission, &limits);
+    }
+
+    if (server_ctx.io_mode != RTMP_SERVER_IO_THREADED && server_ctx.num_loops == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        server_ctx.num_loops = cpus > 0 ? (uint32_t)cpus : 1;
+    }
+
+    // The frame consumer runs before any producer can receive a frame
+    if (server_ctx.frame_delivery == RTMP_FRAME_DELIVERY_RING &&
+        !rtmp_server_delivery_start(server_ctx.io_mode == RTMP_SERVER_IO_THREADED ? 0 : server_ctx.num_loops)) {
+        rtmp_server_delivery_stop();
+        close(server_ctx.listen_socket);
+        return false;
+    }
+
+    // Published streams go to disk through the recorder's own writer thread
+    record_active = record_directory[0] && rtmp_record_start();
+    if (record_directory[0] && !record_active) {
+        rtmp_server_delivery_stop();
         close(server_ctx.listen_socket);
         return false;
     }
 
+    // Start threads
+    server_ctx.running = true;
+    server_ctx.accepting = true;
+    server_ctx.draining = false;
+    server_ctx.port = port;
+
+    if (server_ctx.io_mode != RTMP_SERVER_IO_THREADED) {
+        if (!rtmp_server_reactor_start()) {
+            rtmp_server_reactor_stop();
+            rtmp_server_reactor_destroy();
+            rtmp_server_delivery_stop();
+            rtmp_record_stop();
+            close(server_ctx.listen_socket);
+            server_ctx.running = false;
+            return false;
+        }
+    } else {
+        // Threaded connections share one wheel, driven by the monitor thread
+        threaded_clock_ms = rtmp_reactor_clock_ms();
+        threaded_timers.wheel = rtmp_timer_wheel_create(RTMP_REACTOR_TICK_MS, threaded_clock_ms);
+        if (!threaded_timers.wheel ||
+            pthread_create(&server_ctx.accept_thread, NULL, rtmp_server_accept_thread, NULL) != 0) {
+            rtmp_timer_wheel_destroy(threaded_timers.wheel);
+            threaded_timers.wheel = NULL;
+            rtmp_server_delivery_stop();
+            rtmp_record_stop();
+            close(server_ctx.listen_socket);
+            server_ctx.running = false;
+            return false;
+        }
+
+        if (pthread_create(&server_ctx.monitor_thread, NULL, rtmp_server_monitor_thread, NULL) != 0) {
+            server_ctx.running = false;
+            close(server_ctx.listen_socket);
+            pthread_join(server_ctx.accept_thread, NULL);
+            rtmp_timer_wheel_destroy(threaded_timers.wheel);
+            threaded_timers.wheel = NULL;
+            rtmp_server_delivery_stop();
+            rtmp_record_stop();
+            return false;
+        }
+    }
+
+    // Connections handed over by a predecessor rejoin once their owners run
+    rtmp_server_close_adopted_listeners();
+    rtmp_server_resume_adopted();
+
+    rtmp_server_update_state(RTMP_SERVER_STATE_RUNNING);
+    return true;
+}
+
+// Create a bound, listening TCP socket
+static int rtmp_server_open_listener(uint16_t port, bool reuse_port) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return -1;
+    }
+
+    // Set socket options
+    int reuse = 1;
+    if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0) {
+        close(sock);
+        return -1;
+    }
+
+    // Linux balances new connections across SO_REUSEPORT listeners; Darwin accepts
+    // the option but keeps delivering to one socket, so sharding there only splits loops
+    if (reuse_port && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) < 0) {
+        close(sock);
+        return -1;
+    }
+
     // Bind socket
     struct sockaddr_in addr;
     memset(&addr, 0, sizeof(addr));
@@ -73,41 +459,111 @@ bool rtmp_server_start(uint16_t port) {
     addr.sin_addr.s_addr = htonl(INADDR_ANY);
     addr.sin_port = htons(port);
 
-    if (bind(server_ctx.listen_socket, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-        close(server_ctx.listen_socket);
-        return false;
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
     }
 
-    // Listen for connections
-    if (listen(server_ctx.listen_socket, RTMP_MAX_CONNECTIONS) < 0) {
-        close(server_ctx.listen_socket);
-        return false;
+    // Listen for connections; admission sheds excess clients, not the kernel queue
+    if (listen(sock, SOMAXCONN) < 0) {
+        close(sock);
+        return -1;
     }
 
-    // Start threads
-    server_ctx.running = true;
-    server_ctx.port = port;
+    return sock;
+}
 
-    if (pthread_create(&server_ctx.accept_thread, NULL, rtmp_server_accept_thread, NULL) != 0) {
-        close(server_ctx.listen_socket);
-        server_ctx.running = false;
-        return false;
+// Number of connection lists: one global list, or one per loop when sharded
+static uint32_t rtmp_server_num_lists(void) {
+    if (server_ctx.io_mode == RTMP_SERVER_IO_SHARDED && server_loops) {
+        return server_ctx.num_loops;
+    }
+    return 1;
+}
+
+static rtmp_server_list_t rtmp_server_list(uint32_t index) {
+    rtmp_server_list_t list;
+    if (server_ctx.io_mode == RTMP_SERVER_IO_SHARDED && server_loops) {
+        list.head = &server_loops[index].connections;
+        list.count = &server_loops[index].num_connections;
+        list.lock = &server_loops[index].lock;
+    } else {
+        list.head = &server_ctx.connections;
+        list.count = &server_ctx.num_connections;
+        list.lock = &server_ctx.lock;
     }
+    return list;
+}
 
-    if (pthread_create(&server_ctx.monitor_thread, NULL, rtmp_server_monitor_thread, NULL) != 0) {
-        server_ctx.running = false;
-        pthread_join(server_ctx.accept_thread, NULL);
-        close(server_ctx.listen_socket);
+// List a connection belongs to
+static rtmp_server_list_t rtmp_server_conn_list(rtmp_connection_t* conn) {
+    return rtmp_server_list(server_ctx.io_mode == RTMP_SERVER_IO_SHARDED ? conn->loop_index : 0);
+}
+
+// Link a new connection into its list and the fd index
+static void rtmp_server_track_connection(rtmp_connection_t* conn) {
+    rtmp_server_list_t list = rtmp_server_conn_list(conn);
+    pthread_mutex_lock(list.lock);
+    conn->prev = NULL;
+    conn->next = *list.head;
+    if (*list.head) {
+        (*list.head)->prev = conn;
+    }
+    *list.head = conn;
+    (*list.count)++;
+    pthread_mutex_unlock(list.lock);
+
+    pthread_rwlock_wrlock(&registry_lock);
+    rtmp_registry_put_fd(conns_by_fd, conn->socket, conn);
+    pthread_rwlock_unlock(&registry_lock);
+}
+
+// O(1) unlink, caller holds list.lock; false if conn was not linked
+static bool rtmp_server_list_unlink(rtmp_server_list_t list, rtmp_connection_t* conn) {
+    if (!conn->prev && *list.head != conn) {
         return false;
     }
 
-    rtmp_server_update_state(RTMP_SERVER_STATE_RUNNING);
+    if (conn->prev) {
+        conn->prev->next = conn->next;
+    } else {
+        *list.head = conn->next;
+    }
+    if (conn->next) {
+        conn->next->prev = conn->prev;
+    }
+    conn->prev = NULL;
+    conn->next = NULL;
+    (*list.count)--;
     return true;
 }
 
+// Publishers are indexed by "app/stream" and by bare stream name, which is
+// what the public lookups are called with
+static void rtmp_server_index_publisher(rtmp_connection_t* conn) {
+    char key[RTMP_REGISTRY_MAX_NAME];
+    rtmp_registry_stream_key(key, sizeof(key), conn->metadata.app_name, conn->metadata.stream_name);
+
+    pthread_rwlock_wrlock(&registry_lock);
+    rtmp_registry_put_name(publishers_by_name, key, conn);
+    rtmp_registry_put_name(publishers_by_name, conn->metadata.stream_name, conn);
+    pthread_rwlock_unlock(&registry_lock);
+}
+
+// Drop this connection's name entries, leaving any newer publisher's in place
+static void rtmp_server_unindex_publisher(rtmp_connection_t* conn) {
+    char key[RTMP_REGISTRY_MAX_NAME];
+    rtmp_registry_stream_key(key, sizeof(key), conn->metadata.app_name, conn->metadata.stream_name);
+
+    pthread_rwlock_wrlock(&registry_lock);
+    rtmp_registry_remove_name(publishers_by_name, key, conn);
+    rtmp_registry_remove_name(publishers_by_name, conn->metadata.stream_name, conn);
+    pthread_rwlock_unlock(&registry_lock);
+}
+
 // Accept thread function
 static void* rtmp_server_accept_thread(void* arg) {
-    while (server_ctx.running) {
+    while (server_ctx.running && server_ctx.accepting) {
         struct sockaddr_in client_addr;
         socklen_t addr_len = sizeof(client_addr);
         
@@ -120,24 +576,24 @@ static void* rtmp_server_accept_thread(void* arg) {
             continue;
         }
 
+        // Shed load before anything is allocated for the client
+        if (!rtmp_server_admit(client_socket, &client_addr)) {
+            continue;
+        }
+
         // Create new connection
-        rtmp_connection_t* conn = calloc(1, sizeof(rtmp_connection_t));
+        rtmp_connection_t* conn = rtmp_server_connection_create(client_socket);
         if (!conn) {
+            rtmp_admission_release(admission, client_addr.sin_addr.s_addr, RTMP_SERVER_CONN_COST, true);
             close(client_socket);
             continue;
         }
-
-        conn->socket = client_socket;
-        conn->state = RTMP_CONN_STATE_NEW;
-        gettimeofday(&conn->last_recv_time, NULL);
-        gettimeofday(&conn->last_send_time, NULL);
+        conn->peer_addr = client_addr.sin_addr.s_addr;
+        conn->handshake_pending = true;
 
         // Add to connection list
-        pthread_mutex_lock(&server_ctx.lock);
-        conn->next = server_ctx.connections;
-        server_ctx.connections = conn;
-        server_ctx.num_connections++;
-        pthread_mutex_unlock(&server_ctx.lock);
+        rtmp_server_track_connection(conn);
+        rtmp_server_start_timers(conn);
 
         // Notify callback
         if (connection_callback) {
@@ -145,55 +601,194 @@ static void* rtmp_server_accept_thread(void* arg) {
         }
 
         // Handle connection in new thread
-        pthread_t thread;
-        if (pthread_create(&thread, NULL, (void*(*)(void*))rtmp_server_handle_connection, conn) != 0) {
-            rtmp_server_cleanup_connection(conn);
-            continue;
-        }
-        pthread_detach(thread);
+        rtmp_server_spawn_client(conn);
     }
 
     return NULL;
 }
 
-// Monitor thread function
+static void* rtmp_server_client_thread(void* arg) {
+    rtmp_server_handle_connection((rtmp_connection_t*)arg);
+    return NULL;
+}
+
+// Give conn its own thread; stop waits on threaded_live for every one started
+static bool rtmp_server_spawn_client(rtmp_connection_t* conn) {
+    pthread_t thread;
+    __atomic_add_fetch(&threaded_live, 1, __ATOMIC_RELAXED);
+    if (pthread_create(&thread, NULL, rtmp_server_client_thread, conn) != 0) {
+        rtmp_server_cleanup_connection(conn);
+        __atomic_sub_fetch(&threaded_live, 1, __ATOMIC_RELEASE);
+        return false;
+    }
+    pthread_detach(thread);
+    return true;
+}
+
+// Monitor thread function: drives the threaded-mode timer wheel
 static void* rtmp_server_monitor_thread(void* arg) {
     while (server_ctx.running) {
-        pthread_mutex_lock(&server_ctx.lock);
-        
-        struct timeval now;
-        gettimeofday(&now, NULL);
+        threaded_clock_ms = rtmp_reactor_clock_ms();
 
-        rtmp_connection_t* prev = NULL;
-        rtmp_connection_t* conn = server_ctx.connections;
+        pthread_mutex_lock(&threaded_timers.lock);
+        rtmp_timer_wheel_advance(threaded_timers.wheel, threaded_clock_ms);
+        pthread_mutex_unlock(&threaded_timers.lock);
 
-        while (conn) {
-            rtmp_connection_t* next = conn->next;
-            
-            // Check timeout
-            if (now.tv_sec - conn->last_recv_time.tv_sec > RTMP_TIMEOUT_SEC) {
-                // Remove from list
-                if (prev) {
-                    prev->next = next;
-                } else {
-                    server_ctx.connections = next;
-                }
-                server_ctx.num_connections--;
-                
-                // Cleanup connection
-                rtmp_server_cleanup_connection(conn);
-            } else {
-                prev = conn;
-            }
-            
-            conn = next;
+        usleep(RTMP_REACTOR_TICK_MS * 1000);
+    }
+
+    return NULL;
+}
+
+// Wheel owning a connection's deadlines
+static rtmp_server_timers_t* rtmp_server_conn_timers(rtmp_connection_t* conn) {
+    if (server_ctx.io_mode == RTMP_SERVER_IO_THREADED) {
+        return &threaded_timers;
+    }
+    return &server_loops[conn->loop_index].timers;
+}
+
+// Cached clock of the connection's owner; no syscall on the receive path.
+// Connections off every loop (file sources) read the clock itself.
+static uint64_t rtmp_server_now_ms(rtmp_connection_t* conn) {
+    if (server_ctx.io_mode == RTMP_SERVER_IO_THREADED) {
+        return threaded_clock_ms;
+    }
+    if (!conn->reactor_handle) {
+        return rtmp_reactor_clock_ms();
+    }
+    return rtmp_reactor_now_ms(server_loops[conn->loop_index].reactor);
+}
+
+// Arm the handshake and idle deadlines of a new connection
+static void rtmp_server_start_timers(rtmp_connection_t* conn) {
+    conn->last_recv_ms = rtmp_server_now_ms(conn);
+    conn->last_send_ms = conn->last_recv_ms;
+
+    rtmp_timer_init(&conn->idle_timer, rtmp_server_on_idle_timer, conn);
+    rtmp_timer_init(&conn->handshake_timer, rtmp_server_on_handshake_timer, conn);
+    rtmp_timer_init(&conn->ping_timer, rtmp_server_on_ping_timer, conn);
+
+    rtmp_server_arm_timer(conn, &conn->handshake_timer, RTMP_HANDSHAKE_TIMEOUT_SEC * 1000);
+    rtmp_server_arm_timer(conn, &conn->idle_timer, RTMP_TIMEOUT_SEC * 1000);
+}
+
+static void rtmp_server_arm_timer(rtmp_connection_t* conn, rtmp_timer_t* timer, uint32_t timeout_ms) {
+    rtmp_server_timers_t* timers = rtmp_server_conn_timers(conn);
+    pthread_mutex_lock(&timers->lock);
+    rtmp_timer_arm(timers->wheel, timer, timeout_ms);
+    pthread_mutex_unlock(&timers->lock);
+}
+
+static void rtmp_server_cancel_timers(rtmp_connection_t* conn) {
+    rtmp_server_timers_t* timers = rtmp_server_conn_timers(conn);
+    pthread_mutex_lock(&timers->lock);
+    rtmp_timer_cancel(timers->wheel, &conn->idle_timer);
+    rtmp_timer_cancel(timers->wheel, &conn->handshake_timer);
+    rtmp_timer_cancel(timers->wheel, &conn->ping_timer);
+    pthread_mutex_unlock(&timers->lock);
+}
+
+// Expiry callbacks run under the wheel lock on the wheel's thread. They never
+// free the connection: shutting the socket down makes its owner see EOF and
+// clean up on its own thread.
+
+// Idle timer is re-armed lazily: receives only stamp last_recv_ms
+static void rtmp_server_on_idle_timer(rtmp_timer_wheel_t* wheel, rtmp_timer_t* timer, void* userdata) {
+    rtmp_connection_t* conn = (rtmp_connection_t*)userdata;
+    uint64_t now = rtmp_timer_wheel_now_ms(wheel);
+    uint64_t idle = now > conn->last_recv_ms ? now - conn->last_recv_ms : 0;
+
+    if (idle >= RTMP_TIMEOUT_SEC * 1000) {
+        shutdown(conn->socket, SHUT_RDWR);
+        return;
+    }
+    rtmp_timer_arm(wheel, timer, (uint32_t)(RTMP_TIMEOUT_SEC * 1000 - idle));
+}
+
+static void rtmp_server_on_handshake_timer(rtmp_timer_wheel_t* wheel, rtmp_timer_t* timer, void* userdata) {
+    rtmp_connection_t* conn = (rtmp_connection_t*)userdata;
+    shutdown(conn->socket, SHUT_RDWR);
+}
+
+// Ping peers that have gone quiet; the reply counts as receive activity
+static void rtmp_server_on_ping_timer(rtmp_timer_wheel_t* wheel, rtmp_timer_t* timer, void* userdata) {
+    rtmp_connection_t* conn = (rtmp_connection_t*)userdata;
+
+    // A ping must not cut into a partially written relay message
+    if (rtmp_timer_wheel_now_ms(wheel) >= conn->last_recv_ms + RTMP_PING_INTERVAL_SEC * 1000 &&
+        !rtmp_send_queue_pending(&conn->send_queue)) {
+        if (conn->reactor_handle) {
+            // Reactor wheels fire on the connection's own loop thread
+            rtmp_connection_send_ping(conn);
+        } else {
+            conn->ping_pending = true;
         }
+    }
+    rtmp_timer_arm(wheel, timer, RTMP_PING_INTERVAL_SEC * 1000);
+}
+
+// Send a User Control PingRequest stamped with the owner's clock
+static bool rtmp_connection_send_ping(rtmp_connection_t* conn) {
+    uint32_t timestamp = (uint32_t)rtmp_server_now_ms(conn);
+    uint8_t ping[6];
+    ping[0] = 0;
+    ping[1] = 6; // PingRequest
+    ping[2] = (timestamp >> 24) & 0xff;
+    ping[3] = (timestamp >> 16) & 0xff;
+    ping[4] = (timestamp >> 8) & 0xff;
+    ping[5] = timestamp & 0xff;
+
+    rtmp_chunk_stream_t request;
+    memset(&request, 0, sizeof(request));
+    request.msg_type_id = RTMP_MSG_USER_CONTROL;
+    request.msg_stream_id = 0;
+    request.msg_length = 6;
+    request.msg_data = ping;
+
+    conn->ping_pending = false;
+    conn->last_send_ms = rtmp_server_now_ms(conn);
+    return rtmp_connection_send_chunk(conn, &request);
+}
+
+// Queue a message built by hand; protocol control goes on chunk stream 2, commands on 3
+static bool rtmp_connection_send_chunk(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk) {
+    uint32_t csid = chunk->msg_type_id <= RTMP_MSG_SET_PEER_BW ? RTMP_CHUNK_STREAM_PROTOCOL
+                                                                : RTMP_CHUNK_STREAM_COMMAND;
+    rtmp_msgbuf_t* msg = rtmp_msgbuf_create(csid, chunk->msg_type_id, chunk->timestamp, chunk->msg_stream_id,
+                                            chunk->msg_data, chunk->msg_length);
+    if (!msg) return false;
+
+    rtmp_connection_enqueue(conn, msg);
+    rtmp_msgbuf_release(msg);
+    return true;
+}
 
-        pthread_mutex_unlock(&server_ctx.lock);
-        sleep(1);
+// Wait up to a second for input, or for room when output is queued, then
+// read what arrived into the chunk stream; false once the peer is gone.
+// Only bytes read count as activity for the idle and ping deadlines.
+static bool rtmp_connection_receive_chunk(rtmp_connection_t* conn) {
+    struct pollfd pfd;
+    pfd.fd = conn->socket;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    pthread_mutex_lock(&conn->send_lock);
+    if (rtmp_send_queue_pending(&conn->send_queue)) {
+        pfd.events |= POLLOUT;
     }
+    pthread_mutex_unlock(&conn->send_lock);
 
-    return NULL;
+    int ready = poll(&pfd, 1, 1000);
+    if (ready < 0) return errno == EINTR;
+    if (ready == 0 || !(pfd.revents & (POLLIN | POLLHUP | POLLERR))) return true;
+
+    ssize_t bytes = rtmp_chunk_stream_receive(conn->chunk_stream, conn->socket);
+    if (bytes > 0) {
+        conn->last_recv_ms = threaded_clock_ms;
+        return true;
+    }
+    return bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
 }
 
 // Handle client connection
@@ -204,21 +799,16 @@ static bool rtmp_server_handle_connection(rtmp_connection_t* conn) {
     int flags = fcntl(conn->socket, F_GETFL, 0);
     fcntl(conn->socket, F_SETFL, flags | O_NONBLOCK);
 
-    // Initialize chunk stream
-    conn->chunk_stream = rtmp_chunk_stream_create();
+    // Initialize chunk stream, unless adopted with one, then handshake
     if (!conn->chunk_stream) {
-        rtmp_server_cleanup_connection(conn);
-        return false;
+        conn->chunk_stream = rtmp_chunk_stream_create();
     }
-
-    // Handshake
-    if (!rtmp_handshake_process(conn)) {
+    if (!conn->chunk_stream || !rtmp_handshake_process(conn)) {
         rtmp_server_cleanup_connection(conn);
+        __atomic_sub_fetch(&threaded_live, 1, __ATOMIC_RELEASE);
         return false;
     }
 
-    conn->state = RTMP_CONN_STATE_HANDSHAKE;
-
     // Main connection loop
     while (server_ctx.running) {
         // Receive chunks
@@ -227,16 +817,27 @@ static bool rtmp_server_handle_connection(rtmp_connection_t* conn) {
         }
 
         // Process chunks
-        rtmp_chunk_stream_t* chunk;
-        while ((chunk = rtmp_chunk_stream_get_next(conn->chunk_stream)) != NULL) {
-            rtmp_connection_handle_message(conn, chunk);
+        rtmp_connection_dispatch(conn);
+
+        rtmp_server_drain_audio_only(conn);
+
+        // Pings are raised by the monitor thread but written from here
+        if (conn->ping_pending) {
+            rtmp_connection_send_ping(conn);
         }
 
-        // Update timestamps
-        gettimeofday(&conn->last_recv_time, NULL);
+        // Relayed media left over when the socket was full
+        pthread_mutex_lock(&conn->send_lock);
+        bool flushed = rtmp_connection_flush(conn);
+        pthread_mutex_unlock(&conn->send_lock);
+        if (!flushed) {
+            break;
+        }
     }
 
+    // Last touch of server state: stop waits for this count before tearing down
     rtmp_server_cleanup_connection(conn);
+    __atomic_sub_fetch(&threaded_live, 1, __ATOMIC_RELEASE);
     return true;
 }
 
@@ -244,6 +845,32 @@ static bool rtmp_server_handle_connection(rtmp_connection_t* conn) {
 static void rtmp_server_cleanup_connection(rtmp_connection_t* conn) {
     if (!conn) return;
 
+    // Leave the stream first so no publisher enqueues to this connection again
+    rtmp_server_stream_detach(conn);
+
+    // Unregister from its event loop before the descriptor goes away
+    if (conn->reactor_handle) {
+        rtmp_reactor_remove(server_loops[conn->loop_index].reactor, conn->reactor_handle);
+        conn->reactor_handle = NULL;
+    }
+
+    // No deadline may fire once the connection is gone
+    rtmp_server_cancel_timers(conn);
+
+    // Drop index entries while the fd still belongs to this connection
+    pthread_rwlock_wrlock(&registry_lock);
+    rtmp_registry_remove_fd(conns_by_fd, conn->socket, conn);
+    pthread_rwlock_unlock(&registry_lock);
+    if (conn->is_publisher) {
+        rtmp_server_unindex_publisher(conn);
+    }
+
+    // Remove from list if still there, so no list walker sees the fd once it is closed
+    rtmp_server_list_t list = rtmp_server_conn_list(conn);
+    pthread_mutex_lock(list.lock);
+    rtmp_server_list_unlink(list, conn);
+    pthread_mutex_unlock(list.lock);
+
     // Close socket
     if (conn->socket >= 0) {
         close(conn->socket);
@@ -259,140 +886,1216 @@ static void rtmp_server_cleanup_connection(rtmp_connection_t* conn) {
         free(conn->handshake_data);
     }
 
-    // Remove from list if still there
-    pthread_mutex_lock(&server_ctx.lock);
-    rtmp_connection_t* prev = NULL;
-    rtmp_connection_t* current = server_ctx.connections;
-    
-    while (current) {
-        if (current == conn) {
-            if (prev) {
-                prev->next = current->next;
-            } else {
-                server_ctx.connections = current->next;
-            }
-            server_ctx.num_connections--;
-            break;
-        }
-        prev = current;
-        current = current->next;
-    }
-    
-    pthread_mutex_unlock(&server_ctx.lock);
-
     // Notify callback
     if (connection_callback) {
         connection_callback(conn, connection_callback_data);
     }
 
-    free(conn);
+    rtmp_server_connection_free(conn);
 }
 
-// Update server state with notification
-static void rtmp_server_update_state(rtmp_server_state_t new_state) {
-    server_ctx.state = new_state;
-    if (state_callback) {
-        state_callback(new_state, state_callback_data);
+// Admission check right after accept(); a rejected client is closed right away
+static bool rtmp_server_admit(int client_socket, const struct sockaddr_in* client_addr) {
+    rtmp_admission_verdict_t verdict = rtmp_admission_admit(admission, client_addr->sin_addr.s_addr,
+                                                            RTMP_SERVER_CONN_COST);
+    if (verdict == RTMP_ADMISSION_ACCEPT) {
+        return true;
     }
+
+    // Reset instead of FIN so a flood does not pile up sockets in TIME_WAIT
+    struct linger reset = { 1, 0 };
+    setsockopt(client_socket, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+    close(client_socket);
+    return false;
 }
 
-// Process RTMP handshake
-static bool rtmp_handshake_process(rtmp_connection_t* conn) {
-    uint8_t c0c1[1537]; // C0 + C1
-    uint8_t s0s1s2[3073]; // S0 + S1 + S2
-    ssize_t bytes;
+// Allocate a connection with an empty send queue
+static rtmp_connection_t* rtmp_server_connection_create(int socket) {
+    rtmp_connection_t* conn = calloc(1, sizeof(rtmp_connection_t));
+    if (!conn) return NULL;
 
-    // Receive C0+C1
-    bytes = recv(conn->socket, c0c1, sizeof(c0c1), MSG_WAITALL);
-    if (bytes != sizeof(c0c1)) {
-        return false;
+    if (!rtmp_send_queue_init(&conn->send_queue, RTMP_DEFAULT_CHUNK_SIZE)) {
+        free(conn);
+        return NULL;
+    }
+    rtmp_send_queue_set_budget(&conn->send_queue, send_budget_bytes, send_budget_ms);
+    conn->metrics = rtmp_metrics_acquire(socket);
+    pthread_mutex_init(&conn->send_lock, NULL);
+
+    conn->socket = socket;
+    conn->state = RTMP_CONN_STATE_NEW;
+#ifdef SO_NOSIGPIPE
+    // No MSG_NOSIGNAL here: a peer that hangs up must not kill the process
+    if (socket >= 0) {
+        int nosigpipe = 1;
+        setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE, &nosigpipe, sizeof(nosigpipe));
     }
+#endif
+    return conn;
+}
 
-    // Verify C0
-    if (c0c1[0] != 3) {
-        return false;
+static void rtmp_server_connection_free(rtmp_connection_t* conn) {
+    // Socketless publishers (file sources) never went through admission
+    if (conn->socket >= 0) {
+        rtmp_admission_release(admission, conn->peer_addr, RTMP_SERVER_CONN_COST, conn->handshake_pending);
     }
+    rtmp_metrics_release(conn->metrics);
+    rtmp_relay_run_clear(&conn->relay_run);
+    rtmp_send_queue_destroy(&conn->send_queue);
+    pthread_mutex_destroy(&conn->send_lock);
+    free(conn);
+}
 
-    // Generate S0+S1+S2
-    s0s1s2[0] = 3; // S0 - version
-    
-    // S1 - timestamp + zero + random bytes
-    uint32_t timestamp = (uint32_t)time(NULL);
-    memcpy(s0s1s2 + 1, &timestamp, 4);
-    memset(s0s1s2 + 5, 0, 4);
-    for (int i = 9; i < 1537; i++) {
-        s0s1s2[i] = rand() % 256;
+// Join the named stream as its publisher or as a player
+static rtmp_server_stream_t* rtmp_server_stream_attach(rtmp_connection_t* conn, bool publisher) {
+    char key[RTMP_REGISTRY_MAX_NAME];
+    rtmp_registry_stream_key(key, sizeof(key), conn->metadata.app_name, conn->metadata.stream_name);
+
+    rtmp_server_stream_detach(conn);
+
+    pthread_rwlock_wrlock(&registry_lock);
+    rtmp_server_stream_t* stream = rtmp_registry_get_name(streams_by_name, key);
+    if (!stream) {
+        stream = calloc(1, sizeof(rtmp_server_stream_t));
+        if (!stream || !rtmp_registry_put_name(streams_by_name, key, stream)) {
+            free(stream);
+            pthread_rwlock_unlock(&registry_lock);
+            return NULL;
+        }
+        strncpy(stream->key, key, sizeof(stream->key) - 1);
+        pthread_mutex_init(&stream->lock, NULL);
+
+        rtmp_stream_callbacks_t* callbacks = rtmp_registry_get_name(stream_callbacks, key);
+        if (callbacks) {
+            stream->callbacks = *callbacks;
+        }
+    }
+    stream->refs++;
+    pthread_rwlock_unlock(&registry_lock);
+
+    pthread_mutex_lock(&stream->lock);
+    bool attached = true;
+    if (publisher) {
+        // The newest publisher takes the stream over; its headers replace the old ones
+        stream->publisher = conn;
+        rtmp_server_stream_reset_cache(stream);
+        rtmp_server_stream_record(stream, true);
+    } else {
+        if (stream->num_subscribers == stream->max_subscribers) {
+            uint32_t capacity = stream->max_subscribers ? stream->max_subscribers * 2 : 8;
+            rtmp_connection_t** subscribers = realloc(stream->subscribers, capacity * sizeof(rtmp_connection_t*));
+            if (subscribers) {
+                stream->subscribers = subscribers;
+                stream->max_subscribers = capacity;
+            }
+        }
+        attached = stream->num_subscribers < stream->max_subscribers;
+        if (attached) {
+            stream->subscribers[stream->num_subscribers++] = conn;
+            rtmp_server_stream_replay(stream, conn);
+        }
     }
+    pthread_mutex_unlock(&stream->lock);
 
-    // S2 - echo client's timestamp + time2 + random echo
-    memcpy(s0s1s2 + 1537, c0c1 + 1, 1536);
+    if (!attached) {
+        // Drop the reference taken above
+        conn->stream = stream;
+        rtmp_server_stream_detach(conn);
+        return NULL;
+    }
 
-    // Send S0+S1+S2
-    bytes = send(conn->socket, s0s1s2, sizeof(s0s1s2), 0);
-    if (bytes != sizeof(s0s1s2)) {
-        return false;
+    conn->stream = stream;
+    rtmp_metrics_set_stream(conn->metrics, key, publisher ? RTMP_METRICS_ROLE_PUBLISHER : RTMP_METRICS_ROLE_PLAYER);
+    return stream;
+}
+
+// Leave the current stream; the last connection out frees it
+static void rtmp_server_stream_detach(rtmp_connection_t* conn) {
+    rtmp_server_stream_t* stream = conn->stream;
+    if (!stream) return;
+
+    pthread_mutex_lock(&stream->lock);
+    if (stream->publisher == conn) {
+        // Players get what was read before the publisher left
+        rtmp_server_stream_fan_out_run(stream, &conn->relay_run);
+        stream->publisher = NULL;
+        rtmp_server_stream_reset_cache(stream);
+        rtmp_server_stream_record(stream, false);
+    }
+    for (uint32_t i = 0; i < stream->num_subscribers; i++) {
+        if (stream->subscribers[i] == conn) {
+            stream->subscribers[i] = stream->subscribers[--stream->num_subscribers];
+            break;
+        }
     }
+    pthread_mutex_unlock(&stream->lock);
+    conn->stream = NULL;
 
-    // Receive C2
-    uint8_t c2[1536];
-    bytes = recv(conn->socket, c2, sizeof(c2), MSG_WAITALL);
-    if (bytes != sizeof(c2)) {
-        return false;
+    pthread_rwlock_wrlock(&registry_lock);
+    bool last = --stream->refs == 0;
+    if (last) {
+        rtmp_registry_remove_name(streams_by_name, stream->key, stream);
     }
+    pthread_rwlock_unlock(&registry_lock);
+
+    if (last) {
+        rtmp_server_stream_reset_cache(stream);
+        rtmp_record_close(stream->recording);
+        pthread_mutex_destroy(&stream->lock);
+        free(stream->subscribers);
+        free(stream->gop);
+        free(stream);
+    }
+}
 
+// Callbacks of the stream conn publishes, copied under the stream lock
+static bool rtmp_server_stream_callbacks(rtmp_connection_t* conn, rtmp_stream_callbacks_t* callbacks) {
+    rtmp_server_stream_t* stream = conn->stream;
+    if (!stream || stream->publisher != conn) return false;
+
+    pthread_mutex_lock(&stream->lock);
+    *callbacks = stream->callbacks;
+    pthread_mutex_unlock(&stream->lock);
     return true;
 }
 
-// Handle received RTMP message
-static void rtmp_connection_handle_message(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk) {
-    switch (chunk->msg_type_id) {
-        case RTMP_MSG_CONNECT:
-            rtmp_handle_connect(conn, chunk);
-            break;
-            
-        case RTMP_MSG_CREATE_STREAM:
-            rtmp_handle_create_stream(conn, chunk);
-            break;
-            
-        case RTMP_MSG_PLAY:
-            rtmp_handle_play(conn, chunk);
-            break;
-            
-        case RTMP_MSG_PUBLISH:
-            rtmp_handle_publish(conn, chunk);
-            break;
-            
+static void rtmp_server_free_value(void* value, void* userdata) {
+    free(value);
+}
+
+// Serialize a publisher message once for every consumer that shares it
+static rtmp_msgbuf_t* rtmp_server_media_message(rtmp_chunk_stream_t* chunk, uint32_t csid) {
+    return rtmp_msgbuf_create(csid, chunk->msg_type_id, chunk->timestamp, RTMP_RELAY_STREAM_ID,
+                              chunk->msg_data, chunk->msg_length);
+}
+
+// Queue the same buffer to every player of the publisher's stream. With
+// aggregation on, audio and video wait in the publisher's run until its pass
+// ends, and anything else goes out after the run so order is kept.
+static void rtmp_server_stream_relay(rtmp_connection_t* publisher, rtmp_msgbuf_t* msg) {
+    rtmp_server_stream_t* stream = publisher->stream;
+    if (!msg || !stream || stream->publisher != publisher) return;
+
+    pthread_mutex_lock(&stream->lock);
+    rtmp_relay_run_t* run = &publisher->relay_run;
+    if (!rtmp_relay_run_fits(run, msg, send_aggregate_bytes)) {
+        rtmp_server_stream_fan_out_run(stream, run);
+    }
+    if (rtmp_relay_run_fits(run, msg, send_aggregate_bytes)) {
+        rtmp_relay_run_add(run, msg);
+    } else {
+        rtmp_server_stream_fan_out(stream, msg);
+    }
+    pthread_mutex_unlock(&stream->lock);
+}
+
+// Cache, record and queue one message; caller holds stream->lock
+static void rtmp_server_stream_fan_out(rtmp_server_stream_t* stream, rtmp_msgbuf_t* msg) {
+    rtmp_server_stream_cache(stream, msg);
+    rtmp_record_write(stream->recording, msg);
+    for (uint32_t i = 0; i < stream->num_subscribers; i++) {
+        rtmp_connection_enqueue(stream->subscribers[i], msg);
+    }
+}
+
+// Pack the run once and queue the aggregate to every player. The cache and
+// the recording still take the messages one by one, and only now, so a player
+// joining mid-run never gets a frame twice. Caller holds stream->lock.
+static void rtmp_server_stream_fan_out_run(rtmp_server_stream_t* stream, rtmp_relay_run_t* run) {
+    if (!run->count) return;
+
+    for (uint32_t i = 0; i < run->count; i++) {
+        rtmp_server_stream_cache(stream, run->msgs[i]);
+        rtmp_record_write(stream->recording, run->msgs[i]);
+    }
+
+    rtmp_msgbuf_t* aggregate = NULL;
+    if (run->count > 1 && stream->num_subscribers) {
+        aggregate = rtmp_msgbuf_aggregate(run->msgs, run->count);
+    }
+    for (uint32_t i = 0; i < stream->num_subscribers; i++) {
+        rtmp_connection_enqueue_run(stream->subscribers[i], aggregate, run->msgs, run->count);
+    }
+    rtmp_msgbuf_release(aggregate);
+    rtmp_relay_run_clear(run);
+}
+
+// End of a publisher's input pass: its run goes out
+static void rtmp_server_relay_flush(rtmp_connection_t* publisher) {
+    rtmp_server_stream_t* stream = publisher->stream;
+    if (!publisher->relay_run.count) return;
+    if (!stream || stream->publisher != publisher) {
+        rtmp_relay_run_clear(&publisher->relay_run);
+        return;
+    }
+
+    pthread_mutex_lock(&stream->lock);
+    rtmp_server_stream_fan_out_run(stream, &publisher->relay_run);
+    pthread_mutex_unlock(&stream->lock);
+}
+
+// Finish the stream's recording and, for a new publisher, start the next
+// one as <directory>/<app>_<stream>-<date>-<time>-<sequence>.flv; caller
+// holds stream->lock
+static void rtmp_server_stream_record(rtmp_server_stream_t* stream, bool publishing) {
+    rtmp_record_close(stream->recording);
+    stream->recording = NULL;
+    if (!publishing || !record_active) return;
+
+    char name[RTMP_REGISTRY_MAX_NAME];
+    strncpy(name, stream->key, sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+    for (char* c = name; *c; c++) {
+        if (*c == '/' || *c == '\\') *c = '_';
+    }
+
+    char started[32];
+    time_t now = time(NULL);
+    struct tm local;
+    localtime_r(&now, &local);
+    strftime(started, sizeof(started), "%Y%m%d-%H%M%S", &local);
+
+    char path[RTMP_RECORD_PATH_SIZE];
+    uint32_t sequence = __atomic_add_fetch(&record_sequence, 1, __ATOMIC_RELAXED);
+    int length = snprintf(path, sizeof(path), "%s/%s-%s-%u.flv", record_directory, name, started, sequence);
+    if (length > 0 && (size_t)length < sizeof(path)) {
+        stream->recording = rtmp_record_open(path);
+    }
+}
+
+// Keep what a late joiner needs to start decoding; caller holds stream->lock
+static void rtmp_server_stream_cache(rtmp_server_stream_t* stream, rtmp_msgbuf_t* msg) {
+    const uint8_t* data = msg->payload;
+    rtmp_msgbuf_t** slot = NULL;
+    rtmp_flv_video_t video;
+    rtmp_flv_audio_t audio;
+    bool keyframe = false;
+
+    switch (msg->type) {
         case RTMP_MSG_VIDEO:
-            rtmp_handle_video(conn, chunk);
+            if (!rtmp_flv_parse_video(data, msg->length, &video)) break;
+            if (video.sequence_header) {
+                slot = &stream->video_header;
+            }
+            keyframe = video.keyframe;
             break;
-            
         case RTMP_MSG_AUDIO:
-            rtmp_handle_audio(conn, chunk);
+            if (rtmp_flv_parse_audio(data, msg->length, &audio) && audio.sequence_header) {
+                slot = &stream->audio_header;
+            }
             break;
-            
-        case RTMP_MSG_DATA:
-        case RTMP_MSG_METADATA:
-            rtmp_handle_metadata(conn, chunk);
+        case RTMP_MSG_DATA_AMF0:
+        case RTMP_MSG_DATA_AMF3:
+            slot = &stream->metadata;
             break;
+        default:
+            return;
     }
-}
 
-// Handle connect command
-static void rtmp_handle_connect(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk) {
-    // Parse connect parameters
-    rtmp_amf_data_t* amf = rtmp_amf_decode(chunk->msg_data, chunk->msg_length);
-    if (!amf) return;
+    if (slot) {
+        rtmp_msgbuf_release(*slot);
+        *slot = rtmp_msgbuf_retain(msg);
+        return;
+    }
 
-    // Get app name
-    rtmp_amf_data_t* app = rtmp_amf_get_prop(amf, "app");
-    if (app && app->type == RTMP_AMF_STRING) {
-        strncpy(conn->metadata.app_name, app->string_data, sizeof(conn->metadata.app_name)-1);
+    // A keyframe opens a new GOP; anything before the first one is undecodable
+    if (keyframe) {
+        while (stream->gop_count) {
+            rtmp_msgbuf_release(stream->gop[--stream->gop_count]);
+        }
+        stream->gop_bytes = 0;
+    } else if (stream->gop_count == 0) {
+        return;
     }
 
-    // Send Window Acknowledgement Size
-    uint8_t ack_size[4];
-    uint32_t window_size = RTMP_BUFFER_SIZE;
-    ack_size[0] = (window_size >> 24) & 0xff;
+    // Over budget: drop the GOP rather than keep a tail with no keyframe
+    if (stream->gop_bytes + msg->length > RTMP_GOP_CACHE_BYTES) {
+        while (stream->gop_count) {
+            rtmp_msgbuf_release(stream->gop[--stream->gop_count]);
+        }
+        stream->gop_bytes = 0;
+        return;
+    }
+
+    if (stream->gop_count == stream->gop_capacity) {
+        uint32_t capacity = stream->gop_capacity ? stream->gop_capacity * 2 : 64;
+        rtmp_msgbuf_t** gop = realloc(stream->gop, capacity * sizeof(rtmp_msgbuf_t*));
+        if (!gop) return;
+        stream->gop = gop;
+        stream->gop_capacity = capacity;
+    }
+
+    stream->gop[stream->gop_count++] = rtmp_msgbuf_retain(msg);
+    stream->gop_bytes += msg->length;
+}
+
+// Queue the cached burst to a new player; caller holds stream->lock
+static void rtmp_server_stream_replay(rtmp_server_stream_t* stream, rtmp_connection_t* conn) {
+    if (stream->metadata) {
+        rtmp_connection_enqueue(conn, stream->metadata);
+    }
+    if (stream->video_header) {
+        rtmp_connection_enqueue(conn, stream->video_header);
+    }
+    if (stream->audio_header) {
+        rtmp_connection_enqueue(conn, stream->audio_header);
+    }
+    for (uint32_t i = 0; i < stream->gop_count; i++) {
+        rtmp_connection_enqueue(conn, stream->gop[i]);
+    }
+}
+
+static void rtmp_server_stream_reset_cache(rtmp_server_stream_t* stream) {
+    rtmp_msgbuf_release(stream->metadata);
+    rtmp_msgbuf_release(stream->video_header);
+    rtmp_msgbuf_release(stream->audio_header);
+    stream->metadata = NULL;
+    stream->video_header = NULL;
+    stream->audio_header = NULL;
+
+    while (stream->gop_count) {
+        rtmp_msgbuf_release(stream->gop[--stream->gop_count]);
+    }
+    stream->gop_bytes = 0;
+}
+
+// Queue a shared message and write what the socket takes right away.
+// A player past its budget loses video until the next keyframe.
+static void rtmp_connection_enqueue(rtmp_connection_t* conn, rtmp_msgbuf_t* msg) {
+    rtmp_connection_enqueue_run(conn, NULL, &msg, 1);
+}
+
+// Queue a publisher run, as its aggregate when there is one
+static void rtmp_connection_enqueue_run(rtmp_connection_t* conn, rtmp_msgbuf_t* aggregate,
+                                        rtmp_msgbuf_t* const* msgs, uint32_t count) {
+    pthread_mutex_lock(&conn->send_lock);
+    if (!rtmp_send_queue_push_run(&conn->send_queue, aggregate, msgs, count) || !rtmp_connection_flush(conn)) {
+        // The owner sees EOF and tears the connection down on its own thread
+        shutdown(conn->socket, SHUT_RDWR);
+    }
+    conn->metadata.dropped_frames = conn->send_queue.dropped;
+    rtmp_metrics_set(conn->metrics, &conn->metrics->dropped_frames, conn->send_queue.dropped);
+    pthread_mutex_unlock(&conn->send_lock);
+}
+
+// Write queued messages; caller holds send_lock
+static bool rtmp_connection_flush(rtmp_connection_t* conn) {
+    size_t written = 0;
+    bool ok = rtmp_send_queue_flush(&conn->send_queue, conn->socket, &written);
+
+    conn->bytes_sent += (uint32_t)written;
+    conn->metadata.bytes_out += written;
+    rtmp_metrics_add(conn->metrics, &conn->metrics->bytes_out, written);
+    rtmp_metrics_set(conn->metrics, &conn->metrics->queue_depth, conn->send_queue.count);
+    rtmp_metrics_set(conn->metrics, &conn->metrics->queue_bytes, conn->send_queue.bytes);
+
+    // Half-close so what was queued still reaches the peer; its EOF ends the connection
+    if (ok && conn->closing && !rtmp_send_queue_pending(&conn->send_queue)) {
+        shutdown(conn->socket, SHUT_WR);
+    }
+
+    if (conn->reactor_handle) {
+        rtmp_server_reactor_update_interest(conn);
+    }
+    return ok;
+}
+
+// One lock-free ring per event loop, plus the last one shared under
+// producer_lock by client threads and file sources
+static bool rtmp_server_delivery_start(uint32_t num_loops) {
+    uint32_t num_rings = num_loops + 1;
+    rtmp_frame_ring_t** rings = calloc(num_rings, sizeof(rtmp_frame_ring_t*));
+    if (!rings) return false;
+
+    // Published whole, so a scrape never sees a ring missing
+    bool created = true;
+    for (uint32_t i = 0; i < num_rings && created; i++) {
+        rings[i] = rtmp_frame_ring_create(RTMP_FRAME_RING_CAPACITY);
+        created = rings[i] != NULL;
+    }
+    pthread_mutex_lock(&frame_delivery.producer_lock);
+    frame_delivery.rings = rings;
+    frame_delivery.num_rings = created ? num_rings : 0;
+    pthread_mutex_unlock(&frame_delivery.producer_lock);
+    if (!created) {
+        for (uint32_t i = 0; i < num_rings; i++) {
+            rtmp_frame_ring_destroy(rings[i]);
+        }
+        return false;
+    }
+
+    frame_delivery.running = true;
+    if (pthread_create(&frame_delivery.thread, NULL, rtmp_server_delivery_thread, NULL) != 0) {
+        frame_delivery.running = false;
+        return false;
+    }
+    return true;
+}
+
+// Stop the consumer after the producers; queued frames are still delivered
+static void rtmp_server_delivery_stop(void) {
+    if (!frame_delivery.rings) return;
+
+    if (frame_delivery.running) {
+        pthread_mutex_lock(&frame_delivery.wake_lock);
+        frame_delivery.running = false;
+        pthread_cond_signal(&frame_delivery.wake);
+        pthread_mutex_unlock(&frame_delivery.wake_lock);
+        pthread_join(frame_delivery.thread, NULL);
+    }
+
+    pthread_mutex_lock(&frame_delivery.producer_lock);
+    rtmp_frame_ring_t** rings = frame_delivery.rings;
+    uint32_t num_rings = frame_delivery.num_rings;
+    frame_delivery.rings = NULL;
+    frame_delivery.num_rings = 0;
+    pthread_mutex_unlock(&frame_delivery.producer_lock);
+
+    for (uint32_t i = 0; i < num_rings; i++) {
+        rtmp_frame_ring_destroy(rings[i]);
+    }
+    free(rings);
+
+    for (uint32_t i = 0; i < frame_delivery.num_jitters; i++) {
+        rtmp_jitter_destroy(frame_delivery.jitters[i].jitter);
+    }
+    free(frame_delivery.jitters);
+    frame_delivery.jitters = NULL;
+    frame_delivery.num_jitters = 0;
+    frame_delivery.max_jitters = 0;
+}
+
+// Drain every ring into the jitter buffers and hand frame_callback whatever
+// is due; sleep until the next frame is due or a ring fills
+static void* rtmp_server_delivery_thread(void* arg) {
+    int64_t wait = -1;
+
+    for (;;) {
+        bool delivered = false;
+
+        for (uint32_t i = 0; i < frame_delivery.num_rings; i++) {
+            rtmp_frame_t frame;
+            while (rtmp_frame_ring_pop(frame_delivery.rings[i], &frame)) {
+                rtmp_server_delivery_receive(&frame);
+                rtmp_msgbuf_release(frame.msg);
+                delivered = true;
+            }
+        }
+        wait = rtmp_server_delivery_release(rtmp_reactor_clock_ms(), false, &delivered);
+        if (delivered) continue;
+
+        pthread_mutex_lock(&frame_delivery.wake_lock);
+        if (!frame_delivery.running) {
+            pthread_mutex_unlock(&frame_delivery.wake_lock);
+            break;
+        }
+
+        // Announce the sleep, then look once more so a racing push is not missed
+        __atomic_store_n(&frame_delivery.waiting, true, __ATOMIC_SEQ_CST);
+        bool empty = true;
+        for (uint32_t i = 0; i < frame_delivery.num_rings && empty; i++) {
+            empty = rtmp_frame_ring_occupancy(frame_delivery.rings[i]) == 0;
+        }
+        if (empty) {
+            long sleep_ms = wait >= 0 && wait < RTMP_REACTOR_TICK_MS ? (long)wait : RTMP_REACTOR_TICK_MS;
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += sleep_ms * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&frame_delivery.wake, &frame_delivery.wake_lock, &deadline);
+        }
+        __atomic_store_n(&frame_delivery.waiting, false, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&frame_delivery.wake_lock);
+    }
+
+    // Nothing is held back past a stop
+    bool delivered = false;
+    rtmp_server_delivery_release(0, true, &delivered);
+    return NULL;
+}
+
+// Queue a popped frame on its publisher's jitter buffer; the ring keeps its reference
+static void rtmp_server_delivery_receive(const rtmp_frame_t* frame) {
+    rtmp_server_jitter_entry_t* entry = NULL;
+    for (uint32_t i = 0; i < frame_delivery.num_jitters && !entry; i++) {
+        if (frame_delivery.jitters[i].source == frame->source) {
+            entry = &frame_delivery.jitters[i];
+        }
+    }
+
+    if (!entry) {
+        if (frame_delivery.num_jitters == frame_delivery.max_jitters) {
+            uint32_t capacity = frame_delivery.max_jitters ? frame_delivery.max_jitters * 2 : 4;
+            rtmp_server_jitter_entry_t* jitters =
+                realloc(frame_delivery.jitters, capacity * sizeof(rtmp_server_jitter_entry_t));
+            if (jitters) {
+                frame_delivery.jitters = jitters;
+                frame_delivery.max_jitters = capacity;
+            }
+        }
+        rtmp_jitter_t* jitter = frame_delivery.num_jitters < frame_delivery.max_jitters
+                                    ? rtmp_jitter_create(jitter_min_ms, jitter_max_ms)
+                                    : NULL;
+        if (jitter) {
+            entry = &frame_delivery.jitters[frame_delivery.num_jitters++];
+            entry->source = frame->source;
+            entry->jitter = jitter;
+        }
+    }
+
+    // Out of memory: hand it over unpaced rather than lose it
+    if (!entry) {
+        rtmp_jitter_frame_t unpaced = { rtmp_msgbuf_retain(frame->msg), frame->is_keyframe, frame->msg->timestamp };
+        rtmp_server_delivery_emit(&unpaced);
+        return;
+    }
+
+    // A full buffer gives up its oldest frame early
+    entry->last_ms = frame->arrival_ms;
+    while (!rtmp_jitter_push(entry->jitter, frame->msg, frame->is_keyframe, frame->msg->timestamp,
+                             frame->arrival_ms)) {
+        rtmp_jitter_frame_t oldest;
+        rtmp_jitter_pop(entry->jitter, frame->arrival_ms, true, &oldest);
+        rtmp_server_delivery_emit(&oldest);
+    }
+}
+
+// Deliver every due frame, reap idle publishers, and return the wait until the
+// next frame is due (-1 when none is held)
+static int64_t rtmp_server_delivery_release(uint64_t now_ms, bool force, bool* delivered) {
+    int64_t wait = -1;
+
+    for (uint32_t i = 0; i < frame_delivery.num_jitters;) {
+        rtmp_server_jitter_entry_t* entry = &frame_delivery.jitters[i];
+        rtmp_jitter_frame_t frame;
+        while (rtmp_jitter_pop(entry->jitter, now_ms, force, &frame)) {
+            rtmp_server_delivery_emit(&frame);
+            *delivered = true;
+        }
+
+        int64_t next = rtmp_jitter_wait_ms(entry->jitter, now_ms);
+        if (next < 0 && now_ms >= entry->last_ms + RTMP_FRAME_JITTER_IDLE_MS) {
+            rtmp_jitter_destroy(entry->jitter);
+            *entry = frame_delivery.jitters[--frame_delivery.num_jitters];
+            continue;
+        }
+        if (next >= 0 && (wait < 0 || next < wait)) {
+            wait = next;
+        }
+        i++;
+    }
+
+    return wait;
+}
+
+// Hand one frame to frame_callback and drop the reference
+static void rtmp_server_delivery_emit(rtmp_jitter_frame_t* frame) {
+    rtmp_msgbuf_t* msg = frame->msg;
+    if (frame_callback) {
+        frame_callback(msg->payload, msg->length, frame->timestamp, frame->is_keyframe, frame_callback_data);
+    }
+    rtmp_msgbuf_release(msg);
+}
+
+// Push from the receiving thread; a full ring drops the frame and counts it
+static void rtmp_server_deliver_frame(rtmp_connection_t* conn, rtmp_msgbuf_t* msg, bool is_keyframe) {
+    // Only a loop thread pushes to its own ring; everyone else shares the last one
+    bool shared = !conn->reactor_handle;
+    rtmp_frame_ring_t* ring = frame_delivery.rings[shared ? frame_delivery.num_rings - 1 : conn->loop_index];
+
+    if (shared) {
+        pthread_mutex_lock(&frame_delivery.producer_lock);
+    }
+    // Each publisher gets its own jitter buffer on the consumer side
+    if (!conn->frame_source) {
+        do {
+            conn->frame_source = __atomic_add_fetch(&next_frame_source, 1, __ATOMIC_RELAXED);
+        } while (!conn->frame_source);
+    }
+
+    rtmp_frame_t frame;
+    frame.msg = msg;
+    frame.is_keyframe = is_keyframe;
+    frame.source = conn->frame_source;
+    frame.arrival_ms = rtmp_server_now_ms(conn);
+
+    bool queued = rtmp_frame_ring_push(ring, &frame);
+    if (shared) {
+        pthread_mutex_unlock(&frame_delivery.producer_lock);
+    }
+
+    if (queued && __atomic_load_n(&frame_delivery.waiting, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&frame_delivery.wake_lock);
+        pthread_cond_signal(&frame_delivery.wake);
+        pthread_mutex_unlock(&frame_delivery.wake_lock);
+    }
+}
+
+// Update server state with notification
+static void rtmp_server_update_state(rtmp_server_state_t new_state) {
+    server_ctx.state = new_state;
+    if (state_callback) {
+        state_callback(new_state, state_callback_data);
+    }
+}
+
+// Process RTMP handshake on a thread-per-connection socket. The socket is
+// non-blocking, so wait with poll() and let the resumable state machine
+// consume whatever arrives; never read past C2 so chunk data stays queued.
+static bool rtmp_handshake_process(rtmp_connection_t* conn) {
+    // Adopted connections are already past it
+    if (conn->state != RTMP_CONN_STATE_NEW) return true;
+
+    rtmp_server_handshake_t* hs = rtmp_server_handshake_state(conn);
+    if (!hs) return false;
+
+    uint8_t buf[RTMP_HANDSHAKE_SIZE];
+
+    // The handshake timer shuts the socket down if the peer stalls
+    while (!rtmp_server_handshake_finish(conn)) {
+        if (!server_ctx.running) {
+            return false;
+        }
+
+        struct pollfd pfd;
+        pfd.fd = conn->socket;
+        pfd.events = 0;
+        pfd.revents = 0;
+        if (hs->received < RTMP_SERVER_HANDSHAKE_IN) pfd.events |= POLLIN;
+        if (rtmp_server_handshake_wants_write(conn)) pfd.events |= POLLOUT;
+
+        int ready = poll(&pfd, 1, 1000);
+        if (ready < 0 && errno != EINTR) return false;
+        if (ready <= 0) continue;
+        if (pfd.revents & (POLLERR | POLLNVAL)) return false;
+
+        if (pfd.revents & (POLLIN | POLLHUP)) {
+            size_t want = RTMP_SERVER_HANDSHAKE_IN - hs->received;
+            if (want > sizeof(buf)) want = sizeof(buf);
+
+            ssize_t bytes = recv(conn->socket, buf, want, 0);
+            if (bytes == 0) return false;
+            if (bytes < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) return false;
+            } else {
+                size_t consumed = 0;
+                if (!rtmp_server_handshake_input(conn, buf, (size_t)bytes, &consumed)) {
+                    return false;
+                }
+            }
+        }
+
+        if (!rtmp_server_handshake_flush(conn)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Lazily allocate handshake state and prepare S0+S1
+static rtmp_server_handshake_t* rtmp_server_handshake_state(rtmp_connection_t* conn) {
+    if (conn->handshake_data) {
+        return (rtmp_server_handshake_t*)conn->handshake_data;
+    }
+
+    rtmp_server_handshake_t* hs = calloc(1, sizeof(rtmp_server_handshake_t));
+    if (!hs) return NULL;
+
+    // S0 - version
+    hs->out[0] = RTMP_VERSION;
+
+    // S1 - timestamp + zero + random bytes
+    uint32_t timestamp = (uint32_t)time(NULL);
+    memcpy(hs->out + 1, &timestamp, 4);
+    memset(hs->out + 5, 0, 4);
+    for (int i = 9; i < 1 + RTMP_HANDSHAKE_SIZE; i++) {
+        hs->out[i] = rand() % 256;
+    }
+
+    conn->handshake_data = hs;
+    return hs;
+}
+
+// Consume handshake bytes; anything past C2 is left for the chunk parser
+static bool rtmp_server_handshake_input(rtmp_connection_t* conn, const uint8_t* data, size_t length, size_t* consumed) {
+    rtmp_server_handshake_t* hs = rtmp_server_handshake_state(conn);
+    if (!hs) return false;
+
+    size_t offset = 0;
+    while (offset < length && hs->received < RTMP_SERVER_HANDSHAKE_IN) {
+        // C0 - version
+        if (hs->received == 0) {
+            if (data[offset] != RTMP_VERSION) {
+                return false;
+            }
+            hs->received++;
+            offset++;
+            continue;
+        }
+
+        size_t take = length - offset;
+        if (hs->received <= RTMP_HANDSHAKE_SIZE) {
+            // C1 - echoed back verbatim as S2
+            size_t c1_left = 1 + RTMP_HANDSHAKE_SIZE - hs->received;
+            if (take > c1_left) take = c1_left;
+            memcpy(hs->out + 1 + RTMP_HANDSHAKE_SIZE + (hs->received - 1), data + offset, take);
+        } else {
+            // C2 - carries nothing we validate
+            size_t c2_left = RTMP_SERVER_HANDSHAKE_IN - hs->received;
+            if (take > c2_left) take = c2_left;
+        }
+
+        hs->received += take;
+        offset += take;
+    }
+
+    *consumed = offset;
+    return true;
+}
+
+// Bytes of S0S1S2 that may go out: S0S1 once C0 is in, S2 once C1 is complete
+static uint32_t rtmp_server_handshake_ready(rtmp_server_handshake_t* hs) {
+    if (hs->received > RTMP_HANDSHAKE_SIZE) return RTMP_SERVER_HANDSHAKE_OUT;
+    if (hs->received > 0) return 1 + RTMP_HANDSHAKE_SIZE;
+    return 0;
+}
+
+// Write as much of S0S1S2 as the socket takes; false only on a hard error
+static bool rtmp_server_handshake_flush(rtmp_connection_t* conn) {
+    rtmp_server_handshake_t* hs = (rtmp_server_handshake_t*)conn->handshake_data;
+    if (!hs) return true;
+
+    uint32_t ready = rtmp_server_handshake_ready(hs);
+    while (hs->sent < ready) {
+        ssize_t bytes = send(conn->socket, hs->out + hs->sent, ready - hs->sent, RTMP_RELAY_SEND_FLAGS);
+        if (bytes > 0) {
+            hs->sent += (uint32_t)bytes;
+            continue;
+        }
+        if (bytes < 0 && errno == EINTR) continue;
+        if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+        return false;
+    }
+
+    return true;
+}
+
+static bool rtmp_server_handshake_wants_write(rtmp_connection_t* conn) {
+    rtmp_server_handshake_t* hs = (rtmp_server_handshake_t*)conn->handshake_data;
+    return hs && hs->sent < rtmp_server_handshake_ready(hs);
+}
+
+// Release handshake state once C2 is in and S0S1S2 is out; true when done
+static bool rtmp_server_handshake_finish(rtmp_connection_t* conn) {
+    if (conn->state != RTMP_CONN_STATE_NEW) return true;
+
+    rtmp_server_handshake_t* hs = (rtmp_server_handshake_t*)conn->handshake_data;
+    if (!hs || hs->received < RTMP_SERVER_HANDSHAKE_IN || hs->sent < RTMP_SERVER_HANDSHAKE_OUT) {
+        return false;
+    }
+
+    free(hs);
+    conn->handshake_data = NULL;
+    conn->state = RTMP_CONN_STATE_HANDSHAKE;
+
+    rtmp_metrics_handshake_done(conn->metrics);
+
+    // Free the handshake slot for the next client
+    if (conn->handshake_pending) {
+        conn->handshake_pending = false;
+        rtmp_admission_handshake_done(admission);
+    }
+
+    rtmp_server_timers_t* timers = rtmp_server_conn_timers(conn);
+    pthread_mutex_lock(&timers->lock);
+    rtmp_timer_cancel(timers->wheel, &conn->handshake_timer);
+    rtmp_timer_arm(timers->wheel, &conn->ping_timer, RTMP_PING_INTERVAL_SEC * 1000);
+    pthread_mutex_unlock(&timers->lock);
+    return true;
+}
+
+// Start event loops and register the listener
+static bool rtmp_server_reactor_start(void) {
+    server_loops = calloc(server_ctx.num_loops, sizeof(rtmp_server_loop_t));
+    if (!server_loops) return false;
+
+    for (uint32_t i = 0; i < server_ctx.num_loops; i++) {
+        server_loops[i].listen_socket = -1;
+        pthread_mutex_init(&server_loops[i].lock, NULL);
+        pthread_mutex_init(&server_loops[i].timers.lock, NULL);
+    }
+
+    for (uint32_t i = 0; i < server_ctx.num_loops; i++) {
+        server_loops[i].reactor = rtmp_reactor_create();
+        server_loops[i].scratch = malloc(RTMP_BUFFER_SIZE);
+        server_loops[i].timers.wheel = rtmp_timer_wheel_create(RTMP_REACTOR_TICK_MS, rtmp_reactor_clock_ms());
+        if (!server_loops[i].reactor || !server_loops[i].scratch || !server_loops[i].timers.wheel) {
+            return false;
+        }
+        rtmp_reactor_set_tick_callback(server_loops[i].reactor, rtmp_server_reactor_on_tick, &server_loops[i]);
+    }
+
+    // Sharded: every loop accepts on its own SO_REUSEPORT sibling of the main listener.
+    // Otherwise the listener lives on the first loop and connections are spread round-robin.
+    bool sharded = server_ctx.io_mode == RTMP_SERVER_IO_SHARDED;
+    uint32_t num_listeners = sharded ? server_ctx.num_loops : 1;
+
+    for (uint32_t i = 0; i < num_listeners; i++) {
+        int sock = server_ctx.listen_socket;
+        if (i > 0) {
+            // Adopted siblings first, so clients queued on them are not dropped
+            if (i < num_adopted_listeners && adopted_listeners[i] >= 0) {
+                sock = adopted_listeners[i];
+                adopted_listeners[i] = -1;
+            } else {
+                sock = rtmp_server_open_listener(server_ctx.port, true);
+            }
+            if (sock < 0) return false;
+            server_loops[i].listen_socket = sock;
+        }
+
+        int flags = fcntl(sock, F_GETFL, 0);
+        fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+
+        server_loops[i].listen_handle = rtmp_reactor_add(server_loops[i].reactor, sock, RTMP_REACTOR_EVENT_READ,
+                                                         rtmp_server_reactor_on_accept, (void*)(uintptr_t)i);
+        if (!server_loops[i].listen_handle) {
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < server_ctx.num_loops; i++) {
+        if (!rtmp_reactor_start(server_loops[i].reactor)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Stop event loops; connections and loops are released by the caller
+static void rtmp_server_reactor_stop(void) {
+    if (!server_loops) return;
+
+    for (uint32_t i = 0; i < server_ctx.num_loops; i++) {
+        if (server_loops[i].listen_handle) {
+            rtmp_reactor_remove(server_loops[i].reactor, server_loops[i].listen_handle);
+            server_loops[i].listen_handle = NULL;
+        }
+        rtmp_reactor_stop(server_loops[i].reactor);
+    }
+}
+
+// Release stopped event loops
+static void rtmp_server_reactor_destroy(void) {
+    if (!server_loops) return;
+
+    for (uint32_t i = 0; i < server_ctx.num_loops; i++) {
+        rtmp_reactor_destroy(server_loops[i].reactor);
+        rtmp_timer_wheel_destroy(server_loops[i].timers.wheel);
+        free(server_loops[i].scratch);
+        if (server_loops[i].listen_socket >= 0) {
+            close(server_loops[i].listen_socket);
+        }
+        pthread_mutex_destroy(&server_loops[i].lock);
+        pthread_mutex_destroy(&server_loops[i].timers.lock);
+    }
+    free(server_loops);
+    server_loops = NULL;
+}
+
+// Fire this loop's expired deadlines
+static void rtmp_server_reactor_on_tick(rtmp_reactor_t* reactor, uint64_t now_ms, void* userdata) {
+    rtmp_server_loop_t* loop = (rtmp_server_loop_t*)userdata;
+    pthread_mutex_lock(&loop->timers.lock);
+    rtmp_timer_wheel_advance(loop->timers.wheel, now_ms);
+    pthread_mutex_unlock(&loop->timers.lock);
+
+    // A drain ends this loop's publishers that have no keyframe to wait for
+    if (server_ctx.draining) {
+        uint32_t index = (uint32_t)(loop - server_loops);
+        rtmp_server_list_t list = rtmp_server_list(index);
+        pthread_mutex_lock(list.lock);
+        for (rtmp_connection_t* conn = *list.head; conn; conn = conn->next) {
+            if (conn->reactor_handle && conn->loop_index == index) {
+                rtmp_server_drain_audio_only(conn);
+            }
+        }
+        pthread_mutex_unlock(list.lock);
+    }
+}
+
+// Accept pending clients and hand them to a loop
+static void rtmp_server_reactor_on_accept(rtmp_reactor_t* reactor, int fd, uint32_t events, void* userdata) {
+    uint32_t listener_index = (uint32_t)(uintptr_t)userdata;
+
+    for (int i = 0; i < RTMP_REACTOR_ACCEPT_BUDGET && server_ctx.running && server_ctx.accepting; i++) {
+        struct sockaddr_in client_addr;
+        socklen_t addr_len = sizeof(client_addr);
+
+        int client_socket = accept(fd, (struct sockaddr*)&client_addr, &addr_len);
+        if (client_socket < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        // Shed load before anything is allocated for the client
+        if (!rtmp_server_admit(client_socket, &client_addr)) {
+            continue;
+        }
+
+        int flags = fcntl(client_socket, F_GETFL, 0);
+        fcntl(client_socket, F_SETFL, flags | O_NONBLOCK);
+        int nodelay = 1;
+        setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+        rtmp_connection_t* conn = rtmp_server_connection_create(client_socket);
+        if (!conn) {
+            rtmp_admission_release(admission, client_addr.sin_addr.s_addr, RTMP_SERVER_CONN_COST, true);
+            close(client_socket);
+            continue;
+        }
+        conn->peer_addr = client_addr.sin_addr.s_addr;
+        conn->handshake_pending = true;
+
+        // A sharded listener keeps its connections on its own loop
+        if (server_ctx.io_mode == RTMP_SERVER_IO_SHARDED) {
+            conn->loop_index = listener_index;
+        } else {
+            conn->loop_index = next_loop++ % server_ctx.num_loops;
+        }
+
+        conn->chunk_stream = rtmp_chunk_stream_create();
+        if (!conn->chunk_stream) {
+            close(client_socket);
+            rtmp_server_connection_free(conn);
+            continue;
+        }
+
+        // Add to connection list; in sharded mode this is the loop's own list
+        rtmp_server_track_connection(conn);
+        rtmp_server_start_timers(conn);
+
+        // Notify callback
+        if (connection_callback) {
+            connection_callback(conn, connection_callback_data);
+        }
+
+        conn->reactor_handle = rtmp_reactor_add(server_loops[conn->loop_index].reactor, client_socket,
+                                                RTMP_REACTOR_EVENT_READ, rtmp_server_reactor_on_client, conn);
+        if (!conn->reactor_handle) {
+            rtmp_server_cleanup_connection(conn);
+        }
+    }
+}
+
+// Readiness on a client socket
+static void rtmp_server_reactor_on_client(rtmp_reactor_t* reactor, int fd, uint32_t events, void* userdata) {
+    rtmp_connection_t* conn = (rtmp_connection_t*)userdata;
+    rtmp_server_loop_t* loop = &server_loops[conn->loop_index];
+
+    if (events & RTMP_REACTOR_EVENT_WRITE) {
+        if (!rtmp_server_handshake_flush(conn)) {
+            rtmp_server_cleanup_connection(conn);
+            return;
+        }
+        if (conn->state == RTMP_CONN_STATE_NEW && rtmp_server_handshake_finish(conn)) {
+            rtmp_connection_dispatch(conn);
+        }
+
+        pthread_mutex_lock(&conn->send_lock);
+        bool flushed = rtmp_connection_flush(conn);
+        pthread_mutex_unlock(&conn->send_lock);
+        if (!flushed) {
+            rtmp_server_cleanup_connection(conn);
+            return;
+        }
+    }
+
+    if (events & RTMP_REACTOR_EVENT_READ) {
+        for (int i = 0; i < RTMP_REACTOR_READ_BUDGET; i++) {
+            // Past the handshake the chunk stream reads the socket itself, no copy
+            bool handshaking = conn->state == RTMP_CONN_STATE_NEW;
+            ssize_t bytes = handshaking ? recv(fd, loop->scratch, RTMP_BUFFER_SIZE, 0)
+                                        : rtmp_chunk_stream_receive(conn->chunk_stream, fd);
+            if (bytes > 0) {
+                if (!rtmp_connection_process_input(conn, handshaking ? loop->scratch : NULL, (size_t)bytes)) {
+                    rtmp_server_cleanup_connection(conn);
+                    return;
+                }
+                conn->last_recv_ms = rtmp_reactor_now_ms(reactor);
+                if (handshaking && bytes < RTMP_BUFFER_SIZE) break;
+                continue;
+            }
+            if (bytes < 0 && errno == EINTR) continue;
+            if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+
+            // Peer closed or hard error
+            rtmp_server_cleanup_connection(conn);
+            return;
+        }
+    } else if (events & RTMP_REACTOR_EVENT_ERROR) {
+        rtmp_server_cleanup_connection(conn);
+        return;
+    }
+
+    pthread_mutex_lock(&conn->send_lock);
+    rtmp_server_reactor_update_interest(conn);
+    pthread_mutex_unlock(&conn->send_lock);
+}
+
+// Ask for writability only while output is pending; caller holds send_lock
+static void rtmp_server_reactor_update_interest(rtmp_connection_t* conn) {
+    uint32_t events = RTMP_REACTOR_EVENT_READ;
+    if (rtmp_server_handshake_wants_write(conn) || rtmp_send_queue_pending(&conn->send_queue)) {
+        events |= RTMP_REACTOR_EVENT_WRITE;
+    }
+    rtmp_reactor_modify(server_loops[conn->loop_index].reactor, conn->reactor_handle, events);
+}
+
+// Feed received bytes through handshake and chunk parsing, dispatching complete messages;
+// a NULL data means the bytes were received straight into the chunk stream
+static bool rtmp_connection_process_input(rtmp_connection_t* conn, const uint8_t* data, size_t length) {
+    size_t offset = 0;
+
+    if (!data) {
+        offset = length;
+    } else if (conn->state == RTMP_CONN_STATE_NEW) {
+        if (!rtmp_server_handshake_input(conn, data, length, &offset) ||
+            !rtmp_server_handshake_flush(conn)) {
+            return false;
+        }
+
+        // Bytes past C2 are chunk data even if S2 is still going out
+        rtmp_server_handshake_t* hs = (rtmp_server_handshake_t*)conn->handshake_data;
+        if (hs && hs->received < RTMP_SERVER_HANDSHAKE_IN) {
+            return true;
+        }
+    }
+
+    if (offset < length && !rtmp_chunk_stream_feed(conn->chunk_stream, data + offset, length - offset)) {
+        return false;
+    }
+
+    // Replies must not interleave with an unfinished S2, so hold dispatch until then
+    if (rtmp_server_handshake_finish(conn)) {
+        rtmp_connection_dispatch(conn);
+    }
+
+    return conn->state != RTMP_CONN_STATE_CLOSED && !rtmp_chunk_stream_failed(conn->chunk_stream);
+}
+
+// Dispatch every complete message buffered in the chunk stream; media a
+// publisher read in this pass goes to its players together at the end
+static void rtmp_connection_dispatch(rtmp_connection_t* conn) {
+    rtmp_chunk_stream_t* chunk;
+    while ((chunk = rtmp_chunk_stream_get_next(conn->chunk_stream)) != NULL) {
+        rtmp_connection_handle_message(conn, chunk);
+    }
+    rtmp_server_relay_flush(conn);
+}
+
+// Handle received RTMP message
+static void rtmp_connection_handle_message(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk) {
+    switch (chunk->msg_type_id) {
+        case RTMP_MSG_COMMAND_AMF0:
+            rtmp_connection_handle_command(conn, chunk);
+            break;
+
+        case RTMP_MSG_VIDEO:
+            rtmp_handle_video(conn, chunk);
+            break;
+            
+        case RTMP_MSG_AUDIO:
+            rtmp_handle_audio(conn, chunk);
+            break;
+            
+        case RTMP_MSG_DATA_AMF0:
+        case RTMP_MSG_DATA_AMF3:
+            rtmp_handle_metadata(conn, chunk);
+            break;
+
+        case RTMP_MSG_AGGREGATE:
+            rtmp_handle_aggregate(conn, chunk);
+            break;
+    }
+}
+
+// Decode an AMF0 command and route it by name; unknown commands are ignored
+static void rtmp_connection_handle_command(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk) {
+    rtmp_server_command_t command;
+    if (!rtmp_server_command_decode(chunk->msg_data, chunk->msg_length, &command)) return;
+
+    const char* name = rtmp_server_command_string(&command, 0);
+    if (!name) {
+        // Not a command
+    } else if (strcmp(name, "connect") == 0) {
+        rtmp_handle_connect(conn, chunk, &command);
+    } else if (strcmp(name, "createStream") == 0) {
+        rtmp_handle_create_stream(conn, chunk, &command);
+    } else if (strcmp(name, "play") == 0) {
+        rtmp_handle_play(conn, chunk, &command);
+    } else if (strcmp(name, "publish") == 0) {
+        rtmp_handle_publish(conn, chunk, &command);
+    }
+
+    rtmp_server_command_free(&command);
+}
+
+// Split a command into its values: name, transaction id, command object, arguments
+static bool rtmp_server_command_decode(const uint8_t* data, uint32_t length, rtmp_server_command_t* command) {
+    command->count = 0;
+    if (!data) return false;
+
+    size_t offset = 0;
+    while (offset < length && command->count < RTMP_SERVER_COMMAND_VALUES) {
+        rtmp_amf_value_t* value = rtmp_amf_value_new();
+        size_t read = 0;
+        if (!value || !rtmp_amf_decode_value(data + offset, length - offset, value, &read) || read == 0) {
+            rtmp_amf_value_free(value);
+            break;
+        }
+        command->values[command->count++] = value;
+        offset += read;
+    }
+    return command->count > 0;
+}
+
+static void rtmp_server_command_free(rtmp_server_command_t* command) {
+    for (uint32_t i = 0; i < command->count; i++) {
+        rtmp_amf_value_free(command->values[i]);
+    }
+    command->count = 0;
+}
+
+// String value at index, NULL when missing or of another type
+static const char* rtmp_server_command_string(const rtmp_server_command_t* command, uint32_t index) {
+    if (index >= command->count || command->values[index]->type != AMF0_STRING) return NULL;
+    return command->values[index]->value.string.data;
+}
+
+static double rtmp_server_command_transaction(const rtmp_server_command_t* command) {
+    if (command->count < 2 || command->values[1]->type != AMF0_NUMBER) return 0;
+    return command->values[1]->value.number;
+}
+
+// Handle connect command
+static void rtmp_handle_connect(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk,
+                                const rtmp_server_command_t* command) {
+    // Get app name from the command object
+    rtmp_amf_value_t* app = command->count > 2 ? rtmp_amf_get_property(command->values[2], "app") : NULL;
+    if (app && app->type == AMF0_STRING) {
+        strncpy(conn->metadata.app_name, app->value.string.data, sizeof(conn->metadata.app_name)-1);
+    }
+
+    // Send Window Acknowledgement Size
+    uint8_t ack_size[4];
+    uint32_t window_size = RTMP_BUFFER_SIZE;
+    ack_size[0] = (window_size >> 24) & 0xff;
     ack_size[1] = (window_size >> 16) & 0xff;
     ack_size[2] = (window_size >> 8) & 0xff;
     ack_size[3] = window_size & 0xff;
@@ -430,217 +2133,879 @@ static void rtmp_handle_connect(rtmp_connection_t* conn, rtmp_chunk_stream_t* ch
 
     // Send connect response
     uint8_t connect_resp[256];
-    size_t resp_len = rtmp_amf_encode_connect_response(connect_resp, sizeof(connect_resp));
+    size_t resp_len = 0;
+    rtmp_amf_encode_connect_result(rtmp_server_command_transaction(command), connect_resp, &resp_len);
     
-    response.msg_type_id = RTMP_MSG_COMMAND;
+    response.msg_type_id = RTMP_MSG_COMMAND_AMF0;
     response.msg_length = resp_len;
     response.msg_data = connect_resp;
     
     rtmp_connection_send_chunk(conn, &response);
 
     conn->state = RTMP_CONN_STATE_CONNECT;
-    rtmp_amf_data_free(amf);
 }
 
-// Handle create stream command
-static void rtmp_handle_create_stream(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk) {
-    rtmp_amf_data_t* amf = rtmp_amf_decode(chunk->msg_data, chunk->msg_length);
-    if (!amf) return;
+// Handle create stream command
+static void rtmp_handle_create_stream(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk,
+                                      const rtmp_server_command_t* command) {
+    // Send create stream response; every connection gets the relay's stream id
+    uint8_t create_stream_resp[256];
+    size_t resp_len = 0;
+    rtmp_amf_encode_create_stream_result(rtmp_server_command_transaction(command), RTMP_RELAY_STREAM_ID,
+                                         create_stream_resp, &resp_len);
+    
+    rtmp_chunk_stream_t response;
+    memset(&response, 0, sizeof(response));
+    response.msg_type_id = RTMP_MSG_COMMAND_AMF0;
+    response.msg_stream_id = chunk->msg_stream_id;
+    response.msg_length = resp_len;
+    response.msg_data = create_stream_resp;
+    
+    rtmp_connection_send_chunk(conn, &response);
+
+    conn->state = RTMP_CONN_STATE_CREATE_STREAM;
+}
+
+// Handle play command
+static void rtmp_handle_play(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk,
+                             const rtmp_server_command_t* command) {
+    // Get stream name, the first argument
+    const char* stream_name = rtmp_server_command_string(command, 3);
+    if (stream_name) {
+        strncpy(conn->metadata.stream_name, stream_name, sizeof(conn->metadata.stream_name)-1);
+    }
+
+    // Send stream begin
+    uint8_t stream_begin[6] = {0,0,0,0,0,RTMP_RELAY_STREAM_ID};
+    rtmp_chunk_stream_t response;
+    memset(&response, 0, sizeof(response));
+    response.msg_type_id = RTMP_MSG_USER_CONTROL;
+    response.msg_stream_id = 0;
+    response.msg_length = 6;
+    response.msg_data = stream_begin;
+    
+    rtmp_connection_send_chunk(conn, &response);
+
+    // Send play response
+    uint8_t play_resp[128 + RTMP_REGISTRY_MAX_NAME];
+    size_t resp_len = 0;
+    rtmp_amf_encode_on_status("status", "NetStream.Play.Start", conn->metadata.stream_name, play_resp, &resp_len);
+    
+    response.msg_type_id = RTMP_MSG_COMMAND_AMF0;
+    response.msg_stream_id = chunk->msg_stream_id;
+    response.msg_length = resp_len;
+    response.msg_data = play_resp;
+    
+    rtmp_connection_send_chunk(conn, &response);
+
+    conn->state = RTMP_CONN_STATE_PLAY;
+    conn->is_publisher = false;
+    rtmp_server_stream_attach(conn, false);
+}
+
+// Handle publish command
+static void rtmp_handle_publish(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk,
+                                const rtmp_server_command_t* command) {
+    // A republish under a new name must not leave the old one indexed
+    if (conn->is_publisher) {
+        rtmp_server_unindex_publisher(conn);
+    }
+
+    // Get publish name, the first argument
+    const char* publish_name = rtmp_server_command_string(command, 3);
+    if (publish_name) {
+        strncpy(conn->metadata.stream_name, publish_name, sizeof(conn->metadata.stream_name)-1);
+    }
+
+    // Send publish response
+    uint8_t publish_resp[128 + RTMP_REGISTRY_MAX_NAME];
+    size_t resp_len = 0;
+    rtmp_amf_encode_on_status("status", "NetStream.Publish.Start", conn->metadata.stream_name, publish_resp,
+                              &resp_len);
+    
+    rtmp_chunk_stream_t response;
+    memset(&response, 0, sizeof(response));
+    response.msg_type_id = RTMP_MSG_COMMAND_AMF0;
+    response.msg_stream_id = chunk->msg_stream_id;
+    response.msg_length = resp_len;
+    response.msg_data = publish_resp;
+    
+    rtmp_connection_send_chunk(conn, &response);
+
+    conn->state = RTMP_CONN_STATE_PUBLISHING;
+    conn->is_publisher = true;
+    gettimeofday(&conn->metadata.publish_time, NULL);
+    rtmp_server_index_publisher(conn);
+    rtmp_server_stream_attach(conn, true);
+}
+
+// Handle video data
+static void rtmp_handle_video(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk) {
+    if (!conn->is_publisher || !chunk->msg_data || chunk->msg_length == 0) return;
+
+    conn->metadata.has_video = true;
+    conn->metadata.bytes_in += chunk->msg_length;
+    rtmp_metrics_add(conn->metrics, &conn->metrics->bytes_in, chunk->msg_length);
+    rtmp_metrics_add(conn->metrics, &conn->metrics->video_frames, 1);
+
+    // Parse video tag header, legacy or enhanced
+    rtmp_flv_video_t video;
+    rtmp_flv_avc_config_t avc;
+    bool is_keyframe = false;
+    if (rtmp_flv_parse_video(chunk->msg_data, chunk->msg_length, &video)) {
+        conn->metadata.video_codec = video.codec;
+        is_keyframe = video.keyframe;
+    }
+
+    // An AVC sequence header describes the stream even when onMetaData never comes
+    bool avc_header = video.sequence_header &&
+                      video.codec == (video.enhanced ? RTMP_FLV_FOURCC_AVC : RTMP_FLV_CODEC_AVC);
+    if (avc_header && rtmp_flv_parse_avc_config(chunk->msg_data + video.header_length,
+                                                chunk->msg_length - video.header_length, &avc)) {
+        conn->metadata.width = avc.width;
+        conn->metadata.height = avc.height;
+        conn->metadata.video_profile = avc.profile;
+        conn->metadata.video_level = avc.level;
+        if (avc.frame_rate) {
+            conn->metadata.frame_rate = avc.frame_rate;
+        }
+        rtmp_server_notify_metadata(conn);
+    }
+
+    // A draining publisher stops at a GOP boundary, so its players end on whole GOPs
+    if (server_ctx.draining && is_keyframe) {
+        rtmp_server_end_publish(conn);
+        return;
+    }
+
+    // Forward to callback, inline or through the consumer thread; only the
+    // latter is paced by the jitter buffers
+    bool ring = frame_callback && frame_delivery.rings;
+    if (frame_callback && !ring) {
+        frame_callback(chunk->msg_data, chunk->msg_length, chunk->timestamp, is_keyframe, frame_callback_data);
+    }
+
+    // Stream-specific consumers run inline and unpaced, keyed by app/stream
+    rtmp_stream_callbacks_t callbacks;
+    if (rtmp_server_stream_callbacks(conn, &callbacks) && callbacks.on_frame) {
+        callbacks.on_frame(conn->stream->key, chunk->msg_data, chunk->msg_length, chunk->timestamp, is_keyframe,
+                           callbacks.userdata);
+    }
+    if (!ring && !conn->stream) return;
+
+    rtmp_msgbuf_t* msg = rtmp_server_media_message(chunk, RTMP_CHUNK_STREAM_VIDEO);
+    if (!msg) return;
+    if (ring) {
+        rtmp_server_deliver_frame(conn, msg, is_keyframe);
+    }
+
+    // Fan out to players
+    rtmp_server_stream_relay(conn, msg);
+    rtmp_msgbuf_release(msg);
+}
+
+// Handle audio data
+static void rtmp_handle_audio(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk) {
+    if (!conn->is_publisher || !chunk->msg_data || chunk->msg_length == 0) return;
+
+    conn->metadata.has_audio = true;
+    conn->metadata.bytes_in += chunk->msg_length;
+    rtmp_metrics_add(conn->metrics, &conn->metrics->bytes_in, chunk->msg_length);
+    rtmp_metrics_add(conn->metrics, &conn->metrics->audio_frames, 1);
+
+    // Parse audio header; the AAC tag header is fixed, its config has the real values
+    rtmp_flv_audio_t audio;
+    rtmp_flv_aac_config_t aac;
+    if (rtmp_flv_parse_audio(chunk->msg_data, chunk->msg_length, &audio)) {
+        if (audio.format != RTMP_FLV_SOUND_AAC) {
+            conn->metadata.audio_sample_rate = audio.sample_rate;
+            conn->metadata.audio_channels = audio.channels;
+        } else if (audio.sequence_header &&
+                   rtmp_flv_parse_aac_config(chunk->msg_data + audio.header_length,
+                                             chunk->msg_length - audio.header_length, &aac)) {
+            conn->metadata.audio_sample_rate = aac.sample_rate;
+            if (aac.channels) {
+                conn->metadata.audio_channels = aac.channels;
+            }
+            rtmp_server_notify_metadata(conn);
+        }
+    }
+
+    // Fan out to players
+    if (conn->stream) {
+        rtmp_msgbuf_t* msg = rtmp_server_media_message(chunk, RTMP_CHUNK_STREAM_AUDIO);
+        rtmp_server_stream_relay(conn, msg);
+        rtmp_msgbuf_release(msg);
+    }
+}
+
+// Split an aggregate into its tags in place; each goes through its own handler
+// as if it had arrived alone, timed relative to the aggregate's timestamp
+static void rtmp_handle_aggregate(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk) {
+    if (!conn->is_publisher || !chunk->msg_data) return;
+
+    rtmp_chunk_stream_t sub = *chunk;
+    rtmp_flv_tag_t tag;
+    uint32_t offset = 0;
+    uint32_t base = 0;
+
+    while (rtmp_flv_next_tag(chunk->msg_data, chunk->msg_length, &offset, &tag)) {
+        if (sub.msg_data == chunk->msg_data) {
+            base = tag.timestamp;
+        }
+        sub.msg_type_id = tag.type;
+        sub.msg_length = tag.length;
+        sub.msg_data = (uint8_t*)tag.data;
+        sub.timestamp = chunk->timestamp + (tag.timestamp - base);
+
+        // Only media may be nested; commands and aggregates are not
+        if (tag.type == RTMP_MSG_VIDEO || tag.type == RTMP_MSG_AUDIO || tag.type == RTMP_MSG_DATA_AMF0 ||
+            tag.type == RTMP_MSG_DATA_AMF3) {
+            rtmp_connection_handle_message(conn, &sub);
+        }
+    }
+}
+
+// Handle metadata
+static void rtmp_handle_metadata(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk) {
+    if (!conn->is_publisher || !chunk->msg_data || chunk->msg_length == 0) return;
+
+    // Players get the data message as published
+    if (conn->stream) {
+        rtmp_msgbuf_t* msg = rtmp_server_media_message(chunk, RTMP_CHUNK_STREAM_METADATA);
+        rtmp_server_stream_relay(conn, msg);
+        rtmp_msgbuf_release(msg);
+    }
+
+    // AMF3 data messages carry AMF0 values behind a format byte
+    const uint8_t* data = chunk->msg_data;
+    uint32_t length = chunk->msg_length;
+    if (chunk->msg_type_id == RTMP_MSG_DATA_AMF3) {
+        data++;
+        length--;
+    }
+
+    rtmp_server_command_t command;
+    if (!rtmp_server_command_decode(data, length, &command)) return;
+
+    // The properties follow the handler name, and @setDataFrame when present
+    rtmp_amf_value_t* amf = NULL;
+    for (uint32_t i = 0; i < command.count && !amf; i++) {
+        if (command.values[i]->type == AMF0_OBJECT || command.values[i]->type == AMF0_ECMA_ARRAY) {
+            amf = command.values[i];
+        }
+    }
+    if (!amf) {
+        rtmp_server_command_free(&command);
+        return;
+    }
+
+    // Parse metadata values
+    rtmp_amf_value_t* width = rtmp_amf_get_property(amf, "width");
+    if (width && width->type == AMF0_NUMBER) {
+        conn->metadata.width = (uint32_t)width->value.number;
+    }
+
+    rtmp_amf_value_t* height = rtmp_amf_get_property(amf, "height");
+    if (height && height->type == AMF0_NUMBER) {
+        conn->metadata.height = (uint32_t)height->value.number;
+    }
+
+    rtmp_amf_value_t* framerate = rtmp_amf_get_property(amf, "framerate");
+    if (framerate && framerate->type == AMF0_NUMBER) {
+        conn->metadata.frame_rate = (uint32_t)framerate->value.number;
+    }
+
+    rtmp_amf_value_t* videodatarate = rtmp_amf_get_property(amf, "videodatarate");
+    if (videodatarate && videodatarate->type == AMF0_NUMBER) {
+        conn->metadata.video_bitrate = (uint32_t)(videodatarate->value.number * 1024);
+    }
+
+    rtmp_amf_value_t* audiodatarate = rtmp_amf_get_property(amf, "audiodatarate");
+    if (audiodatarate && audiodatarate->type == AMF0_NUMBER) {
+        conn->metadata.audio_bitrate = (uint32_t)(audiodatarate->value.number * 1024);
+    }
+
+    rtmp_server_notify_metadata(conn);
+    rtmp_server_command_free(&command);
+}
+
+// Tell metadata consumers the publisher's parameters changed
+static void rtmp_server_notify_metadata(rtmp_connection_t* conn) {
+    if (metadata_callback) {
+        metadata_callback(&conn->metadata, metadata_callback_data);
+    }
+
+    rtmp_stream_callbacks_t callbacks;
+    if (rtmp_server_stream_callbacks(conn, &callbacks) && callbacks.on_metadata) {
+        callbacks.on_metadata(conn->stream->key, &conn->metadata, callbacks.userdata);
+    }
+}
+
+// Public API implementations
+// Stop server
+void rtmp_server_stop(void) {
+    if (!server_ctx.running) return;
+
+    // Stop threads
+    server_ctx.running = false;
+    
+    // Shut the listener down to break a blocked accept(); it is closed once nothing uses it.
+    // A handed-off listener is only closed: shutdown would stop the successor's copy too.
+    if (server_ctx.listen_socket >= 0 && !listeners_handed_off) {
+        shutdown(server_ctx.listen_socket, SHUT_RDWR);
+    }
+
+    // Wait for threads to finish
+    if (server_ctx.io_mode != RTMP_SERVER_IO_THREADED) {
+        rtmp_server_reactor_stop();
+    } else {
+        pthread_join(server_ctx.accept_thread, NULL);
+
+        // Client threads own their connections: wake each with EOF and let it clean up
+        rtmp_server_list_t list = rtmp_server_list(0);
+        pthread_mutex_lock(list.lock);
+        for (rtmp_connection_t* conn = *list.head; conn; conn = conn->next) {
+            shutdown(conn->socket, SHUT_RDWR);
+        }
+        pthread_mutex_unlock(list.lock);
+        while (__atomic_load_n(&threaded_live, __ATOMIC_ACQUIRE) > 0) {
+            usleep(RTMP_REACTOR_TICK_MS * 1000);
+        }
+        pthread_join(server_ctx.monitor_thread, NULL);
+    }
+
+    if (server_ctx.listen_socket >= 0) {
+        close(server_ctx.listen_socket);
+        server_ctx.listen_socket = -1;
+    }
+
+    // File sources publish like connections and go first
+    rtmp_server_stop_file_sources();
+
+    // Close what the event loops left; cleanup unlinks each one under its list lock
+    for (uint32_t l = 0; l < rtmp_server_num_lists(); l++) {
+        rtmp_server_list_t list = rtmp_server_list(l);
+        while (*list.head) {
+            rtmp_server_cleanup_connection(*list.head);
+        }
+    }
+
+    // Loops are idle now, release them with their handles and wheels
+    rtmp_server_reactor_destroy();
+    rtmp_timer_wheel_destroy(threaded_timers.wheel);
+    threaded_timers.wheel = NULL;
+
+    // No producers are left; the consumer drains what they queued
+    rtmp_server_delivery_stop();
+    rtmp_record_stop();
+
+    listeners_handed_off = false;
+    rtmp_server_update_state(RTMP_SERVER_STATE_STOPPED);
+}
+
+// Cleanup server resources
+void rtmp_server_cleanup(void) {
+    rtmp_server_stop();
+    pthread_mutex_destroy(&server_ctx.lock);
+
+    rtmp_registry_destroy(conns_by_fd);
+    rtmp_registry_destroy(publishers_by_name);
+    rtmp_registry_destroy(streams_by_name);
+    rtmp_registry_foreach(stream_callbacks, rtmp_server_free_value, NULL);
+    rtmp_registry_destroy(stream_callbacks);
+    rtmp_server_stop_metrics();
+    rtmp_server_discard_adopted();
+    rtmp_admission_destroy(admission);
+    conns_by_fd = NULL;
+    publishers_by_name = NULL;
+    streams_by_name = NULL;
+    stream_callbacks = NULL;
+    admission = NULL;
+}
+
+// Stop taking clients, let every publisher finish its GOP and tell players the
+// stream ended, then stop once nobody is left or timeout_ms passes. Returns true
+// when every connection closed on its own.
+bool rtmp_server_drain(uint32_t timeout_ms) {
+    if (!server_ctx.running || server_ctx.draining) return false;
+
+    server_ctx.draining = true;
+    rtmp_server_stop_accepting();
+    rtmp_server_update_state(RTMP_SERVER_STATE_DRAINING);
+
+    // Publishers end themselves at their next keyframe, or on their owner's next
+    // pass if they carry no video, and take their players along; everyone else
+    // hangs up as soon as their queue is written
+    for (uint32_t l = 0; l < rtmp_server_num_lists(); l++) {
+        rtmp_server_list_t list = rtmp_server_list(l);
+        pthread_mutex_lock(list.lock);
+        for (rtmp_connection_t* conn = *list.head; conn; conn = conn->next) {
+            if (!conn->is_publisher && !rtmp_server_plays_live(conn)) {
+                rtmp_connection_close_when_flushed(conn);
+            }
+        }
+        pthread_mutex_unlock(list.lock);
+    }
+
+    uint64_t deadline = rtmp_reactor_clock_ms() + timeout_ms;
+    while (rtmp_server_get_num_connections() > 0 && rtmp_reactor_clock_ms() < deadline) {
+        usleep(RTMP_DRAIN_POLL_MS * 1000);
+    }
+
+    bool drained = rtmp_server_get_num_connections() == 0;
+    rtmp_server_stop();
+    server_ctx.draining = false;
+    return drained;
+}
+
+// Pass the listeners and every established connection to a successor that
+// connects to path within timeout_ms, then stop. Handed-over sockets stay open
+// in the successor, so encoders and players never notice. Reactor modes only:
+// threaded connections cannot be paused while their sockets change hands.
+bool rtmp_server_handoff(const char* path, uint32_t timeout_ms) {
+    if (!server_ctx.running || server_ctx.io_mode == RTMP_SERVER_IO_THREADED) return false;
+
+    // Keep serving until the successor shows up
+    int channel = rtmp_handoff_offer(path, timeout_ms);
+    if (channel < 0) return false;
+
+    // Nothing may read or write a socket while it changes hands
+    rtmp_server_update_state(RTMP_SERVER_STATE_RESTARTING);
+    rtmp_server_reactor_stop();
+
+    rtmp_handoff_record_t record;
+    memset(&record, 0, sizeof(record));
+    record.magic = RTMP_HANDOFF_MAGIC;
+    record.version = RTMP_HANDOFF_VERSION;
+    record.kind = RTMP_HANDOFF_LISTENER;
+
+    // From here the successor may hold the listeners; stop must only close them
+    listeners_handed_off = true;
+
+    bool ok = true;
+    for (uint32_t i = 0; i < server_ctx.num_loops && ok; i++) {
+        int sock = i == 0 ? server_ctx.listen_socket : server_loops[i].listen_socket;
+        if (sock >= 0) {
+            ok = rtmp_handoff_send(channel, &record, sock, NULL);
+        }
+    }
+
+    for (uint32_t l = 0; l < rtmp_server_num_lists() && ok; l++) {
+        rtmp_server_list_t list = rtmp_server_list(l);
+        pthread_mutex_lock(list.lock);
+        for (rtmp_connection_t* conn = *list.head; conn && ok; conn = conn->next) {
+            ok = rtmp_server_handoff_connection(channel, conn);
+        }
+        pthread_mutex_unlock(list.lock);
+    }
+
+    record.kind = RTMP_HANDOFF_END;
+    ok = ok && rtmp_handoff_send(channel, &record, -1, NULL);
+    close(channel);
+
+    // Only this process's descriptors close; whatever was not handed over is dropped
+    rtmp_server_stop();
+    return ok;
+}
+
+// Take over what a predecessor hands out at path. Call after initialize and
+// before rtmp_server_start, with the predecessor's I/O mode; the start serves
+// the adopted listeners and resumes the adopted connections. Whatever arrived
+// before an error is kept, so a false return still adopts part of the server.
+bool rtmp_server_adopt(const char* path) {
+    if (server_ctx.state != RTMP_SERVER_STATE_STOPPED || !admission) return false;
+
+    int channel = rtmp_handoff_connect(path);
+    if (channel < 0) return false;
+
+    rtmp_server_adoptee_t* last = NULL;
+    rtmp_handoff_record_t record;
+    uint8_t* payload;
+    int fd;
+    bool done = false;
+
+    while (!done && rtmp_handoff_recv(channel, &record, &fd, &payload)) {
+        switch (record.kind) {
+            case RTMP_HANDOFF_LISTENER: {
+                int* listeners = realloc(adopted_listeners, (num_adopted_listeners + 1) * sizeof(int));
+                if (listeners) {
+                    adopted_listeners = listeners;
+                    adopted_listeners[num_adopted_listeners++] = fd;
+                } else {
+                    close(fd);
+                }
+                break;
+            }
+            case RTMP_HANDOFF_CONNECTION:
+                last = rtmp_server_adopt_connection(&record, fd);
+                break;
+            case RTMP_HANDOFF_HEADER:
+                if (last) {
+                    rtmp_server_adopt_header(last, &record, payload);
+                }
+                break;
+            case RTMP_HANDOFF_PARSER:
+                if (last && !last->parser) {
+                    last->parser = payload;
+                    last->parser_length = record.payload_length;
+                    payload = NULL;
+                }
+                break;
+            case RTMP_HANDOFF_END:
+                done = true;
+                break;
+        }
+        free(payload);
+    }
+
+    close(channel);
+    return done;
+}
+
+// Refuse new clients. Listeners are shut down rather than closed, so no
+// descriptor is reused under a running loop; stop closes them.
+static void rtmp_server_stop_accepting(void) {
+    server_ctx.accepting = false;
+
+    if (server_loops) {
+        for (uint32_t i = 0; i < server_ctx.num_loops; i++) {
+            if (server_loops[i].listen_handle) {
+                rtmp_reactor_remove(server_loops[i].reactor, server_loops[i].listen_handle);
+                server_loops[i].listen_handle = NULL;
+            }
+            if (i > 0 && server_loops[i].listen_socket >= 0) {
+                shutdown(server_loops[i].listen_socket, SHUT_RDWR);
+            }
+        }
+    }
+
+    // Also wakes a threaded accept() so its thread sees accepting cleared
+    if (server_ctx.listen_socket >= 0) {
+        shutdown(server_ctx.listen_socket, SHUT_RDWR);
+    }
+}
+
+// Mark for hang-up; the flush that empties the queue half-closes the socket
+static void rtmp_connection_close_when_flushed(rtmp_connection_t* conn) {
+    pthread_mutex_lock(&conn->send_lock);
+    conn->closing = true;
+    if (!rtmp_connection_flush(conn)) {
+        shutdown(conn->socket, SHUT_RDWR);
+    }
+    pthread_mutex_unlock(&conn->send_lock);
+}
 
-    // Send create stream response
-    uint8_t create_stream_resp[256];
-    size_t resp_len = rtmp_amf_encode_create_stream_response(create_stream_resp, sizeof(create_stream_resp));
-    
-    rtmp_chunk_stream_t response;
-    memset(&response, 0, sizeof(response));
-    response.msg_type_id = RTMP_MSG_COMMAND;
-    response.msg_stream_id = chunk->msg_stream_id;
-    response.msg_length = resp_len;
-    response.msg_data = create_stream_resp;
-    
-    rtmp_connection_send_chunk(conn, &response);
+// Whether conn plays a stream that still has a publisher. The player's own
+// reference keeps the stream alive until its detach takes the write lock.
+static bool rtmp_server_plays_live(rtmp_connection_t* conn) {
+    bool live = false;
+
+    pthread_rwlock_rdlock(&registry_lock);
+    rtmp_server_stream_t* stream = conn->stream;
+    if (stream) {
+        pthread_mutex_lock(&stream->lock);
+        live = stream->publisher != NULL && stream->publisher != conn;
+        pthread_mutex_unlock(&stream->lock);
+    }
+    pthread_rwlock_unlock(&registry_lock);
 
-    conn->state = RTMP_CONN_STATE_CREATE_STREAM;
-    rtmp_amf_data_free(amf);
+    return live;
 }
 
-// Handle play command
-static void rtmp_handle_play(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk) {
-    rtmp_amf_data_t* amf = rtmp_amf_decode(chunk->msg_data, chunk->msg_length);
-    if (!amf) return;
-
-    // Get stream name
-    rtmp_amf_data_t* stream_name = rtmp_amf_get_prop(amf, "streamName");
-    if (stream_name && stream_name->type == RTMP_AMF_STRING) {
-        strncpy(conn->metadata.stream_name, stream_name->string_data, sizeof(conn->metadata.stream_name)-1);
+// End a publish for a drain: players hear the stream stop, the encoder hears
+// its unpublish succeed, and each hangs up once that is written
+static void rtmp_server_end_publish(rtmp_connection_t* conn) {
+    rtmp_server_stream_t* stream = conn->stream;
+    if (stream && stream->publisher == conn) {
+        rtmp_msgbuf_t* notify = rtmp_server_status_message("NetStream.Play.UnpublishNotify", stream->key);
+
+        pthread_mutex_lock(&stream->lock);
+        for (uint32_t i = 0; i < stream->num_subscribers; i++) {
+            if (notify) {
+                rtmp_connection_enqueue(stream->subscribers[i], notify);
+            }
+            rtmp_connection_close_when_flushed(stream->subscribers[i]);
+        }
+        pthread_mutex_unlock(&stream->lock);
+        rtmp_msgbuf_release(notify);
     }
 
-    // Send stream begin
-    uint8_t stream_begin[6] = {0,0,0,0,0,0};
-    rtmp_chunk_stream_t response;
-    memset(&response, 0, sizeof(response));
-    response.msg_type_id = RTMP_MSG_USER_CONTROL;
-    response.msg_stream_id = chunk->msg_stream_id;
-    response.msg_length = 6;
-    response.msg_data = stream_begin;
-    
-    rtmp_connection_send_chunk(conn, &response);
+    rtmp_server_stream_detach(conn);
+    rtmp_server_unindex_publisher(conn);
+    conn->is_publisher = false;
 
-    // Send play response
-    uint8_t play_resp[256];
-    size_t resp_len = rtmp_amf_encode_play_response(play_resp, sizeof(play_resp));
-    
-    response.msg_type_id = RTMP_MSG_COMMAND;
-    response.msg_length = resp_len;
-    response.msg_data = play_resp;
-    
-    rtmp_connection_send_chunk(conn, &response);
+    rtmp_msgbuf_t* status = rtmp_server_status_message("NetStream.Unpublish.Success", conn->metadata.stream_name);
+    if (status) {
+        rtmp_connection_enqueue(conn, status);
+        rtmp_msgbuf_release(status);
+    }
+    rtmp_connection_close_when_flushed(conn);
+}
 
-    conn->state = RTMP_CONN_STATE_PLAY;
-    conn->is_publisher = false;
-    rtmp_amf_data_free(amf);
+// A publisher without video has no GOP to finish, so a drain ends it at once.
+// Runs on the connection's owner thread, like every other end of a publish.
+static void rtmp_server_drain_audio_only(rtmp_connection_t* conn) {
+    if (server_ctx.draining && conn->is_publisher && !conn->metadata.has_video) {
+        rtmp_server_end_publish(conn);
+    }
 }
 
-// Handle publish command
-static void rtmp_handle_publish(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk) {
-    rtmp_amf_data_t* amf = rtmp_amf_decode(chunk->msg_data, chunk->msg_length);
-    if (!amf) return;
+// onStatus on the relay's message stream
+static rtmp_msgbuf_t* rtmp_server_status_message(const char* code, const char* description) {
+    uint8_t payload[128 + RTMP_REGISTRY_MAX_NAME];
+    size_t length = 0;
 
-    // Get publish name
-    rtmp_amf_data_t* publish_name = rtmp_amf_get_prop(amf, "publishName");
-    if (publish_name && publish_name->type == RTMP_AMF_STRING) {
-        strncpy(conn->metadata.stream_name, publish_name->string_data, sizeof(conn->metadata.stream_name)-1);
+    if (!rtmp_amf_encode_on_status("status", code, description, payload, &length)) {
+        return NULL;
     }
+    return rtmp_msgbuf_create(RTMP_CHUNK_STREAM_COMMAND, RTMP_MSG_COMMAND_AMF0, 0, RTMP_RELAY_STREAM_ID,
+                              payload, (uint32_t)length);
+}
 
-    // Send publish response
-    uint8_t publish_resp[256];
-    size_t resp_len = rtmp_amf_encode_publish_response(publish_resp, sizeof(publish_resp));
-    
-    rtmp_chunk_stream_t response;
-    memset(&response, 0, sizeof(response));
-    response.msg_type_id = RTMP_MSG_COMMAND;
-    response.msg_stream_id = chunk->msg_stream_id;
-    response.msg_length = resp_len;
-    response.msg_data = publish_resp;
-    
-    rtmp_connection_send_chunk(conn, &response);
+// Send one connection and, for a publisher, its stream's start-up burst.
+// Returns false only when the channel failed; a connection that cannot move
+// cleanly is skipped and closed with the rest.
+static bool rtmp_server_handoff_connection(int channel, rtmp_connection_t* conn) {
+    // Clients still in the handshake just retry against the successor
+    if (conn->state == RTMP_CONN_STATE_NEW || conn->state == RTMP_CONN_STATE_CLOSED) {
+        return true;
+    }
 
-    conn->state = RTMP_CONN_STATE_PUBLISHING;
-    conn->is_publisher = true;
-    gettimeofday(&conn->metadata.publish_time, NULL);
-    rtmp_amf_data_free(amf);
-}
+    // A message cut off mid-write would desynchronize the peer's chunk parser
+    pthread_mutex_lock(&conn->send_lock);
+    bool idle = rtmp_connection_flush(conn) && !rtmp_send_queue_pending(&conn->send_queue);
+    uint32_t chunk_size = conn->send_queue.chunk_size;
+    pthread_mutex_unlock(&conn->send_lock);
+    if (!idle) {
+        return true;
+    }
 
-// Handle video data
-static void rtmp_handle_video(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk) {
-    if (!conn->is_publisher || !chunk->msg_data || chunk->msg_length == 0) return;
+    // Inbound chunks may continue headers or messages the parser already holds
+    size_t parser_length = 0;
+    uint8_t* parser = rtmp_chunk_stream_export(conn->chunk_stream, &parser_length);
+    if (!parser || parser_length > RTMP_HANDOFF_MAX_PAYLOAD) {
+        free(parser);
+        return true;
+    }
 
-    conn->metadata.has_video = true;
-    conn->metadata.bytes_in += chunk->msg_length;
+    rtmp_handoff_record_t record;
+    memset(&record, 0, sizeof(record));
+    record.magic = RTMP_HANDOFF_MAGIC;
+    record.version = RTMP_HANDOFF_VERSION;
+    record.kind = RTMP_HANDOFF_CONNECTION;
+    record.state = conn->state;
+    record.is_publisher = conn->is_publisher;
+    record.peer_addr = conn->peer_addr;
+    record.chunk_size = chunk_size;
+    snprintf(record.app_name, sizeof(record.app_name), "%s", conn->metadata.app_name);
+    snprintf(record.stream_name, sizeof(record.stream_name), "%s", conn->metadata.stream_name);
+
+    bool sent = rtmp_handoff_send(channel, &record, conn->socket, NULL);
+    if (sent) {
+        record.kind = RTMP_HANDOFF_PARSER;
+        record.payload_length = (uint32_t)parser_length;
+        sent = rtmp_handoff_send(channel, &record, -1, parser);
+        record.payload_length = 0;
+    }
+    free(parser);
+    if (!sent) {
+        return false;
+    }
 
-    // Parse video frame header
-    uint8_t frame_type = (chunk->msg_data[0] & 0xf0) >> 4;
-    bool is_keyframe = (frame_type == 1);
+    // Late joiners on the successor need the same burst they would get here
+    rtmp_server_stream_t* stream = conn->stream;
+    if (!conn->is_publisher || !stream || stream->publisher != conn) {
+        return true;
+    }
 
-    // Forward to callback
-    if (frame_callback) {
-        frame_callback(chunk->msg_data, chunk->msg_length, chunk->timestamp, is_keyframe, frame_callback_data);
+    bool ok = true;
+    pthread_mutex_lock(&stream->lock);
+    rtmp_msgbuf_t* headers[3] = { stream->metadata, stream->video_header, stream->audio_header };
+    for (int i = 0; i < 3 && ok; i++) {
+        if (!headers[i] || headers[i]->length > RTMP_HANDOFF_MAX_PAYLOAD) continue;
+
+        record.kind = RTMP_HANDOFF_HEADER;
+        record.msg_type = headers[i]->type;
+        record.timestamp = headers[i]->timestamp;
+        record.payload_length = headers[i]->length;
+        ok = rtmp_handoff_send(channel, &record, -1, headers[i]->payload);
     }
+    pthread_mutex_unlock(&stream->lock);
+
+    return ok;
 }
 
-// Handle audio data
-static void rtmp_handle_audio(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk) {
-    if (!conn->is_publisher || !chunk->msg_data || chunk->msg_length == 0) return;
+// Admit a handed-over connection like a fresh accept, minus the handshake
+static rtmp_server_adoptee_t* rtmp_server_adopt_connection(const rtmp_handoff_record_t* record, int fd) {
+    if (rtmp_admission_admit(admission, record->peer_addr, RTMP_SERVER_CONN_COST) != RTMP_ADMISSION_ACCEPT) {
+        close(fd);
+        return NULL;
+    }
+    rtmp_admission_handshake_done(admission);
+
+    rtmp_server_adoptee_t* adoptee = calloc(1, sizeof(rtmp_server_adoptee_t));
+    rtmp_connection_t* conn = adoptee ? rtmp_server_connection_create(fd) : NULL;
+    if (!conn) {
+        rtmp_admission_release(admission, record->peer_addr, RTMP_SERVER_CONN_COST, false);
+        free(adoptee);
+        close(fd);
+        return NULL;
+    }
 
-    conn->metadata.has_audio = true;
-    conn->metadata.bytes_in += chunk->msg_length;
+    conn->peer_addr = record->peer_addr;
+    conn->state = (rtmp_connection_state_t)record->state;
+    conn->is_publisher = record->is_publisher != 0;
+    if (record->chunk_size) {
+        conn->send_queue.chunk_size = record->chunk_size;
+    }
+    // The record came off a socket; its names need not be terminated
+    snprintf(conn->metadata.app_name, sizeof(conn->metadata.app_name), "%.*s", (int)sizeof(record->app_name),
+             record->app_name);
+    snprintf(conn->metadata.stream_name, sizeof(conn->metadata.stream_name), "%.*s",
+             (int)sizeof(record->stream_name), record->stream_name);
+
+    adoptee->conn = conn;
+    adoptee->next = adopted_connections;
+    adopted_connections = adoptee;
+    return adoptee;
+}
+
+static void rtmp_server_adopt_header(rtmp_server_adoptee_t* adoptee, const rtmp_handoff_record_t* record,
+                                     const uint8_t* payload) {
+    if (adoptee->num_headers == 3 || !payload) return;
 
-    // Parse audio header
-    uint8_t format = (chunk->msg_data[0] & 0xf0) >> 4;
-    uint8_t rate = (chunk->msg_data[0] & 0x0c) >> 2;
-    uint8_t size = (chunk->msg_data[0] & 0x02) >> 1;
-    uint8_t type = chunk->msg_data[0] & 0x01;
+    uint32_t csid = RTMP_CHUNK_STREAM_METADATA;
+    if (record->msg_type == RTMP_MSG_VIDEO) {
+        csid = RTMP_CHUNK_STREAM_VIDEO;
+    } else if (record->msg_type == RTMP_MSG_AUDIO) {
+        csid = RTMP_CHUNK_STREAM_AUDIO;
+    }
 
-    // Update metadata
-    conn->metadata.audio_sample_rate = rate;
-    conn->metadata.audio_channels = type + 1;
+    rtmp_msgbuf_t* msg = rtmp_msgbuf_create(csid, (uint8_t)record->msg_type, record->timestamp, RTMP_RELAY_STREAM_ID,
+                                            payload, record->payload_length);
+    if (msg) {
+        adoptee->headers[adoptee->num_headers++] = msg;
+    }
 }
 
-// Handle metadata
-static void rtmp_handle_metadata(rtmp_connection_t* conn, rtmp_chunk_stream_t* chunk) {
-    if (!conn->is_publisher || !chunk->msg_data || chunk->msg_length == 0) return;
+// Publishers first, so players that rejoin get the start-up burst replayed
+static void rtmp_server_resume_adopted(void) {
+    for (int publishers = 1; publishers >= 0; publishers--) {
+        rtmp_server_adoptee_t** link = &adopted_connections;
+        while (*link) {
+            rtmp_server_adoptee_t* adoptee = *link;
+            if (adoptee->conn->is_publisher != (publishers == 1)) {
+                link = &adoptee->next;
+                continue;
+            }
+            *link = adoptee->next;
+            rtmp_server_resume_connection(adoptee);
+            rtmp_server_free_adoptee(adoptee);
+        }
+    }
+}
 
-    rtmp_amf_data_t* amf = rtmp_amf_decode(chunk->msg_data, chunk->msg_length);
-    if (!amf) return;
+// Give an adopted connection an owner and put it back on its stream
+static void rtmp_server_resume_connection(rtmp_server_adoptee_t* adoptee) {
+    rtmp_connection_t* conn = adoptee->conn;
+    bool threaded = server_ctx.io_mode == RTMP_SERVER_IO_THREADED;
 
-    // Parse metadata values
-    rtmp_amf_data_t* width = rtmp_amf_get_prop(amf, "width");
-    if (width && width->type == RTMP_AMF_NUMBER) {
-        conn->metadata.width = (uint32_t)width->number_data;
+    // The parser picks up where the predecessor's left off; without its state
+    // the next compressed header could not be read
+    if (!threaded) {
+        conn->loop_index = next_loop++ % server_ctx.num_loops;
     }
-
-    rtmp_amf_data_t* height = rtmp_amf_get_prop(amf, "height");
-    if (height && height->type == RTMP_AMF_NUMBER) {
-        conn->metadata.height = (uint32_t)height->number_data;
+    conn->chunk_stream = rtmp_chunk_stream_create();
+    if (!conn->chunk_stream || !adoptee->parser ||
+        !rtmp_chunk_stream_import(conn->chunk_stream, adoptee->parser, adoptee->parser_length)) {
+        rtmp_chunk_stream_destroy(conn->chunk_stream);
+        close(conn->socket);
+        rtmp_server_connection_free(conn);
+        return;
     }
 
-    rtmp_amf_data_t* framerate = rtmp_amf_get_prop(amf, "framerate");
-    if (framerate && framerate->type == RTMP_AMF_NUMBER) {
-        conn->metadata.frame_rate = (uint32_t)framerate->number_data;
+    rtmp_server_track_connection(conn);
+    rtmp_server_start_timers(conn);
+
+    rtmp_server_timers_t* timers = rtmp_server_conn_timers(conn);
+    pthread_mutex_lock(&timers->lock);
+    rtmp_timer_cancel(timers->wheel, &conn->handshake_timer);
+    rtmp_timer_arm(timers->wheel, &conn->ping_timer, RTMP_PING_INTERVAL_SEC * 1000);
+    pthread_mutex_unlock(&timers->lock);
+    rtmp_metrics_handshake_done(conn->metrics);
+
+    if (conn->is_publisher) {
+        gettimeofday(&conn->metadata.publish_time, NULL);
+        rtmp_server_index_publisher(conn);
+        rtmp_server_stream_t* stream = rtmp_server_stream_attach(conn, true);
+        if (stream) {
+            pthread_mutex_lock(&stream->lock);
+            for (uint32_t i = 0; i < adoptee->num_headers; i++) {
+                rtmp_server_stream_cache(stream, adoptee->headers[i]);
+            }
+            pthread_mutex_unlock(&stream->lock);
+        }
+    } else if (conn->state == RTMP_CONN_STATE_PLAY) {
+        rtmp_server_stream_attach(conn, false);
     }
 
-    rtmp_amf_data_t* videodatarate = rtmp_amf_get_prop(amf, "videodatarate");
-    if (videodatarate && videodatarate->type == RTMP_AMF_NUMBER) {
-        conn->metadata.video_bitrate = (uint32_t)(videodatarate->number_data * 1024);
+    // Notify callback
+    if (connection_callback) {
+        connection_callback(conn, connection_callback_data);
     }
 
-    rtmp_amf_data_t* audiodatarate = rtmp_amf_get_prop(amf, "audiodatarate");
-    if (audiodatarate && audiodatarate->type == RTMP_AMF_NUMBER) {
-        conn->metadata.audio_bitrate = (uint32_t)(audiodatarate->number_data * 1024);
+    if (threaded) {
+        rtmp_server_spawn_client(conn);
+        return;
     }
 
-    // Notify callback
-    if (metadata_callback) {
-        metadata_callback(&conn->metadata, metadata_callback_data);
+    // Messages the carried-over input completes are handled before the loop takes over
+    rtmp_connection_dispatch(conn);
+    conn->reactor_handle = rtmp_reactor_add(server_loops[conn->loop_index].reactor, conn->socket,
+                                            RTMP_REACTOR_EVENT_READ, rtmp_server_reactor_on_client, conn);
+    if (!conn->reactor_handle) {
+        rtmp_server_cleanup_connection(conn);
+        return;
     }
 
-    rtmp_amf_data_free(amf);
+    pthread_mutex_lock(&conn->send_lock);
+    rtmp_server_reactor_update_interest(conn);
+    pthread_mutex_unlock(&conn->send_lock);
 }
 
-// Public API implementations
-// Stop server
-void rtmp_server_stop(void) {
-    if (!server_ctx.running) return;
-
-    // Stop threads
-    server_ctx.running = false;
-    
-    // Close listen socket to break accept thread
-    if (server_ctx.listen_socket >= 0) {
-        close(server_ctx.listen_socket);
-        server_ctx.listen_socket = -1;
+static void rtmp_server_free_adoptee(rtmp_server_adoptee_t* adoptee) {
+    for (uint32_t i = 0; i < adoptee->num_headers; i++) {
+        rtmp_msgbuf_release(adoptee->headers[i]);
     }
+    free(adoptee->parser);
+    free(adoptee);
+}
 
-    // Wait for threads to finish
-    pthread_join(server_ctx.accept_thread, NULL);
-    pthread_join(server_ctx.monitor_thread, NULL);
-
-    // Close all connections
-    pthread_mutex_lock(&server_ctx.lock);
-    while (server_ctx.connections) {
-        rtmp_connection_t* conn = server_ctx.connections;
-        server_ctx.connections = conn->next;
-        rtmp_server_cleanup_connection(conn);
+// Siblings this start had no loop for
+static void rtmp_server_close_adopted_listeners(void) {
+    for (uint32_t i = 0; i < num_adopted_listeners; i++) {
+        if (adopted_listeners[i] >= 0) {
+            close(adopted_listeners[i]);
+        }
     }
-    pthread_mutex_unlock(&server_ctx.lock);
-
-    rtmp_server_update_state(RTMP_SERVER_STATE_STOPPED);
+    free(adopted_listeners);
+    adopted_listeners = NULL;
+    num_adopted_listeners = 0;
 }
 
-// Cleanup server resources
-void rtmp_server_cleanup(void) {
-    rtmp_server_stop();
-    pthread_mutex_destroy(&server_ctx.lock);
+// Adopted but never started
+static void rtmp_server_discard_adopted(void) {
+    rtmp_server_close_adopted_listeners();
+
+    while (adopted_connections) {
+        rtmp_server_adoptee_t* adoptee = adopted_connections;
+        adopted_connections = adoptee->next;
+
+        close(adoptee->conn->socket);
+        rtmp_server_connection_free(adoptee->conn);
+        rtmp_server_free_adoptee(adoptee);
+    }
 }
 
 // Get server state
@@ -650,14 +3015,9 @@ rtmp_server_state_t rtmp_server_get_state(void) {
 
 // Get connection by socket
 rtmp_connection_t* rtmp_server_get_connection(int socket) {
-    rtmp_connection_t* conn = NULL;
-    
-    pthread_mutex_lock(&server_ctx.lock);
-    for (conn = server_ctx.connections; conn; conn = conn->next) {
-        if (conn->socket == socket) break;
-    }
-    pthread_mutex_unlock(&server_ctx.lock);
-    
+    pthread_rwlock_rdlock(&registry_lock);
+    rtmp_connection_t* conn = rtmp_registry_get_fd(conns_by_fd, socket);
+    pthread_rwlock_unlock(&registry_lock);
     return conn;
 }
 
@@ -669,22 +3029,20 @@ void rtmp_server_close_connection(rtmp_connection_t* conn) {
 
 // Get number of active connections
 uint32_t rtmp_server_get_num_connections(void) {
-    return server_ctx.num_connections;
+    uint32_t total = 0;
+    for (uint32_t l = 0; l < rtmp_server_num_lists(); l++) {
+        total += *rtmp_server_list(l).count;
+    }
+    return total;
 }
 
-// Check if stream is being published
+// Check if stream is being published; accepts "stream" or "app/stream"
 bool rtmp_server_is_publishing(const char* stream_name) {
-    bool publishing = false;
-    
-    pthread_mutex_lock(&server_ctx.lock);
-    for (rtmp_connection_t* conn = server_ctx.connections; conn; conn = conn->next) {
-        if (conn->is_publisher && strcmp(conn->metadata.stream_name, stream_name) == 0) {
-            publishing = true;
-            break;
-        }
-    }
-    pthread_mutex_unlock(&server_ctx.lock);
-    
+    if (!stream_name) return false;
+
+    pthread_rwlock_rdlock(&registry_lock);
+    bool publishing = rtmp_registry_get_name(publishers_by_name, stream_name) != NULL;
+    pthread_rwlock_unlock(&registry_lock);
     return publishing;
 }
 
@@ -709,33 +3067,233 @@ void rtmp_server_set_state_callback(rtmp_server_state_callback_t callback, void*
     state_callback_data = userdata;
 }
 
+// Register callbacks for one app/stream, live or not yet published; NULL removes them
+bool rtmp_server_set_stream_callbacks(const char* app, const char* stream, const rtmp_stream_callbacks_t* callbacks) {
+    char key[RTMP_REGISTRY_MAX_NAME];
+    rtmp_registry_stream_key(key, sizeof(key), app, stream);
+
+    pthread_rwlock_wrlock(&registry_lock);
+    rtmp_stream_callbacks_t* entry = rtmp_registry_get_name(stream_callbacks, key);
+    bool ok = true;
+
+    if (!callbacks) {
+        rtmp_registry_remove_name(stream_callbacks, key, NULL);
+        free(entry);
+    } else if (entry) {
+        *entry = *callbacks;
+    } else {
+        entry = malloc(sizeof(rtmp_stream_callbacks_t));
+        ok = entry && rtmp_registry_put_name(stream_callbacks, key, entry);
+        if (ok) {
+            *entry = *callbacks;
+        } else {
+            free(entry);
+        }
+    }
+
+    // A stream already live switches over immediately
+    rtmp_server_stream_t* live = rtmp_registry_get_name(streams_by_name, key);
+    if (live && ok) {
+        pthread_mutex_lock(&live->lock);
+        if (callbacks) {
+            live->callbacks = *callbacks;
+        } else {
+            memset(&live->callbacks, 0, sizeof(live->callbacks));
+        }
+        pthread_mutex_unlock(&live->lock);
+    }
+    pthread_rwlock_unlock(&registry_lock);
+
+    return ok;
+}
+
+// Publish a local FLV file as app/stream, taking the stream over as a new
+// encoder would; its tags go through the handlers a socket's messages take
+bool rtmp_server_add_file_source(const char* path, const char* app, const char* stream, double speed, bool loop) {
+    if (!server_ctx.running || !path || !app || !stream) return false;
+
+    rtmp_server_file_source_t* entry = calloc(1, sizeof(rtmp_server_file_source_t));
+    if (!entry) return false;
+    entry->source = rtmp_file_source_open(path);
+    entry->conn = entry->source ? rtmp_server_connection_create(-1) : NULL;
+    if (!entry->conn) {
+        rtmp_file_source_close(entry->source);
+        free(entry);
+        return false;
+    }
+
+    rtmp_connection_t* conn = entry->conn;
+    strncpy(conn->metadata.app_name, app, sizeof(conn->metadata.app_name) - 1);
+    strncpy(conn->metadata.stream_name, stream, sizeof(conn->metadata.stream_name) - 1);
+    conn->state = RTMP_CONN_STATE_PUBLISHING;
+    conn->is_publisher = true;
+    gettimeofday(&conn->metadata.publish_time, NULL);
+    rtmp_server_index_publisher(conn);
+    rtmp_server_stream_attach(conn, true);
+
+    if (!rtmp_file_source_start(entry->source, speed, loop, rtmp_server_file_source_tag, conn)) {
+        rtmp_server_file_source_free(entry);
+        return false;
+    }
+
+    pthread_mutex_lock(&file_sources_lock);
+    entry->next = file_sources;
+    file_sources = entry;
+    pthread_mutex_unlock(&file_sources_lock);
+    return true;
+}
+
+// Stop a file source early, or forget one that has finished
+bool rtmp_server_remove_file_source(const char* app, const char* stream) {
+    if (!app || !stream) return false;
+
+    rtmp_server_file_source_t* entry = NULL;
+    pthread_mutex_lock(&file_sources_lock);
+    for (rtmp_server_file_source_t** link = &file_sources; *link; link = &(*link)->next) {
+        rtmp_connection_t* conn = (*link)->conn;
+        if (strcmp(conn->metadata.app_name, app) == 0 && strcmp(conn->metadata.stream_name, stream) == 0) {
+            entry = *link;
+            *link = entry->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&file_sources_lock);
+
+    if (!entry) return false;
+    rtmp_server_file_source_free(entry);
+    return true;
+}
+
+// Progress of a file source; tags and bytes over elapsed_ms give the pipeline's throughput
+bool rtmp_server_get_file_source_stats(const char* app, const char* stream, rtmp_file_source_stats_t* stats) {
+    if (!app || !stream || !stats) return false;
+
+    bool found = false;
+    pthread_mutex_lock(&file_sources_lock);
+    for (rtmp_server_file_source_t* entry = file_sources; entry && !found; entry = entry->next) {
+        rtmp_connection_t* conn = entry->conn;
+        found = strcmp(conn->metadata.app_name, app) == 0 && strcmp(conn->metadata.stream_name, stream) == 0;
+        if (found) {
+            rtmp_file_source_get_stats(entry->source, stats);
+        }
+    }
+    pthread_mutex_unlock(&file_sources_lock);
+    return found;
+}
+
+// Source thread: one file tag, handled as if it had arrived on a socket
+static bool rtmp_server_file_source_tag(const rtmp_flv_tag_t* tag, void* userdata) {
+    rtmp_connection_t* conn = (rtmp_connection_t*)userdata;
+    if (!tag) {
+        // The file ran out; its players see what an encoder hanging up does
+        rtmp_server_file_source_unpublish(conn);
+        return false;
+    }
+
+    if (tag->type == RTMP_MSG_VIDEO || tag->type == RTMP_MSG_AUDIO || tag->type == RTMP_MSG_DATA_AMF0 ||
+        tag->type == RTMP_MSG_DATA_AMF3) {
+        rtmp_chunk_stream_t chunk;
+        memset(&chunk, 0, sizeof(chunk));
+        chunk.msg_type_id = tag->type;
+        chunk.msg_stream_id = RTMP_RELAY_STREAM_ID;
+        chunk.timestamp = tag->timestamp;
+        chunk.msg_length = tag->length;
+        chunk.msg_data = (uint8_t*)tag->data;
+        rtmp_connection_handle_message(conn, &chunk);
+        rtmp_server_relay_flush(conn);
+    }
+
+    // A drain or a newer publisher may have ended this one
+    return conn->is_publisher && conn->stream && conn->stream->publisher == conn;
+}
+
+static void rtmp_server_file_source_unpublish(rtmp_connection_t* conn) {
+    rtmp_server_stream_detach(conn);
+    if (conn->is_publisher) {
+        rtmp_server_unindex_publisher(conn);
+        conn->is_publisher = false;
+    }
+}
+
+// Join the source thread, then take its publisher down
+static void rtmp_server_file_source_free(rtmp_server_file_source_t* entry) {
+    rtmp_file_source_close(entry->source);
+    rtmp_server_file_source_unpublish(entry->conn);
+    rtmp_server_connection_free(entry->conn);
+    free(entry);
+}
+
+static void rtmp_server_stop_file_sources(void) {
+    pthread_mutex_lock(&file_sources_lock);
+    rtmp_server_file_source_t* entry = file_sources;
+    file_sources = NULL;
+    pthread_mutex_unlock(&file_sources_lock);
+
+    while (entry) {
+        rtmp_server_file_source_t* next = entry->next;
+        rtmp_server_file_source_free(entry);
+        entry = next;
+    }
+}
+
 // Get stream info
 bool rtmp_server_get_stream_info(const char* stream_name, rtmp_stream_metadata_t* info) {
     if (!stream_name || !info) return false;
+
+    // Cleanup unindexes under the write lock before freeing, so the copy is safe
+    pthread_rwlock_rdlock(&registry_lock);
+    rtmp_connection_t* conn = rtmp_registry_get_name(publishers_by_name, stream_name);
+    if (conn) {
+        memcpy(info, &conn->metadata, sizeof(rtmp_stream_metadata_t));
+    }
+    pthread_rwlock_unlock(&registry_lock);
+
+    return conn != NULL;
+}
+
+// Metadata of the current publisher of app/stream
+bool rtmp_server_get_stream_metadata(const char* app, const char* stream, rtmp_stream_metadata_t* metadata) {
+    if (!metadata) return false;
+
+    char key[RTMP_REGISTRY_MAX_NAME];
+    rtmp_registry_stream_key(key, sizeof(key), app, stream);
+
+    // The publisher stays alive while it is attached, which detach changes under the stream lock
     bool found = false;
-    
-    pthread_mutex_lock(&server_ctx.lock);
-    for (rtmp_connection_t* conn = server_ctx.connections; conn; conn = conn->next) {
-        if (strcmp(conn->metadata.stream_name, stream_name) == 0) {
-            memcpy(info, &conn->metadata, sizeof(rtmp_stream_metadata_t));
+    pthread_rwlock_rdlock(&registry_lock);
+    rtmp_server_stream_t* live = rtmp_registry_get_name(streams_by_name, key);
+    if (live) {
+        pthread_mutex_lock(&live->lock);
+        if (live->publisher) {
+            memcpy(metadata, &live->publisher->metadata, sizeof(rtmp_stream_metadata_t));
             found = true;
-            break;
         }
+        pthread_mutex_unlock(&live->lock);
     }
-    pthread_mutex_unlock(&server_ctx.lock);
-    
+    pthread_rwlock_unlock(&registry_lock);
+
     return found;
 }
 
+uint32_t rtmp_server_get_num_streams(void) {
+    pthread_rwlock_rdlock(&registry_lock);
+    uint32_t count = rtmp_registry_count(streams_by_name);
+    pthread_rwlock_unlock(&registry_lock);
+    return count;
+}
+
 // Get server statistics
 uint64_t rtmp_server_get_bytes_received(void) {
     uint64_t total = 0;
     
-    pthread_mutex_lock(&server_ctx.lock);
-    for (rtmp_connection_t* conn = server_ctx.connections; conn; conn = conn->next) {
-        total += conn->metadata.bytes_in;
+    for (uint32_t l = 0; l < rtmp_server_num_lists(); l++) {
+        rtmp_server_list_t list = rtmp_server_list(l);
+        pthread_mutex_lock(list.lock);
+        for (rtmp_connection_t* conn = *list.head; conn; conn = conn->next) {
+            total += conn->metadata.bytes_in;
+        }
+        pthread_mutex_unlock(list.lock);
     }
-    pthread_mutex_unlock(&server_ctx.lock);
     
     return total;
 }
@@ -743,11 +3301,14 @@ uint64_t rtmp_server_get_bytes_received(void) {
 uint64_t rtmp_server_get_bytes_sent(void) {
     uint64_t total = 0;
     
-    pthread_mutex_lock(&server_ctx.lock);
-    for (rtmp_connection_t* conn = server_ctx.connections; conn; conn = conn->next) {
-        total += conn->metadata.bytes_out;
+    for (uint32_t l = 0; l < rtmp_server_num_lists(); l++) {
+        rtmp_server_list_t list = rtmp_server_list(l);
+        pthread_mutex_lock(list.lock);
+        for (rtmp_connection_t* conn = *list.head; conn; conn = conn->next) {
+            total += conn->metadata.bytes_out;
+        }
+        pthread_mutex_unlock(list.lock);
     }
-    pthread_mutex_unlock(&server_ctx.lock);
     
     return total;
 }
@@ -755,15 +3316,45 @@ uint64_t rtmp_server_get_bytes_sent(void) {
 uint32_t rtmp_server_get_dropped_frames(void) {
     uint32_t total = 0;
     
-    pthread_mutex_lock(&server_ctx.lock);
-    for (rtmp_connection_t* conn = server_ctx.connections; conn; conn = conn->next) {
-        total += conn->metadata.dropped_frames;
+    for (uint32_t l = 0; l < rtmp_server_num_lists(); l++) {
+        rtmp_server_list_t list = rtmp_server_list(l);
+        pthread_mutex_lock(list.lock);
+        for (rtmp_connection_t* conn = *list.head; conn; conn = conn->next) {
+            total += conn->metadata.dropped_frames;
+        }
+        pthread_mutex_unlock(list.lock);
     }
-    pthread_mutex_unlock(&server_ctx.lock);
     
     return total;
 }
 
+// Frames waiting for the consumer thread, and frames lost to full rings
+void rtmp_server_get_frame_ring_stats(uint32_t* occupancy, uint64_t* overflows) {
+    uint32_t queued = 0;
+    uint64_t lost = 0;
+
+    // A scrape may race stop, which frees the rings under the same lock
+    pthread_mutex_lock(&frame_delivery.producer_lock);
+    for (uint32_t i = 0; i < frame_delivery.num_rings; i++) {
+        queued += rtmp_frame_ring_occupancy(frame_delivery.rings[i]);
+        lost += rtmp_frame_ring_overflows(frame_delivery.rings[i]);
+    }
+    pthread_mutex_unlock(&frame_delivery.producer_lock);
+
+    if (occupancy) *occupancy = queued;
+    if (overflows) *overflows = lost;
+}
+
+// Admitted load and rejections per limit
+void rtmp_server_get_admission_stats(rtmp_admission_stats_t* stats) {
+    rtmp_admission_get_stats(admission, stats);
+}
+
+// Open files, disk backlog and tags dropped by the recorder
+void rtmp_server_get_record_stats(rtmp_record_stats_t* stats) {
+    rtmp_record_get_stats(stats);
+}
+
 // Configuration functions
 void rtmp_server_set_chunk_size(uint32_t size) {
     uint8_t msg[4];
@@ -772,18 +3363,27 @@ void rtmp_server_set_chunk_size(uint32_t size) {
     msg[2] = (size >> 8) & 0xff;
     msg[3] = size & 0xff;
     
-    rtmp_chunk_stream_t chunk;
-    memset(&chunk, 0, sizeof(chunk));
-    chunk.msg_type_id = RTMP_MSG_SET_CHUNK_SIZE;
-    chunk.msg_stream_id = 0;
-    chunk.msg_length = 4;
-    chunk.msg_data = msg;
-    
-    pthread_mutex_lock(&server_ctx.lock);
-    for (rtmp_connection_t* conn = server_ctx.connections; conn; conn = conn->next) {
-        rtmp_connection_send_chunk(conn, &chunk);
+    // Goes through the send queues so relayed data behind it is chunked at the new size
+    rtmp_msgbuf_t* chunk = rtmp_msgbuf_create(RTMP_CHUNK_STREAM_PROTOCOL, RTMP_RELAY_MSG_SET_CHUNK_SIZE, 0, 0, msg, 4);
+    if (!chunk) return;
+    rtmp_server_broadcast_control(chunk);
+    rtmp_msgbuf_release(chunk);
+}
+
+// Queue one shared protocol control message to every connection past the
+// handshake; the send queue keeps it in order with relayed data
+static void rtmp_server_broadcast_control(rtmp_msgbuf_t* msg) {
+    for (uint32_t l = 0; l < rtmp_server_num_lists(); l++) {
+        rtmp_server_list_t list = rtmp_server_list(l);
+        pthread_mutex_lock(list.lock);
+        for (rtmp_connection_t* conn = *list.head; conn; conn = conn->next) {
+            // Connections still in the handshake get the defaults at connect
+            if (conn->state != RTMP_CONN_STATE_NEW && conn->state != RTMP_CONN_STATE_CLOSED) {
+                rtmp_connection_enqueue(conn, msg);
+            }
+        }
+        pthread_mutex_unlock(list.lock);
     }
-    pthread_mutex_unlock(&server_ctx.lock);
 }
 
 void rtmp_server_set_window_ack_size(uint32_t size) {
@@ -793,18 +3393,10 @@ void rtmp_server_set_window_ack_size(uint32_t size) {
     msg[2] = (size >> 8) & 0xff;
     msg[3] = size & 0xff;
     
-    rtmp_chunk_stream_t chunk;
-    memset(&chunk, 0, sizeof(chunk));
-    chunk.msg_type_id = RTMP_MSG_WINDOW_ACK_SIZE;
-    chunk.msg_stream_id = 0;
-    chunk.msg_length = 4;
-    chunk.msg_data = msg;
-    
-    pthread_mutex_lock(&server_ctx.lock);
-    for (rtmp_connection_t* conn = server_ctx.connections; conn; conn = conn->next) {
-        rtmp_connection_send_chunk(conn, &chunk);
-    }
-    pthread_mutex_unlock(&server_ctx.lock);
+    rtmp_msgbuf_t* chunk = rtmp_msgbuf_create(RTMP_CHUNK_STREAM_PROTOCOL, RTMP_MSG_WINDOW_ACK_SIZE, 0, 0, msg, 4);
+    if (!chunk) return;
+    rtmp_server_broadcast_control(chunk);
+    rtmp_msgbuf_release(chunk);
 }
 
 void rtmp_server_set_peer_bandwidth(uint32_t window_size, uint8_t limit_type) {
@@ -815,18 +3407,58 @@ void rtmp_server_set_peer_bandwidth(uint32_t window_size, uint8_t limit_type) {
     msg[3] = window_size & 0xff;
     msg[4] = limit_type;
     
-    rtmp_chunk_stream_t chunk;
-    memset(&chunk, 0, sizeof(chunk));
-    chunk.msg_type_id = RTMP_MSG_SET_PEER_BW;
-    chunk.msg_stream_id = 0;
-    chunk.msg_length = 5;
-    chunk.msg_data = msg;
-    
-    pthread_mutex_lock(&server_ctx.lock);
-    for (rtmp_connection_t* conn = server_ctx.connections; conn; conn = conn->next) {
-        rtmp_connection_send_chunk(conn, &chunk);
+    rtmp_msgbuf_t* chunk = rtmp_msgbuf_create(RTMP_CHUNK_STREAM_PROTOCOL, RTMP_MSG_SET_PEER_BW, 0, 0, msg, 5);
+    if (!chunk) return;
+    rtmp_server_broadcast_control(chunk);
+    rtmp_msgbuf_release(chunk);
+}
+
+void rtmp_server_set_io_mode(rtmp_server_io_mode_t mode, uint32_t num_loops) {
+    if (server_ctx.state != RTMP_SERVER_STATE_STOPPED) return;
+
+    server_ctx.io_mode = mode;
+    server_ctx.num_loops = num_loops;
+}
+
+// Egress budget for players accepted from now on
+void rtmp_server_set_send_budget(size_t max_bytes, uint32_t max_latency_ms) {
+    send_budget_bytes = max_bytes;
+    send_budget_ms = max_latency_ms;
+}
+
+// Egress aggregation: what a publisher reads in one pass reaches its players
+// as one aggregate, packed once and shared
+void rtmp_server_set_aggregation(size_t max_bytes) {
+    send_aggregate_bytes = max_bytes;
+}
+
+// Playout delay bounds in ring delivery, for publishers that start afterwards;
+// max_delay_ms 0 hands frames over as soon as they arrive
+void rtmp_server_set_jitter_buffer(uint32_t min_delay_ms, uint32_t max_delay_ms) {
+    jitter_min_ms = min_delay_ms;
+    jitter_max_ms = max_delay_ms;
+}
+
+// Takes effect on the next start
+void rtmp_server_set_frame_delivery(rtmp_frame_delivery_t mode) {
+    if (server_ctx.state != RTMP_SERVER_STATE_STOPPED) return;
+    server_ctx.frame_delivery = mode;
+}
+
+// Applies to the next accepted client; nobody already connected is evicted
+void rtmp_server_set_admission_limits(const rtmp_admission_limits_t* limits) {
+    rtmp_admission_set_limits(admission, limits);
+    admission_configured = admission && limits;
+}
+
+// Record every publisher into the directory, from the next start on
+void rtmp_server_set_record_directory(const char* directory) {
+    if (server_ctx.state != RTMP_SERVER_STATE_STOPPED) return;
+
+    record_directory[0] = '\0';
+    if (directory && strlen(directory) < sizeof(record_directory)) {
+        strcpy(record_directory, directory);
     }
-    pthread_mutex_unlock(&server_ctx.lock);
 }
 
 // Utility functions
@@ -842,6 +3474,8 @@ const char* rtmp_server_state_string(rtmp_server_state_t state) {
             return "Error";
         case RTMP_SERVER_STATE_RESTARTING:
             return "Restarting";
+        case RTMP_SERVER_STATE_DRAINING:
+            return "Draining";
         default:
             return "Unknown";
     }
@@ -869,33 +3503,65 @@ const char* rtmp_connection_state_string(rtmp_connection_state_t state) {
 }
 
 void rtmp_server_dump_stats(void) {
-    pthread_mutex_lock(&server_ctx.lock);
-    
     printf("RTMP Server Statistics:\n");
     printf("  State: %s\n", rtmp_server_state_string(server_ctx.state));
     printf("  Port: %d\n", server_ctx.port);
-    printf("  Connections: %d\n", server_ctx.num_connections);
-    
-    rtmp_connection_t* conn = server_ctx.connections;
-    while (conn) {
-        printf("  Connection %d:\n", conn->socket);
-        printf("    State: %s\n", rtmp_connection_state_string(conn->state));
-        printf("    App: %s\n", conn->metadata.app_name);
-        printf("    Stream: %s\n", conn->metadata.stream_name);
-        printf("    Is Publisher: %s\n", conn->is_publisher ? "Yes" : "No");
-        printf("    Bytes In: %lu\n", conn->metadata.bytes_in);
-        printf("    Bytes Out: %lu\n", conn->metadata.bytes_out);
-        if (conn->is_publisher) {
-            printf("    Video: %dx%d @ %d fps\n", 
-                   conn->metadata.width,
-                   conn->metadata.height,
-                   conn->metadata.frame_rate);
-            printf("    Video Bitrate: %d kbps\n", conn->metadata.video_bitrate / 1024);
-            printf("    Audio Bitrate: %d kbps\n", conn->metadata.audio_bitrate / 1024);
-            printf("    Dropped Frames: %d\n", conn->metadata.dropped_frames);
-        }
-        conn = conn->next;
+    printf("  Connections: %d\n", rtmp_server_get_num_connections());
+
+    rtmp_admission_stats_t admitted;
+    rtmp_server_get_admission_stats(&admitted);
+    printf("  Handshakes In Progress: %u\n", admitted.handshakes);
+    printf("  Rejected Connections: %llu\n", (unsigned long long)rtmp_admission_rejected(admission));
+    for (int v = RTMP_ADMISSION_REJECT_CONNECTIONS; v < RTMP_ADMISSION_VERDICTS; v++) {
+        printf("    %s: %llu\n", rtmp_admission_verdict_string((rtmp_admission_verdict_t)v),
+               (unsigned long long)admitted.rejected[v]);
     }
     
-    pthread_mutex_unlock(&server_ctx.lock);
-}
\ No newline at end of file
+    for (uint32_t l = 0; l < rtmp_server_num_lists(); l++) {
+        rtmp_server_list_t list = rtmp_server_list(l);
+        pthread_mutex_lock(list.lock);
+
+        rtmp_connection_t* conn = *list.head;
+        while (conn) {
+            printf("  Connection %d:\n", conn->socket);
+            printf("    State: %s\n", rtmp_connection_state_string(conn->state));
+            printf("    App: %s\n", conn->metadata.app_name);
+            printf("    Stream: %s\n", conn->metadata.stream_name);
+            printf("    Is Publisher: %s\n", conn->is_publisher ? "Yes" : "No");
+            printf("    Bytes In: %lu\n", conn->metadata.bytes_in);
+            printf("    Bytes Out: %lu\n", conn->metadata.bytes_out);
+            if (conn->is_publisher) {
+                printf("    Video: %dx%d @ %d fps\n", 
+                       conn->metadata.width,
+                       conn->metadata.height,
+                       conn->metadata.frame_rate);
+                printf("    Video Bitrate: %d kbps\n", conn->metadata.video_bitrate / 1024);
+                printf("    Audio Bitrate: %d kbps\n", conn->metadata.audio_bitrate / 1024);
+                printf("    Dropped Frames: %d\n", conn->metadata.dropped_frames);
+            }
+            conn = conn->next;
+        }
+
+        pthread_mutex_unlock(list.lock);
+    }
+}
+
+// Serve Prometheus text and JSON on "unix:/path" or "tcp:PORT" (loopback)
+bool rtmp_server_start_metrics(const char* address) {
+    return rtmp_metrics_start(address, rtmp_server_collect_metrics, NULL);
+}
+
+void rtmp_server_stop_metrics(void) {
+    rtmp_metrics_stop();
+}
+
+// Server-wide gauges for a scrape; none of these touch a connection list
+static void rtmp_server_collect_metrics(rtmp_metrics_global_t* global, void* userdata) {
+    rtmp_admission_stats_t admitted;
+    rtmp_admission_get_stats(admission, &admitted);
+
+    global->connections = admitted.connections;
+    global->handshakes = admitted.handshakes;
+    global->rejected = rtmp_admission_rejected(admission);
+    rtmp_server_get_frame_ring_stats(&global->ring_occupancy, &global->ring_overflows);
+}
@@ -4,16 +4,39 @@
 
 #include <stdbool.h>
 #include <stdint.h>
-#include "rtmp_core.h"
+#include <pthread.h>
+#include "rtmp_chunk.h"
 #include "rtmp_utils.h"
 #include "rtmp_stream.h"
 #include "rtmp_protocol.h"
+#include "rtmp_reactor.h"
+#include "rtmp_timer.h"
+#include "rtmp_relay.h"
+#include "rtmp_frame_ring.h"
+#include "rtmp_jitter.h"
+#include "rtmp_record.h"
+#include "rtmp_file_source.h"
+#include "rtmp_admission.h"
+#include "rtmp_metrics.h"
 
 // Server configurations
 #define RTMP_DEFAULT_PORT 1935
-#define RTMP_MAX_CONNECTIONS 10
+#define RTMP_MAX_CONNECTIONS 10                 // Threaded mode defaults: one thread per client
+#define RTMP_MAX_CONNECTIONS_PER_IP 8
+#define RTMP_MAX_PENDING_HANDSHAKES 8
+#define RTMP_MEMORY_BUDGET (64 * 1024 * 1024)   // Estimated connection footprint, not queued media
+#define RTMP_RESERVED_FDS 64                    // Event loop modes admit RLIMIT_NOFILE less these
 #define RTMP_BUFFER_SIZE 131072
 #define RTMP_TIMEOUT_SEC 30
+#define RTMP_HANDSHAKE_TIMEOUT_SEC 10
+#define RTMP_PING_INTERVAL_SEC 10
+#define RTMP_GOP_CACHE_BYTES (8 * 1024 * 1024)   // Per-stream bound on the cached GOP
+#define RTMP_SEND_QUEUE_MAX_BYTES (16 * 1024 * 1024) // Per-player egress bound
+#define RTMP_SEND_QUEUE_LATENCY_MS 5000            // Per-player backlog before video is shed
+#define RTMP_FRAME_RING_CAPACITY 256               // Frames buffered per producer thread
+#define RTMP_FRAME_JITTER_MAX_MS 250               // Default ceiling on the ring delivery playout delay
+#define RTMP_FRAME_JITTER_IDLE_MS 10000            // A publisher's jitter buffer is freed after this long unused
+#define RTMP_DRAIN_POLL_MS 100                     // How often a drain checks for remaining connections
 
 // Server states 
 typedef enum {
@@ -21,9 +44,23 @@ typedef enum {
     RTMP_SERVER_STATE_STARTING,
     RTMP_SERVER_STATE_RUNNING,
     RTMP_SERVER_STATE_ERROR,
-    RTMP_SERVER_STATE_RESTARTING
+    RTMP_SERVER_STATE_RESTARTING,
+    RTMP_SERVER_STATE_DRAINING
 } rtmp_server_state_t;
 
+// Server I/O modes
+typedef enum {
+    RTMP_SERVER_IO_THREADED = 0,  // One blocking thread per connection
+    RTMP_SERVER_IO_REACTOR,       // Non-blocking connections multiplexed on event loops
+    RTMP_SERVER_IO_SHARDED        // Reactor with one SO_REUSEPORT listener and connection list per loop
+} rtmp_server_io_mode_t;
+
+// Frame callback delivery
+typedef enum {
+    RTMP_FRAME_DELIVERY_INLINE = 0,  // Called on the thread that received the frame
+    RTMP_FRAME_DELIVERY_RING         // Handed over through SPSC rings to one consumer thread, jitter paced
+} rtmp_frame_delivery_t;
+
 // Connection states
 typedef enum {
     RTMP_CONN_STATE_NEW = 0,
@@ -42,9 +79,12 @@ typedef struct {
     uint32_t width;
     uint32_t height; 
     uint32_t frame_rate;
+    uint32_t video_codec;       // FLV codec id, or Enhanced RTMP FourCC
+    uint32_t video_profile;     // AVC profile_idc and level_idc from the sequence header
+    uint32_t video_level;
     uint32_t video_bitrate;
     uint32_t audio_bitrate;
-    uint32_t audio_sample_rate;
+    uint32_t audio_sample_rate; // Hz
     uint32_t audio_channels;
     bool has_video;
     bool has_audio;
@@ -62,12 +102,28 @@ typedef struct rtmp_connection {
     rtmp_stream_metadata_t metadata;
     rtmp_chunk_stream_t* chunk_stream;
     void* handshake_data;
-    struct timeval last_recv_time;
-    struct timeval last_send_time;
+    rtmp_reactor_handle_t* reactor_handle;
+    uint32_t loop_index;
+    uint64_t last_recv_ms;          // Monotonic, from the owning loop's cached clock
+    uint64_t last_send_ms;
+    rtmp_timer_t idle_timer;
+    rtmp_timer_t handshake_timer;
+    rtmp_timer_t ping_timer;
+    bool ping_pending;
+    rtmp_send_queue_t send_queue;   // Relayed messages awaiting the socket
+    rtmp_relay_run_t relay_run;     // Media published this pass, not yet fanned out
+    pthread_mutex_t send_lock;      // Guards send_queue and write interest
+    struct rtmp_server_stream* stream;
+    uint32_t peer_addr;             // IPv4, network order; admission key
+    uint32_t frame_source;          // Jitter buffer key in ring delivery; 0 until the first frame
+    bool handshake_pending;         // Holds one of the admission handshake slots
+    bool closing;                   // Hang up once the send queue is empty; guarded by send_lock
+    rtmp_metrics_slot_t* metrics;   // Lock-free counters for the metrics endpoint, may be NULL
     uint32_t bytes_received;
     uint32_t bytes_sent;
     bool is_publisher;
     void* userdata;
+    struct rtmp_connection* prev;
     struct rtmp_connection* next;
 } rtmp_connection_t;
 
@@ -78,9 +134,14 @@ typedef struct {
     rtmp_server_state_t state;
     rtmp_connection_t* connections;
     uint32_t num_connections;
+    rtmp_server_io_mode_t io_mode;
+    uint32_t num_loops;
+    rtmp_frame_delivery_t frame_delivery;
     pthread_t accept_thread;
     pthread_t monitor_thread;
     bool running;
+    bool accepting;                 // Cleared when a drain stops taking clients
+    bool draining;
     void* userdata;
     pthread_mutex_t lock;
 } rtmp_server_context_t;
@@ -91,6 +152,17 @@ typedef void (*rtmp_metadata_callback_t)(rtmp_stream_metadata_t* metadata, void*
 typedef void (*rtmp_frame_callback_t)(uint8_t* data, size_t size, uint32_t timestamp, bool is_keyframe, void* userdata);
 typedef void (*rtmp_server_state_callback_t)(rtmp_server_state_t state, void* userdata);
 
+// Per-stream callbacks; stream_key is "app/stream"
+typedef void (*rtmp_stream_frame_callback_t)(const char* stream_key, uint8_t* data, size_t size, uint32_t timestamp,
+                                             bool is_keyframe, void* userdata);
+typedef void (*rtmp_stream_metadata_callback_t)(const char* stream_key, rtmp_stream_metadata_t* metadata,
+                                                void* userdata);
+typedef struct {
+    rtmp_stream_frame_callback_t on_frame;
+    rtmp_stream_metadata_callback_t on_metadata;
+    void* userdata;
+} rtmp_stream_callbacks_t;
+
 // Server API functions
 bool rtmp_server_initialize(void);
 void rtmp_server_cleanup(void);
@@ -98,6 +170,11 @@ bool rtmp_server_start(uint16_t port);
 void rtmp_server_stop(void);
 rtmp_server_state_t rtmp_server_get_state(void);
 
+// Graceful shutdown and restart
+bool rtmp_server_drain(uint32_t timeout_ms);
+bool rtmp_server_handoff(const char* path, uint32_t timeout_ms);
+bool rtmp_server_adopt(const char* path);
+
 // Connection management
 rtmp_connection_t* rtmp_server_get_connection(int socket);
 void rtmp_server_close_connection(rtmp_connection_t* conn);
@@ -109,21 +186,42 @@ void rtmp_server_set_connection_callback(rtmp_connection_callback_t callback, vo
 void rtmp_server_set_metadata_callback(rtmp_metadata_callback_t callback, void* userdata);
 void rtmp_server_set_frame_callback(rtmp_frame_callback_t callback, void* userdata);
 void rtmp_server_set_state_callback(rtmp_server_state_callback_t callback, void* userdata);
+bool rtmp_server_set_stream_callbacks(const char* app, const char* stream, const rtmp_stream_callbacks_t* callbacks);
+
+// Local FLV files published as app/stream while the server runs; speed 1 is
+// real time, N is N times faster, 0 unthrottled
+bool rtmp_server_add_file_source(const char* path, const char* app, const char* stream, double speed, bool loop);
+bool rtmp_server_remove_file_source(const char* app, const char* stream);
+bool rtmp_server_get_file_source_stats(const char* app, const char* stream, rtmp_file_source_stats_t* stats);
 
 // Stream info and stats
 bool rtmp_server_get_stream_info(const char* stream_name, rtmp_stream_metadata_t* info);
+bool rtmp_server_get_stream_metadata(const char* app, const char* stream, rtmp_stream_metadata_t* metadata);
+uint32_t rtmp_server_get_num_streams(void);
 uint64_t rtmp_server_get_bytes_received(void);
 uint64_t rtmp_server_get_bytes_sent(void);
 uint32_t rtmp_server_get_dropped_frames(void);
+void rtmp_server_get_frame_ring_stats(uint32_t* occupancy, uint64_t* overflows);
+void rtmp_server_get_admission_stats(rtmp_admission_stats_t* stats);
+void rtmp_server_get_record_stats(rtmp_record_stats_t* stats);
 
 // Configuration
 void rtmp_server_set_chunk_size(uint32_t size);
 void rtmp_server_set_window_ack_size(uint32_t size);
 void rtmp_server_set_peer_bandwidth(uint32_t window_size, uint8_t limit_type);
+void rtmp_server_set_io_mode(rtmp_server_io_mode_t mode, uint32_t num_loops);
+void rtmp_server_set_send_budget(size_t max_bytes, uint32_t max_latency_ms);
+void rtmp_server_set_aggregation(size_t max_bytes);     // 0 disables; a few KB suits small, frequent frames
+void rtmp_server_set_frame_delivery(rtmp_frame_delivery_t mode);
+void rtmp_server_set_jitter_buffer(uint32_t min_delay_ms, uint32_t max_delay_ms);   // Ring delivery only
+void rtmp_server_set_admission_limits(const rtmp_admission_limits_t* limits);   // Unset: per-mode defaults at start
+void rtmp_server_set_record_directory(const char* directory);   // NULL disables recording
 
 // Diagnostic functions
 const char* rtmp_server_state_string(rtmp_server_state_t state);
 const char* rtmp_connection_state_string(rtmp_connection_state_t state);
 void rtmp_server_dump_stats(void);
+bool rtmp_server_start_metrics(const char* address);
+void rtmp_server_stop_metrics(void);
 
 #endif /* RTMP_SERVER_INTEGRATION_H */
\ No newline at end of file
@@ -0,0 +1,178 @@
+// rtmp_timer.c
+#include "rtmp_timer.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define RTMP_TIMER_SLOT_MASK (RTMP_TIMER_SLOTS - 1)
+#define RTMP_TIMER_MAX_TICKS ((1ull << (RTMP_TIMER_LEVELS * RTMP_TIMER_SLOT_BITS)) - 1)
+
+// Timer wheel; each slot is a circular list headed by a sentinel timer
+struct rtmp_timer_wheel {
+    uint32_t tick_ms;
+    uint64_t base_ms;
+    uint64_t current;       // Last processed tick
+    uint32_t count;
+    rtmp_timer_t slots[RTMP_TIMER_LEVELS][RTMP_TIMER_SLOTS];
+};
+
+// Forward declarations of internal functions
+static void rtmp_timer_link(rtmp_timer_t* head, rtmp_timer_t* timer);
+static void rtmp_timer_unlink(rtmp_timer_t* timer);
+static void rtmp_timer_place(rtmp_timer_wheel_t* wheel, rtmp_timer_t* timer);
+static void rtmp_timer_cascade(rtmp_timer_wheel_t* wheel, uint32_t level);
+
+rtmp_timer_wheel_t* rtmp_timer_wheel_create(uint32_t tick_ms, uint64_t now_ms) {
+    rtmp_timer_wheel_t* wheel = calloc(1, sizeof(rtmp_timer_wheel_t));
+    if (!wheel) return NULL;
+
+    wheel->tick_ms = tick_ms ? tick_ms : 1;
+    wheel->base_ms = now_ms;
+
+    for (uint32_t l = 0; l < RTMP_TIMER_LEVELS; l++) {
+        for (uint32_t s = 0; s < RTMP_TIMER_SLOTS; s++) {
+            wheel->slots[l][s].prev = &wheel->slots[l][s];
+            wheel->slots[l][s].next = &wheel->slots[l][s];
+        }
+    }
+
+    return wheel;
+}
+
+// Destroy the wheel; timers still armed are disarmed, never fired
+void rtmp_timer_wheel_destroy(rtmp_timer_wheel_t* wheel) {
+    if (!wheel) return;
+
+    for (uint32_t l = 0; l < RTMP_TIMER_LEVELS; l++) {
+        for (uint32_t s = 0; s < RTMP_TIMER_SLOTS; s++) {
+            rtmp_timer_t* head = &wheel->slots[l][s];
+            while (head->next != head) {
+                rtmp_timer_unlink(head->next);
+            }
+        }
+    }
+
+    free(wheel);
+}
+
+// Process every tick up to now_ms and fire what expired; returns timers fired
+uint32_t rtmp_timer_wheel_advance(rtmp_timer_wheel_t* wheel, uint64_t now_ms) {
+    if (!wheel || now_ms < wheel->base_ms) return 0;
+
+    uint64_t target = (now_ms - wheel->base_ms) / wheel->tick_ms;
+    uint32_t fired = 0;
+
+    while (wheel->current < target) {
+        wheel->current++;
+
+        // Refill lower levels whenever a level wraps
+        for (uint32_t l = 1; l < RTMP_TIMER_LEVELS; l++) {
+            if (wheel->current & ((1ull << (l * RTMP_TIMER_SLOT_BITS)) - 1)) break;
+            rtmp_timer_cascade(wheel, l);
+        }
+
+        // Detach the due slot first so callbacks can arm and cancel freely
+        rtmp_timer_t* slot = &wheel->slots[0][wheel->current & RTMP_TIMER_SLOT_MASK];
+        if (slot->next == slot) continue;
+
+        rtmp_timer_t due;
+        due.next = slot->next;
+        due.prev = slot->prev;
+        due.next->prev = &due;
+        due.prev->next = &due;
+        slot->next = slot;
+        slot->prev = slot;
+
+        while (due.next != &due) {
+            rtmp_timer_t* timer = due.next;
+            rtmp_timer_unlink(timer);
+            wheel->count--;
+            fired++;
+            if (timer->callback) {
+                timer->callback(wheel, timer, timer->userdata);
+            }
+        }
+    }
+
+    return fired;
+}
+
+uint64_t rtmp_timer_wheel_now_ms(rtmp_timer_wheel_t* wheel) {
+    return wheel ? wheel->base_ms + wheel->current * wheel->tick_ms : 0;
+}
+
+uint32_t rtmp_timer_wheel_count(rtmp_timer_wheel_t* wheel) {
+    return wheel ? wheel->count : 0;
+}
+
+void rtmp_timer_init(rtmp_timer_t* timer, rtmp_timer_callback_t callback, void* userdata) {
+    memset(timer, 0, sizeof(rtmp_timer_t));
+    timer->callback = callback;
+    timer->userdata = userdata;
+}
+
+// Arm relative to the wheel's current tick, rounding the timeout up to whole ticks
+void rtmp_timer_arm(rtmp_timer_wheel_t* wheel, rtmp_timer_t* timer, uint32_t timeout_ms) {
+    if (!wheel || !timer) return;
+
+    if (rtmp_timer_is_armed(timer)) {
+        rtmp_timer_unlink(timer);
+        wheel->count--;
+    }
+
+    uint64_t ticks = ((uint64_t)timeout_ms + wheel->tick_ms - 1) / wheel->tick_ms;
+    if (ticks == 0) ticks = 1;
+    if (ticks > RTMP_TIMER_MAX_TICKS) ticks = RTMP_TIMER_MAX_TICKS;
+
+    timer->expires = wheel->current + ticks;
+    rtmp_timer_place(wheel, timer);
+    wheel->count++;
+}
+
+void rtmp_timer_cancel(rtmp_timer_wheel_t* wheel, rtmp_timer_t* timer) {
+    if (!wheel || !timer || !rtmp_timer_is_armed(timer)) return;
+    rtmp_timer_unlink(timer);
+    wheel->count--;
+}
+
+bool rtmp_timer_is_armed(const rtmp_timer_t* timer) {
+    return timer && timer->next != NULL;
+}
+
+static void rtmp_timer_link(rtmp_timer_t* head, rtmp_timer_t* timer) {
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+static void rtmp_timer_unlink(rtmp_timer_t* timer) {
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = NULL;
+    timer->next = NULL;
+}
+
+// The level is the highest slot group in which expires and current differ,
+// so a timer only moves down when the wheel reaches its range
+static void rtmp_timer_place(rtmp_timer_wheel_t* wheel, rtmp_timer_t* timer) {
+    uint64_t diff = timer->expires ^ wheel->current;
+    uint32_t level = 0;
+    while (level < RTMP_TIMER_LEVELS - 1 && (diff >> ((level + 1) * RTMP_TIMER_SLOT_BITS)) != 0) {
+        level++;
+    }
+
+    uint32_t slot = (timer->expires >> (level * RTMP_TIMER_SLOT_BITS)) & RTMP_TIMER_SLOT_MASK;
+    rtmp_timer_link(&wheel->slots[level][slot], timer);
+}
+
+// Move the slot of a wrapped level down to finer levels
+static void rtmp_timer_cascade(rtmp_timer_wheel_t* wheel, uint32_t level) {
+    uint32_t slot = (wheel->current >> (level * RTMP_TIMER_SLOT_BITS)) & RTMP_TIMER_SLOT_MASK;
+    rtmp_timer_t* head = &wheel->slots[level][slot];
+
+    while (head->next != head) {
+        rtmp_timer_t* timer = head->next;
+        rtmp_timer_unlink(timer);
+        rtmp_timer_place(wheel, timer);
+    }
+}
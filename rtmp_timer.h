@@ -0,0 +1,42 @@
+// rtmp_timer.h
+#ifndef RTMP_TIMER_H
+#define RTMP_TIMER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Wheel geometry: 4 levels of 64 slots cover 2^24 ticks
+#define RTMP_TIMER_LEVELS 4
+#define RTMP_TIMER_SLOT_BITS 6
+#define RTMP_TIMER_SLOTS (1u << RTMP_TIMER_SLOT_BITS)
+
+typedef struct rtmp_timer_wheel rtmp_timer_wheel_t;
+typedef struct rtmp_timer rtmp_timer_t;
+
+// Expiry callback; runs inside rtmp_timer_wheel_advance and may re-arm any timer
+typedef void (*rtmp_timer_callback_t)(rtmp_timer_wheel_t* wheel, rtmp_timer_t* timer, void* userdata);
+
+// Intrusive timer, embedded in the object it guards. Armed while linked into a slot.
+struct rtmp_timer {
+    rtmp_timer_t* prev;
+    rtmp_timer_t* next;
+    uint64_t expires;       // Absolute tick
+    rtmp_timer_callback_t callback;
+    void* userdata;
+};
+
+// Hierarchical timer wheel with O(1) arm and cancel.
+// Not thread-safe: the owner serializes arm, cancel and advance.
+rtmp_timer_wheel_t* rtmp_timer_wheel_create(uint32_t tick_ms, uint64_t now_ms);
+void rtmp_timer_wheel_destroy(rtmp_timer_wheel_t* wheel);
+uint32_t rtmp_timer_wheel_advance(rtmp_timer_wheel_t* wheel, uint64_t now_ms);
+uint64_t rtmp_timer_wheel_now_ms(rtmp_timer_wheel_t* wheel);
+uint32_t rtmp_timer_wheel_count(rtmp_timer_wheel_t* wheel);
+
+// Timer operations; arming an armed timer re-arms it
+void rtmp_timer_init(rtmp_timer_t* timer, rtmp_timer_callback_t callback, void* userdata);
+void rtmp_timer_arm(rtmp_timer_wheel_t* wheel, rtmp_timer_t* timer, uint32_t timeout_ms);
+void rtmp_timer_cancel(rtmp_timer_wheel_t* wheel, rtmp_timer_t* timer);
+bool rtmp_timer_is_armed(const rtmp_timer_t* timer);
+
+#endif /* RTMP_TIMER_H */
@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 // Buffer management
 uint8_t *rtmp_buffer_create(size_t size);